@@ -0,0 +1,690 @@
+/** @file
+
+    @brief  Admin: the loopback HTTP interface operators query for the
+            notary's counters and, with a token, give hosts to warm.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "admin.h"
+#include "signer.h"
+#include "observation.h"
+#include "respcache.h"
+#include "resolver.h"
+#include "eyeballs.h"
+#include "deadline.h"
+#include "origin.h"
+#include "hedge.h"
+#include "negcache.h"
+#include "refresh.h"
+#include "hitters.h"
+#include "hostkey.h"
+#include "certpool.h"
+#include "history.h"
+#include "warm.h"
+#include "snapshot.h"
+#include "handoff.h"
+#include "shmcache.h"
+#include "connection.h"
+#include "tlsfront.h"
+#include "tcptune.h"
+#include <netinet/in.h>
+#include <openssl/crypto.h>
+
+const char admin_not_found_page[] = "No such admin resource.\n";
+const char admin_unauthorized_page[] = "A bearer token is required.\n";
+const char admin_forbidden_page[] = "Wrong token.\n";
+const char admin_too_large_page[] = "The list of hosts is too large.\n";
+
+/* Longest list of hosts accepted by /admin/prefetch. */
+#define ADMIN_MAX_UPLOAD (16 * 1024 * 1024)
+
+/* Longest token accepted from a token file. */
+#define ADMIN_MAX_TOKEN 256
+
+/* A list of hosts being uploaded to /admin/prefetch. */
+struct upload
+{
+  char *data;
+  size_t length;
+  size_t size;
+  int status;                   // set once the upload is refused
+};
+
+static char token[ADMIN_MAX_TOKEN];
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Writes one metric with its help line and type.
+ */
+static void
+metric (FILE *stream, const char *name, const char *type, const char *help,
+        unsigned long long value)
+{
+  fprintf (stream, "# HELP notary_%s %s\n# TYPE notary_%s %s\n"
+           "notary_%s %llu\n", name, help, name, type, name, value);
+} // metric
+
+/**
+ * @brief Queues a text response, which MHD frees once it is sent.
+ *
+ * @param connection    the connection to answer
+ * @param status_code   the HTTP status of the response
+ * @param text          the newly allocated body
+ * @param content_type  the content type of the body
+ *
+ * @return MHD_YES if the response was queued, MHD_NO otherwise
+ */
+static int
+queue_text (struct MHD_Connection *connection, int status_code, char *text,
+            const char *content_type)
+{
+  struct MHD_Response *response;
+  int queued;
+
+  response = MHD_create_response_from_buffer (strlen (text), text,
+                                              MHD_RESPMEM_MUST_FREE);
+  if (response == NULL)
+    {
+      free (text);
+      return MHD_NO;
+    }
+
+  MHD_add_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE,
+                           content_type);
+  queued = MHD_queue_response (connection, status_code, response);
+  MHD_destroy_response (response);
+  return queued;
+} // queue_text
+
+/**
+ * @brief Queues one of the fixed pages.
+ *
+ * @return MHD_YES if the response was queued, MHD_NO otherwise
+ */
+static int
+queue_page (struct MHD_Connection *connection, int status_code,
+            const char *page)
+{
+  char *text = strdup (page);
+
+  if (text == NULL)
+    return MHD_NO;
+  return queue_text (connection, status_code, text, "text/plain");
+} // queue_page
+
+/**
+ * @brief Appends a piece of an upload, refusing it once it grows too large.
+ */
+static void
+append_upload (struct upload *upload, const char *data, size_t length)
+{
+  char *grown;
+  size_t size;
+
+  if (upload->status != 0)
+    return;
+  if (upload->length + length >= ADMIN_MAX_UPLOAD)
+    {
+      upload->status = MHD_HTTP_PAYLOAD_TOO_LARGE;
+      return;
+    }
+
+  if (upload->length + length + 1 > upload->size)
+    {
+      size = upload->size ? upload->size : 4096;
+      while (size < upload->length + length + 1)
+        size *= 2;
+      grown = realloc (upload->data, size);
+      if (grown == NULL)
+        {
+          upload->status = MHD_HTTP_PAYLOAD_TOO_LARGE;
+          return;
+        }
+      upload->data = grown;
+      upload->size = size;
+    }
+  memcpy (upload->data + upload->length, data, length);
+  upload->length += length;
+  upload->data[upload->length] = '\0';
+} // append_upload
+
+/**
+ * @brief Frees the upload of a request once MHD is done with it.
+ */
+static void
+admin_request_completed (void *cls, struct MHD_Connection *connection,
+                         void **con_cls, enum MHD_RequestTerminationCode toe)
+{
+  struct upload *upload = *con_cls;
+
+  if (upload == NULL)
+    return;
+  free (upload->data);
+  free (upload);
+  *con_cls = NULL;
+} // admin_request_completed
+
+/**
+ * @brief Handles POST /admin/prefetch: checks the token on the first call,
+ *        collects the list of hosts over the next ones and queues them for
+ *        warming on the last.
+ *
+ * @return MHD_YES on success, MHD_NO otherwise
+ */
+static int
+answer_prefetch (struct MHD_Connection *connection, const char *upload_data,
+                 size_t *upload_data_size, void **con_cls)
+{
+  struct upload *upload = *con_cls;
+  const char *authorization;
+  char *text;
+  int queued;
+
+  if (upload == NULL)
+    {
+      authorization = MHD_lookup_connection_value (connection,
+                                                   MHD_HEADER_KIND,
+                                                   MHD_HTTP_HEADER_AUTHORIZATION);
+      if (authorization == NULL)
+        return queue_page (connection, MHD_HTTP_UNAUTHORIZED,
+                           admin_unauthorized_page);
+      if (!admin_check_token (authorization))
+        return queue_page (connection, MHD_HTTP_FORBIDDEN,
+                           admin_forbidden_page);
+
+      upload = calloc (1, sizeof (*upload));
+      if (upload == NULL)
+        return MHD_NO;
+      *con_cls = upload;
+      return MHD_YES;
+    }
+
+  if (*upload_data_size != 0)
+    {
+      append_upload (upload, upload_data, *upload_data_size);
+      *upload_data_size = 0;
+      return MHD_YES;
+    }
+
+  if (upload->status != 0)
+    return queue_page (connection, upload->status, admin_too_large_page);
+
+  queued = warm_queue (upload->data != NULL ? upload->data : "");
+  if (queued < 0 || asprintf (&text, "Queued %d hosts\n", queued) < 0)
+    return MHD_NO;
+  return queue_text (connection, MHD_HTTP_ACCEPTED, text, "text/plain");
+} // answer_prefetch
+
+/**
+ * @brief Handles GET /admin/ready: whether enough hosts are warm.
+ *
+ * @return MHD_YES if a response was queued, MHD_NO otherwise
+ */
+static int
+answer_ready (struct MHD_Connection *connection)
+{
+  struct warm_stats warming;
+  char *text;
+
+  if (warm_ready ())
+    return queue_page (connection, MHD_HTTP_OK, "ready\n");
+
+  warm_get_stats (&warming);
+  if (asprintf (&text, "warming: %lu of %lu hosts warm\n", warming.warmed,
+                warming.queued) < 0)
+    return MHD_NO;
+  return queue_text (connection, MHD_HTTP_SERVICE_UNAVAILABLE, text,
+                     "text/plain");
+} // answer_ready
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Formats the counters of the notary for /admin/metrics.
+ *
+ * @return a newly allocated string, or NULL on failure
+ */
+char *
+admin_format_metrics ()
+{
+  struct signer_stats signing;
+  struct observation_stats observations;
+  struct response_cache_stats responses;
+  struct resolver_stats dns;
+  struct eyeballs_stats races;
+  struct deadline_stats deadlines;
+  struct origin_stats origins;
+  struct hedge_stats hedges;
+  struct negcache_stats failures;
+  struct refresh_stats refreshes;
+  struct hitters_stats hitters;
+  struct hostkey_stats hosts;
+  struct certpool_stats pool;
+  struct history_stats history;
+  struct warm_stats warming;
+  struct snapshot_stats snapshots;
+  struct handoff_stats handoffs;
+  struct shmcache_stats shared;
+  struct connection_stats clients;
+  struct tlsfront_stats tls;
+  struct tcptune_stats tcp;
+  static const char *stages[DEADLINE_STAGES] =
+    {"queue", "dns", "connect", "tls", "sign"};
+  char *text = NULL;
+  size_t length;
+  FILE *stream;
+  int i;
+
+  stream = open_memstream (&text, &length);
+  if (stream == NULL)
+    return NULL;
+
+  signer_get_stats (&signing);
+  metric (stream, "signatures_total", "counter", "Signatures produced.",
+          signing.signatures);
+  metric (stream, "signing_failures_total", "counter",
+          "Signing attempts that failed.", signing.failures);
+  metric (stream, "signing_microseconds_total", "counter",
+          "Time spent in private key operations.", signing.total_sign);
+
+  observation_get_stats (&observations);
+  metric (stream, "observation_hits_total", "counter",
+          "Verifications answered from a fresh observation.",
+          observations.hits);
+  metric (stream, "observation_misses_total", "counter",
+          "Verifications that had to contact the host.", observations.misses);
+  fprintf (stream, "# HELP notary_observation_segment_hits_total Hits of the "
+           "observation cache, by segment.\n"
+           "# TYPE notary_observation_segment_hits_total counter\n"
+           "notary_observation_segment_hits_total{segment=\"window\"} %lu\n"
+           "notary_observation_segment_hits_total{segment=\"probation\"} "
+           "%lu\n"
+           "notary_observation_segment_hits_total{segment=\"protected\"} "
+           "%lu\n", observations.window_hits, observations.probation_hits,
+           observations.protected_hits);
+  metric (stream, "observation_admitted_total", "counter",
+          "New hosts admitted to the observation cache over a rarer host.",
+          observations.admitted);
+  metric (stream, "observation_rejected_total", "counter",
+          "New hosts evicted because they were rarer than the host they "
+          "would displace.", observations.rejected);
+  metric (stream, "observation_hosts", "gauge", "Hosts with an observation.",
+          observations.hosts);
+  metric (stream, "observation_bytes", "gauge",
+          "Memory held by the observation cache.", observations.bytes);
+
+  refresh_get_stats (&refreshes);
+  metric (stream, "refreshes_total", "counter",
+          "Popular hosts refreshed in the background.", refreshes.started);
+  metric (stream, "refresh_failures_total", "counter",
+          "Background refreshes that could not contact the host.",
+          refreshes.failed);
+  metric (stream, "refreshes_dropped_total", "counter",
+          "Background refreshes the refresh budget did not allow.",
+          refreshes.dropped);
+  metric (stream, "refreshes_inflight", "gauge",
+          "Background refreshes running.", refreshes.inflight);
+
+  hitters_get_stats (&hitters);
+  metric (stream, "heavy_hitters", "gauge",
+          "Hosts in the heavy-hitter table.", hitters.tracked);
+  metric (stream, "heavy_hitter_threshold", "gauge",
+          "Requests a host needs to enter the heavy-hitter table.",
+          hitters.threshold);
+
+  hostkey_get_stats (&hosts);
+  metric (stream, "hostkey_ids", "gauge",
+          "Distinct hosts given an ID since the notary started.",
+          hosts.interned);
+  metric (stream, "hostkey_invalid_total", "counter",
+          "Requests about hosts that are not valid host names or addresses.",
+          hosts.invalid);
+  metric (stream, "hostkey_full_total", "counter",
+          "Hosts not remembered because hostkey_max_ids hosts have an ID.",
+          hosts.full);
+
+  certpool_get_stats (&pool);
+  metric (stream, "certpool_certificates", "gauge",
+          "Distinct certificates in the certificate pool.", pool.certs);
+  metric (stream, "certpool_chains", "gauge",
+          "Distinct chains in the certificate pool.", pool.chains);
+  metric (stream, "certpool_hits_total", "counter",
+          "Certificates found in the pool instead of being fingerprinted.",
+          pool.hits);
+  metric (stream, "certpool_full_total", "counter",
+          "Certificates or chains refused an ID by certpool_max_ids.",
+          pool.full);
+  metric (stream, "certpool_bytes", "gauge",
+          "Memory held by the certificate pool.", pool.bytes);
+
+  history_get_stats (&history);
+  metric (stream, "history_hosts", "gauge",
+          "Hosts with an observation history.", history.hosts);
+  metric (stream, "history_runs", "gauge",
+          "Runs of chains kept in the observation history.", history.runs);
+  metric (stream, "history_extended_total", "counter",
+          "Observations that only extended a run of a host.",
+          history.extended);
+  metric (stream, "history_trimmed_total", "counter",
+          "Runs dropped beyond history_max_runs.", history.trimmed);
+  metric (stream, "history_stale_total", "counter",
+          "Old sightings dropped for a later run of another chain.",
+          history.stale);
+  metric (stream, "history_bytes", "gauge",
+          "Memory held by the observation history.", history.bytes);
+
+  warm_get_stats (&warming);
+  metric (stream, "warm_queued_total", "counter",
+          "Hosts given to warm.", warming.queued);
+  metric (stream, "warm_invalid_total", "counter",
+          "Lines of warm-up lists that named no valid host.",
+          warming.invalid);
+  metric (stream, "warm_done_total", "counter",
+          "Hosts warmed or given up on.", warming.done);
+  metric (stream, "warm_warmed_total", "counter",
+          "Hosts of warm-up lists with a fresh observation.", warming.warmed);
+  metric (stream, "warm_failed_total", "counter",
+          "Hosts of warm-up lists that could not be observed.",
+          warming.failed);
+  metric (stream, "warm_ready", "gauge",
+          "Whether enough hosts are warm to take traffic.", warm_ready ());
+
+  snapshot_get_stats (&snapshots);
+  metric (stream, "snapshot_hosts", "gauge",
+          "Hosts in the snapshot mapped at startup.", snapshots.hosts);
+  metric (stream, "snapshot_restored_total", "counter",
+          "Hosts restored from the snapshot.", snapshots.restored);
+  metric (stream, "snapshot_restored_on_demand_total", "counter",
+          "Hosts restored from the snapshot for a request.",
+          snapshots.on_demand);
+  metric (stream, "snapshot_map_milliseconds", "gauge",
+          "Time taken to map and check the snapshot.", snapshots.map_ms);
+  metric (stream, "snapshot_rebuild_milliseconds", "gauge",
+          "Time taken to restore every host of the snapshot.",
+          snapshots.rebuild_ms);
+  metric (stream, "snapshot_writes_total", "counter",
+          "Snapshots written.", snapshots.writes);
+  metric (stream, "snapshot_write_failures_total", "counter",
+          "Snapshots that could not be written.", snapshots.write_failures);
+  metric (stream, "snapshot_write_milliseconds", "gauge",
+          "Time the last snapshot took to write.", snapshots.write_ms);
+  metric (stream, "snapshot_bytes", "gauge",
+          "Size of the last snapshot written.", snapshots.write_bytes);
+
+  handoff_get_stats (&handoffs);
+  metric (stream, "handoff_inherited_sockets", "gauge",
+          "Listening sockets taken over from the previous notary.",
+          handoffs.inherited);
+  metric (stream, "handoff_failures_total", "counter",
+          "Successors that failed to take over the listening sockets.",
+          handoffs.failures);
+
+  shmcache_get_stats (&shared);
+  metric (stream, "shmcache_hits_total", "counter",
+          "Observations found in the table shared with other processes.",
+          shared.hits);
+  metric (stream, "shmcache_misses_total", "counter",
+          "Hosts without a fresh observation in the shared table.",
+          shared.misses);
+  metric (stream, "shmcache_published_total", "counter",
+          "Observations written to the shared table.", shared.published);
+  metric (stream, "shmcache_claims_total", "counter",
+          "Hosts claimed in the shared table before contacting them.",
+          shared.claims);
+  metric (stream, "shmcache_busy_total", "counter",
+          "Hosts found claimed by another process or thread.", shared.busy);
+  metric (stream, "shmcache_waited_hits_total", "counter",
+          "Observations waited for and published in time.",
+          shared.waited_hits);
+  metric (stream, "shmcache_reclaimed_total", "counter",
+          "Slots and claims taken over from dead processes.",
+          shared.reclaimed);
+  metric (stream, "shmcache_evictions_total", "counter",
+          "Hosts displaced from the shared table.", shared.evictions);
+
+  connection_get_stats (&clients);
+  metric (stream, "client_connections_total", "counter",
+          "Client connections accepted.", clients.connections);
+  metric (stream, "client_requests_total", "counter",
+          "Client requests received.", clients.requests);
+  metric (stream, "client_requests_reused_total", "counter",
+          "Client requests on a connection kept open from an earlier one.",
+          clients.reused);
+  metric (stream, "client_connections_capped_total", "counter",
+          "Client connections closed after keepalive_max_requests.",
+          clients.capped);
+
+  tlsfront_get_stats (&tls);
+  metric (stream, "tls_handshakes_total", "counter",
+          "TLS handshakes completed on the SSL port.", tls.handshakes);
+  metric (stream, "tls_resumed_total", "counter",
+          "TLS handshakes that resumed an earlier session.", tls.resumed);
+  metric (stream, "tls_handshake_failures_total", "counter",
+          "TLS handshakes that failed or timed out.", tls.failures);
+  metric (stream, "tls_ktls_total", "counter",
+          "TLS connections whose records the kernel encrypts.", tls.ktls);
+  metric (stream, "tls_relayed_total", "counter",
+          "TLS connections relayed to the daemon by a thread.", tls.relayed);
+  metric (stream, "tls_overloaded_total", "counter",
+          "TLS connections closed over tls_max_connections.", tls.overloaded);
+  metric (stream, "tls_ticket_rotations_total", "counter",
+          "Session-ticket keys replaced.", tls.rotations);
+
+  tcptune_get_stats (&tcp);
+  metric (stream, "tcp_upstream_sockets_total", "counter",
+          "Sockets of upstream fetches given the upstream TCP profile.",
+          tcp.upstream);
+  metric (stream, "tcp_options_refused_total", "counter",
+          "TCP profile options the kernel refused.", tcp.refused);
+
+  response_cache_get_stats (&responses);
+  metric (stream, "response_cache_hits_total", "counter",
+          "Signed responses served from the cache.", responses.hits);
+  metric (stream, "response_cache_misses_total", "counter",
+          "Signed responses that had to be signed.", responses.misses);
+  metric (stream, "response_cache_spared_total", "counter",
+          "Heavy hitters given a second chance instead of being evicted.",
+          responses.spared);
+
+  resolver_get_stats (&dns);
+  metric (stream, "dns_hits_total", "counter",
+          "Host names answered from the DNS cache.", dns.hits);
+  metric (stream, "dns_misses_total", "counter",
+          "Host names that had to be resolved.", dns.misses);
+  metric (stream, "dns_timeouts_total", "counter",
+          "DNS queries that were not answered.", dns.timeouts);
+
+  eyeballs_get_stats (&races);
+  metric (stream, "connect_races_total", "counter",
+          "Connection races to hosts.", races.races);
+  metric (stream, "connect_fallbacks_total", "counter",
+          "Races the first address tried lost.", races.fallbacks);
+
+  deadline_get_stats (&deadlines);
+  fprintf (stream, "# HELP notary_deadline_expired_total Verifications that "
+           "ran out of time, by stage.\n"
+           "# TYPE notary_deadline_expired_total counter\n");
+  for (i = 0; i < DEADLINE_STAGES; i++)
+    fprintf (stream, "notary_deadline_expired_total{stage=\"%s\"} %lu\n",
+             stages[i], deadlines.expired[i]);
+  metric (stream, "verifications_cancelled_total", "counter",
+          "Verifications whose client hung up.", deadlines.cancelled);
+
+  origin_get_stats (&origins);
+  metric (stream, "fetch_slots_queued_total", "counter",
+          "Fetches that waited for a slot of their origin.", origins.queued);
+  metric (stream, "fetch_slots_refused_total", "counter",
+          "Fetches that gave up waiting for a slot.", origins.rejected);
+
+  hedge_get_stats (&hedges);
+  metric (stream, "fetches_total", "counter",
+          "Fetches whose latency was recorded.", hedges.fetches);
+  metric (stream, "hedges_total", "counter",
+          "Second fetches started for slow fetches.", hedges.hedges);
+  metric (stream, "hedge_wins_total", "counter",
+          "Fetches won by the second fetch.", hedges.hedge_wins);
+  metric (stream, "hedges_denied_total", "counter",
+          "Second fetches the hedge budget did not allow.", hedges.denied);
+  metric (stream, "hedge_saved_milliseconds_total", "counter",
+          "Estimated latency saved by second fetches.", hedges.saved_ms);
+
+  negcache_get_stats (&failures);
+  fprintf (stream, "# HELP notary_host_failures_total Hosts that could not be "
+           "contacted, by failure class.\n"
+           "# TYPE notary_host_failures_total counter\n");
+  for (i = 0; i < NEGCACHE_CLASSES; i++)
+    fprintf (stream, "notary_host_failures_total{class=\"%s\"} %lu\n",
+             negcache_class_name (i), failures.failures[i]);
+  metric (stream, "negative_cache_hits_total", "counter",
+          "Verifications failed at once because their host failed recently.",
+          failures.hits);
+  metric (stream, "negative_cache_hosts", "gauge",
+          "Hosts with a recent failure remembered.", failures.entries);
+
+  if (fclose (stream) != 0)
+    {
+      free (text);
+      return NULL;
+    }
+  return text;
+} // admin_format_metrics
+
+/**
+ * @brief Handles a request to the admin daemon.
+ *
+ * @return MHD_YES if a response was queued, MHD_NO otherwise
+ */
+int
+answer_to_admin_connection (void *cls, struct MHD_Connection *connection,
+                            const char *url, const char *method,
+                            const char *version, const char *upload_data,
+                            size_t *upload_data_size, void **con_cls)
+{
+  char *text;
+
+  if (strcmp (method, "POST") == 0 && strcmp (url, "/admin/prefetch") == 0)
+    return answer_prefetch (connection, upload_data, upload_data_size,
+                            con_cls);
+
+  if (strcmp (method, "GET") == 0 && strcmp (url, "/admin/ready") == 0)
+    return answer_ready (connection);
+
+  if (strcmp (method, "GET") == 0 && strcmp (url, "/admin/metrics") == 0)
+    {
+      text = admin_format_metrics ();
+      if (text != NULL)
+        return queue_text (connection, MHD_HTTP_OK, text,
+                           "text/plain; version=0.0.4");
+      return MHD_NO;
+    }
+
+  if (strcmp (method, "GET") == 0 && strcmp (url, "/admin/hitters") == 0)
+    {
+      text = hitters_format ();
+      if (text != NULL)
+        return queue_text (connection, MHD_HTTP_OK, text, "text/plain");
+      return MHD_NO;
+    }
+
+  return queue_page (connection, MHD_HTTP_NOT_FOUND, admin_not_found_page);
+} // answer_to_admin_connection
+
+/**
+ * @brief Reads the token that /admin/prefetch requires: the first line of a
+ *        file.
+ *
+ * @param file_name  the file
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+admin_load_token (const char *file_name)
+{
+  FILE *file;
+  size_t length;
+
+  file = fopen (file_name, "r");
+  if (file == NULL)
+    {
+      fprintf (stderr, "Could not open %s: %s\n", file_name, strerror (errno));
+      return 0;
+    }
+  if (fgets (token, sizeof (token), file) == NULL)
+    token[0] = '\0';
+  fclose (file);
+
+  length = strcspn (token, "\r\n");
+  token[length] = '\0';
+  if (length == 0 || length == sizeof (token) - 1)
+    {
+      fprintf (stderr, "%s holds no token of at most %d characters\n",
+               file_name, ADMIN_MAX_TOKEN - 2);
+      token[0] = '\0';
+      return 0;
+    }
+  return 1;
+} // admin_load_token
+
+/**
+ * @brief Checks the value of an Authorization header against the token, in
+ *        time that does not depend on where they differ.
+ *
+ * @param authorization  the header value, "Bearer " and the token
+ *
+ * @return 1 if it holds the token, 0 otherwise or if no token was loaded
+ */
+int
+admin_check_token (const char *authorization)
+{
+  size_t length = strlen (token);
+
+  if (length == 0 || strncmp (authorization, "Bearer ", 7) != 0)
+    return 0;
+  authorization += 7;
+  if (strlen (authorization) != length)
+    return 0;
+  return CRYPTO_memcmp (authorization, token, length) == 0;
+} // admin_check_token
+
+/**
+ * @brief Starts the admin daemon. It listens on the loopback interface only,
+ *        since only /admin/prefetch asks for a token, on a socket handed
+ *        over on upgrades.
+ *
+ * @param port  the port to listen on
+ *
+ * @return the daemon, or NULL if it could not be started
+ */
+struct MHD_Daemon *
+admin_start (int port)
+{
+  struct sockaddr_in loopback;
+  int listener;
+
+  memset (&loopback, 0, sizeof (loopback));
+  loopback.sin_family = AF_INET;
+  loopback.sin_port = htons (port);
+  loopback.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+  listener = handoff_listen ("admin", (struct sockaddr *) &loopback,
+                             sizeof (loopback), 0);
+  if (listener < 0)
+    return NULL;
+
+  return MHD_start_daemon (MHD_USE_SELECT_INTERNALLY
+                           | MHD_USE_PIPE_FOR_SHUTDOWN, port, NULL, NULL,
+                           &answer_to_admin_connection, NULL,
+                           MHD_OPTION_LISTEN_SOCKET, listener,
+                           MHD_OPTION_NOTIFY_COMPLETED,
+                           &admin_request_completed, NULL, MHD_OPTION_END);
+} // admin_start
@@ -0,0 +1,45 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the notary's admin interface, an
+ * HTTP daemon bound to the loopback interface that operators query for the
+ * counters the notary keeps and for whether it is ready for traffic. Lists
+ * of hosts to warm can be posted to it by holders of a bearer token read
+ * from a file; without a token file no list is accepted.
+ ******************************************************************************/
+#ifndef ADMIN_H
+#define ADMIN_H
+
+#include "notary.h"
+
+/* Formats the counters of the notary in the Prometheus text format. Returns
+ * a newly allocated string, or NULL on failure.
+ */
+char *admin_format_metrics (void);
+
+/* Handles a request to the admin daemon. The address of this function needs
+ * to be passed to MHD_start_daemon.
+ */
+int
+answer_to_admin_connection (void *cls, struct MHD_Connection *connection,
+                            const char *url, const char *method,
+                            const char *version, const char *upload_data,
+                            size_t *upload_data_size, void **con_cls);
+
+/* Reads the token that posting hosts to warm requires from the first line
+ * of a file. Returns 1 on success, 0 otherwise.
+ */
+int admin_load_token (const char *file_name);
+
+/* Returns 1 if the value of an Authorization header is "Bearer " followed
+ * by the token, 0 otherwise or if no token was loaded.
+ */
+int admin_check_token (const char *authorization);
+
+/* Starts the admin daemon on a loopback port. Returns the daemon, or NULL
+ * if it could not be started.
+ */
+struct MHD_Daemon *admin_start (int port);
+
+#endif // ADMIN_H
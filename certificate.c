@@ -13,6 +13,17 @@
 */
 
 #include "certificate.h"
+#include "worker.h"
+#include "resolver.h"
+#include "eyeballs.h"
+#include "deadline.h"
+#include "hedge.h"
+#include "hostkey.h"
+#include "negcache.h"
+#include "certpool.h"
+#include "tcptune.h"
+#include "config.h"
+#include <errno.h>
 
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 // Helpers
@@ -37,16 +48,6 @@ static size_t wrfu (void *ptr,  size_t  size,  size_t  nmemb,  void *stream)
   return size * nmemb;
 }
 
-/**
- * @brief Combines curl cleanup calls.
- * @param curl_handle ___. FIXME
- */
-static void curl_cleanup(CURL* curl_handle)
-{
-  curl_easy_cleanup(curl_handle);
-  curl_global_cleanup();
-}
-
 /**
  * @brief Changes fingerprint (hex characters) to upper case.
  * @param fingerprint  pointer to the string to be changed into upper case.
@@ -65,172 +66,579 @@ static void to_upper_case(char* fingerprint)
 }
 
 /**
- * @brief converts the PEM certificate to its corresponding SHA1 fingerprint
+ * @brief Finds a PEM certificate in the certificate pool by the digest of
+ *        its DER encoding, and only if it is not there yet decodes it,
+ *        computes its SHA1 fingerprint and adds it to the pool.
  * 
- * @param cert          array of certificates to be converted.
- * @param fingerprints  pointer to the array to which @c get_fingerprint_from_cert writes the SHA1 fingerprints     
- * @param num_of_certs  size of the @c cert array
+ * @param worker  the worker context of the request
+ * @param cert    the PEM certificate
+ * @param id      output parameter for the ID of the certificate in the pool
+ *
+ * @return 1 on success, 0 if the certificate could not be decoded, -1 if
+ *         the pool is full.
  */
-static void get_fingerprint_from_cert (char** cert, char** fingerprints, int num_of_certs)
+static int pool_certificate (struct worker_context *worker, char* cert, uint32_t *id)
 {
-  ssize_t len;
   BIO* bio_buffer;
-  X509* decoded_certificate;
-  const EVP_MD* digest;
-  unsigned char md[EVP_MAX_MD_SIZE];
-  unsigned int n;
+  unsigned char *der = NULL;
   char errmsg[1024];
   unsigned err;
-  int pos;
+  long der_length;
+  int result;
+
+  //create BIO buffer for SSL, this buffer contains the certificate, buff
+  bio_buffer = BIO_new_mem_buf(cert, strlen(cert));
+  if (bio_buffer == NULL)
+    return 0;
+
+  //only take the DER encoding out of the buffer, without decoding it
+  if(!PEM_bytes_read_bio(&der, &der_length, NULL, PEM_STRING_X509,
+                         bio_buffer, NULL, NULL))
+    {
+      while( (err = ERR_get_error()))
+        {
+          errmsg[1023] = '\0';
+          ERR_error_string_n(err, errmsg, 1023);
+          fprintf(stderr, "peminfo: %s\n", errmsg);
+        }
+
+      BIO_free(bio_buffer);
+      return 0;
+    }
+  BIO_free(bio_buffer);
 
-  //initialize OpenSSL
-  //this allows us to access error messages
-  SSL_load_error_strings();
+  result = pool_der_certificate(worker, der, der_length, id);
+  OPENSSL_free(der);
 
-  //this initializes the library for ssl (algorithms)
-  SSL_library_init();
+  return result;
+}//pool_certificate
 
-  //temporary value to store parts of the fingerprint
-  char* temp = malloc(sizeof(char) * 4);
 
-  int i;
-  for(i=0; i<num_of_certs; i++)
+/**
+ * @brief Hands curl the socket connected by eyeballs_connect instead of
+ *        letting it open one.
+ *
+ * @param clientp  pointer to the connected socket, which curl owns afterwards
+ *
+ * @return the socket, or CURL_SOCKET_BAD if it was already handed over
+ */
+static curl_socket_t
+open_connected_socket (void *clientp, curlsocktype purpose,
+                       struct curl_sockaddr *address)
+{
+  int *connected = clientp;
+  int fd = *connected;
+
+  *connected = -1;
+  return fd >= 0 ? fd : CURL_SOCKET_BAD;
+}
+
+/**
+ * @brief Applies the upstream TCP profile to a socket curl opened itself.
+ *        curl may race it against another address, so its SYN is not
+ *        held back for Fast Open.
+ */
+static int
+tune_socket (void *clientp, curl_socket_t fd, curlsocktype purpose)
+{
+  tcptune_upstream(fd, 0);
+  return CURL_SOCKOPT_OK;
+}
+
+/**
+ * @brief Tells curl that the socket it was handed is connected already.
+ */
+static int
+skip_connect (void *clientp, curl_socket_t fd, curlsocktype purpose)
+{
+  return CURL_SOCKOPT_ALREADY_CONNECTED;
+}
+
+/**
+ * @brief Aborts a transfer whose deadline passed or whose client hung up.
+ *
+ * @param clientp  the deadline of the verification
+ *
+ * @return nonzero to abort the transfer
+ */
+static int
+check_deadline (void *clientp, curl_off_t dltotal, curl_off_t dlnow,
+                curl_off_t ultotal, curl_off_t ulnow)
+{
+  return deadline_expired(clientp);
+}
+
+/**
+ * @brief Tells why a transfer failed, for the negative cache.
+ *
+ * @param result    the result of the transfer
+ * @param deadline  the deadline of the verification
+ *
+ * @return a negcache_class
+ */
+static int
+classify_failure (CURLcode result, struct deadline *deadline)
+{
+  /* A client that hung up says nothing about the host. */
+  if(deadline->cancelled)
+    return NEGCACHE_NONE;
+
+  switch(result)
     {
-      len = strlen(cert[i]);
-      //create BIO buffer for SSL, this buffer contains the certificate, buff
-      bio_buffer = BIO_new_mem_buf(cert[i], len);
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_ABORTED_BY_CALLBACK:
+      return NEGCACHE_TIMEOUT;
+    case CURLE_COULDNT_RESOLVE_HOST:
+      return NEGCACHE_DNS;
+    case CURLE_COULDNT_CONNECT:
+      return NEGCACHE_CONNECT;
+    case CURLE_FAILED_INIT:
+    case CURLE_OUT_OF_MEMORY:
+      return NEGCACHE_NONE;
+    default:
+      /* Anything else went wrong once the connection was up. */
+      return NEGCACHE_TLS;
+    }
+}
+
+/**
+ * @brief Tells whether a transfer over a Fast Open connection failed because
+ *        the host could not be reached. Such a connection reports itself
+ *        connected at once and only sends its SYN with the ClientHello, so a
+ *        refused or unreachable host shows up as an error of the handshake.
+ *
+ * @param curl  the handle of the transfer
+ *
+ * @return 1 if the connection was never made, 0 otherwise
+ */
+static int
+fastopen_unreachable (CURL *curl)
+{
+  long error = 0;
+
+  if(curl_easy_getinfo(curl, CURLINFO_OS_ERRNO, &error) != CURLE_OK)
+    return 0;
+
+  switch(error)
+    {
+    case ECONNREFUSED:
+    case EHOSTUNREACH:
+    case ENETUNREACH:
+    case ETIMEDOUT:
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+/**
+ * @brief Sets the options every certificate request uses on a curl handle.
+ *
+ * @param curl            the handle, which is reset first
+ * @param host_to_verify  the url and port of the website
+ * @param deadline        the deadline of the verification
+ */
+static void
+prepare_transfer (CURL *curl, host *host_to_verify, struct deadline *deadline)
+{
+  curl_easy_reset(curl);
+
+  curl_easy_setopt(curl, CURLOPT_URL, host_to_verify->url);
+  curl_easy_setopt(curl, CURLOPT_PORT, host_to_verify->port);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, wrfu);
+ 
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+ 
+  curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+  curl_easy_setopt(curl, CURLOPT_CERTINFO, 1L);
+
+  /* Every verification needs a full handshake: a reused connection or a
+   * resumed session would not show us the certificates. */
+  curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+  curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+  curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 0L);
+
+  /* The transfer stops when the deadline passes or the client hangs up. */
+  curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, check_deadline);
+  curl_easy_setopt(curl, CURLOPT_XFERINFODATA, deadline);
+
+  /* A socket connected by eyeballs_connect is tuned already. */
+  curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, tune_socket);
+}
+
+/**
+ * @brief Runs the prepared transfer of a worker. If it takes longer than
+ *        fetches from the origin usually do, a second one is started on a
+ *        new connection, and the first to finish wins.
+ *
+ * @param worker          the worker context whose curl handle is prepared
+ * @param host_to_verify  the url and port of the website
+ * @param origin          the origin, for its latency history
+ * @param hedge_resolve   the CURLOPT_RESOLVE list for a second fetch
+ * @param deadline        the deadline of the verification
+ * @param result          output parameter for the result of the transfer
+ *
+ * @return the handle of the transfer that succeeded, or NULL
+ */
+static CURL *
+perform_hedged (struct worker_context *worker, host *host_to_verify,
+                const char *origin, struct curl_slist *hedge_resolve,
+                struct deadline *deadline, CURLcode *result)
+{
+  CURL *winner = NULL;
+  CURLMsg *message;
+  long long start = deadline_now_ms(), now, hedge_at = 0;
+  long delay = hedge_delay_ms(origin), budget;
+  int running = 1, pending, hedged = 0;
+  int wait;
 
-      //decode the buffer by reading from the newly created BIO buffer
-      if(! (decoded_certificate = PEM_read_bio_X509(bio_buffer, NULL, 0L, NULL)))
+  if(delay > 0)
+    hedge_at = start + delay;
+
+  *result = CURLE_FAILED_INIT;
+  curl_multi_add_handle(worker->multi, worker->curl);
+
+  while(winner == NULL && running > 0)
+    {
+      curl_multi_perform(worker->multi, &running);
+      while((message = curl_multi_info_read(worker->multi, &pending)))
         {
-          while( (err = ERR_get_error()))
+          if(message->msg != CURLMSG_DONE)
+            continue;
+          *result = message->data.result;
+          if(*result == CURLE_OK)
             {
-              errmsg[1023] = '\0';
-              ERR_error_string_n(err, errmsg, 1023);
-              fprintf(stderr, "peminfo: %s\n", errmsg);
+              winner = message->easy_handle;
+              break;
             }
+        } //a failed transfer leaves the other one running, if there is one
+      if(winner != NULL || running == 0)
+        break;
 
-          BIO_free(bio_buffer);
-          ERR_free_strings();
-          exit(1);
+      now = deadline_now_ms();
+      if(hedge_at > 0 && now >= hedge_at)
+        {
+          hedge_at = 0;
+          budget = deadline_budget_ms(deadline, DEADLINE_CONNECT)
+            + deadline_budget_ms(deadline, DEADLINE_TLS);
+          if(budget > deadline_left_ms(deadline, DEADLINE_CONNECT))
+            budget = deadline_left_ms(deadline, DEADLINE_CONNECT);
+          if(budget > 0 && hedge_start())
+            {
+              prepare_transfer(worker->hedge, host_to_verify, deadline);
+              curl_easy_setopt(worker->hedge, CURLOPT_RESOLVE, hedge_resolve);
+              curl_easy_setopt(worker->hedge, CURLOPT_CONNECTTIMEOUT_MS, budget);
+              curl_easy_setopt(worker->hedge, CURLOPT_TIMEOUT_MS, budget);
+              curl_multi_add_handle(worker->multi, worker->hedge);
+              hedged = 1;
+              running++;
+              continue;
+            }
         }
 
-      //calculate and print out the fingerprint
-      digest = EVP_get_digestbyname("sha1");
-      X509_digest(decoded_certificate, digest, md, &n);
+      /* Wake up for the hedge, and now and then for the deadline. */
+      wait = 1000;
+      if(hedge_at > 0 && hedge_at - now < wait)
+        wait = hedge_at - now;
+      curl_multi_poll(worker->multi, NULL, 0, wait, NULL);
+    }
 
-      //concatenate the fingerprint to the return string
-      for(pos=0; pos < 19; pos++)
-        {
-          sprintf(temp, "%02x:", md[pos]);
-          strcat(fingerprints[i], temp);
-        }
+  curl_multi_remove_handle(worker->multi, worker->curl);
+  if(hedged)
+    curl_multi_remove_handle(worker->multi, worker->hedge);
 
-      //then concatenate the final two characters
-      //strcat adds a terminating null character to the end
-      sprintf(temp, "%02x", md[pos]);
-      strcat(fingerprints[i], temp);
+  if(winner != NULL)
+    hedge_observe(origin, deadline_now_ms() - start, winner == worker->hedge);
+  return winner;
+}
 
-      //free all used memory
-      X509_free(decoded_certificate);
-      BIO_free(bio_buffer);
-      ERR_free_strings();
-    }
+/**
+ * @brief Finds a DER certificate in the certificate pool by its digest, and
+ *        only if it is not there yet computes its SHA1 fingerprint and adds
+ *        it to the pool. The fingerprint is the digest of the encoding, so
+ *        the certificate is not decoded, which would take a hundred times
+ *        longer; only its outer SEQUENCE is checked to span the encoding.
+ *
+ * @param worker      the worker context of the request
+ * @param der         the DER encoding of the certificate
+ * @param der_length  the length of the encoding
+ * @param id          output parameter for the ID of the certificate
+ *
+ * @return 1 on success, 0 if the certificate could not be decoded, -1 if
+ *         the pool is full.
+ */
+int pool_der_certificate (struct worker_context *worker,
+                          const unsigned char *der, long der_length,
+                          uint32_t *id)
+{
+  unsigned char digest[CERTPOOL_DIGEST_LENGTH];
+  char fingerprint[FPT_LENGTH];
+  const unsigned char *content = der;
+  long content_length;
+  int tag, class;
+
+  //a certificate is one SEQUENCE, and nothing follows it
+  if(ASN1_get_object(&content, &content_length, &tag, &class, der_length)
+     != V_ASN1_CONSTRUCTED
+     || tag != V_ASN1_SEQUENCE
+     || content + content_length != der + der_length
+     || !certpool_digest(der, der_length, digest))
+    return 0;
 
-  //free all memory
-  free(temp);
+  //most certificates, intermediates above all, were seen before
+  *id = certpool_find(digest);
+  if(*id != CERTPOOL_NONE)
+    return 1;
 
-}//get_fingerprint_from_cert
+  //calculate the fingerprint with the worker's digest context
+  if(!worker_fingerprint_der(worker, der, der_length, fingerprint))
+    return 0;
 
+  /* Fingerprints are sent to clients in upper case. */
+  to_upper_case(fingerprint);
+  *id = certpool_intern(digest, fingerprint);
+  return *id != CERTPOOL_NONE ? 1 : -1;
+}//pool_der_certificate
 
 /** 
  * @brief Requests the certificates from the website given by the url, 
- * and stores the fingerprints of the corresponding certificates. 
+ * and interns the chain they form in the certificate pool. 
  *
- * @param host_to_verify  FIXME  
- * @param fingerprints    pointer to the array to which @c request_certificate writes the fingerprints from the host. 
+ * @param host_to_verify  the url and port of the website
+ * @param chain           output parameter for the ID of the chain in the certificate pool
+ * @param deadline        the deadline of the verification, or NULL for none
+ * @param failure         output parameter for the negcache_class of a
+ *                        failure, or NULL
  *
- * @return  the number of fingerprints retrieved.
+ * @return  the number of certificates in the chain.
  */
 int 
-request_certificate (host *host_to_verify, char** fingerprints)
+request_certificate (host *host_to_verify, uint32_t *chain,
+                     struct deadline *deadline, int *failure)
 {  
+  struct deadline no_deadline;
+  int no_failure;
+  long budget, connect_budget = 0, tls_budget;
+  struct worker_context *worker;
+  struct curl_certinfo *ci = NULL;
+  struct curl_slist *slist;
+  struct curl_slist *resolve_list = NULL;
+  struct curl_slist *hedge_resolve = NULL;
+  struct resolver_answer answer, alternative;
+  char name[RESOLVER_NAME_LENGTH];
+  char origin[HOSTKEY_LENGTH];
+  long port = host_to_verify->port;
+  int resolved, winner, connected = -1, fastopen = 0;
   CURL *curl;
   CURLcode res;
   //variable to determine the number of certificates retrieved
-  int number_of_certs;
-
-  //initialize curl
-  curl_global_init(CURL_GLOBAL_DEFAULT);
-  curl = curl_easy_init();
-  
-  //If curl has been initialized, set curl options.
-  if(curl) {
-    curl_easy_setopt(curl, CURLOPT_URL, host_to_verify->url);
-    curl_easy_setopt(curl, CURLOPT_PORT, host_to_verify->port);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, wrfu);
- 
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
- 
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
-    curl_easy_setopt(curl, CURLOPT_CERTINFO, 1L);
-    
-    //res is 0 if curl_easy_perform succeeds.
-    res = curl_easy_perform(curl);
-    
-    //Initialize ci and determine number of certificates.
-    if(!res) {
-      struct curl_certinfo *ci = NULL;
-      res = curl_easy_getinfo(curl, CURLINFO_CERTINFO, &ci);
-      number_of_certs = ci->num_of_certs;
-
-      //allocate memory for the array to store the retrieved certificates
-      char** certificates;
-      certificates = (char**)calloc(number_of_certs, sizeof *certificates);
-
-      int i;
-      if((!res) && ci)
-        {
-          for(i=0; i<number_of_certs; i++)
-            {
-              struct curl_slist *slist;
-              for(slist = ci->certinfo[i]; slist; slist = slist->next)
-                if(!strncmp(slist->data, "Cert:", 5))
-                  {
-                    certificates[i] = slist->data+5;
-                    //printf("%s\n", certificates[i]);
-                  }
-            }
+  int number_of_certs = 0;
+  uint32_t *certs;
+  int i, pooled = 1;
 
-          //retrieve the fingerprints from these certificates
-          get_fingerprint_from_cert(certificates, fingerprints, number_of_certs);
+  if(deadline == NULL)
+    {
+      memset(&no_deadline, 0, sizeof(no_deadline));
+      deadline = &no_deadline;
+    }
+  if(failure == NULL)
+    failure = &no_failure;
+  *failure = NEGCACHE_NONE;
 
-          //Cleanup curl
-          curl_cleanup(curl);
+  //take a worker context; its curl handle is reused from earlier requests
+  worker = worker_acquire();
+  if(worker == NULL)
+    {
+      fprintf(stderr, "Could not initialize CURL\n");
+      return 0;
+    } //if curl could not be initialized, return 0
 
-          return number_of_certs;
-        }
-      else
+  curl = worker->curl;
+  prepare_transfer(curl, host_to_verify, deadline);
+
+  /* Hand curl the shared resolver's answer so it need not resolve. */
+  budget = deadline_budget_ms(deadline, DEADLINE_DNS);
+  resolved = budget > 0
+    ? resolver_resolve_url(host_to_verify->url, &port, name, sizeof(name),
+                           &answer, budget)
+    : RESOLVER_FAILED;
+  if(resolved == RESOLVER_NOT_FOUND)
+    {
+      fprintf(stderr, "Could not resolve %s\n", host_to_verify->url);
+      *failure = NEGCACHE_DNS;
+      worker_release(worker);
+      return 0;
+    } //If the name does not exist, return 0
+
+  if(resolved == RESOLVER_FAILED && deadline_expired(deadline))
+    {
+      fprintf(stderr, "Gave up resolving %s\n", host_to_verify->url);
+      deadline_record(deadline, DEADLINE_DNS);
+      *failure = classify_failure(CURLE_OPERATION_TIMEDOUT, deadline);
+      worker_release(worker);
+      return 0;
+    } //If the deadline passed while resolving, return 0
+
+  budget = deadline_budget_ms(deadline, DEADLINE_CONNECT);
+  if(budget == 0)
+    {
+      deadline_record(deadline, DEADLINE_CONNECT);
+      *failure = classify_failure(CURLE_OPERATION_TIMEDOUT, deadline);
+      worker_release(worker);
+      return 0;
+    } //If no time is left to connect, return 0
+
+  if(resolved == RESOLVER_OK)
+    {
+      /* Race the addresses of the host, so that a broken address family
+       * costs no more than the head start of the other one. */
+      connected = eyeballs_connect(host_to_verify->url, &answer, port, budget,
+                                   &winner);
+      if(connected < 0)
         {
-          fprintf(stderr, "Could not retrieve certificate from server\n");
-          curl_cleanup(curl);
+          if(deadline_budget_ms(deadline, DEADLINE_CONNECT) == 0)
+            {
+              deadline_record(deadline, DEADLINE_CONNECT);
+              *failure = classify_failure(CURLE_OPERATION_TIMEDOUT, deadline);
+            }
+          else
+            *failure = NEGCACHE_CONNECT;
+          fprintf(stderr, "Could not establish a connection with the server\n");
+          worker_release(worker);
           return 0;
-        } //If the certificate cannot be retrieved from the server, return 0
+        } //If no address of the host could be reached, return 0
+
+      /* The only address is connected to with Fast Open, if enabled. */
+      fastopen = answer.num_addresses == 1 && tunables.upstream_fastopen;
+
+      /* A second fetch goes to another address if there is one. */
+      alternative = answer;
+      i = (winner + 1) % answer.num_addresses;
+      strcpy(alternative.addresses[0], answer.addresses[i]);
+      alternative.families[0] = answer.families[i];
+      alternative.num_addresses = 1;
+      hedge_resolve = resolver_curl_entry(name, port, &alternative);
+
+      /* curl only learns about the address that won. */
+      strcpy(answer.addresses[0], answer.addresses[winner]);
+      answer.families[0] = answer.families[winner];
+      answer.num_addresses = 1;
+      resolve_list = resolver_curl_entry(name, port, &answer);
+
+      curl_easy_setopt(curl, CURLOPT_OPENSOCKETFUNCTION, open_connected_socket);
+      curl_easy_setopt(curl, CURLOPT_OPENSOCKETDATA, &connected);
+      curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, skip_connect);
     }
-    else
-      {
-        fprintf(stderr, "Could not establish a connection with the server\n");
-        curl_cleanup(curl);
-        return 0;
-      } //If curl could not establish a connection with server, return 0
-  }
   else
     {
-      fprintf(stderr, "Could not initialize CURL\n");
-      curl_cleanup(curl);
+      if(name[0] != '\0')
+        {
+          resolve_list = resolver_curl_entry(name, port, NULL);
+          hedge_resolve = resolver_curl_entry(name, port, NULL);
+        }
+      connect_budget = budget;
+    }
+  curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve_list);
+
+  /* When curl connects itself, its connect timeout covers the handshake
+   * too, so it gets both budgets. */
+  tls_budget = deadline_budget_ms(deadline, DEADLINE_TLS);
+  if(tls_budget == 0)
+    {
+      deadline_record(deadline, DEADLINE_TLS);
+      *failure = classify_failure(CURLE_OPERATION_TIMEDOUT, deadline);
+      curl_slist_free_all(resolve_list);
+      curl_slist_free_all(hedge_resolve);
+      if(connected >= 0)
+        close(connected);
+      worker_release(worker);
       return 0;
-    } //if curl could not be initialized, return 0
+    } //If no time is left for the handshake, return 0
+
+  if(connect_budget > 0)
+    {
+      budget = deadline_left_ms(deadline, DEADLINE_CONNECT);
+      if(connect_budget + tls_budget < budget)
+        budget = connect_budget + tls_budget;
+      curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, budget);
+    }
+  else
+    budget = tls_budget;
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, budget);
+    
+  //res is 0 if one of the transfers succeeds.
+  if(!hostkey_canonicalize(host_to_verify->url, host_to_verify->port, origin,
+                           sizeof(origin)))
+    origin[0] = '\0';
+  curl = perform_hedged(worker, host_to_verify, origin, hedge_resolve,
+                        deadline, &res);
+  curl_slist_free_all(resolve_list);
+  curl_slist_free_all(hedge_resolve);
+  if(connected >= 0)
+    close(connected);
+  if(curl == NULL)
+    {
+      if(res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT)
+        deadline_record(deadline, connect_budget > 0
+                        ? DEADLINE_CONNECT : DEADLINE_TLS);
+      *failure = classify_failure(res, deadline);
+      if(*failure == NEGCACHE_TLS && fastopen
+         && fastopen_unreachable(worker->curl))
+        *failure = NEGCACHE_CONNECT;
+      fprintf(stderr, "Could not establish a connection with the server\n");
+      worker_release(worker);
+      return 0;
+    } //If curl could not establish a connection with server, return 0
+
+  res = curl_easy_getinfo(curl, CURLINFO_CERTINFO, &ci);
+  if(res || ci == NULL || ci->num_of_certs <= 0)
+    {
+      fprintf(stderr, "Could not retrieve certificate from server\n");
+      *failure = NEGCACHE_TLS;
+      worker_release(worker);
+      return 0;
+    } //If the certificate cannot be retrieved from the server, return 0
+
+  certs = malloc(ci->num_of_certs * sizeof(uint32_t));
+  if(certs == NULL)
+    {
+      *failure = NEGCACHE_NONE;
+      worker_release(worker);
+      return 0;
+    } //If there is no memory for the chain, return 0
+
+  //pool every certificate of the chain, up to one that cannot be decoded
+  for(i=0; i<ci->num_of_certs; i++)
+    {
+      for(slist = ci->certinfo[i]; slist; slist = slist->next)
+        if(!strncmp(slist->data, "Cert:", 5))
+          break;
+
+      if(slist == NULL
+         || (pooled = pool_certificate(worker, slist->data+5, &certs[i])) <= 0)
+        break;
+    }
+  number_of_certs = i;
+
+  //a full pool is not the fault of the host
+  if(pooled < 0)
+    number_of_certs = 0;
+  if(number_of_certs > 0)
+    *chain = certpool_chain(certs, number_of_certs);
+  if(number_of_certs > 0 && *chain == CERTPOOL_NONE)
+    {
+      fprintf(stderr, "The certificate pool is full\n");
+      number_of_certs = 0;
+      pooled = -1;
+    }
+  if(number_of_certs == 0)
+    *failure = pooled < 0 ? NEGCACHE_NONE : NEGCACHE_TLS;
+  free(certs);
+
+  worker_release(worker);
+  return number_of_certs;
 }
 // request_certificate
 
@@ -9,15 +9,31 @@
 #define CERTIFICATE_H
 
 #include "notary.h"
+#include "deadline.h"
 #include <regex.h>
 /* Requests a certificate from the website given by the url
-   This function calculates and returns the fingerprint of the 
-   requested certificate
+   This function interns the chain of the requested certificates in the
+   certificate pool, sets *chain to its ID and returns its length. Each
+   stage of the request gets its budget out of
+   the deadline, which may be NULL for no deadline. When no chain is
+   returned, *failure is set to the negcache_class of the failure, unless
+   failure is NULL.
 */
 int 
-request_certificate (host *host_to_verify, char** fingerprints);
+request_certificate (host *host_to_verify, uint32_t *chain,
+                     struct deadline *deadline, int *failure);
 
 
+/* Interns a DER encoded certificate in the certificate pool, fingerprinting
+   it with the worker's digest context only if the pool does not know it yet,
+   and sets *id to its ID. Returns 1 on success, 0 if the certificate cannot
+   be decoded and -1 if the pool is full.
+*/
+struct worker_context;
+int pool_der_certificate (struct worker_context *worker,
+                          const unsigned char *der, long der_length,
+                          uint32_t *id);
+
 /* Verifies that the received certificate from the website matches with the
  * fingerprint from the user. Returns 1 if fingerprints match. Otherwise,
  * returns 0.
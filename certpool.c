@@ -0,0 +1,440 @@
+/** @file
+
+    @brief  Certpool: certificates interned by the digest of their DER
+            encoding, and chains interned as lists of certificate IDs, in
+            tables split into shards with a lock each.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "certpool.h"
+#include "config.h"
+#include <pthread.h>
+#include <openssl/evp.h>
+
+/* Shards of each table, each with its own lock and buckets. */
+#define CERTPOOL_SHARDS 64
+
+/* IDs whose entries are allocated together. */
+#define CERTPOOL_CHUNK 4096
+
+/* An interned key, chained into the buckets of its shard. The key of a
+ * certificate is its digest followed by its fingerprint, of which only the
+ * digest is compared; the key of a chain is the IDs of its certificates. */
+struct pooled
+{
+  uint32_t id;
+  uint64_t hash;
+  struct pooled *next_in_bucket;
+  size_t compared;              // bytes of the key that identify it
+  unsigned char key[];
+};
+
+struct shard
+{
+  pthread_mutex_t lock;
+  struct pooled **buckets;
+  size_t num_buckets;
+  size_t count;
+};
+
+/* A table of interned keys. Readers of the chunks take no lock: a chunk and
+ * its entries are published before their IDs. */
+struct table
+{
+  struct shard shards[CERTPOOL_SHARDS];
+  struct pooled **chunks[CERTPOOL_MAX_IDS / CERTPOOL_CHUNK];
+  uint32_t last_id;
+  unsigned long bytes;
+};
+
+static struct table certs =
+  {.shards = {[0 ... CERTPOOL_SHARDS - 1] =
+              {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0}}};
+static struct table chains =
+  {.shards = {[0 ... CERTPOOL_SHARDS - 1] =
+              {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0}}};
+static unsigned long hits = 0;
+static unsigned long full = 0;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Hashes a key with 64-bit FNV-1a.
+ */
+static uint64_t
+hash_key (const unsigned char *key, size_t length)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i;
+
+  for (i = 0; i < length; i++)
+    {
+      hash ^= key[i];
+      hash *= 1099511628211ULL;
+    }
+  return hash;
+} // hash_key
+
+/**
+ * @brief Finds a key in a shard. Called with the shard locked.
+ */
+static struct pooled *
+find_in (struct shard *shard, const unsigned char *key, size_t length,
+         uint64_t hash)
+{
+  struct pooled *entry;
+
+  if (shard->buckets == NULL)
+    return NULL;
+
+  for (entry = shard->buckets[hash & (shard->num_buckets - 1)]; entry != NULL;
+       entry = entry->next_in_bucket)
+    if (entry->hash == hash && entry->compared == length
+        && memcmp (entry->key, key, length) == 0)
+      return entry;
+  return NULL;
+} // find_in
+
+/**
+ * @brief Doubles the buckets of a shard once it holds a key per bucket.
+ *        Called with the shard locked.
+ *
+ * @return 1 if the shard has room for another key, 0 otherwise
+ */
+static int
+grow (struct table *table, struct shard *shard)
+{
+  struct pooled **buckets, *entry, *next;
+  size_t wanted, i;
+
+  if (shard->count < shard->num_buckets)
+    return 1;
+
+  wanted = shard->num_buckets ? 2 * shard->num_buckets : 64;
+  buckets = calloc (wanted, sizeof (struct pooled *));
+  if (buckets == NULL)
+    return shard->buckets != NULL;
+
+  for (i = 0; i < shard->num_buckets; i++)
+    for (entry = shard->buckets[i]; entry != NULL; entry = next)
+      {
+        next = entry->next_in_bucket;
+        entry->next_in_bucket = buckets[entry->hash & (wanted - 1)];
+        buckets[entry->hash & (wanted - 1)] = entry;
+      }
+
+  __atomic_add_fetch (&table->bytes,
+                      (wanted - shard->num_buckets) * sizeof (struct pooled *),
+                      __ATOMIC_RELAXED);
+  free (shard->buckets);
+  shard->buckets = buckets;
+  shard->num_buckets = wanted;
+  return 1;
+} // grow
+
+/**
+ * @brief Hands out the next ID of a table and publishes its entry. Called
+ *        with the shard of the entry locked.
+ *
+ * @return the ID, or CERTPOOL_NONE if no more IDs may be handed out
+ */
+static uint32_t
+next_id (struct table *table, struct pooled *entry)
+{
+  struct pooled **chunk, **fresh;
+  uint32_t id = __atomic_load_n (&table->last_id, __ATOMIC_RELAXED);
+  uint32_t limit = tunables.certpool_max_ids;
+
+  if (limit >= CERTPOOL_MAX_IDS)
+    limit = CERTPOOL_MAX_IDS - 1;
+
+  do
+    if (id >= limit)
+      return CERTPOOL_NONE;
+  while (!__atomic_compare_exchange_n (&table->last_id, &id, id + 1, 0,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  id++;
+
+  chunk = __atomic_load_n (&table->chunks[id / CERTPOOL_CHUNK],
+                           __ATOMIC_ACQUIRE);
+  if (chunk == NULL)
+    {
+      fresh = calloc (CERTPOOL_CHUNK, sizeof (struct pooled *));
+      if (fresh == NULL)
+        return CERTPOOL_NONE;   // the ID is lost, which is harmless
+      if (__atomic_compare_exchange_n (&table->chunks[id / CERTPOOL_CHUNK],
+                                       &chunk, fresh, 0, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_ACQUIRE))
+        {
+          chunk = fresh;
+          __atomic_add_fetch (&table->bytes,
+                              CERTPOOL_CHUNK * sizeof (struct pooled *),
+                              __ATOMIC_RELAXED);
+        }
+      else
+        free (fresh);
+    }
+  entry->id = id;
+  __atomic_store_n (&chunk[id % CERTPOOL_CHUNK], entry, __ATOMIC_RELEASE);
+  return id;
+} // next_id
+
+/**
+ * @brief Returns the ID of a key, giving it one if needed. The first
+ *        compared bytes of the key identify it; the rest is stored along.
+ *
+ * @return the ID, or CERTPOOL_NONE if the table is full
+ */
+static uint32_t
+intern (struct table *table, const unsigned char *key, size_t compared,
+        size_t length)
+{
+  uint64_t hash = hash_key (key, compared);
+  struct shard *shard = &table->shards[(hash >> 32) % CERTPOOL_SHARDS];
+  struct pooled *entry;
+  uint32_t id = CERTPOOL_NONE;
+
+  pthread_mutex_lock (&shard->lock);
+  entry = find_in (shard, key, compared, hash);
+  if (entry != NULL)
+    id = entry->id;
+  else if (grow (table, shard)
+           && (entry = malloc (sizeof (*entry) + length)) != NULL)
+    {
+      memcpy (entry->key, key, length);
+      entry->compared = compared;
+      entry->hash = hash;
+      if (next_id (table, entry) == CERTPOOL_NONE)
+        free (entry);
+      else
+        {
+          id = entry->id;
+          entry->next_in_bucket =
+            shard->buckets[hash & (shard->num_buckets - 1)];
+          shard->buckets[hash & (shard->num_buckets - 1)] = entry;
+          shard->count++;
+          __atomic_add_fetch (&table->bytes, sizeof (*entry) + length,
+                              __ATOMIC_RELAXED);
+        }
+    }
+  pthread_mutex_unlock (&shard->lock);
+
+  if (id == CERTPOOL_NONE)
+    __atomic_add_fetch (&full, 1, __ATOMIC_RELAXED);
+  return id;
+} // intern
+
+/**
+ * @brief Returns the entry of an ID.
+ *
+ * @return the entry, or NULL if the ID was never handed out
+ */
+static struct pooled *
+entry_of (struct table *table, uint32_t id)
+{
+  struct pooled **chunk;
+
+  if (id == CERTPOOL_NONE || id >= CERTPOOL_MAX_IDS)
+    return NULL;
+
+  chunk = __atomic_load_n (&table->chunks[id / CERTPOOL_CHUNK],
+                           __ATOMIC_ACQUIRE);
+  if (chunk == NULL)
+    return NULL;
+  return __atomic_load_n (&chunk[id % CERTPOOL_CHUNK], __ATOMIC_ACQUIRE);
+} // entry_of
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Computes the SHA-256 digest of a DER encoded certificate.
+ *
+ * @param der         the certificate
+ * @param der_length  its length
+ * @param digest      output buffer of CERTPOOL_DIGEST_LENGTH bytes
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+certpool_digest (const unsigned char *der, size_t der_length,
+                 unsigned char *digest)
+{
+  unsigned int length;
+
+  return EVP_Digest (der, der_length, digest, &length, EVP_sha256 (), NULL)
+    == 1 && length == CERTPOOL_DIGEST_LENGTH;
+} // certpool_digest
+
+/**
+ * @brief Returns the ID of a certificate without giving it one.
+ *
+ * @param digest  the digest of the certificate
+ *
+ * @return the ID, or CERTPOOL_NONE if the certificate has none
+ */
+uint32_t
+certpool_find (const unsigned char *digest)
+{
+  uint64_t hash = hash_key (digest, CERTPOOL_DIGEST_LENGTH);
+  struct shard *shard = &certs.shards[(hash >> 32) % CERTPOOL_SHARDS];
+  struct pooled *entry;
+  uint32_t id;
+
+  pthread_mutex_lock (&shard->lock);
+  entry = find_in (shard, digest, CERTPOOL_DIGEST_LENGTH, hash);
+  id = entry != NULL ? entry->id : CERTPOOL_NONE;
+  pthread_mutex_unlock (&shard->lock);
+
+  if (id != CERTPOOL_NONE)
+    __atomic_add_fetch (&hits, 1, __ATOMIC_RELAXED);
+  return id;
+} // certpool_find
+
+/**
+ * @brief Returns the ID of a certificate, giving it one if needed.
+ *
+ * @param digest       the digest of the certificate
+ * @param fingerprint  its fingerprint, kept if it gets an ID
+ *
+ * @return the ID, or CERTPOOL_NONE if the pool is full
+ */
+uint32_t
+certpool_intern (const unsigned char *digest, const char *fingerprint)
+{
+  unsigned char key[CERTPOOL_DIGEST_LENGTH + FPT_LENGTH];
+
+  memcpy (key, digest, CERTPOOL_DIGEST_LENGTH);
+  snprintf ((char *) key + CERTPOOL_DIGEST_LENGTH, FPT_LENGTH, "%s",
+            fingerprint);
+  return intern (&certs, key, CERTPOOL_DIGEST_LENGTH, sizeof (key));
+} // certpool_intern
+
+/**
+ * @brief Returns the fingerprint of a certificate.
+ *
+ * @param cert  the ID of the certificate
+ *
+ * @return the fingerprint, or NULL if the ID was never handed out
+ */
+const char *
+certpool_fingerprint (uint32_t cert)
+{
+  struct pooled *entry = entry_of (&certs, cert);
+
+  if (entry == NULL)
+    return NULL;
+  return (const char *) entry->key + CERTPOOL_DIGEST_LENGTH;
+} // certpool_fingerprint
+
+/**
+ * @brief Returns the digest of a certificate.
+ *
+ * @param cert  the ID of the certificate
+ *
+ * @return the digest, or NULL if the ID was never handed out
+ */
+const unsigned char *
+certpool_digest_of (uint32_t cert)
+{
+  struct pooled *entry = entry_of (&certs, cert);
+
+  if (entry == NULL)
+    return NULL;
+  return entry->key;
+} // certpool_digest_of
+
+/**
+ * @brief Returns the ID of a chain, giving it one if needed.
+ *
+ * @param chain_certs  the IDs of its certificates, leaf first
+ * @param length       number of certificates
+ *
+ * @return the ID, or CERTPOOL_NONE if the pool is full or the chain empty
+ */
+uint32_t
+certpool_chain (const uint32_t *chain_certs, int length)
+{
+  size_t bytes = length * sizeof (uint32_t);
+
+  if (length <= 0)
+    return CERTPOOL_NONE;
+  return intern (&chains, (const unsigned char *) chain_certs, bytes, bytes);
+} // certpool_chain
+
+/**
+ * @brief Returns the certificates of a chain.
+ *
+ * @param chain   the ID of the chain
+ * @param length  output parameter for the number of certificates
+ *
+ * @return the IDs of the certificates, leaf first, or NULL if the ID was
+ *         never handed out
+ */
+const uint32_t *
+certpool_chain_certs (uint32_t chain, int *length)
+{
+  struct pooled *entry = entry_of (&chains, chain);
+
+  if (entry == NULL)
+    {
+      *length = 0;
+      return NULL;
+    }
+  *length = entry->compared / sizeof (uint32_t);
+  return (const uint32_t *) entry->key;
+} // certpool_chain_certs
+
+/**
+ * @brief Interns a chain given by fingerprints, each standing in for the
+ *        DER encoding of its certificate.
+ *
+ * @param fingerprints  the fingerprints, leaf first
+ * @param length        number of fingerprints
+ *
+ * @return the ID of the chain, or CERTPOOL_NONE
+ */
+uint32_t
+certpool_chain_of_fingerprints (char **fingerprints, int length)
+{
+  unsigned char digest[CERTPOOL_DIGEST_LENGTH];
+  uint32_t *ids, chain = CERTPOOL_NONE;
+  int i;
+
+  if (length <= 0 || (ids = malloc (length * sizeof (uint32_t))) == NULL)
+    return CERTPOOL_NONE;
+
+  for (i = 0; i < length; i++)
+    if (!certpool_digest ((unsigned char *) fingerprints[i],
+                          strlen (fingerprints[i]), digest)
+        || (ids[i] = certpool_intern (digest, fingerprints[i]))
+           == CERTPOOL_NONE)
+      break;
+  if (i == length)
+    chain = certpool_chain (ids, length);
+
+  free (ids);
+  return chain;
+} // certpool_chain_of_fingerprints
+
+/**
+ * @brief Copies the counters of the pool.
+ */
+void
+certpool_get_stats (struct certpool_stats *stats_out)
+{
+  stats_out->certs = __atomic_load_n (&certs.last_id, __ATOMIC_RELAXED);
+  stats_out->chains = __atomic_load_n (&chains.last_id, __ATOMIC_RELAXED);
+  stats_out->hits = __atomic_load_n (&hits, __ATOMIC_RELAXED);
+  stats_out->full = __atomic_load_n (&full, __ATOMIC_RELAXED);
+  stats_out->bytes = __atomic_load_n (&certs.bytes, __ATOMIC_RELAXED)
+    + __atomic_load_n (&chains.bytes, __ATOMIC_RELAXED);
+} // certpool_get_stats
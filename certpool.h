@@ -0,0 +1,86 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the certificate pool. Most
+ * chains hosts show share a few dozen intermediate and root certificates,
+ * so every certificate the notary sees is interned once, by the SHA-256
+ * digest of its DER encoding, into a small integer ID that carries its
+ * fingerprint. A chain is interned in turn as the list of the IDs of its
+ * certificates, and observations keep only the ID of their chain. IDs are
+ * never reused while the notary runs; at most certpool_max_ids
+ * certificates, and as many chains, get one.
+ ******************************************************************************/
+#ifndef CERTPOOL_H
+#define CERTPOOL_H
+
+#include "notary.h"
+
+/* Length of the digest that identifies a certificate. */
+#define CERTPOOL_DIGEST_LENGTH 32
+
+/* The ID of no certificate or chain: the pool is full. */
+#define CERTPOOL_NONE 0
+
+/* Most IDs the pool can ever hand out, whatever certpool_max_ids. */
+#define CERTPOOL_MAX_IDS (1 << 26)
+
+/* Counters of the pool. */
+struct certpool_stats
+{
+  unsigned long certs;          // certificates with an ID
+  unsigned long chains;         // chains with an ID
+  unsigned long hits;           // certificates found without fingerprinting
+  unsigned long full;           // certificates or chains refused an ID
+  unsigned long bytes;          // memory held by the pool
+};
+
+/* Writes the digest of a DER encoded certificate into digest, which must
+ * hold CERTPOOL_DIGEST_LENGTH bytes. Returns 1 on success, 0 otherwise.
+ */
+int certpool_digest (const unsigned char *der, size_t der_length,
+                     unsigned char *digest);
+
+/* Returns the ID of the certificate with a digest, or CERTPOOL_NONE if it
+ * has none yet.
+ */
+uint32_t certpool_find (const unsigned char *digest);
+
+/* Returns the ID of the certificate with a digest, giving it one with the
+ * fingerprint if it has none yet, or CERTPOOL_NONE if the pool is full.
+ */
+uint32_t certpool_intern (const unsigned char *digest,
+                          const char *fingerprint);
+
+/* Returns the fingerprint of a certificate, or NULL for an unknown ID. The
+ * string lives as long as the notary.
+ */
+const char *certpool_fingerprint (uint32_t cert);
+
+/* Returns the digest of a certificate, CERTPOOL_DIGEST_LENGTH bytes, or
+ * NULL for an unknown ID. The digest lives as long as the notary.
+ */
+const unsigned char *certpool_digest_of (uint32_t cert);
+
+/* Returns the ID of the chain of the given certificates, leaf first, giving
+ * it one if it has none yet, or CERTPOOL_NONE if the pool is full or the
+ * chain is empty.
+ */
+uint32_t certpool_chain (const uint32_t *chain_certs, int length);
+
+/* Returns the certificates of a chain, leaf first, and sets *length to
+ * their number; NULL and 0 for an unknown ID. The array lives as long as
+ * the notary.
+ */
+const uint32_t *certpool_chain_certs (uint32_t chain, int *length);
+
+/* Interns a chain given by the fingerprints of its certificates, which
+ * stand in for their DER encodings. For tools and tests that have no
+ * certificates. Returns the ID of the chain, or CERTPOOL_NONE.
+ */
+uint32_t certpool_chain_of_fingerprints (char **fingerprints, int length);
+
+/* Copies the counters of the pool into stats. */
+void certpool_get_stats (struct certpool_stats *stats);
+
+#endif // CERTPOOL_H
@@ -0,0 +1,316 @@
+/** @file
+
+    @brief  Config: the notary's tunables and the parsing of -o name=value
+            command-line settings.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "config.h"
+#include "shard.h"
+
+struct notary_tunables tunables =
+  {
+    .merkle_window_ms = 0,
+    .merkle_max_batch = 64,
+    .observation_ttl = 600,
+    .observation_max_hosts = 100000,
+    .response_bucket_s = 60,
+    .response_cache_entries = 10000,
+    .dns_max_inflight = 32,
+    .dns_timeout_ms = 1000,
+    .dns_negative_ttl = 60,
+    .dns_prefetch_pct = 10,
+    .dns_cache_entries = 10000,
+    .eyeballs_delay_ms = 250,
+    .eyeballs_timeout_ms = 10000,
+    .verify_deadline_ms = 10000,
+    .verify_queue_ms = 2000,
+    .verify_dns_ms = 2000,
+    .verify_connect_ms = 3000,
+    .verify_tls_ms = 4000,
+    .verify_sign_ms = 1000,
+    .origin_max_inflight = 4,
+    .hedge_quantile = 95,
+    .hedge_budget_pct = 5,
+    .hedge_min_samples = 20,
+    .negative_base_ms = 1000,
+    .negative_max_ms = 60000,
+    .observation_refresh_pct = 10,
+    .refresh_max_inflight = 4,
+    .mismatch_recheck_s = 60,
+    .hitters_window = 100000,
+    .observation_max_bytes = 256 << 20,
+    .observation_window_pct = 1,
+    .hostkey_max_ids = 1 << 22,
+    .certpool_max_ids = 1 << 22,
+    .history_max_runs = 32,
+    .warm_rate = 50,
+    .warm_concurrency = 8,
+    .warm_ready_pct = 90,
+    .snapshot_interval_s = 300,
+    .handoff_timeout_ms = 10000,
+    .drain_timeout_ms = 30000,
+    .shmcache_slots = 16384,
+    .shmcache_wait_ms = 2000,
+    .listen_shards = 1,
+    .listen_pin_cpus = 0,
+    .listen_steer_cpu = 0,
+    .listen_ipv6 = 0,
+    .keepalive_timeout_s = 15,
+    .keepalive_max_requests = 100,
+    .tls_session_cache_size = 20480,
+    .tls_ticket_rotate_s = 3600,
+    .tls_ktls = 1,
+    .tls_handshake_timeout_ms = 10000,
+    .tls_max_connections = 1020,
+    .listen_backlog = SOMAXCONN,
+    .listen_fastopen = 256,
+    .listen_defer_accept_s = 0,
+    .listen_nodelay = 1,
+    .upstream_fastopen = 0,
+    .upstream_quickack = 1,
+    .upstream_sndbuf = 16384,
+    .upstream_rcvbuf = 65536,
+    .upstream_port_min = 0,
+    .upstream_port_max = 0,
+  };
+
+/* Describes one tunable: its name, where it is stored and its valid range. */
+struct tunable
+{
+  const char *name;
+  int *value;
+  int minimum;
+  int maximum;
+  const char *description;
+};
+
+static const struct tunable tunable_table[] =
+  {
+    {"merkle_window_ms", &tunables.merkle_window_ms, 0, 1000,
+     "collect responses for this long and sign them as one Merkle batch"},
+    {"merkle_max_batch", &tunables.merkle_max_batch, 1, 1 << 16,
+     "sign a batch as soon as it holds this many responses"},
+    {"observation_ttl", &tunables.observation_ttl, 1, 86400,
+     "seconds before a host is contacted again"},
+    {"observation_max_hosts", &tunables.observation_max_hosts, 1, 1 << 24,
+     "most hosts whose observations are kept in memory"},
+    {"response_bucket_s", &tunables.response_bucket_s, 1, 86400,
+     "seconds a signed response is reused before it is signed again"},
+    {"response_cache_entries", &tunables.response_cache_entries, 1, 1 << 24,
+     "most signed responses kept in memory"},
+    {"dns_max_inflight", &tunables.dns_max_inflight, 1, 1024,
+     "most host names resolved at the same time"},
+    {"dns_timeout_ms", &tunables.dns_timeout_ms, 10, 10000,
+     "milliseconds to wait for a DNS answer before asking again"},
+    {"dns_negative_ttl", &tunables.dns_negative_ttl, 0, 3600,
+     "longest time in seconds a missing host name is remembered"},
+    {"dns_prefetch_pct", &tunables.dns_prefetch_pct, 0, 100,
+     "refresh hot host names when this percentage of their TTL is left"},
+    {"dns_cache_entries", &tunables.dns_cache_entries, 1, 1 << 24,
+     "most host names kept in the DNS cache"},
+    {"eyeballs_delay_ms", &tunables.eyeballs_delay_ms, 10, 2000,
+     "milliseconds before the next address of a host is tried as well"},
+    {"eyeballs_timeout_ms", &tunables.eyeballs_timeout_ms, 100, 120000,
+     "milliseconds to connect to any address of a host"},
+    {"verify_deadline_ms", &tunables.verify_deadline_ms, 100, 120000,
+     "milliseconds from accepting a verification request to answering it"},
+    {"verify_queue_ms", &tunables.verify_queue_ms, 0, 120000,
+     "milliseconds a verification may wait for a fetch slot of its host"},
+    {"verify_dns_ms", &tunables.verify_dns_ms, 10, 120000,
+     "milliseconds a verification may spend resolving its host"},
+    {"verify_connect_ms", &tunables.verify_connect_ms, 10, 120000,
+     "milliseconds a verification may spend connecting to its host"},
+    {"verify_tls_ms", &tunables.verify_tls_ms, 10, 120000,
+     "milliseconds a verification may spend in the TLS handshake"},
+    {"verify_sign_ms", &tunables.verify_sign_ms, 0, 10000,
+     "milliseconds of the deadline kept back for signing the answer"},
+    {"origin_max_inflight", &tunables.origin_max_inflight, 1, 1024,
+     "most verifications contacting one host at the same time"},
+    {"hedge_quantile", &tunables.hedge_quantile, 50, 99,
+     "start a second fetch when the first is slower than this percentile"},
+    {"hedge_budget_pct", &tunables.hedge_budget_pct, 0, 100,
+     "most second fetches per hundred fetches; 0 turns hedging off"},
+    {"hedge_min_samples", &tunables.hedge_min_samples, 1, 10000,
+     "fetches from a host needed before its latency is trusted"},
+    {"negative_base_ms", &tunables.negative_base_ms, 0, 60000,
+     "milliseconds to fail requests about a host after it could not be "
+     "contacted; doubles with every failure, 0 turns this off"},
+    {"negative_max_ms", &tunables.negative_max_ms, 100, 3600000,
+     "longest time in milliseconds requests about a failed host fail at once"},
+    {"observation_refresh_pct", &tunables.observation_refresh_pct, 0, 100,
+     "refresh popular hosts in the background when this percentage of their "
+     "observation TTL is left; 0 turns this off"},
+    {"refresh_max_inflight", &tunables.refresh_max_inflight, 0, 1024,
+     "most hosts refreshed in the background at the same time"},
+    {"mismatch_recheck_s", &tunables.mismatch_recheck_s, 0, 86400,
+     "seconds an observation must be old before a client showing another "
+     "fingerprint has the host refreshed in the background; 0 turns this "
+     "off"},
+    {"hitters_window", &tunables.hitters_window, 1000, 1 << 30,
+     "requests after which the counts of heavy-hitter hosts are halved"},
+    {"observation_max_bytes", &tunables.observation_max_bytes, 1 << 16,
+     1 << 30, "most bytes of memory held by cached observations"},
+    {"observation_window_pct", &tunables.observation_window_pct, 1, 100,
+     "percentage of the observation cache that admits every new host; the "
+     "rest keeps the hosts requested most often, and 100 is plain LRU"},
+    {"hostkey_max_ids", &tunables.hostkey_max_ids, 1024, (1 << 26) - 1,
+     "most distinct hosts observed, warmed, ingested or restored while the "
+     "notary runs; further hosts cannot be observed"},
+    {"certpool_max_ids", &tunables.certpool_max_ids, 1024, (1 << 26) - 1,
+     "most distinct certificates, and as many distinct chains, given an ID "
+     "while the notary runs; hosts showing further ones cannot be observed"},
+    {"history_max_runs", &tunables.history_max_runs, 1, 1024,
+     "most runs of chains kept for a host and listed in its responses; the "
+     "oldest are dropped first"},
+    {"warm_rate", &tunables.warm_rate, 0, 100000,
+     "hosts of warm-up lists contacted per second, 0 for no limit"},
+    {"warm_concurrency", &tunables.warm_concurrency, 1, 256,
+     "most hosts of warm-up lists contacted at a time"},
+    {"warm_ready_pct", &tunables.warm_ready_pct, 0, 100,
+     "percentage of the hosts of warm-up lists that must be warm before "
+     "the notary reports itself ready for traffic"},
+    {"snapshot_interval_s", &tunables.snapshot_interval_s, 0, 86400,
+     "seconds between snapshots of the history written with -S, 0 to write "
+     "one only on exit"},
+    {"handoff_timeout_ms", &tunables.handoff_timeout_ms, 100, 600000,
+     "milliseconds a new binary started on SIGUSR2 has to take over the "
+     "listening sockets before the old notary gives up and keeps serving"},
+    {"drain_timeout_ms", &tunables.drain_timeout_ms, 0, 3600000,
+     "milliseconds a notary stopping or handing over waits for requests in "
+     "flight to finish"},
+    {"shmcache_slots", &tunables.shmcache_slots, 1024, 1 << 22,
+     "hosts kept in the observation table shared with -M; every process "
+     "sharing it must use the same value"},
+    {"shmcache_wait_ms", &tunables.shmcache_wait_ms, 0, 60000,
+     "milliseconds a verification waits for another notary process that "
+     "is contacting the same host, instead of contacting it too"},
+    {"listen_shards", &tunables.listen_shards, 1, SHARD_MAX,
+     "listening sockets opened per client port and address family with "
+     "SO_REUSEPORT, each with its own accept queue and daemon; changing it "
+     "across an upgrade on SIGUSR2 needs a restart instead"},
+    {"listen_pin_cpus", &tunables.listen_pin_cpus, 0, 1,
+     "1 to pin the daemon of each shard, and its connections, to a core"},
+    {"listen_steer_cpu", &tunables.listen_steer_cpu, 0, 1,
+     "1 to have the kernel queue a connection on the shard of the core "
+     "that received it, best with listen_pin_cpus"},
+    {"listen_ipv6", &tunables.listen_ipv6, 0, 2,
+     "0 to take clients over IPv4 only, 1 over IPv6 with IPv4 mapped onto "
+     "it, 2 over separate IPv4 and IPv6 sockets"},
+    {"keepalive_timeout_s", &tunables.keepalive_timeout_s, 0, 3600,
+     "seconds a client connection may stay idle between requests before "
+     "it is closed, 0 for no limit; each open connection holds a thread"},
+    {"keepalive_max_requests", &tunables.keepalive_max_requests, 1, 1000000,
+     "most requests a client connection carries before the response to "
+     "the last one closes it, 1 to close after every request"},
+    {"tls_session_cache_size", &tunables.tls_session_cache_size, 0, 1 << 20,
+     "TLS sessions of clients remembered on the SSL port so they can "
+     "resume, 0 to remember none"},
+    {"tls_ticket_rotate_s", &tunables.tls_ticket_rotate_s, 0, 604800,
+     "seconds between new session-ticket keys on the SSL port, the "
+     "previous key still accepted until the next; 0 to issue no tickets"},
+    {"tls_ktls", &tunables.tls_ktls, 0, 1,
+     "1 to have the kernel encrypt TLS records where it can, so that "
+     "no thread relays between TLS and the daemon"},
+    {"tls_handshake_timeout_ms", &tunables.tls_handshake_timeout_ms, 100,
+     600000, "milliseconds a client has to complete the TLS handshake"},
+    {"tls_max_connections", &tunables.tls_max_connections, 1, 65536,
+     "most connections to the SSL port in their TLS handshake or relayed at "
+     "a time, and most each of its daemons takes; further ones are closed "
+     "at once"},
+    {"listen_backlog", &tunables.listen_backlog, 1, 65535,
+     "connections queued on each client listener before they are "
+     "accepted, capped by net.core.somaxconn"},
+    {"listen_fastopen", &tunables.listen_fastopen, 0, 65535,
+     "connections to a client listener whose request may arrive in the "
+     "SYN waiting at a time, 0 to turn TCP Fast Open off; the kernel needs "
+     "it allowed in net.ipv4.tcp_fastopen too"},
+    {"listen_defer_accept_s", &tunables.listen_defer_accept_s, 0, 600,
+     "seconds a client connection is kept from its daemon until its "
+     "request arrives, 0 to hand it over on connecting"},
+    {"listen_nodelay", &tunables.listen_nodelay, 0, 1,
+     "1 to send responses to clients without waiting to fill a segment"},
+    {"upstream_fastopen", &tunables.upstream_fastopen, 0, 1,
+     "1 to send the ClientHello in the SYN to hosts with a single address; "
+     "a host that cannot be reached then fails the TLS stage instead of "
+     "the connect stage"},
+    {"upstream_quickack", &tunables.upstream_quickack, 0, 1,
+     "1 to acknowledge the segments of a host's handshake at once"},
+    {"upstream_sndbuf", &tunables.upstream_sndbuf, 0, 1 << 24,
+     "bytes of send buffer of a connection to a host, 0 for the kernel's "
+     "own sizing"},
+    {"upstream_rcvbuf", &tunables.upstream_rcvbuf, 0, 1 << 24,
+     "bytes of receive buffer of a connection to a host, 0 for the "
+     "kernel's own sizing; a certificate chain needs some tens of KB"},
+    {"upstream_port_min", &tunables.upstream_port_min, 0, 65535,
+     "lowest local port of a connection to a host, 0 to use the kernel's "
+     "range"},
+    {"upstream_port_max", &tunables.upstream_port_max, 0, 65535,
+     "highest local port of a connection to a host"},
+  };
+
+#define NUMBER_OF_TUNABLES (sizeof (tunable_table) / sizeof (tunable_table[0]))
+
+/**
+ * @brief Sets a tunable from a string of the form name=value.
+ *
+ * @param assignment  the name=value string
+ *
+ * @return 1 on success, 0 if the name is unknown or the value out of range
+ */
+int
+set_tunable (const char *assignment)
+{
+  const char *equals = strchr (assignment, '=');
+  char *end;
+  long value;
+  int i;
+
+  if (equals == NULL)
+    return 0;
+
+  for (i = 0; i < NUMBER_OF_TUNABLES; i++)
+    {
+      if (strlen (tunable_table[i].name) != equals - assignment
+          || strncmp (tunable_table[i].name, assignment, equals - assignment))
+        continue;
+
+      value = strtol (equals + 1, &end, 10);
+      if (*(equals + 1) == '\0' || *end != '\0'
+          || value < tunable_table[i].minimum
+          || value > tunable_table[i].maximum)
+        {
+          fprintf (stderr, "%s must be a number between %d and %d\n",
+                   tunable_table[i].name, tunable_table[i].minimum,
+                   tunable_table[i].maximum);
+          return 0;
+        }
+
+      *tunable_table[i].value = value;
+      return 1;
+    }
+
+  fprintf (stderr, "Unknown tunable %.*s\n", (int) (equals - assignment),
+           assignment);
+  return 0;
+} // set_tunable
+
+/**
+ * @brief Prints every tunable with its current value.
+ *
+ * @param stream  where to print
+ */
+void
+print_tunables (FILE *stream)
+{
+  int i;
+
+  for (i = 0; i < NUMBER_OF_TUNABLES; i++)
+    fprintf (stream, "\t   %-24s %8d  %s\n", tunable_table[i].name,
+             *tunable_table[i].value, tunable_table[i].description);
+} // print_tunables
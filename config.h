@@ -0,0 +1,91 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the notary's tunables: numeric
+ * settings which can be changed on the command line with -o name=value.
+ ******************************************************************************/
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "notary.h"
+
+/* All tunables of the notary, with the defaults set in config.c. */
+struct notary_tunables
+{
+  int merkle_window_ms;         // batch signing window, 0 signs every response
+  int merkle_max_batch;         // most responses signed with one signature
+  int observation_ttl;          // seconds an observation of a host stays fresh
+  int observation_max_hosts;    // most hosts whose observations are kept
+  int response_bucket_s;        // seconds a signed response is reused for
+  int response_cache_entries;   // most signed responses kept
+  int dns_max_inflight;         // most names resolved at the same time
+  int dns_timeout_ms;           // time to wait for a DNS answer
+  int dns_negative_ttl;         // longest time a missing name is remembered
+  int dns_prefetch_pct;         // refresh hot names with this much TTL left
+  int dns_cache_entries;        // most names kept in the DNS cache
+  int eyeballs_delay_ms;        // head start of one connection attempt
+  int eyeballs_timeout_ms;      // time to connect to any address of a host
+  int verify_deadline_ms;       // time to answer a verification request
+  int verify_queue_ms;          // budget for waiting for a fetch slot
+  int verify_dns_ms;            // budget for resolving the host
+  int verify_connect_ms;        // budget for connecting to the host
+  int verify_tls_ms;            // budget for the TLS handshake
+  int verify_sign_ms;           // budget kept back for signing the answer
+  int origin_max_inflight;      // most fetches from one origin at a time
+  int hedge_quantile;           // hedge fetches slower than this percentile
+  int hedge_budget_pct;         // most hedges per 100 fetches, 0 for none
+  int hedge_min_samples;        // fetches of an origin before hedging it
+  int negative_base_ms;         // first backoff from a failed host, 0 for none
+  int negative_max_ms;          // longest backoff from a failed host
+  int observation_refresh_pct;  // refresh popular hosts with this much TTL left
+  int refresh_max_inflight;     // most background refreshes at a time
+  int mismatch_recheck_s;       // least age of an observation a client disputes
+  int hitters_window;           // requests between halvings of host counts
+  int observation_max_bytes;    // most memory held by cached observations
+  int observation_window_pct;   // share of the observation cache for new hosts
+  int hostkey_max_ids;          // most hosts ever given an ID
+  int certpool_max_ids;         // most certificates, and chains, given an ID
+  int history_max_runs;         // most runs of chains kept for a host
+  int warm_rate;                // hosts warmed per second, 0 for no limit
+  int warm_concurrency;         // most hosts warmed at a time
+  int warm_ready_pct;           // share of the warm list needed to be ready
+  int snapshot_interval_s;      // seconds between snapshots, 0 for on exit only
+  int handoff_timeout_ms;       // longest a successor may take to serve
+  int drain_timeout_ms;         // longest requests in flight are waited for
+  int shmcache_slots;           // hosts kept in the shared observation table
+  int shmcache_wait_ms;         // longest waited for another process's fetch
+  int listen_shards;            // listening sockets per port, per family
+  int listen_pin_cpus;          // pin the daemon of each shard to a core
+  int listen_steer_cpu;         // accept on the shard of the receiving core
+  int listen_ipv6;              // 0 IPv4, 1 dual-stack, 2 separate sockets
+  int keepalive_timeout_s;      // idle seconds before a connection is closed
+  int keepalive_max_requests;   // most requests a connection carries
+  int tls_session_cache_size;   // TLS sessions remembered, 0 for none
+  int tls_ticket_rotate_s;      // seconds between ticket keys, 0 for none
+  int tls_ktls;                 // let the kernel encrypt TLS records
+  int tls_handshake_timeout_ms; // longest a TLS handshake may take
+  int tls_max_connections;      // most TLS connections served at a time
+  int listen_backlog;           // connections queued on a client listener
+  int listen_fastopen;          // TCP Fast Open queue of a listener, 0 off
+  int listen_defer_accept_s;    // wait this long for a request before accept
+  int listen_nodelay;           // send responses without Nagle's delay
+  int upstream_fastopen;        // send the ClientHello in the SYN
+  int upstream_quickack;        // acknowledge the server's handshake at once
+  int upstream_sndbuf;          // send buffer of a fetch, 0 for the kernel's
+  int upstream_rcvbuf;          // receive buffer of a fetch, 0 for the kernel's
+  int upstream_port_min;        // lowest local port of a fetch, 0 for any
+  int upstream_port_max;        // highest local port of a fetch
+};
+
+extern struct notary_tunables tunables;
+
+/* Sets a tunable from a string of the form name=value. Returns 1 on success
+ * and 0 if the name is unknown or the value is out of range.
+ */
+int set_tunable (const char *assignment);
+
+/* Prints every tunable with its current value. */
+void print_tunables (FILE *stream);
+
+#endif // CONFIG_H
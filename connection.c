@@ -15,6 +15,9 @@
 #include "connection.h"
 #include "response.h"
 #include "certificate.h"
+#include "respcache.h"
+#include "deadline.h"
+#include "config.h"
 #include "notary.h"
 
 #define MAX_HOST_LEN 10
@@ -22,12 +25,14 @@
 /* Keep track of the number of clients with active requests. */
 unsigned int number_active_clients = 0;
 
-/* Response strings for the server to return. */
-const char busy_page[] = 
-  "The server is too busy to handle the verification request.\n";
+/* A connection from a client, which may carry several requests. */
+struct client_connection
+{
+  unsigned int requests;        // requests it has carried
+};
 
-const char unsupported_method_page[] = 
-  "The server received a request with an unsupported method.\n";
+/* Counters of client connections, updated atomically. */
+static struct connection_stats stats;
 
 
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -60,6 +65,24 @@ extract_host (char *url, host *host_to_verify)
 
 }// extract_host
 
+/**
+ * @brief Counts a request on the connection it arrived on.
+ *
+ * @param connection  the connection
+ *
+ * @return 1 if the connection is to close after the request, 0 otherwise
+ */
+static int
+count_request (struct MHD_Connection *connection)
+{
+  const union MHD_ConnectionInfo *info;
+
+  info = MHD_get_connection_info (connection,
+                                  MHD_CONNECTION_INFO_SOCKET_CONTEXT);
+  return connection_count_request (info != NULL ? info->socket_context
+                                   : NULL);
+} // count_request
+
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 // Functions
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -96,15 +119,28 @@ answer_to_SSL_connection (void *cls, struct MHD_Connection *connection,
   if (*con_cls == NULL)
   {
     struct connection_info_struct *con_info;
+    int closing = count_request (connection);
 
     /* If there are too many clients connected, refuse a new connection. */
     if (number_active_clients >= MAX_CLIENTS)
-      return send_response (connection, busy_page, MHD_HTTP_SERVICE_UNAVAILABLE);
+      return send_static_response (connection, STATIC_BUSY, closing);
 
-    con_info = malloc (sizeof (struct connection_info_struct));
+    con_info = calloc (1, sizeof (struct connection_info_struct));
 
     if (con_info == NULL)
       return MHD_NO;
+    con_info->closing = closing;
+
+    /* The verification has to be answered within the deadline, which
+     * starts now that the request is accepted. */
+    con_info->deadline = malloc (sizeof (struct deadline));
+    if (con_info->deadline == NULL)
+      {
+        free (con_info);
+        return MHD_NO;
+      }
+    deadline_start (con_info->deadline, tunables.verify_deadline_ms,
+                    connection);
 
     /* Process POST and GET request separately. 
      */
@@ -113,7 +149,7 @@ answer_to_SSL_connection (void *cls, struct MHD_Connection *connection,
     else if (strcmp (method, "GET") == 0)
       con_info->connection_type = GET;
     
-    number_active_clients++;
+    __sync_add_and_fetch (&number_active_clients, 1);
     *con_cls = (void *) con_info;
     return MHD_YES;
   }
@@ -147,8 +183,7 @@ answer_to_SSL_connection (void *cls, struct MHD_Connection *connection,
     else
       {
         /* Send response of the POST request to the client */
-        return send_response (connection, con_info->answer_string,
-                              con_info->answer_code);
+        return send_answer (connection, con_info);
       }
   }
   else
@@ -167,7 +202,7 @@ answer_to_SSL_connection (void *cls, struct MHD_Connection *connection,
           free(requested_url);
 
           /* We send the response of the GET request to the client*/
-          return send_response (connection, con_info->answer_string, con_info->answer_code);
+          return send_answer (connection, con_info);
         }
       else
         { 
@@ -181,7 +216,8 @@ answer_to_SSL_connection (void *cls, struct MHD_Connection *connection,
            * appropriate error code. 
            */
           con_info->answer_code = MHD_HTTP_BAD_REQUEST;
-          return send_response (connection, unsupported_method_page, con_info->answer_code);
+          con_info->static_page = STATIC_UNSUPPORTED_METHOD;
+          return send_answer (connection, con_info);
         }
     }
 }//answer_to_SSL_connection
@@ -254,13 +290,90 @@ request_completed (void *cls, struct MHD_Connection *connection,
         {
           free ((char*)con_info->answer_string);
         }
+      response_cache_release (con_info->cached_response);
     }
 
+  free (con_info->deadline);
+
+  /* The client no longer counts toward MAX_CLIENTS. */
+  __sync_sub_and_fetch (&number_active_clients, 1);
+
   //free memory and set previously used pointers to NULL
   con_info->answer_string = NULL;
+  con_info->cached_response = NULL;
+  con_info->deadline = NULL;
 
   free (*con_cls);
   *con_cls = NULL;
   con_info = NULL;
 } // request_completed
 
+/**
+ * @brief Keeps track of the connections of clients. The address of this
+ *        function needs to be passed to MHD_start_daemon with
+ *        MHD_OPTION_NOTIFY_CONNECTION.
+ *
+ * @param cls
+ * @param connection
+ * @param socket_context  the state of the connection
+ * @param toe             whether the connection started or closed
+ */
+void
+connection_notify (void *cls, struct MHD_Connection *connection,
+                   void **socket_context,
+                   enum MHD_ConnectionNotificationCode toe)
+{
+  if (toe == MHD_CONNECTION_NOTIFY_STARTED)
+    {
+      *socket_context = calloc (1, sizeof (struct client_connection));
+      __sync_add_and_fetch (&stats.connections, 1);
+    }
+  else
+    {
+      free (*socket_context);
+      *socket_context = NULL;
+    }
+} // connection_notify
+
+/**
+ * @brief Counts a request on a connection, and tells whether the connection
+ *        has carried keepalive_max_requests with it, so that the response
+ *        to it closes the connection.
+ *
+ * @param socket_context  the state of the connection, or NULL if unknown
+ *
+ * @return 1 if the connection is to close after the request, 0 otherwise
+ */
+int
+connection_count_request (void *socket_context)
+{
+  struct client_connection *client = socket_context;
+  unsigned int requests;
+
+  __sync_add_and_fetch (&stats.requests, 1);
+  if (client == NULL)
+    return 0;
+
+  /* Requests on a connection arrive one after another. */
+  requests = ++client->requests;
+  if (requests > 1)
+    __sync_add_and_fetch (&stats.reused, 1);
+  if (requests < (unsigned int) tunables.keepalive_max_requests)
+    return 0;
+  __sync_add_and_fetch (&stats.capped, 1);
+  return 1;
+} // connection_count_request
+
+/**
+ * @brief Copies the counters of client connections.
+ *
+ * @param copy  where to copy them
+ */
+void
+connection_get_stats (struct connection_stats *copy)
+{
+  copy->connections = __sync_fetch_and_add (&stats.connections, 0);
+  copy->requests = __sync_fetch_and_add (&stats.requests, 0);
+  copy->reused = __sync_fetch_and_add (&stats.reused, 0);
+  copy->capped = __sync_fetch_and_add (&stats.capped, 0);
+} // connection_get_stats
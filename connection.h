@@ -10,6 +10,21 @@
 
 #include "notary.h"
 
+/* The number of clients with a request in flight. */
+extern unsigned int number_active_clients;
+
+/* Counters of client connections. A connection is reused when it carries
+ * more than one request, and capped when it closes after carrying
+ * keepalive_max_requests.
+ */
+struct connection_stats
+{
+  unsigned long connections;    // connections accepted
+  unsigned long requests;       // requests received
+  unsigned long reused;         // of those, on a connection used before
+  unsigned long capped;         // connections closed at the request cap
+};
+
 /* Handles the connection of a client. The address of this function needs to
  * be passed to MHD_start_daemon.
  */
@@ -41,4 +56,21 @@ void
 request_completed (void *cls, struct MHD_Connection *connection,
                    void **con_cls, enum MHD_RequestTerminationCode toe);
 
+/* Keeps track of the connections of clients, which stay open between
+ * requests. The address of this function needs to be passed to
+ * MHD_start_daemon with MHD_OPTION_NOTIFY_CONNECTION.
+ */
+void
+connection_notify (void *cls, struct MHD_Connection *connection,
+                   void **socket_context,
+                   enum MHD_ConnectionNotificationCode toe);
+
+/* Counts a request on the connection whose state is socket_context.
+ * Returns 1 if the connection is to close after the request, 0 otherwise.
+ */
+int connection_count_request (void *socket_context);
+
+/* Copies the counters of client connections into stats. */
+void connection_get_stats (struct connection_stats *stats);
+
 #endif // CONNECTION_H
@@ -0,0 +1,201 @@
+/** @file
+
+    @brief  Deadline: the time budget of a verification, split into budgets
+            for its stages, and its cancellation when the client hangs up.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "deadline.h"
+#include "config.h"
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+
+static struct deadline_stats stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Returns the budget tunable of a stage.
+ */
+static int
+stage_budget (enum deadline_stage stage)
+{
+  switch (stage)
+    {
+    case DEADLINE_QUEUE:
+      return tunables.verify_queue_ms;
+    case DEADLINE_DNS:
+      return tunables.verify_dns_ms;
+    case DEADLINE_CONNECT:
+      return tunables.verify_connect_ms;
+    case DEADLINE_TLS:
+      return tunables.verify_tls_ms;
+    default:
+      return tunables.verify_sign_ms;
+    }
+} // stage_budget
+
+/**
+ * @brief Checks whether the client's connection is gone, without reading
+ *        from it. A client that only shut down its side of the connection
+ *        may still be waiting for the answer, so only a connection closed
+ *        both ways or broken counts.
+ */
+static int
+client_gone (int fd)
+{
+  struct pollfd client;
+
+  client.fd = fd;
+  client.events = 0;
+  client.revents = 0;
+  return poll (&client, 1, 0) > 0
+    && (client.revents & (POLLHUP | POLLERR | POLLNVAL));
+} // client_gone
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Returns the time on the monotonic clock in milliseconds.
+ */
+long long
+deadline_now_ms ()
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+} // deadline_now_ms
+
+/**
+ * @brief Starts a deadline.
+ *
+ * @param deadline    the deadline to start
+ * @param timeout_ms  milliseconds until it passes
+ * @param connection  the connection of the client, or NULL
+ */
+void
+deadline_start (struct deadline *deadline, int timeout_ms,
+                struct MHD_Connection *connection)
+{
+  const union MHD_ConnectionInfo *info = NULL;
+
+  memset (deadline, 0, sizeof (*deadline));
+  deadline->expires_ms = deadline_now_ms () + timeout_ms;
+
+  if (connection != NULL)
+    info = MHD_get_connection_info (connection,
+                                    MHD_CONNECTION_INFO_CONNECTION_FD);
+  if (info != NULL)
+    {
+      deadline->client_fd = info->connect_fd;
+      deadline->watching = 1;
+    }
+} // deadline_start
+
+/**
+ * @brief Returns the time a stage may take. Stages before signing leave the
+ *        signing budget untouched, so a slow host cannot use up the time
+ *        needed to answer.
+ *
+ * @return the budget in milliseconds, or 0 if the stage must not start
+ */
+long
+deadline_budget_ms (struct deadline *deadline, enum deadline_stage stage)
+{
+  long left = deadline_left_ms (deadline, stage);
+  long budget = stage_budget (stage);
+
+  return left < budget ? left : budget;
+} // deadline_budget_ms
+
+/**
+ * @brief Returns the time left for a stage and the stages after it but
+ *        before signing, regardless of their budgets.
+ *
+ * @return the time in milliseconds, LONG_MAX for a zeroed deadline, or 0
+ *         if the stage must not start
+ */
+long
+deadline_left_ms (struct deadline *deadline, enum deadline_stage stage)
+{
+  long long left;
+
+  if (deadline_expired (deadline))
+    return 0;
+  if (deadline->expires_ms == 0)
+    return LONG_MAX;
+
+  left = deadline->expires_ms - deadline_now_ms ();
+  if (stage != DEADLINE_SIGN)
+    left -= tunables.verify_sign_ms;
+
+  return left > 0 ? left : 0;
+} // deadline_left_ms
+
+/**
+ * @brief Checks whether a verification should stop.
+ *
+ * @return 1 if the deadline passed or the verification was cancelled
+ */
+int
+deadline_expired (struct deadline *deadline)
+{
+  if (deadline->cancelled)
+    return 1;
+
+  if (deadline->watching && client_gone (deadline->client_fd))
+    {
+      deadline->cancelled = 1;
+      return 1;
+    }
+
+  return deadline->expires_ms != 0
+    && deadline_now_ms () >= deadline->expires_ms;
+} // deadline_expired
+
+/**
+ * @brief Cancels the verification of a deadline.
+ */
+void
+deadline_cancel (struct deadline *deadline)
+{
+  deadline->cancelled = 1;
+} // deadline_cancel
+
+/**
+ * @brief Counts a verification that stopped in a stage, as cancelled if it
+ *        was and as expired in that stage otherwise.
+ */
+void
+deadline_record (struct deadline *deadline, enum deadline_stage stage)
+{
+  pthread_mutex_lock (&stats_lock);
+  if (deadline->cancelled)
+    stats.cancelled++;
+  else
+    stats.expired[stage]++;
+  pthread_mutex_unlock (&stats_lock);
+} // deadline_record
+
+/**
+ * @brief Copies the counters of all deadlines.
+ */
+void
+deadline_get_stats (struct deadline_stats *stats_out)
+{
+  pthread_mutex_lock (&stats_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&stats_lock);
+} // deadline_get_stats
@@ -0,0 +1,78 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for verification deadlines. Every
+ * verification gets a deadline when its request is accepted. Queueing, DNS,
+ * connecting, the TLS handshake and signing each get a budget out of what is
+ * left of it, and a verification is cancelled once its deadline passes or
+ * its client hangs up.
+ ******************************************************************************/
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include "notary.h"
+
+/* The stages of a verification, in the order they run. */
+enum deadline_stage
+  {
+    DEADLINE_QUEUE = 0,         // waiting for a fetch slot of the origin
+    DEADLINE_DNS = 1,
+    DEADLINE_CONNECT = 2,
+    DEADLINE_TLS = 3,
+    DEADLINE_SIGN = 4,
+    DEADLINE_STAGES = 5
+  };
+
+/* The deadline of a verification. A zeroed deadline never expires and
+ * watches no client.
+ */
+struct deadline
+{
+  long long expires_ms;         // on the monotonic clock, 0 for never
+  int client_fd;                // socket of the client, watched for hang-ups
+  int watching;                 // whether client_fd is set
+  volatile int cancelled;
+};
+
+/* Verifications that ran out of time in each stage, and those cancelled. */
+struct deadline_stats
+{
+  unsigned long expired[DEADLINE_STAGES];
+  unsigned long cancelled;      // the client hung up or the caller cancelled
+};
+
+/* Returns the time on the monotonic clock in milliseconds. */
+long long deadline_now_ms (void);
+
+/* Starts a deadline timeout_ms from now. When connection is not NULL, the
+ * deadline counts as cancelled once the client closes the connection.
+ */
+void deadline_start (struct deadline *deadline, int timeout_ms,
+                     struct MHD_Connection *connection);
+
+/* Returns the milliseconds a stage may take: its budget, cut down to what
+ * is left of the deadline after the signing budget. Returns 0 if the
+ * stage must not start.
+ */
+long deadline_budget_ms (struct deadline *deadline, enum deadline_stage stage);
+
+/* Returns the milliseconds left of the deadline for a stage and the ones
+ * after it, keeping back the signing budget, without applying their
+ * budgets. Returns 0 if the stage must not start.
+ */
+long deadline_left_ms (struct deadline *deadline, enum deadline_stage stage);
+
+/* Returns 1 if the deadline passed or the verification was cancelled. */
+int deadline_expired (struct deadline *deadline);
+
+/* Cancels the verification of a deadline. */
+void deadline_cancel (struct deadline *deadline);
+
+/* Counts a verification that stopped in a stage because of its deadline. */
+void deadline_record (struct deadline *deadline, enum deadline_stage stage);
+
+/* Copies the counters of all deadlines into stats. */
+void deadline_get_stats (struct deadline_stats *stats);
+
+#endif // DEADLINE_H
@@ -0,0 +1,340 @@
+/** @file
+
+    @brief  Eyeballs: races connection attempts to the IPv6 and IPv4
+            addresses of a host with staggered starts (RFC 8305) and keeps
+            track of which family wins for each destination.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "eyeballs.h"
+#include "config.h"
+#include "tcptune.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+/* Race results of a destination. Slots are picked by hash and a new
+ * destination takes over the slot of an old one. */
+struct destination
+{
+  char name[128];
+  int last_winner;              // family that won the last race, or 0
+  struct eyeballs_stats stats;
+};
+
+static struct destination destinations[EYEBALLS_DESTINATIONS];
+static struct eyeballs_stats totals;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Finds the slot of a destination.
+ */
+static struct destination *
+slot_of (const char *name)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  while (*name)
+    {
+      hash ^= (unsigned char) *name++;
+      hash *= 1099511628211ULL;
+    }
+  return &destinations[hash % EYEBALLS_DESTINATIONS];
+} // slot_of
+
+/**
+ * @brief Returns the milliseconds elapsed on the monotonic clock.
+ */
+static long long
+now_ms ()
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+} // now_ms
+
+/**
+ * @brief Orders the addresses of an answer for racing: alternating
+ *        families, starting with the preferred one.
+ *
+ * @return the number of addresses ordered
+ */
+static int
+order_addresses (const struct resolver_answer *answer, int first_family,
+                 int *order)
+{
+  int preferred[RESOLVER_MAX_ADDRESSES], other[RESOLVER_MAX_ADDRESSES];
+  int num_preferred = 0, num_other = 0, count = 0, i;
+
+  for (i = 0; i < answer->num_addresses; i++)
+    if (answer->families[i] == first_family)
+      preferred[num_preferred++] = i;
+    else
+      other[num_other++] = i;
+
+  for (i = 0; i < num_preferred || i < num_other; i++)
+    {
+      if (i < num_preferred)
+        order[count++] = preferred[i];
+      if (i < num_other)
+        order[count++] = other[i];
+    }
+  return count;
+} // order_addresses
+
+/**
+ * @brief Starts a non-blocking connection attempt.
+ *
+ * @param fastopen  whether the attempt is the only one, so its SYN may wait
+ *                  for the first write
+ *
+ * @return the socket, or -1 if the attempt failed at once
+ */
+static int
+start_attempt (const char *address, int family, long port, int fastopen)
+{
+  struct sockaddr_storage target;
+  struct sockaddr_in *ipv4 = (struct sockaddr_in *) &target;
+  struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *) &target;
+  socklen_t length;
+  int fd;
+
+  memset (&target, 0, sizeof (target));
+  if (family == AF_INET6)
+    {
+      ipv6->sin6_family = AF_INET6;
+      ipv6->sin6_port = htons (port);
+      if (inet_pton (AF_INET6, address, &ipv6->sin6_addr) != 1)
+        return -1;
+      length = sizeof (*ipv6);
+    }
+  else
+    {
+      ipv4->sin_family = AF_INET;
+      ipv4->sin_port = htons (port);
+      if (inet_pton (AF_INET, address, &ipv4->sin_addr) != 1)
+        return -1;
+      length = sizeof (*ipv4);
+    }
+
+  fd = socket (family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  tcptune_upstream (fd, fastopen);
+
+  if (connect (fd, (struct sockaddr *) &target, length) < 0
+      && errno != EINPROGRESS)
+    {
+      close (fd);
+      return -1;
+    }
+  return fd;
+} // start_attempt
+
+/**
+ * @brief Records the outcome of a race.
+ */
+static void
+record_race (const char *destination, int winner_family, int fallback)
+{
+  struct destination *slot = slot_of (destination);
+  struct eyeballs_stats *counters[2];
+  int i;
+
+  pthread_mutex_lock (&stats_lock);
+  if (strncmp (slot->name, destination, sizeof (slot->name) - 1) != 0)
+    {
+      memset (slot, 0, sizeof (*slot));
+      strncpy (slot->name, destination, sizeof (slot->name) - 1);
+    }
+
+  counters[0] = &slot->stats;
+  counters[1] = &totals;
+  for (i = 0; i < 2; i++)
+    {
+      counters[i]->races++;
+      if (winner_family == AF_INET6)
+        counters[i]->ipv6_wins++;
+      else if (winner_family == AF_INET)
+        counters[i]->ipv4_wins++;
+      else
+        counters[i]->failures++;
+      if (fallback)
+        counters[i]->fallbacks++;
+    }
+
+  if (winner_family != 0)
+    slot->last_winner = winner_family;
+  pthread_mutex_unlock (&stats_lock);
+} // record_race
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Connects to the fastest of the addresses of a destination. A new
+ *        attempt starts every eyeballs_delay_ms, or as soon as the previous
+ *        one fails; the first to connect wins and the others are closed.
+ *
+ * @param destination  the destination, for the race results
+ * @param answer       the addresses of the destination
+ * @param port         the port to connect to
+ * @param timeout_ms   the time to connect in, at most eyeballs_timeout_ms;
+ *                     0 for eyeballs_timeout_ms
+ * @param winner       output parameter for the index of the winning address
+ *
+ * @return the connected socket, or -1 if no address could be reached
+ */
+int
+eyeballs_connect (const char *destination,
+                  const struct resolver_answer *answer, long port,
+                  long timeout_ms, int *winner)
+{
+  struct destination *slot = slot_of (destination);
+  struct pollfd fds[RESOLVER_MAX_ADDRESSES];
+  int attempt_of[RESOLVER_MAX_ADDRESSES];
+  int order[RESOLVER_MAX_ADDRESSES];
+  int first_family = AF_INET6, count, started = 0, pending = 0;
+  int connected = -1, error, fd, i, j, ready;
+  socklen_t error_length;
+  long long deadline, next_start, now, wait;
+
+  /* Prefer IPv6, unless IPv4 won the last race to this destination. */
+  pthread_mutex_lock (&stats_lock);
+  if (strncmp (slot->name, destination, sizeof (slot->name) - 1) == 0
+      && slot->last_winner == AF_INET)
+    first_family = AF_INET;
+  pthread_mutex_unlock (&stats_lock);
+
+  count = order_addresses (answer, first_family, order);
+  now = now_ms ();
+  if (timeout_ms <= 0 || timeout_ms > tunables.eyeballs_timeout_ms)
+    timeout_ms = tunables.eyeballs_timeout_ms;
+  deadline = now + timeout_ms;
+  next_start = now;
+
+  while (connected < 0)
+    {
+      now = now_ms ();
+      if (started < count && now >= next_start)
+        {
+          i = order[started++];
+          fd = start_attempt (answer->addresses[i], answer->families[i],
+                              port, count == 1);
+          if (fd < 0)
+            {
+              /* Unreachable at once: go on to the next address. */
+              next_start = now;
+              continue;
+            }
+
+          fds[pending].fd = fd;
+          fds[pending].events = POLLOUT;
+          fds[pending].revents = 0;
+          attempt_of[pending++] = i;
+          next_start = now + tunables.eyeballs_delay_ms;
+          continue;
+        }
+
+      if (pending == 0 && started == count)
+        break;
+      if (now >= deadline)
+        break;
+
+      wait = deadline - now;
+      if (started < count && next_start - now < wait)
+        wait = next_start - now;
+
+      ready = poll (fds, pending, wait);
+      if (ready < 0 && errno != EINTR)
+        break;
+
+      for (j = 0; ready > 0 && j < pending; j++)
+        {
+          if (fds[j].revents == 0)
+            continue;
+
+          error = 0;
+          error_length = sizeof (error);
+          getsockopt (fds[j].fd, SOL_SOCKET, SO_ERROR, &error, &error_length);
+          if (error == 0 && connected < 0)
+            {
+              connected = j;
+              continue;
+            }
+          if (error == 0)
+            continue;
+
+          /* A failed attempt lets the next one start at once. */
+          close (fds[j].fd);
+          fds[j] = fds[pending - 1];
+          attempt_of[j] = attempt_of[pending - 1];
+          if (connected == pending - 1)
+            connected = j;
+          pending--;
+          j--;
+          next_start = now;
+        }
+    }
+
+  /* Cancel the attempts that lost. */
+  for (j = 0; j < pending; j++)
+    if (j != connected)
+      close (fds[j].fd);
+
+  if (connected < 0)
+    {
+      record_race (destination, 0, 0);
+      return -1;
+    }
+
+  *winner = attempt_of[connected];
+  record_race (destination, answer->families[*winner],
+               count > 0 && *winner != order[0]);
+  return fds[connected].fd;
+} // eyeballs_connect
+
+/**
+ * @brief Copies the race results of a destination.
+ *
+ * @return 1 if the destination is known, 0 otherwise
+ */
+int
+eyeballs_destination_stats (const char *destination,
+                            struct eyeballs_stats *stats)
+{
+  struct destination *slot = slot_of (destination);
+  int known;
+
+  pthread_mutex_lock (&stats_lock);
+  known = strncmp (slot->name, destination, sizeof (slot->name) - 1) == 0
+    && slot->stats.races > 0;
+  if (known)
+    *stats = slot->stats;
+  pthread_mutex_unlock (&stats_lock);
+
+  return known;
+} // eyeballs_destination_stats
+
+/**
+ * @brief Copies the race results of all destinations.
+ */
+void
+eyeballs_get_stats (struct eyeballs_stats *stats)
+{
+  pthread_mutex_lock (&stats_lock);
+  *stats = totals;
+  pthread_mutex_unlock (&stats_lock);
+} // eyeballs_get_stats
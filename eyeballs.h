@@ -0,0 +1,48 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for connection racing. Connections to
+ * the addresses of a host are attempted with staggered starts, alternating
+ * between IPv6 and IPv4 as in RFC 8305 (Happy Eyeballs), and the first one
+ * to connect is used.
+ ******************************************************************************/
+#ifndef EYEBALLS_H
+#define EYEBALLS_H
+
+#include "notary.h"
+#include "resolver.h"
+
+/* Destinations whose race results are remembered. */
+#define EYEBALLS_DESTINATIONS 1024
+
+/* Race results for one destination, or for all of them. */
+struct eyeballs_stats
+{
+  unsigned long races;
+  unsigned long ipv6_wins;
+  unsigned long ipv4_wins;
+  unsigned long fallbacks;      // races the first address started lost
+  unsigned long failures;       // races no address won
+};
+
+/* Connects to the fastest of the addresses of a destination within
+ * timeout_ms, or eyeballs_timeout_ms if that is 0 or shorter. The family
+ * that won the last race for the destination is tried first. Returns the
+ * connected, non-blocking socket and sets *winner to the index of its
+ * address, or returns -1 if no address could be connected to.
+ */
+int eyeballs_connect (const char *destination,
+                      const struct resolver_answer *answer, long port,
+                      long timeout_ms, int *winner);
+
+/* Copies the race results of a destination into stats. Returns 1 if the
+ * destination is known, 0 otherwise.
+ */
+int eyeballs_destination_stats (const char *destination,
+                                struct eyeballs_stats *stats);
+
+/* Copies the race results of all destinations into stats. */
+void eyeballs_get_stats (struct eyeballs_stats *stats);
+
+#endif // EYEBALLS_H
@@ -0,0 +1,544 @@
+/** @file
+
+    @brief  Handoff: opens the listening sockets of the notary and hands
+            them to a new binary on SIGUSR2, so that an upgrade drops no
+            connection.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "handoff.h"
+#include "deadline.h"
+#include "config.h"
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+/* A listening socket and its name. */
+struct listener
+{
+  char name[HANDOFF_NAME_LENGTH];
+  int fd;                       // -1 for none
+};
+
+/* The listening sockets opened, which are handed over, and those taken
+ * over from a predecessor, until they are opened. Only the main thread
+ * opens and hands over sockets. */
+static struct listener listeners[HANDOFF_MAX_SOCKETS];
+static int num_listeners = 0;
+static struct listener inherited[HANDOFF_MAX_SOCKETS];
+static int num_inherited = 0;
+
+/* The channel to the predecessor, until this notary is serving. */
+static int predecessor = -1;
+
+/* Written by the signal handler, one byte per event. */
+static int signal_pipe[2] = {-1, -1};
+
+static struct handoff_stats stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Handles SIGUSR2, SIGTERM and SIGINT by waking handoff_wait.
+ */
+static void
+handle_signal (int signal_number)
+{
+  char event = signal_number == SIGUSR2 ? HANDOFF_UPGRADE : HANDOFF_STOP;
+  int saved_errno = errno;
+
+  if (write (signal_pipe[1], &event, 1) < 0)
+    {
+      // The pipe is full of events already.
+    }
+  errno = saved_errno;
+} // handle_signal
+
+/**
+ * @brief Remembers a listening socket to hand over, replacing one of the
+ *        same name.
+ */
+static void
+add_listener (const char *name, int fd)
+{
+  int i;
+
+  for (i = 0; i < num_listeners; i++)
+    if (strcmp (listeners[i].name, name) == 0)
+      break;
+  if (i == HANDOFF_MAX_SOCKETS)
+    {
+      fprintf (stderr, "Warning: The %s socket will not be handed over\n",
+               name);
+      return;
+    }
+  snprintf (listeners[i].name, sizeof (listeners[i].name), "%s", name);
+  listeners[i].fd = fd;
+  if (i == num_listeners)
+    num_listeners++;
+} // add_listener
+
+/**
+ * @brief Builds the environment of a successor: this one, telling it where
+ *        its predecessor is.
+ *
+ * @return the environment, to be freed with free_environment, or NULL if
+ *         out of memory
+ */
+static char **
+successor_environment (int channel)
+{
+  extern char **environ;
+  char **environment;
+  int count = 0, kept = 0, i;
+
+  while (environ[count] != NULL)
+    count++;
+  environment = calloc (count + 2, sizeof (char *));
+  if (environment == NULL)
+    return NULL;
+
+  for (i = 0; i < count; i++)
+    if (strncmp (environ[i], HANDOFF_ENV "=", strlen (HANDOFF_ENV "=")) != 0)
+      environment[kept++] = environ[i];
+  if (asprintf (&environment[kept], HANDOFF_ENV "=%d", channel) < 0)
+    {
+      free (environment);
+      return NULL;
+    }
+  return environment;
+} // successor_environment
+
+/**
+ * @brief Frees the environment of a successor.
+ */
+static void
+free_environment (char **environment)
+{
+  int i;
+
+  for (i = 0; environment[i + 1] != NULL; i++)
+    ;
+  free (environment[i]);
+  free (environment);
+} // free_environment
+
+/**
+ * @brief Waits up to handoff_timeout_ms for a successor to say it is
+ *        serving.
+ *
+ * @return 1 if it is, 0 otherwise
+ */
+static int
+wait_for_successor (int channel)
+{
+  long long deadline = deadline_now_ms () + tunables.handoff_timeout_ms;
+  struct pollfd ready = {channel, POLLIN, 0};
+  long long left;
+  char byte;
+  int polled;
+
+  while ((left = deadline - deadline_now_ms ()) > 0)
+    {
+      polled = poll (&ready, 1, left);
+      if (polled < 0 && errno == EINTR)
+        continue;
+      if (polled <= 0)
+        break;
+      return read (channel, &byte, 1) == 1 && byte == 'R';
+    }
+  return 0;
+} // wait_for_successor
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Installs the signal handlers and takes over the listening sockets
+ *        of a predecessor, if there is one.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+handoff_init ()
+{
+  struct sigaction action;
+  const char *channel;
+  int received;
+
+  if (signal_pipe[0] < 0 && pipe2 (signal_pipe, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+      fprintf (stderr, "Could not create the signal pipe: %s\n",
+               strerror (errno));
+      return 0;
+    }
+
+  memset (&action, 0, sizeof (action));
+  action.sa_handler = handle_signal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset (&action.sa_mask);
+  sigaction (SIGUSR2, &action, NULL);
+  sigaction (SIGTERM, &action, NULL);
+  sigaction (SIGINT, &action, NULL);
+
+  channel = getenv (HANDOFF_ENV);
+  if (channel == NULL)
+    return 1;
+
+  predecessor = atoi (channel);
+  unsetenv (HANDOFF_ENV);
+  fcntl (predecessor, F_SETFD, FD_CLOEXEC);
+  received = handoff_receive_sockets (predecessor);
+  if (received < 0)
+    {
+      fprintf (stderr, "Could not take over the listening sockets\n");
+      close (predecessor);
+      predecessor = -1;
+      return 0;
+    }
+
+  pthread_mutex_lock (&stats_lock);
+  stats.inherited = received;
+  pthread_mutex_unlock (&stats_lock);
+  return 1;
+} // handoff_init
+
+/**
+ * @brief Returns a listening socket, taken over or bound anew.
+ *
+ * @param name     the name it is handed over under
+ * @param address  the address to bind
+ * @param length   the length of the address
+ * @param flags    HANDOFF_REUSE_PORT and HANDOFF_V6ONLY, or 0
+ *
+ * @return the socket, or -1 on failure
+ */
+int
+handoff_listen (const char *name, const struct sockaddr *address,
+                socklen_t length, int flags)
+{
+  int fd = -1, on = 1, v6only = (flags & HANDOFF_V6ONLY) != 0, i;
+
+  for (i = 0; i < num_inherited; i++)
+    if (inherited[i].fd >= 0 && strcmp (inherited[i].name, name) == 0)
+      {
+        fd = inherited[i].fd;
+        inherited[i].fd = -1;
+        break;
+      }
+
+  if (fd < 0)
+    {
+      fd = socket (address->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (fd < 0)
+        return -1;
+      setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+      if ((flags & HANDOFF_REUSE_PORT)
+          && setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof (on)) != 0)
+        fprintf (stderr, "Warning: %s cannot share its port: %s\n", name,
+                 strerror (errno));
+      if (address->sa_family == AF_INET6)
+        setsockopt (fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof (v6only));
+      if (bind (fd, address, length) != 0 || listen (fd, SOMAXCONN) != 0)
+        {
+          fprintf (stderr, "Could not listen for %s: %s\n", name,
+                   strerror (errno));
+          close (fd);
+          return -1;
+        }
+    }
+
+  add_listener (name, fd);
+  return fd;
+} // handoff_listen
+
+/**
+ * @brief Tells the predecessor this notary is serving, and closes the
+ *        sockets taken over that were not opened.
+ */
+void
+handoff_ready ()
+{
+  int i;
+
+  for (i = 0; i < num_inherited; i++)
+    if (inherited[i].fd >= 0)
+      {
+        close (inherited[i].fd);
+        inherited[i].fd = -1;
+      }
+
+  if (predecessor < 0)
+    return;
+  if (write (predecessor, "R", 1) != 1)
+    fprintf (stderr, "Warning: Could not tell the old notary to stop\n");
+  close (predecessor);
+  predecessor = -1;
+} // handoff_ready
+
+/**
+ * @brief Waits for a signal, or for a line or the end of standard input.
+ *
+ * @return what the notary was asked to do
+ */
+enum handoff_event
+handoff_wait ()
+{
+  struct pollfd events[2] = {{signal_pipe[0], POLLIN, 0},
+                             {STDIN_FILENO, POLLIN, 0}};
+  char event;
+
+  for (;;)
+    {
+      if (poll (events, 2, -1) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return HANDOFF_STOP;
+        }
+      if ((events[0].revents & POLLIN)
+          && read (signal_pipe[0], &event, 1) == 1)
+        return event;
+      if (events[1].revents != 0)
+        {
+          getchar ();
+          return HANDOFF_STOP;
+        }
+    }
+} // handoff_wait
+
+/**
+ * @brief Starts a successor and hands it every listening socket.
+ *
+ * @param argv  the command line of the successor
+ *
+ * @return 1 once it is serving, 0 otherwise
+ */
+int
+handoff_start (char *const argv[])
+{
+  char **environment;
+  int channel[2], started = 0;
+  pid_t successor;
+
+  if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) != 0)
+    {
+      fprintf (stderr, "Could not create the handoff channel: %s\n",
+               strerror (errno));
+      goto done;
+    }
+  environment = successor_environment (channel[1]);
+  if (environment == NULL)
+    {
+      close (channel[0]);
+      close (channel[1]);
+      goto done;
+    }
+
+  successor = fork ();
+  if (successor == 0)
+    {
+      /* Only the successor's end of the channel survives the exec. */
+      fcntl (channel[1], F_SETFD, 0);
+      execvpe (argv[0], argv, environment);
+      _exit (127);
+    }
+  close (channel[1]);
+  free_environment (environment);
+
+  if (successor < 0)
+    fprintf (stderr, "Could not start %s: %s\n", argv[0], strerror (errno));
+  else if (handoff_send_sockets (channel[0])
+           && wait_for_successor (channel[0]))
+    started = 1;
+  else
+    {
+      fprintf (stderr, "%s did not take over\n", argv[0]);
+      kill (successor, SIGKILL);
+      waitpid (successor, NULL, 0);
+    }
+  close (channel[0]);
+
+ done:
+  pthread_mutex_lock (&stats_lock);
+  if (started)
+    stats.handoffs++;
+  else
+    stats.failures++;
+  pthread_mutex_unlock (&stats_lock);
+  return started;
+} // handoff_start
+
+/**
+ * @brief Waits for the requests in flight to finish.
+ *
+ * @param active      the number of requests in flight
+ * @param timeout_ms  the longest to wait
+ *
+ * @return the number of requests still in flight
+ */
+unsigned int
+handoff_drain (const unsigned int *active, int timeout_ms)
+{
+  long long start = deadline_now_ms ();
+  unsigned int left;
+
+  while ((left = __atomic_load_n (active, __ATOMIC_ACQUIRE)) > 0
+         && deadline_now_ms () - start < timeout_ms)
+    usleep (10000);
+
+  pthread_mutex_lock (&stats_lock);
+  stats.drain_ms = deadline_now_ms () - start;
+  stats.abandoned = left;
+  pthread_mutex_unlock (&stats_lock);
+  return left;
+} // handoff_drain
+
+/**
+ * @brief Sends every listening socket, with the names they were opened
+ *        under, in one message.
+ *
+ * @param channel  a Unix socket
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+handoff_send_sockets (int channel)
+{
+  char names[HANDOFF_MAX_SOCKETS * HANDOFF_NAME_LENGTH + 1] = "";
+  union
+  {
+    struct cmsghdr header;
+    char space[CMSG_SPACE (HANDOFF_MAX_SOCKETS * sizeof (int))];
+  } control;
+  struct msghdr message;
+  struct cmsghdr *header;
+  struct iovec data;
+  size_t length = 0;
+  int fds[HANDOFF_MAX_SOCKETS], i;
+
+  for (i = 0; i < num_listeners; i++)
+    {
+      length += snprintf (names + length, sizeof (names) - length, "%s\n",
+                          listeners[i].name);
+      fds[i] = listeners[i].fd;
+    }
+
+  memset (&message, 0, sizeof (message));
+  data.iov_base = names;
+  data.iov_len = length + 1;
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  if (num_listeners > 0)
+    {
+      memset (&control, 0, sizeof (control));
+      message.msg_control = control.space;
+      message.msg_controllen = CMSG_SPACE (num_listeners * sizeof (int));
+      header = CMSG_FIRSTHDR (&message);
+      header->cmsg_level = SOL_SOCKET;
+      header->cmsg_type = SCM_RIGHTS;
+      header->cmsg_len = CMSG_LEN (num_listeners * sizeof (int));
+      memcpy (CMSG_DATA (header), fds, num_listeners * sizeof (int));
+    }
+
+  if (sendmsg (channel, &message, MSG_NOSIGNAL) != (ssize_t) (length + 1))
+    {
+      fprintf (stderr, "Could not hand over the listening sockets: %s\n",
+               strerror (errno));
+      return 0;
+    }
+  return 1;
+} // handoff_send_sockets
+
+/**
+ * @brief Receives listening sockets and their names, as sent by
+ *        handoff_send_sockets.
+ *
+ * @param channel  a Unix socket
+ *
+ * @return the number of sockets received, or -1 on failure
+ */
+int
+handoff_receive_sockets (int channel)
+{
+  char names[HANDOFF_MAX_SOCKETS * HANDOFF_NAME_LENGTH + 2];
+  union
+  {
+    struct cmsghdr header;
+    char space[CMSG_SPACE (HANDOFF_MAX_SOCKETS * sizeof (int))];
+  } control;
+  struct msghdr message;
+  struct cmsghdr *header;
+  struct iovec data;
+  char *name, *rest;
+  ssize_t received;
+  int fds[HANDOFF_MAX_SOCKETS], count = 0, i;
+
+  memset (&message, 0, sizeof (message));
+  data.iov_base = names;
+  data.iov_len = sizeof (names) - 1;
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control.space;
+  message.msg_controllen = sizeof (control.space);
+
+  do
+    received = recvmsg (channel, &message, MSG_CMSG_CLOEXEC);
+  while (received < 0 && errno == EINTR);
+  if (received <= 0)
+    return -1;
+  names[received] = '\0';
+
+  for (header = CMSG_FIRSTHDR (&message); header != NULL;
+       header = CMSG_NXTHDR (&message, header))
+    if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS
+        && count == 0)
+      {
+        count = (header->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+        if (count > HANDOFF_MAX_SOCKETS)
+          count = HANDOFF_MAX_SOCKETS;
+        memcpy (fds, CMSG_DATA (header), count * sizeof (int));
+      }
+
+  /* Every socket needs a name, and every name a socket. */
+  num_inherited = 0;
+  name = strtok_r (names, "\n", &rest);
+  for (i = 0; i < count && name != NULL && strlen (name) > 0
+         && strlen (name) < HANDOFF_NAME_LENGTH; i++)
+    {
+      snprintf (inherited[i].name, sizeof (inherited[i].name), "%s", name);
+      inherited[i].fd = fds[i];
+      name = strtok_r (NULL, "\n", &rest);
+    }
+  if (i < count || name != NULL || (message.msg_flags & MSG_CTRUNC))
+    {
+      for (i = 0; i < count; i++)
+        close (fds[i]);
+      return -1;
+    }
+
+  num_inherited = count;
+  return count;
+} // handoff_receive_sockets
+
+/**
+ * @brief Copies the counters of handoffs.
+ */
+void
+handoff_get_stats (struct handoff_stats *stats_out)
+{
+  pthread_mutex_lock (&stats_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&stats_lock);
+} // handoff_get_stats
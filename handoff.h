@@ -0,0 +1,92 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for socket handoff, which lets a
+ * notary be upgraded without dropping a connection. The notary opens its
+ * listening sockets here, by name. On SIGUSR2 it starts a new copy of its
+ * binary with the same arguments and passes it every listening socket over
+ * a Unix socket; the successor serves on them at once and says so, and the
+ * old notary stops accepting, waits for its requests in flight to finish,
+ * and exits. If the successor fails to start, the old notary keeps
+ * serving. SIGTERM and SIGINT stop the notary, draining the same way.
+ ******************************************************************************/
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include "notary.h"
+
+/* Most listening sockets handed over, and the longest name of one. */
+#define HANDOFF_MAX_SOCKETS 128
+#define HANDOFF_NAME_LENGTH 16
+
+/* Options of a listening socket bound anew. */
+#define HANDOFF_REUSE_PORT 1    // share the port with other sockets
+#define HANDOFF_V6ONLY 2        // take no IPv4 connections on an IPv6 socket
+
+/* The environment variable telling a successor where its predecessor is. */
+#define HANDOFF_ENV "NOTARY_HANDOFF_FD"
+
+/* What the notary was asked to do. */
+enum handoff_event
+  {
+    HANDOFF_STOP = 0,           // stop, on SIGTERM, SIGINT or from stdin
+    HANDOFF_UPGRADE = 1         // hand over to a new binary, on SIGUSR2
+  };
+
+/* Counters of handoffs. */
+struct handoff_stats
+{
+  unsigned long inherited;      // listening sockets taken over at startup
+  unsigned long handoffs;       // successors that took over
+  unsigned long failures;       // successors that failed to take over
+  unsigned long drain_ms;       // time the last drain took
+  unsigned long abandoned;      // requests still in flight when it ended
+};
+
+/* Installs the signal handlers and, in a successor, takes over the
+ * listening sockets of its predecessor. Returns 1 on success, 0 otherwise.
+ */
+int handoff_init (void);
+
+/* Returns a listening socket for name: the one taken over under that name
+ * or a new one bound to address with the HANDOFF_ options in flags. An
+ * IPv6 socket takes IPv4 connections too unless flags ask otherwise.
+ * Returns -1 if no socket could be bound.
+ */
+int handoff_listen (const char *name, const struct sockaddr *address,
+                    socklen_t length, int flags);
+
+/* Tells the predecessor this notary is serving, so it can stop accepting.
+ * Does nothing in a notary that took over nothing.
+ */
+void handoff_ready (void);
+
+/* Waits until the notary is asked to stop or to upgrade. */
+enum handoff_event handoff_wait (void);
+
+/* Starts a successor with argv and hands it every listening socket.
+ * Returns 1 once it is serving, 0 if it failed to within
+ * handoff_timeout_ms, in which case it is killed.
+ */
+int handoff_start (char *const argv[]);
+
+/* Waits up to timeout_ms for the requests counted by active to finish.
+ * Returns the number still in flight.
+ */
+unsigned int handoff_drain (const unsigned int *active, int timeout_ms);
+
+/* Sends every listening socket over channel. Returns 1 on success, 0
+ * otherwise.
+ */
+int handoff_send_sockets (int channel);
+
+/* Receives listening sockets over channel for handoff_listen to return.
+ * Returns the number received, or -1 on failure.
+ */
+int handoff_receive_sockets (int channel);
+
+/* Copies the counters of handoffs into stats. */
+void handoff_get_stats (struct handoff_stats *stats);
+
+#endif // HANDOFF_H
@@ -0,0 +1,287 @@
+/** @file
+
+    @brief  Hedge: per-origin latency histories and the budget that decides
+            when a slow fetch gets a second one.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "hedge.h"
+#include "config.h"
+#include <math.h>
+#include <pthread.h>
+
+/* Weight of the newest sample in the moving average. */
+#define EWMA_WEIGHT 0.125
+
+/* Every sample scales the older ones down by this much, so that a history
+ * follows an origin whose latency changes. */
+#define DECAY 0.98
+
+/* The latency history of an origin. Slots are picked by hash and a new
+ * origin takes over the slot of an old one. */
+struct history
+{
+  char name[128];
+  unsigned long samples;
+  double ewma_ms;
+  double weight;                // sum of the bucket counts
+  double buckets[HEDGE_BUCKETS];
+};
+
+static struct history histories[HEDGE_ORIGINS];
+static struct hedge_stats totals;
+static double tokens = HEDGE_MAX_TOKENS;
+static pthread_mutex_t hedge_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Finds the slot of an origin.
+ */
+static struct history *
+slot_of (const char *name)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  while (*name)
+    {
+      hash ^= (unsigned char) *name++;
+      hash *= 1099511628211ULL;
+    }
+  return &histories[hash % HEDGE_ORIGINS];
+} // slot_of
+
+/**
+ * @brief Finds the history of an origin. Called with the lock held.
+ *
+ * @return the history, or NULL if the origin is not known
+ */
+static struct history *
+find (const char *name)
+{
+  struct history *slot = slot_of (name);
+
+  if (slot->samples == 0
+      || strncmp (slot->name, name, sizeof (slot->name) - 1) != 0)
+    return NULL;
+  return slot;
+} // find
+
+/**
+ * @brief Returns the bucket a latency falls into: twice the base 2
+ *        logarithm of latency + 1, rounded down.
+ */
+static int
+bucket_of (long latency_ms)
+{
+  unsigned long long value = latency_ms > 0 ? latency_ms + 1 : 1;
+  int bucket, power = 63 - __builtin_clzll (value);
+
+  /* Halfway between two powers of two is at 2^power * sqrt(2). */
+  bucket = 2 * power + (value * value >= 2ULL << (2 * power));
+  return bucket < HEDGE_BUCKETS ? bucket : HEDGE_BUCKETS - 1;
+} // bucket_of
+
+/**
+ * @brief Returns the latency at which a bucket starts.
+ */
+static double
+bucket_start (int bucket)
+{
+  double start = (double) (1ULL << (bucket / 2));
+
+  return (bucket % 2 ? start * M_SQRT2 : start) - 1;
+} // bucket_start
+
+/**
+ * @brief Returns a quantile of a history, as the end of the bucket it falls
+ *        into. Called with the lock held.
+ */
+static long
+quantile (const struct history *history, int percent)
+{
+  double wanted = history->weight * percent / 100.0, seen = 0;
+  int bucket;
+
+  for (bucket = 0; bucket < HEDGE_BUCKETS - 1; bucket++)
+    {
+      seen += history->buckets[bucket];
+      if (seen >= wanted)
+        break;
+    }
+  return (long) bucket_start (bucket + 1) + 1;
+} // quantile
+
+/**
+ * @brief Estimates how long a fetch that was still running after a given
+ *        time would have taken, from the part of the history above it.
+ *        Called with the lock held.
+ *
+ * @return the estimate, or 0 if the history has nothing that slow
+ */
+static double
+expected_beyond (const struct history *history, long latency_ms)
+{
+  double weight = 0, total = 0, middle;
+  int bucket;
+
+  for (bucket = bucket_of (latency_ms) + 1; bucket < HEDGE_BUCKETS; bucket++)
+    {
+      middle = (bucket_start (bucket) + bucket_start (bucket + 1)) / 2;
+      weight += history->buckets[bucket];
+      total += history->buckets[bucket] * middle;
+    }
+  return weight > 0 ? total / weight : 0;
+} // expected_beyond
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Returns how long a fetch from an origin may run before a second
+ *        one is started: the hedge_quantile of its latency history.
+ *
+ * @return the delay in milliseconds, or 0 if the fetch must not be hedged
+ */
+long
+hedge_delay_ms (const char *origin)
+{
+  struct history *history;
+  long delay = 0;
+
+  if (tunables.hedge_budget_pct == 0)
+    return 0;
+
+  pthread_mutex_lock (&hedge_lock);
+  history = find (origin);
+  if (history != NULL
+      && history->samples >= (unsigned long) tunables.hedge_min_samples)
+    delay = quantile (history, tunables.hedge_quantile);
+  pthread_mutex_unlock (&hedge_lock);
+
+  return delay;
+} // hedge_delay_ms
+
+/**
+ * @brief Takes a hedge from the budget, which every recorded fetch adds
+ *        hedge_budget_pct percent of a hedge to.
+ *
+ * @return 1 if a hedge may start, 0 otherwise
+ */
+int
+hedge_start ()
+{
+  int allowed;
+
+  pthread_mutex_lock (&hedge_lock);
+  allowed = tokens >= 1;
+  if (allowed)
+    {
+      tokens -= 1;
+      totals.hedges++;
+    }
+  else
+    totals.denied++;
+  pthread_mutex_unlock (&hedge_lock);
+
+  return allowed;
+} // hedge_start
+
+/**
+ * @brief Records the latency of a completed fetch.
+ *
+ * @param origin      the origin fetched from
+ * @param latency_ms  time from the start of the first fetch to the end of
+ *                    the one that won
+ * @param hedge_won   whether a second fetch was started and finished first
+ */
+void
+hedge_observe (const char *origin, long latency_ms, int hedge_won)
+{
+  struct history *history;
+  double expected;
+  int bucket;
+
+  pthread_mutex_lock (&hedge_lock);
+  totals.fetches++;
+  tokens += tunables.hedge_budget_pct / 100.0;
+  if (tokens > HEDGE_MAX_TOKENS)
+    tokens = HEDGE_MAX_TOKENS;
+
+  history = find (origin);
+  if (history == NULL)
+    {
+      history = slot_of (origin);
+      memset (history, 0, sizeof (*history));
+      strncpy (history->name, origin, sizeof (history->name) - 1);
+    }
+
+  /* The first fetch was still running when the hedge won; its latency
+   * would have been what the history shows beyond that point. */
+  if (hedge_won)
+    {
+      totals.hedge_wins++;
+      expected = expected_beyond (history, latency_ms);
+      if (expected > latency_ms)
+        totals.saved_ms += (unsigned long long) (expected - latency_ms);
+    }
+
+  /* A hedge that won cut the first fetch short, so its latency is not one
+   * the origin showed. */
+  if (!hedge_won)
+    {
+      for (bucket = 0; bucket < HEDGE_BUCKETS; bucket++)
+        history->buckets[bucket] *= DECAY;
+      history->weight = history->weight * DECAY + 1;
+      history->buckets[bucket_of (latency_ms)] += 1;
+
+      if (history->samples == 0)
+        history->ewma_ms = latency_ms;
+      else
+        history->ewma_ms += EWMA_WEIGHT * (latency_ms - history->ewma_ms);
+      history->samples++;
+    }
+  pthread_mutex_unlock (&hedge_lock);
+} // hedge_observe
+
+/**
+ * @brief Copies the latency history of an origin.
+ *
+ * @return 1 if the origin is known, 0 otherwise
+ */
+int
+hedge_origin_stats (const char *origin, struct hedge_origin_stats *stats)
+{
+  struct history *history;
+
+  pthread_mutex_lock (&hedge_lock);
+  history = find (origin);
+  if (history != NULL)
+    {
+      stats->samples = history->samples;
+      stats->ewma_ms = (long) history->ewma_ms;
+      stats->quantile_ms = quantile (history, tunables.hedge_quantile);
+    }
+  pthread_mutex_unlock (&hedge_lock);
+
+  return history != NULL;
+} // hedge_origin_stats
+
+/**
+ * @brief Copies the counters of all hedged fetches.
+ */
+void
+hedge_get_stats (struct hedge_stats *stats)
+{
+  pthread_mutex_lock (&hedge_lock);
+  *stats = totals;
+  pthread_mutex_unlock (&hedge_lock);
+} // hedge_get_stats
@@ -0,0 +1,64 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for hedged fetches. The notary keeps
+ * a decaying latency histogram of the fetches from every origin. A fetch
+ * that takes longer than the origin's hedge_quantile gets a second one on a
+ * new connection, and the first to finish wins. A global budget caps hedges
+ * at hedge_budget_pct of all fetches.
+ ******************************************************************************/
+#ifndef HEDGE_H
+#define HEDGE_H
+
+#include "notary.h"
+
+/* Origins whose latency history is kept. */
+#define HEDGE_ORIGINS 1024
+
+/* Buckets of a latency histogram; bucket b starts at 2^(b/2) - 1 ms. */
+#define HEDGE_BUCKETS 40
+
+/* Most hedges the budget can save up for a burst. */
+#define HEDGE_MAX_TOKENS 10
+
+/* Counters of all hedged fetches. */
+struct hedge_stats
+{
+  unsigned long fetches;        // fetches whose latency was recorded
+  unsigned long hedges;         // second fetches started
+  unsigned long hedge_wins;     // of those, fetches the second one won
+  unsigned long denied;         // hedges the budget did not allow
+  unsigned long long saved_ms;  // estimated latency saved by hedge wins
+};
+
+/* The latency history of one origin. */
+struct hedge_origin_stats
+{
+  unsigned long samples;
+  long ewma_ms;                 // moving average of the latency
+  long quantile_ms;             // hedge_quantile of the latency
+};
+
+/* Returns how long a fetch from an origin may run before it is hedged, or
+ * 0 if it must not be: hedging is off or the origin has too little history.
+ */
+long hedge_delay_ms (const char *origin);
+
+/* Takes a hedge from the budget. Returns 1 if a hedge may start. */
+int hedge_start (void);
+
+/* Records the latency of a completed fetch from an origin, and whether a
+ * hedge was started for it and won.
+ */
+void hedge_observe (const char *origin, long latency_ms, int hedge_won);
+
+/* Copies the latency history of an origin into stats. Returns 1 if the
+ * origin is known, 0 otherwise.
+ */
+int hedge_origin_stats (const char *origin, struct hedge_origin_stats *stats);
+
+/* Copies the counters of all hedged fetches into stats. */
+void hedge_get_stats (struct hedge_stats *stats);
+
+#endif // HEDGE_H
@@ -0,0 +1,543 @@
+/** @file
+
+    @brief  History: the runs of chains every host showed, kept by hostkey
+            ID in chunks of fixed size slots, with the older runs of a host
+            in an array of their own.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "history.h"
+#include "hostkey.h"
+#include "certpool.h"
+#include "config.h"
+#include <pthread.h>
+
+/* Hosts whose slots are allocated together. */
+#define HISTORY_CHUNK 4096
+
+/* Locks over the slots, picked by host ID. */
+#define HISTORY_LOCKS 256
+
+/* The history of a host. Most hosts only ever show one chain, so the newest
+ * run is kept in the slot and only older runs take an allocation. */
+struct slot
+{
+  struct history_run newest;    // chain is CERTPOOL_NONE for no history
+  uint32_t num_older;
+  struct history_run *older;    // oldest first
+};
+
+static struct slot *chunks[HOSTKEY_MAX_IDS / HISTORY_CHUNK];
+static pthread_mutex_t locks[HISTORY_LOCKS] =
+  {[0 ... HISTORY_LOCKS - 1] = PTHREAD_MUTEX_INITIALIZER};
+static struct history_stats stats;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Returns the slot of a host, allocating its chunk if asked to.
+ *        Called with the lock of the host held.
+ *
+ * @return the slot, or NULL if there is none
+ */
+static struct slot *
+slot_of (uint32_t id, int allocate)
+{
+  struct slot *chunk, *fresh;
+
+  if (id == HOSTKEY_NONE || id >= HOSTKEY_MAX_IDS)
+    return NULL;
+
+  chunk = __atomic_load_n (&chunks[id / HISTORY_CHUNK], __ATOMIC_ACQUIRE);
+  if (chunk == NULL && allocate)
+    {
+      fresh = calloc (HISTORY_CHUNK, sizeof (struct slot));
+      if (fresh == NULL)
+        return NULL;
+      if (__atomic_compare_exchange_n (&chunks[id / HISTORY_CHUNK], &chunk,
+                                       fresh, 0, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_ACQUIRE))
+        {
+          chunk = fresh;
+          __atomic_add_fetch (&stats.bytes,
+                              HISTORY_CHUNK * sizeof (struct slot),
+                              __ATOMIC_RELAXED);
+        }
+      else
+        free (fresh);
+    }
+  if (chunk == NULL)
+    return NULL;
+  return &chunk[id % HISTORY_CHUNK];
+} // slot_of
+
+/**
+ * @brief Returns a run of a host, the oldest being 0 and the newest
+ *        num_older.
+ */
+static struct history_run *
+run_of (struct slot *slot, uint32_t i)
+{
+  return i < slot->num_older ? &slot->older[i] : &slot->newest;
+} // run_of
+
+/**
+ * @brief Moves the newest run of a host among its older runs to make way
+ *        for a new one, dropping the oldest runs beyond history_max_runs.
+ *        Called with the lock of the host held.
+ *
+ * @return 1 on success, 0 if out of memory
+ */
+static int
+push_newest (struct slot *slot)
+{
+  struct history_run *older;
+  uint32_t keep = tunables.history_max_runs - 1, dropped = 0;
+
+  if (keep == 0)
+    {
+      dropped = slot->num_older + 1;
+      __atomic_sub_fetch (&stats.bytes,
+                          slot->num_older * sizeof (struct history_run),
+                          __ATOMIC_RELAXED);
+      free (slot->older);
+      slot->older = NULL;
+      slot->num_older = 0;
+    }
+  else
+    {
+      if (slot->num_older >= keep)
+        {
+          dropped = slot->num_older - keep + 1;
+          memmove (slot->older, slot->older + dropped,
+                   (slot->num_older - dropped) * sizeof (struct history_run));
+          slot->num_older -= dropped;
+        }
+      else
+        {
+          older = realloc (slot->older, (slot->num_older + 1)
+                           * sizeof (struct history_run));
+          if (older == NULL)
+            return 0;
+          slot->older = older;
+          __atomic_add_fetch (&stats.bytes, sizeof (struct history_run),
+                              __ATOMIC_RELAXED);
+        }
+      slot->older[slot->num_older++] = slot->newest;
+    }
+
+  __atomic_add_fetch (&stats.trimmed, dropped, __ATOMIC_RELAXED);
+  __atomic_sub_fetch (&stats.runs, dropped, __ATOMIC_RELAXED);
+  return 1;
+} // push_newest
+
+/**
+ * @brief Puts a run among the older runs of a host, before the one at i,
+ *        dropping the oldest run if the host has history_max_runs already.
+ *        Called with the lock of the host held.
+ *
+ * @return 1 on success, 0 if the run would be the one dropped or out of
+ *         memory
+ */
+static int
+insert_older (struct slot *slot, uint32_t i, const struct history_run *run)
+{
+  struct history_run *older;
+  uint32_t keep = tunables.history_max_runs - 1;
+
+  if (slot->num_older >= keep)
+    {
+      if (i == 0)
+        return 0;
+      memmove (slot->older, slot->older + 1,
+               (i - 1) * sizeof (struct history_run));
+      slot->older[i - 1] = *run;
+      __atomic_add_fetch (&stats.trimmed, 1, __ATOMIC_RELAXED);
+      return 1;
+    }
+
+  older = realloc (slot->older,
+                   (slot->num_older + 1) * sizeof (struct history_run));
+  if (older == NULL)
+    return 0;
+  slot->older = older;
+  memmove (older + i + 1, older + i,
+           (slot->num_older - i) * sizeof (struct history_run));
+  older[i] = *run;
+  slot->num_older++;
+  __atomic_add_fetch (&stats.bytes, sizeof (struct history_run),
+                      __ATOMIC_RELAXED);
+  __atomic_add_fetch (&stats.runs, 1, __ATOMIC_RELAXED);
+  return 1;
+} // insert_older
+
+/**
+ * @brief Records that a host showed a chain. Runs stay ordered by time, and
+ *        a sighting older than the newest run, as from a scan, goes where
+ *        it belongs: it extends a run of the same chain next to it, starts
+ *        a run of its own between two others, or is dropped if a run of
+ *        another chain covers it. A run never starts before the one before
+ *        it ended. Called with the lock of the host held.
+ */
+static void
+record_run (uint32_t id, uint32_t chain, time_t start, time_t end)
+{
+  struct slot *slot = slot_of (id, 1);
+  struct history_run *run, *next, *previous, added;
+  uint32_t i;
+
+  if (slot == NULL)
+    return;
+  if (end < start)
+    end = start;
+
+  if (slot->newest.chain == CERTPOOL_NONE)
+    {
+      slot->newest.chain = chain;
+      slot->newest.first_seen = start;
+      slot->newest.last_seen = end;
+      __atomic_add_fetch (&stats.hosts, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch (&stats.runs, 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+  /* The sighting belongs after the runs 0 to i - 1, which started before
+   * it ended, and before run i. */
+  for (i = slot->num_older + 1;
+       i > 0 && run_of (slot, i - 1)->first_seen > (uint32_t) end; i--)
+    ;
+  run = i > 0 ? run_of (slot, i - 1) : NULL;
+  next = i <= slot->num_older ? run_of (slot, i) : NULL;
+  previous = i > 1 ? run_of (slot, i - 2) : NULL;
+
+  if (run != NULL && run->chain == chain)
+    {
+      if ((uint32_t) end > run->last_seen)
+        run->last_seen = end;
+      if ((uint32_t) start < run->first_seen)
+        run->first_seen = previous != NULL
+          && (uint32_t) start < previous->last_seen
+          ? previous->last_seen : start;
+      __atomic_add_fetch (&stats.extended, 1, __ATOMIC_RELAXED);
+    }
+  else if (next != NULL && next->chain == chain)
+    {
+      /* The next run of the chain started earlier than we knew. */
+      next->first_seen = run != NULL && (uint32_t) start < run->last_seen
+        ? run->last_seen : start;
+      __atomic_add_fetch (&stats.extended, 1, __ATOMIC_RELAXED);
+    }
+  else if (run != NULL && (uint32_t) end < run->last_seen)
+    {
+      /* Another chain was seen after this one, and is what the host
+       * showed then. */
+      __atomic_add_fetch (&stats.stale, 1, __ATOMIC_RELAXED);
+    }
+  else if (next == NULL)
+    {
+      if (!push_newest (slot))
+        return;
+      if ((uint32_t) start < slot->newest.last_seen)
+        start = slot->newest.last_seen;
+      slot->newest.chain = chain;
+      slot->newest.first_seen = start;
+      slot->newest.last_seen = end > start ? end : start;
+      __atomic_add_fetch (&stats.runs, 1, __ATOMIC_RELAXED);
+    }
+  else
+    {
+      added.chain = chain;
+      added.first_seen = run != NULL && (uint32_t) start < run->last_seen
+        ? run->last_seen : start;
+      added.last_seen = end;
+      if (!insert_older (slot, i, &added))
+        __atomic_add_fetch (&stats.stale, 1, __ATOMIC_RELAXED);
+    }
+} // record_run
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Records that a host showed a chain.
+ *
+ * @param id     the ID of the host
+ * @param chain  the ID of the chain it showed
+ * @param start  when the fetch started
+ * @param end    when the fetch finished
+ */
+void
+history_record (uint32_t id, uint32_t chain, time_t start, time_t end)
+{
+  pthread_mutex_t *lock = &locks[id % HISTORY_LOCKS];
+
+  if (chain == CERTPOOL_NONE)
+    return;
+
+  pthread_mutex_lock (lock);
+  record_run (id, chain, start, end);
+  pthread_mutex_unlock (lock);
+} // history_record
+
+/**
+ * @brief Records many sightings at once, taking each lock once for all the
+ *        sightings it covers. Sightings of a host are recorded in the order
+ *        given.
+ *
+ * @param sightings  the sightings
+ * @param count      their number
+ *
+ * @return 1 on success, 0 if out of memory
+ */
+int
+history_record_batch (const struct history_sighting *sightings, int count)
+{
+  int starts[HISTORY_LOCKS + 1] = {0};
+  int *order, i, l;
+
+  order = malloc (count * sizeof (int));
+  if (order == NULL)
+    return 0;
+
+  /* Sort the sightings by lock, keeping their order within a lock. */
+  for (i = 0; i < count; i++)
+    starts[sightings[i].id % HISTORY_LOCKS + 1]++;
+  for (l = 0; l < HISTORY_LOCKS; l++)
+    starts[l + 1] += starts[l];
+  for (i = 0; i < count; i++)
+    order[starts[sightings[i].id % HISTORY_LOCKS]++] = i;
+
+  /* starts[l] now holds where the sightings of lock l end. */
+  for (l = 0, i = 0; l < HISTORY_LOCKS; l++)
+    {
+      if (i == starts[l])
+        continue;
+      pthread_mutex_lock (&locks[l]);
+      for (; i < starts[l]; i++)
+        if (sightings[order[i]].chain != CERTPOOL_NONE)
+          record_run (sightings[order[i]].id, sightings[order[i]].chain,
+                      sightings[order[i]].start, sightings[order[i]].end);
+      pthread_mutex_unlock (&locks[l]);
+    }
+
+  free (order);
+  return 1;
+} // history_record_batch
+
+/**
+ * @brief Gives a host the runs it had before a restart, keeping the newest
+ *        history_max_runs. A host that was seen since the restart keeps
+ *        what it showed then, with the restored runs put before it as
+ *        sightings of their own would be.
+ *
+ * @param id     the ID of the host
+ * @param runs   its runs, oldest first
+ * @param count  their number
+ *
+ * @return 1 if the runs were restored, 0 if out of memory
+ */
+int
+history_restore (uint32_t id, const struct history_run *runs, int count)
+{
+  pthread_mutex_t *lock = &locks[id % HISTORY_LOCKS];
+  struct history_run *older = NULL;
+  struct slot *slot;
+  int restored = 0, i;
+
+  if (count > tunables.history_max_runs)
+    {
+      runs += count - tunables.history_max_runs;
+      count = tunables.history_max_runs;
+    }
+  if (count <= 0)
+    return 0;
+
+  if (count > 1
+      && (older = malloc ((count - 1) * sizeof (struct history_run))) == NULL)
+    return 0;
+
+  pthread_mutex_lock (lock);
+  slot = slot_of (id, 1);
+  if (slot != NULL && slot->newest.chain == CERTPOOL_NONE)
+    {
+      if (older != NULL)
+        memcpy (older, runs, (count - 1) * sizeof (struct history_run));
+      slot->older = older;
+      slot->num_older = count - 1;
+      slot->newest = runs[count - 1];
+      older = NULL;
+      restored = 1;
+      __atomic_add_fetch (&stats.hosts, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch (&stats.runs, count, __ATOMIC_RELAXED);
+      __atomic_add_fetch (&stats.bytes,
+                          (count - 1) * sizeof (struct history_run),
+                          __ATOMIC_RELAXED);
+    }
+  else if (slot != NULL)
+    {
+      /* Newest first, so that every run goes before the ones merged
+       * already rather than extending a run of its chain past them. */
+      for (i = count - 1; i >= 0; i--)
+        record_run (id, runs[i].chain, runs[i].first_seen,
+                    runs[i].last_seen);
+      restored = 1;
+    }
+  pthread_mutex_unlock (lock);
+
+  free (older);
+  return restored;
+} // history_restore
+
+/**
+ * @brief Copies the newest run of a host.
+ *
+ * @param id   the ID of the host
+ * @param run  output parameter for the run
+ *
+ * @return 1 if the host has a history, 0 otherwise
+ */
+int
+history_latest (uint32_t id, struct history_run *run)
+{
+  pthread_mutex_t *lock = &locks[id % HISTORY_LOCKS];
+  struct slot *slot;
+  int found = 0;
+
+  pthread_mutex_lock (lock);
+  slot = slot_of (id, 0);
+  if (slot != NULL && slot->newest.chain != CERTPOOL_NONE)
+    {
+      *run = slot->newest;
+      found = 1;
+    }
+  pthread_mutex_unlock (lock);
+
+  return found;
+} // history_latest
+
+/**
+ * @brief Finds the run of a host that covers a time, by binary search over
+ *        its runs.
+ *
+ * @param id    the ID of the host
+ * @param when  the time
+ * @param run   output parameter for the run
+ *
+ * @return 1 if a run covers the time, 0 otherwise
+ */
+int
+history_at (uint32_t id, time_t when, struct history_run *run)
+{
+  pthread_mutex_t *lock = &locks[id % HISTORY_LOCKS];
+  struct slot *slot;
+  uint32_t low = 0, high, middle;
+  int found = 0;
+
+  pthread_mutex_lock (lock);
+  slot = slot_of (id, 0);
+  if (slot != NULL && slot->newest.chain != CERTPOOL_NONE
+      && when >= run_of (slot, 0)->first_seen)
+    {
+      /* The last run that started no later than the time. */
+      high = slot->num_older;
+      while (low < high)
+        {
+          middle = low + (high - low + 1) / 2;
+          if (run_of (slot, middle)->first_seen <= when)
+            low = middle;
+          else
+            high = middle - 1;
+        }
+      if (when <= run_of (slot, low)->last_seen)
+        {
+          *run = *run_of (slot, low);
+          found = 1;
+        }
+    }
+  pthread_mutex_unlock (lock);
+
+  return found;
+} // history_at
+
+/**
+ * @brief Copies the newest runs of a host, oldest first.
+ *
+ * @param id    the ID of the host
+ * @param runs  output array for the runs
+ * @param max   size of the output array
+ *
+ * @return the number of runs copied
+ */
+int
+history_copy (uint32_t id, struct history_run *runs, int max)
+{
+  pthread_mutex_t *lock = &locks[id % HISTORY_LOCKS];
+  struct slot *slot;
+  uint32_t count = 0, first, i;
+
+  pthread_mutex_lock (lock);
+  slot = slot_of (id, 0);
+  if (slot != NULL && slot->newest.chain != CERTPOOL_NONE && max > 0)
+    {
+      count = slot->num_older + 1;
+      if (count > (uint32_t) max)
+        count = max;
+      first = slot->num_older + 1 - count;
+      for (i = 0; i < count; i++)
+        runs[i] = *run_of (slot, first + i);
+    }
+  pthread_mutex_unlock (lock);
+
+  return count;
+} // history_copy
+
+/**
+ * @brief Forgets every history. The counters other than hosts, runs and
+ *        bytes are kept.
+ */
+void
+history_clear ()
+{
+  struct slot *chunk;
+  size_t c, i;
+  int l;
+
+  for (l = 0; l < HISTORY_LOCKS; l++)
+    pthread_mutex_lock (&locks[l]);
+
+  for (c = 0; c < HOSTKEY_MAX_IDS / HISTORY_CHUNK; c++)
+    {
+      chunk = __atomic_exchange_n (&chunks[c], NULL, __ATOMIC_ACQ_REL);
+      if (chunk == NULL)
+        continue;
+      for (i = 0; i < HISTORY_CHUNK; i++)
+        free (chunk[i].older);
+      free (chunk);
+    }
+  stats.hosts = stats.runs = stats.bytes = 0;
+
+  for (l = HISTORY_LOCKS - 1; l >= 0; l--)
+    pthread_mutex_unlock (&locks[l]);
+} // history_clear
+
+/**
+ * @brief Copies the counters of the history.
+ */
+void
+history_get_stats (struct history_stats *stats_out)
+{
+  stats_out->hosts = __atomic_load_n (&stats.hosts, __ATOMIC_RELAXED);
+  stats_out->runs = __atomic_load_n (&stats.runs, __ATOMIC_RELAXED);
+  stats_out->extended = __atomic_load_n (&stats.extended, __ATOMIC_RELAXED);
+  stats_out->trimmed = __atomic_load_n (&stats.trimmed, __ATOMIC_RELAXED);
+  stats_out->stale = __atomic_load_n (&stats.stale, __ATOMIC_RELAXED);
+  stats_out->bytes = __atomic_load_n (&stats.bytes, __ATOMIC_RELAXED);
+} // history_get_stats
@@ -0,0 +1,92 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the observation history, which
+ * keeps for every host the runs of chains the notary saw it show: the chain
+ * and when it was first and last seen. Seeing the same chain again only
+ * extends its run; a sighting older than the newest run, as from a scan, is
+ * put where it belongs in time. Histories are kept by hostkey ID for every
+ * host, not only those in the observation cache, in 24 bytes for a host
+ * with one run and 12 for every further run; at most history_max_runs are
+ * kept, the oldest being dropped first. Runs are ordered by time, so the run in effect
+ * at a given time is found by binary search.
+ ******************************************************************************/
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "notary.h"
+#include <time.h>
+
+/* A chain seen continuously from first_seen to last_seen. Times are in
+ * seconds since the epoch. */
+struct history_run
+{
+  uint32_t chain;               // the chain, interned by certpool
+  uint32_t first_seen;
+  uint32_t last_seen;
+};
+
+/* A host, given by its hostkey ID, seen showing a chain. */
+struct history_sighting
+{
+  uint32_t id;
+  uint32_t chain;
+  time_t start;
+  time_t end;
+};
+
+/* Counters of the history. */
+struct history_stats
+{
+  unsigned long hosts;          // hosts with a history
+  unsigned long runs;           // runs kept, over all hosts
+  unsigned long extended;       // observations that only extended a run
+  unsigned long trimmed;        // runs dropped beyond history_max_runs
+  unsigned long stale;          // old sightings a later run contradicts
+  unsigned long bytes;          // memory held by the history
+};
+
+/* Records that a host, given by its hostkey ID, showed a chain between
+ * start and end. The same chain as in the run in effect then extends it;
+ * another one starts a new run, or is dropped if it is older than the end
+ * of the run of another chain in effect then.
+ */
+void history_record (uint32_t id, uint32_t chain, time_t start, time_t end);
+
+/* Records many sightings as history_record would, taking every lock once
+ * for the whole batch. Returns 1 on success, 0 if out of memory.
+ */
+int history_record_batch (const struct history_sighting *sightings,
+                          int count);
+
+/* Gives a host count runs, oldest first, as saved before a restart. Runs
+ * of a host seen since are merged in by time, as sightings would be.
+ * Returns 1 if they were restored, 0 if memory ran out.
+ */
+int history_restore (uint32_t id, const struct history_run *runs,
+                     int count);
+
+/* Copies the newest run of a host into run. Returns 1 if the host has a
+ * history, 0 otherwise.
+ */
+int history_latest (uint32_t id, struct history_run *run);
+
+/* Copies the run of a host that covers the time when into run. Returns 1
+ * if one does, 0 if the host was not observed at that time as far as the
+ * history knows.
+ */
+int history_at (uint32_t id, time_t when, struct history_run *run);
+
+/* Copies up to max runs of a host into runs, oldest first, ending with the
+ * newest. Returns the number of runs copied.
+ */
+int history_copy (uint32_t id, struct history_run *runs, int max);
+
+/* Forgets every history. */
+void history_clear (void);
+
+/* Copies the counters of the history into stats. */
+void history_get_stats (struct history_stats *stats);
+
+#endif // HISTORY_H
@@ -0,0 +1,344 @@
+/** @file
+
+    @brief  Hitters: finds the hosts that dominate the traffic with a
+            count-min sketch and a top-K table of fixed size.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "hitters.h"
+#include "config.h"
+#include "hostkey.h"
+#include <pthread.h>
+
+/* The sketch is updated with atomic additions and needs no lock. */
+static uint32_t sketch[HITTERS_DEPTH][HITTERS_WIDTH];
+static unsigned long updates = 0;
+static unsigned long threshold = HITTERS_MIN_COUNT;
+
+/* The top-K table. */
+static struct hitter table[HITTERS_TOP];
+static int table_size = 0;
+static struct hitters_stats stats;
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Hashes a host ID with the finalizer of SplitMix64, so that hosts
+ *        interned one after the other land far apart in the sketch.
+ */
+static uint64_t
+hash_id (uint32_t id)
+{
+  uint64_t hash = id;
+
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+} // hash_id
+
+/**
+ * @brief Returns the counter of a host in a row of the sketch. The rows use
+ *        double hashing, so one hash serves them all.
+ */
+static uint32_t *
+counter_of (uint64_t hash, int row)
+{
+  uint64_t step = (hash >> 32) | 1;
+
+  return &sketch[row][(hash + row * step) & (HITTERS_WIDTH - 1)];
+} // counter_of
+
+/**
+ * @brief Finds a host in the top-K table. Called with the table locked.
+ *
+ * @return its index, or -1 if it is not in the table
+ */
+static int
+find (uint32_t id)
+{
+  int i;
+
+  for (i = 0; i < table_size; i++)
+    if (table[i].id == id)
+      return i;
+  return -1;
+} // find
+
+/**
+ * @brief Sets the estimate a host needs to enter the table: the smallest
+ *        count in it once it is full. Called with the table locked.
+ */
+static void
+update_threshold ()
+{
+  unsigned long minimum = HITTERS_MIN_COUNT;
+  int i;
+
+  if (table_size == HITTERS_TOP)
+    {
+      minimum = table[0].count;
+      for (i = 1; i < table_size; i++)
+        if (table[i].count < minimum)
+          minimum = table[i].count;
+      if (minimum < HITTERS_MIN_COUNT)
+        minimum = HITTERS_MIN_COUNT;
+    }
+  __atomic_store_n (&threshold, minimum, __ATOMIC_RELAXED);
+  stats.tracked = table_size;
+  stats.threshold = minimum;
+} // update_threshold
+
+/**
+ * @brief Puts the estimate of a host into the table, taking the place of
+ *        the host with the smallest count if the table is full and the
+ *        estimate is larger. Called with the table locked.
+ */
+static void
+update_table (uint32_t id, unsigned long estimate)
+{
+  int i, slot = find (id);
+
+  if (slot < 0 && table_size < HITTERS_TOP)
+    slot = table_size++;
+  else if (slot < 0)
+    {
+      slot = 0;
+      for (i = 1; i < table_size; i++)
+        if (table[i].count < table[slot].count)
+          slot = i;
+      if (table[slot].count >= estimate)
+        return;
+      stats.replacements++;
+    }
+
+  table[slot].id = id;
+  table[slot].count = estimate;
+  update_threshold ();
+} // update_table
+
+/**
+ * @brief Halves every count, so that hosts that are no longer requested
+ *        make way for new ones. Hosts whose count falls below
+ *        HITTERS_MIN_COUNT leave the table.
+ */
+static void
+halve ()
+{
+  uint32_t value;
+  int row, column, i;
+
+  /* An addition racing with this may be lost, which a sketch tolerates. */
+  for (row = 0; row < HITTERS_DEPTH; row++)
+    for (column = 0; column < HITTERS_WIDTH; column++)
+      {
+        value = __atomic_load_n (&sketch[row][column], __ATOMIC_RELAXED);
+        __atomic_store_n (&sketch[row][column], value / 2, __ATOMIC_RELAXED);
+      }
+
+  pthread_mutex_lock (&table_lock);
+  for (i = 0; i < table_size; i++)
+    {
+      table[i].count /= 2;
+      if (table[i].count < HITTERS_MIN_COUNT)
+        {
+          table[i] = table[table_size - 1];
+          table_size--;
+          i--;
+        }
+    }
+  stats.halvings++;
+  update_threshold ();
+  pthread_mutex_unlock (&table_lock);
+} // halve
+
+/**
+ * @brief Orders hitters by count, largest first.
+ */
+static int
+compare_hitters (const void *a, const void *b)
+{
+  const struct hitter *first = a, *second = b;
+
+  if (first->count != second->count)
+    return first->count < second->count ? 1 : -1;
+  return first->id < second->id ? -1 : first->id > second->id;
+} // compare_hitters
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Counts a request about a host. Only hosts whose estimate reaches
+ *        the threshold of the table touch its lock, and then only if it is
+ *        free.
+ *
+ * @param id  the ID of the host
+ */
+void
+hitters_record (uint32_t id)
+{
+  uint64_t hash = hash_id (id);
+  unsigned long estimate = ULONG_MAX, value, count;
+  int row;
+
+  for (row = 0; row < HITTERS_DEPTH; row++)
+    {
+      value = __atomic_add_fetch (counter_of (hash, row), 1, __ATOMIC_RELAXED);
+      if (value < estimate)
+        estimate = value;
+    }
+
+  count = __atomic_add_fetch (&updates, 1, __ATOMIC_RELAXED);
+  if (count % tunables.hitters_window == 0)
+    halve ();
+
+  if (estimate < __atomic_load_n (&threshold, __ATOMIC_RELAXED))
+    return;
+
+  if (pthread_mutex_trylock (&table_lock) != 0)
+    {
+      __atomic_add_fetch (&stats.skipped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  update_table (id, estimate);
+  pthread_mutex_unlock (&table_lock);
+} // hitters_record
+
+/**
+ * @brief Estimates the requests about a host in the current window.
+ *
+ * @param id  the ID of the host
+ *
+ * @return the smallest of its counters in the sketch
+ */
+unsigned long
+hitters_estimate (uint32_t id)
+{
+  uint64_t hash = hash_id (id);
+  unsigned long estimate = ULONG_MAX, value;
+  int row;
+
+  for (row = 0; row < HITTERS_DEPTH; row++)
+    {
+      value = __atomic_load_n (counter_of (hash, row), __ATOMIC_RELAXED);
+      if (value < estimate)
+        estimate = value;
+    }
+  return estimate;
+} // hitters_estimate
+
+/**
+ * @brief Checks whether a host is in the top-K table.
+ *
+ * @return 1 if it is, 0 otherwise
+ */
+int
+hitters_is_heavy (uint32_t id)
+{
+  int heavy;
+
+  pthread_mutex_lock (&table_lock);
+  heavy = find (id) >= 0;
+  pthread_mutex_unlock (&table_lock);
+
+  return heavy;
+} // hitters_is_heavy
+
+/**
+ * @brief Copies the top-K table, most requested host first.
+ *
+ * @param top  output array for the hosts
+ * @param max  size of the output array
+ *
+ * @return the number of hosts copied
+ */
+int
+hitters_top (struct hitter *top, int max)
+{
+  struct hitter sorted[HITTERS_TOP];
+  int count;
+
+  pthread_mutex_lock (&table_lock);
+  count = table_size;
+  memcpy (sorted, table, count * sizeof (struct hitter));
+  pthread_mutex_unlock (&table_lock);
+
+  qsort (sorted, count, sizeof (struct hitter), compare_hitters);
+  if (count > max)
+    count = max;
+  memcpy (top, sorted, count * sizeof (struct hitter));
+  return count;
+} // hitters_top
+
+/**
+ * @brief Formats the top-K table as lines of estimated requests and host,
+ *        most requested first.
+ *
+ * @return a newly allocated string, or NULL on failure
+ */
+char *
+hitters_format ()
+{
+  struct hitter *top;
+  char *text = NULL;
+  size_t length;
+  FILE *stream;
+  int count, i;
+
+  top = malloc (HITTERS_TOP * sizeof (struct hitter));
+  if (top == NULL)
+    return NULL;
+  count = hitters_top (top, HITTERS_TOP);
+
+  stream = open_memstream (&text, &length);
+  if (stream != NULL)
+    {
+      fprintf (stream, "# requests host:port, over about the last %d "
+               "requests\n", tunables.hitters_window);
+      for (i = 0; i < count; i++)
+        fprintf (stream, "%lu %s\n", top[i].count,
+                 hostkey_name (top[i].id));
+      if (fclose (stream) != 0)
+        {
+          free (text);
+          text = NULL;
+        }
+    }
+
+  free (top);
+  return text;
+} // hitters_format
+
+/**
+ * @brief Forgets every count.
+ */
+void
+hitters_clear ()
+{
+  pthread_mutex_lock (&table_lock);
+  memset (sketch, 0, sizeof (sketch));
+  table_size = 0;
+  update_threshold ();
+  pthread_mutex_unlock (&table_lock);
+} // hitters_clear
+
+/**
+ * @brief Copies the counters of the tracker.
+ */
+void
+hitters_get_stats (struct hitters_stats *stats_out)
+{
+  pthread_mutex_lock (&table_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&table_lock);
+  stats_out->updates = __atomic_load_n (&updates, __ATOMIC_RELAXED);
+} // hitters_get_stats
@@ -0,0 +1,74 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for heavy-hitter tracking. Every
+ * verification request counts its host in a count-min sketch, and the hosts
+ * with the highest estimates are kept in a small top-K table. Both are fixed
+ * in size however many hosts are seen, and counts are halved every
+ * hitters_window requests so that the table follows current traffic.
+ ******************************************************************************/
+#ifndef HITTERS_H
+#define HITTERS_H
+
+#include "notary.h"
+
+/* Rows and counters per row of the count-min sketch. */
+#define HITTERS_DEPTH 4
+#define HITTERS_WIDTH 4096
+
+/* Hosts kept in the top-K table. */
+#define HITTERS_TOP 64
+
+/* Requests a host needs in the current window to count as a heavy hitter. */
+#define HITTERS_MIN_COUNT 8
+
+/* A host of the top-K table with its estimated number of requests. */
+struct hitter
+{
+  uint32_t id;                  // the host, interned by hostkey
+  unsigned long count;
+};
+
+/* Counters of the heavy-hitter tracker. */
+struct hitters_stats
+{
+  unsigned long updates;        // requests counted
+  unsigned long halvings;       // times all counts were halved
+  unsigned long replacements;   // hosts that took another's place in the table
+  unsigned long skipped;        // table updates skipped under contention
+  unsigned long tracked;        // hosts in the table
+  unsigned long threshold;      // estimate a host needs to enter the table
+};
+
+/* Counts a request about a host, given by its hostkey ID. Never blocks: when the
+ * table is busy, the update of the table is skipped and left to the next
+ * request about the host.
+ */
+void hitters_record (uint32_t id);
+
+/* Returns the estimated number of requests about a host in the current
+ * window. The estimate is never below the true count.
+ */
+unsigned long hitters_estimate (uint32_t id);
+
+/* Returns 1 if a host is among the heavy hitters, 0 otherwise. */
+int hitters_is_heavy (uint32_t id);
+
+/* Copies up to max hosts of the top-K table into top, most requested
+ * first, and returns how many were copied.
+ */
+int hitters_top (struct hitter *top, int max);
+
+/* Formats the top-K table for /admin/hitters. Returns a newly allocated
+ * string, or NULL on failure.
+ */
+char *hitters_format (void);
+
+/* Forgets every count. */
+void hitters_clear (void);
+
+/* Copies the counters of the tracker into stats. */
+void hitters_get_stats (struct hitters_stats *stats);
+
+#endif // HITTERS_H
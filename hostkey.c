@@ -0,0 +1,400 @@
+/** @file
+
+    @brief  Hostkey: canonical host:port keys, interned into integer IDs by
+            a table split into shards with a lock each.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "hostkey.h"
+#include "config.h"
+#include <pthread.h>
+#include <idn2.h>
+
+/* Shards of the intern table, each with its own lock and buckets. */
+#define HOSTKEY_SHARDS 64
+
+/* IDs whose names are allocated together. */
+#define HOSTKEY_CHUNK 4096
+
+/* An interned key, chained into the buckets of its shard. */
+struct interned
+{
+  uint32_t id;
+  uint64_t hash;
+  struct interned *next_in_bucket;
+  char name[];
+};
+
+struct shard
+{
+  pthread_mutex_t lock;
+  struct interned **buckets;
+  size_t num_buckets;
+  size_t count;
+};
+
+static struct shard shards[HOSTKEY_SHARDS] =
+  {[0 ... HOSTKEY_SHARDS - 1] = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0}};
+
+/* The names of the IDs, in chunks allocated as IDs are handed out. Readers
+ * take no lock: a chunk and its names are published before their IDs. */
+static const char **chunks[HOSTKEY_MAX_IDS / HOSTKEY_CHUNK];
+static uint32_t last_id = 0;
+static unsigned long invalid = 0;
+static unsigned long full = 0;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Hashes a key with 64-bit FNV-1a.
+ */
+static uint64_t
+hash_key (const char *key)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  while (*key)
+    {
+      hash ^= (unsigned char) *key++;
+      hash *= 1099511628211ULL;
+    }
+  return hash;
+} // hash_key
+
+/**
+ * @brief Checks that a lower-case host name is made of labels of letters,
+ *        digits, hyphens and underscores, none longer than 63 characters or
+ *        starting or ending with a hyphen. Addresses in brackets were
+ *        checked by curl.
+ *
+ * @return 1 if it is valid, 0 otherwise
+ */
+static int
+valid_host (const char *name)
+{
+  size_t label = 0, length = strlen (name);
+  const char *c;
+
+  if (length == 0 || length > 253)
+    return 0;
+  if (name[0] == '[')
+    return name[length - 1] == ']';
+
+  for (c = name; ; c++)
+    {
+      if (*c == '.' || *c == '\0')
+        {
+          if (label == 0 || label > 63 || c[-1] == '-')
+            return 0;
+          if (*c == '\0')
+            return 1;
+          label = 0;
+          continue;
+        }
+      if (!(islower ((unsigned char) *c) || isdigit ((unsigned char) *c)
+            || *c == '-' || *c == '_')
+          || (label == 0 && *c == '-'))
+        return 0;
+      label++;
+    }
+} // valid_host
+
+/**
+ * @brief Converts a host name with characters outside ASCII to punycode,
+ *        trying the transitional mapping of UTS #46 if the name is not
+ *        valid without it, as curl does.
+ *
+ * @return the newly allocated ASCII name, or NULL if it is invalid
+ */
+static char *
+to_ascii (const char *name)
+{
+  char *ascii = NULL;
+
+  if (idn2_to_ascii_8z (name, &ascii, IDN2_NFC_INPUT | IDN2_NONTRANSITIONAL)
+      != IDN2_OK
+      && idn2_to_ascii_8z (name, &ascii, IDN2_NFC_INPUT | IDN2_TRANSITIONAL)
+         != IDN2_OK)
+    return NULL;
+  return ascii;
+} // to_ascii
+
+/**
+ * @brief Finds a key in a shard. Called with the shard locked.
+ */
+static struct interned *
+find_in (struct shard *shard, const char *key, uint64_t hash)
+{
+  struct interned *entry;
+
+  if (shard->buckets == NULL)
+    return NULL;
+
+  for (entry = shard->buckets[hash & (shard->num_buckets - 1)]; entry != NULL;
+       entry = entry->next_in_bucket)
+    if (entry->hash == hash && strcmp (entry->name, key) == 0)
+      return entry;
+  return NULL;
+} // find_in
+
+/**
+ * @brief Doubles the buckets of a shard once it holds a key per bucket.
+ *        Called with the shard locked.
+ *
+ * @return 1 if the shard has room for another key, 0 otherwise
+ */
+static int
+grow (struct shard *shard)
+{
+  struct interned **buckets, *entry, *next;
+  size_t wanted, i;
+
+  if (shard->count < shard->num_buckets)
+    return 1;
+
+  wanted = shard->num_buckets ? 2 * shard->num_buckets : 256;
+  buckets = calloc (wanted, sizeof (struct interned *));
+  if (buckets == NULL)
+    return shard->buckets != NULL;
+
+  for (i = 0; i < shard->num_buckets; i++)
+    for (entry = shard->buckets[i]; entry != NULL; entry = next)
+      {
+        next = entry->next_in_bucket;
+        entry->next_in_bucket = buckets[entry->hash & (wanted - 1)];
+        buckets[entry->hash & (wanted - 1)] = entry;
+      }
+
+  free (shard->buckets);
+  shard->buckets = buckets;
+  shard->num_buckets = wanted;
+  return 1;
+} // grow
+
+/**
+ * @brief Hands out the next ID and publishes its name. Called with the shard
+ *        of the name locked.
+ *
+ * @return the ID, or HOSTKEY_NONE if no more IDs may be handed out
+ */
+static uint32_t
+next_id (const char *name)
+{
+  const char **chunk, **fresh;
+  uint32_t id = __atomic_load_n (&last_id, __ATOMIC_RELAXED);
+  uint32_t limit = tunables.hostkey_max_ids;
+
+  if (limit >= HOSTKEY_MAX_IDS)
+    limit = HOSTKEY_MAX_IDS - 1;
+
+  do
+    if (id >= limit)
+      return HOSTKEY_NONE;
+  while (!__atomic_compare_exchange_n (&last_id, &id, id + 1, 0,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  id++;
+
+  chunk = __atomic_load_n (&chunks[id / HOSTKEY_CHUNK], __ATOMIC_ACQUIRE);
+  if (chunk == NULL)
+    {
+      fresh = calloc (HOSTKEY_CHUNK, sizeof (char *));
+      if (fresh == NULL)
+        return HOSTKEY_NONE;    // the ID is lost, which is harmless
+      if (__atomic_compare_exchange_n (&chunks[id / HOSTKEY_CHUNK], &chunk,
+                                       fresh, 0, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_ACQUIRE))
+        chunk = fresh;
+      else
+        free (fresh);
+    }
+  __atomic_store_n (&chunk[id % HOSTKEY_CHUNK], name, __ATOMIC_RELEASE);
+  return id;
+} // next_id
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Writes the canonical key of a host. The URL is parsed by curl, and
+ *        an international name is converted to punycode by libidn2.
+ *
+ * @param url         the host as the client sent it
+ * @param port        the port the client asked for, or 0 for that of the URL
+ * @param key         output buffer for the key
+ * @param key_length  size of the output buffer
+ *
+ * @return 1 on success, 0 if the host is invalid or the key does not fit
+ */
+int
+hostkey_canonicalize (const char *url, long port, char *key,
+                      size_t key_length)
+{
+  CURLU *parsed;
+  char *name = NULL, *port_text = NULL, *ascii = NULL, *canonical;
+  int valid = 0, international = 0, length;
+  size_t i;
+
+  parsed = curl_url ();
+  if (url != NULL && parsed != NULL
+      && !curl_url_set (parsed, CURLUPART_URL, url,
+                        CURLU_DEFAULT_SCHEME | CURLU_NON_SUPPORT_SCHEME)
+      && !curl_url_get (parsed, CURLUPART_HOST, &name, 0)
+      && !curl_url_get (parsed, CURLUPART_PORT, &port_text,
+                        CURLU_DEFAULT_PORT))
+    {
+      if (port <= 0)
+        port = atol (port_text);
+
+      for (i = 0; name[i] != '\0'; i++)
+        {
+          name[i] = tolower ((unsigned char) name[i]);
+          international |= (unsigned char) name[i] >= 0x80;
+        }
+      if (i > 1 && name[i - 1] == '.')
+        name[i - 1] = '\0';
+
+      canonical = name;
+      if (international)
+        canonical = ascii = to_ascii (name);
+
+      if (canonical != NULL && port > 0 && port <= 65535
+          && valid_host (canonical))
+        {
+          length = snprintf (key, key_length, "%s:%ld", canonical, port);
+          valid = length > 0 && (size_t) length < key_length;
+        }
+    }
+
+  idn2_free (ascii);
+  curl_free (name);
+  curl_free (port_text);
+  curl_url_cleanup (parsed);
+
+  if (!valid)
+    __atomic_add_fetch (&invalid, 1, __ATOMIC_RELAXED);
+  return valid;
+} // hostkey_canonicalize
+
+/**
+ * @brief Returns the ID of a canonical key, giving it one if needed.
+ *
+ * @param key  the canonical key
+ *
+ * @return the ID, or HOSTKEY_NONE if the table is full
+ */
+uint32_t
+hostkey_intern (const char *key)
+{
+  uint64_t hash = hash_key (key);
+  struct shard *shard = &shards[(hash >> 32) % HOSTKEY_SHARDS];
+  struct interned *entry;
+  uint32_t id = HOSTKEY_NONE;
+
+  pthread_mutex_lock (&shard->lock);
+  entry = find_in (shard, key, hash);
+  if (entry != NULL)
+    id = entry->id;
+  else if (grow (shard)
+           && (entry = malloc (sizeof (*entry) + strlen (key) + 1)) != NULL)
+    {
+      strcpy (entry->name, key);
+      entry->hash = hash;
+      entry->id = next_id (entry->name);
+      if (entry->id == HOSTKEY_NONE)
+        free (entry);
+      else
+        {
+          id = entry->id;
+          entry->next_in_bucket =
+            shard->buckets[hash & (shard->num_buckets - 1)];
+          shard->buckets[hash & (shard->num_buckets - 1)] = entry;
+          shard->count++;
+        }
+    }
+  pthread_mutex_unlock (&shard->lock);
+
+  if (id == HOSTKEY_NONE)
+    __atomic_add_fetch (&full, 1, __ATOMIC_RELAXED);
+  return id;
+} // hostkey_intern
+
+/**
+ * @brief Returns the ID of a canonical key without giving it one.
+ *
+ * @param key  the canonical key
+ *
+ * @return the ID, or HOSTKEY_NONE if the key has none
+ */
+uint32_t
+hostkey_find (const char *key)
+{
+  uint64_t hash = hash_key (key);
+  struct shard *shard = &shards[(hash >> 32) % HOSTKEY_SHARDS];
+  struct interned *entry;
+  uint32_t id;
+
+  pthread_mutex_lock (&shard->lock);
+  entry = find_in (shard, key, hash);
+  id = entry != NULL ? entry->id : HOSTKEY_NONE;
+  pthread_mutex_unlock (&shard->lock);
+
+  return id;
+} // hostkey_find
+
+/**
+ * @brief Canonicalizes and interns the host a client asks about.
+ *
+ * @param host_to_verify  the host
+ *
+ * @return its ID, or HOSTKEY_NONE
+ */
+uint32_t
+hostkey_of (host *host_to_verify)
+{
+  char key[HOSTKEY_LENGTH];
+
+  if (!hostkey_canonicalize (host_to_verify->url, host_to_verify->port, key,
+                             sizeof (key)))
+    return HOSTKEY_NONE;
+  return hostkey_intern (key);
+} // hostkey_of
+
+/**
+ * @brief Returns the canonical key of an ID.
+ *
+ * @param id  the ID
+ *
+ * @return the key, or NULL if the ID was never handed out
+ */
+const char *
+hostkey_name (uint32_t id)
+{
+  const char **chunk;
+
+  if (id == HOSTKEY_NONE || id >= HOSTKEY_MAX_IDS)
+    return NULL;
+
+  chunk = __atomic_load_n (&chunks[id / HOSTKEY_CHUNK], __ATOMIC_ACQUIRE);
+  if (chunk == NULL)
+    return NULL;
+  return __atomic_load_n (&chunk[id % HOSTKEY_CHUNK], __ATOMIC_ACQUIRE);
+} // hostkey_name
+
+/**
+ * @brief Copies the counters of the intern table.
+ */
+void
+hostkey_get_stats (struct hostkey_stats *stats_out)
+{
+  stats_out->interned = __atomic_load_n (&last_id, __ATOMIC_RELAXED);
+  stats_out->invalid = __atomic_load_n (&invalid, __ATOMIC_RELAXED);
+  stats_out->full = __atomic_load_n (&full, __ATOMIC_RELAXED);
+} // hostkey_get_stats
@@ -0,0 +1,66 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for host keys. The host a client asks
+ * about is brought into one canonical form, host:port with the host in lower
+ * case and in punycode and without scheme, path or trailing dot, so that
+ * every way of writing it finds the same cached state. Canonical keys are
+ * then interned into small integer IDs, which key the in-memory caches. A
+ * host gets an ID once it was observed, or when it comes from a warm-up
+ * list, an ingested scan or a snapshot, never just for being asked about.
+ * IDs are never reused while the notary runs; at most hostkey_max_ids hosts
+ * get one.
+ ******************************************************************************/
+#ifndef HOSTKEY_H
+#define HOSTKEY_H
+
+#include "notary.h"
+
+/* Longest canonical key: a 253 character host name, a colon and a port. */
+#define HOSTKEY_LENGTH 264
+
+/* The ID of no host: the key was invalid or the intern table is full. */
+#define HOSTKEY_NONE 0
+
+/* Most IDs the intern table can ever hand out, whatever hostkey_max_ids. */
+#define HOSTKEY_MAX_IDS (1 << 26)
+
+/* Counters of the intern table. */
+struct hostkey_stats
+{
+  unsigned long interned;       // hosts with an ID
+  unsigned long invalid;        // hosts that could not be canonicalized
+  unsigned long full;           // hosts refused an ID, the table being full
+};
+
+/* Writes the canonical key of a host, given as a URL or host name, into key.
+ * A port above 0 overrides the port of the URL, which defaults to 443.
+ * Returns 1 on success and 0 if the host is not a valid host name or
+ * address, or its key does not fit in key_length bytes.
+ */
+int hostkey_canonicalize (const char *url, long port, char *key,
+                          size_t key_length);
+
+/* Returns the ID of a canonical key, giving it one if it has none yet, or
+ * HOSTKEY_NONE if the table is full.
+ */
+uint32_t hostkey_intern (const char *key);
+
+/* Returns the ID of a canonical key, or HOSTKEY_NONE if it has none. */
+uint32_t hostkey_find (const char *key);
+
+/* Canonicalizes and interns the host a client asks about. Returns its ID, or
+ * HOSTKEY_NONE if the host is invalid or the table is full.
+ */
+uint32_t hostkey_of (host *host_to_verify);
+
+/* Returns the canonical key of an ID, or NULL for an unknown ID. The string
+ * lives as long as the notary.
+ */
+const char *hostkey_name (uint32_t id);
+
+/* Copies the counters of the intern table into stats. */
+void hostkey_get_stats (struct hostkey_stats *stats);
+
+#endif // HOSTKEY_H
@@ -0,0 +1,352 @@
+/** @file
+
+    @brief  Ingest: loads chains collected by TLS scanners into the
+            observation history, fingerprinting them on several threads
+            and recording them in batches.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "ingest.h"
+#include "certificate.h"
+#include "certpool.h"
+#include "history.h"
+#include "hostkey.h"
+#include "worker.h"
+#include <openssl/evp.h>
+#include <pthread.h>
+
+/* An ingest shared by its threads. */
+struct ingest_job
+{
+  FILE *input;
+  pthread_mutex_t lock;         // taken to read the input and add counters
+  pthread_cond_t turn;          // signalled when a batch was recorded
+  unsigned long batches_read;
+  unsigned long batches_recorded;
+  int failed;                   // whether reading the input failed
+  struct ingest_stats *stats;
+};
+
+/* What a thread keeps from one batch to the next. */
+struct reader
+{
+  char *lines[INGEST_BATCH];
+  size_t sizes[INGEST_BATCH];
+  struct history_sighting sightings[INGEST_BATCH];
+  unsigned char *der;           // the certificate being decoded
+  size_t der_size;
+  uint32_t *certs;              // the chain being parsed
+  int certs_size;
+  struct worker_context *worker;
+  struct ingest_stats stats;
+};
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Decodes the base64 of a DER encoded certificate into the buffer
+ *        of the reader.
+ *
+ * @return the length of the certificate, or 0 if it is not valid base64
+ */
+static long
+decode_certificate (struct reader *reader, const char *base64, size_t length)
+{
+  unsigned char *der;
+  int decoded;
+
+  if (length == 0 || length % 4 != 0 || length > INT_MAX)
+    return 0;
+
+  if (length / 4 * 3 > reader->der_size)
+    {
+      der = realloc (reader->der, length / 4 * 3);
+      if (der == NULL)
+        return 0;
+      reader->der = der;
+      reader->der_size = length / 4 * 3;
+    }
+
+  decoded = EVP_DecodeBlock (reader->der, (const unsigned char *) base64,
+                             length);
+  if (decoded <= 0)
+    return 0;
+
+  /* EVP_DecodeBlock counts the padding as decoded bytes. */
+  if (base64[length - 1] == '=')
+    decoded--;
+  if (base64[length - 2] == '=')
+    decoded--;
+  return decoded;
+} // decode_certificate
+
+/**
+ * @brief Parses a record into a sighting, interning its host, certificates
+ *        and chain.
+ *
+ * @return 1 on success, 0 if the record is not valid, -1 if an ID was
+ *         refused
+ */
+static int
+parse_record (struct reader *reader, char *line,
+              struct history_sighting *sighting)
+{
+  char key[HOSTKEY_LENGTH], *word, *rest, *end;
+  uint32_t *certs;
+  long long timestamp;
+  long der_length;
+  int length = 0, pooled;
+
+  word = strtok_r (line, " \t\r\n", &rest);
+  if (word == NULL || !hostkey_canonicalize (word, 0, key, sizeof (key)))
+    return 0;
+
+  word = strtok_r (NULL, " \t\r\n", &rest);
+  if (word == NULL)
+    return 0;
+  timestamp = strtoll (word, &end, 10);
+  if (*end != '\0' || timestamp <= 0 || timestamp > UINT32_MAX)
+    return 0;
+
+  while ((word = strtok_r (NULL, " \t\r\n", &rest)) != NULL)
+    {
+      der_length = decode_certificate (reader, word, strlen (word));
+      if (der_length == 0)
+        return 0;
+
+      if (length == reader->certs_size)
+        {
+          certs = realloc (reader->certs,
+                           2 * (length + 4) * sizeof (uint32_t));
+          if (certs == NULL)
+            return 0;
+          reader->certs = certs;
+          reader->certs_size = 2 * (length + 4);
+        }
+
+      pooled = pool_der_certificate (reader->worker, reader->der, der_length,
+                                     &reader->certs[length]);
+      if (pooled <= 0)
+        return pooled;
+      reader->stats.certificates++;
+      length++;
+    }
+  if (length == 0)
+    return 0;
+
+  sighting->id = hostkey_intern (key);
+  sighting->chain = certpool_chain (reader->certs, length);
+  if (sighting->id == HOSTKEY_NONE || sighting->chain == CERTPOOL_NONE)
+    return -1;
+  sighting->start = timestamp;
+  sighting->end = timestamp;
+  return 1;
+} // parse_record
+
+/**
+ * @brief Reads the next batch of lines of the input.
+ *
+ * @param batch  output parameter for the number of the batch
+ *
+ * @return the number of lines read
+ */
+static int
+read_batch (struct ingest_job *job, struct reader *reader,
+            unsigned long *batch)
+{
+  int count = 0;
+
+  pthread_mutex_lock (&job->lock);
+  while (count < INGEST_BATCH && !job->failed
+         && getline (&reader->lines[count], &reader->sizes[count],
+                     job->input) >= 0)
+    count++;
+  if (ferror (job->input))
+    job->failed = 1;
+  *batch = job->batches_read;
+  if (count > 0)
+    job->batches_read++;
+  pthread_mutex_unlock (&job->lock);
+
+  return count;
+} // read_batch
+
+/**
+ * @brief Records the sightings of a batch once the batches read before it
+ *        are recorded, so that the sightings of a host are recorded in the
+ *        order of the input.
+ *
+ * @return 1 on success, 0 if out of memory
+ */
+static int
+record_batch (struct ingest_job *job, struct reader *reader,
+              unsigned long batch, int sightings)
+{
+  int recorded;
+
+  pthread_mutex_lock (&job->lock);
+  while (job->batches_recorded != batch)
+    pthread_cond_wait (&job->turn, &job->lock);
+  pthread_mutex_unlock (&job->lock);
+
+  recorded = history_record_batch (reader->sightings, sightings);
+
+  pthread_mutex_lock (&job->lock);
+  job->batches_recorded++;
+  pthread_cond_broadcast (&job->turn);
+  pthread_mutex_unlock (&job->lock);
+
+  return recorded;
+} // record_batch
+
+/**
+ * @brief An ingest thread: parses batches of records and records them
+ *        until the input runs out.
+ */
+static void *
+ingest_thread (void *arg)
+{
+  struct ingest_job *job = arg;
+  struct reader *reader;
+  unsigned long batch;
+  int count, sightings, parsed, i;
+  char *line;
+
+  reader = calloc (1, sizeof (*reader));
+  if (reader == NULL || (reader->worker = worker_acquire ()) == NULL)
+    {
+      fprintf (stderr, "Could not start an ingest thread\n");
+      free (reader);
+      pthread_mutex_lock (&job->lock);
+      job->failed = 1;
+      pthread_mutex_unlock (&job->lock);
+      return NULL;
+    }
+
+  while ((count = read_batch (job, reader, &batch)) > 0)
+    {
+      sightings = 0;
+      for (i = 0; i < count; i++)
+        {
+          line = reader->lines[i];
+          line += strspn (line, " \t");
+          if (*line == '\0' || *line == '\n' || *line == '\r' || *line == '#')
+            continue;
+
+          reader->stats.records++;
+          parsed = parse_record (reader, line,
+                                 &reader->sightings[sightings]);
+          if (parsed > 0)
+            sightings++;
+          else if (parsed == 0)
+            reader->stats.invalid++;
+          else
+            reader->stats.full++;
+        }
+
+      if (record_batch (job, reader, batch, sightings))
+        reader->stats.ingested += sightings;
+      else
+        reader->stats.full += sightings;
+    }
+
+  pthread_mutex_lock (&job->lock);
+  job->stats->records += reader->stats.records;
+  job->stats->ingested += reader->stats.ingested;
+  job->stats->invalid += reader->stats.invalid;
+  job->stats->full += reader->stats.full;
+  job->stats->certificates += reader->stats.certificates;
+  pthread_mutex_unlock (&job->lock);
+
+  worker_release (reader->worker);
+  for (i = 0; i < INGEST_BATCH; i++)
+    free (reader->lines[i]);
+  free (reader->der);
+  free (reader->certs);
+  free (reader);
+  return NULL;
+} // ingest_thread
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Ingests the records of a stream on several threads.
+ *
+ * @param input    the stream
+ * @param threads  the number of threads, 0 or less for one per processor
+ * @param stats    the counters to add to
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+ingest_stream (FILE *input, int threads, struct ingest_stats *stats)
+{
+  struct ingest_job job = {input, PTHREAD_MUTEX_INITIALIZER,
+                           PTHREAD_COND_INITIALIZER, 0, 0, 0, stats};
+  pthread_t *thread_ids;
+  int started, i;
+
+  if (threads <= 0)
+    threads = sysconf (_SC_NPROCESSORS_ONLN);
+  if (threads <= 0)
+    threads = 1;
+
+  thread_ids = malloc (threads * sizeof (pthread_t));
+  if (thread_ids == NULL)
+    return 0;
+
+  for (started = 0; started < threads; started++)
+    if (pthread_create (&thread_ids[started], NULL, ingest_thread, &job) != 0)
+      break;
+  if (started == 0)
+    {
+      fprintf (stderr, "Could not start an ingest thread\n");
+      job.failed = 1;
+    }
+  for (i = 0; i < started; i++)
+    pthread_join (thread_ids[i], NULL);
+
+  free (thread_ids);
+  pthread_mutex_destroy (&job.lock);
+  pthread_cond_destroy (&job.turn);
+  return !job.failed;
+} // ingest_stream
+
+/**
+ * @brief Ingests the records of a file.
+ *
+ * @param file_name  the file, - for standard input
+ * @param threads    the number of threads, 0 or less for one per processor
+ * @param stats      the counters to add to
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+ingest_file (const char *file_name, int threads, struct ingest_stats *stats)
+{
+  FILE *file = stdin;
+  int result;
+
+  if (strcmp (file_name, "-") != 0 && (file = fopen (file_name, "r")) == NULL)
+    {
+      fprintf (stderr, "Could not open %s: %s\n", file_name, strerror (errno));
+      return 0;
+    }
+
+  result = ingest_stream (file, threads, stats);
+  if (!result)
+    fprintf (stderr, "Could not read %s\n", file_name);
+
+  if (file != stdin)
+    fclose (file);
+  return result;
+} // ingest_file
@@ -0,0 +1,50 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for offline ingest, which loads
+ * chains collected by TLS scanners into the observation history without
+ * contacting any host. Every record is one line:
+ *
+ *   host[:port] timestamp certificate [certificate ...]
+ *
+ * where the timestamp is in seconds since the epoch and every certificate,
+ * leaf first, is the base64 of its DER encoding, the body of a PEM block
+ * on one line. Records are fingerprinted in parallel, with the certificate
+ * pool sparing certificates seen before, and recorded in batches in the
+ * order of the input. A record older than the newest run of its host goes
+ * where it belongs in time, and is dropped if the host was seen showing
+ * another chain after it.
+ ******************************************************************************/
+#ifndef INGEST_H
+#define INGEST_H
+
+#include "notary.h"
+
+/* Records read, fingerprinted and recorded together. */
+#define INGEST_BATCH 4096
+
+/* Counters of an ingest. */
+struct ingest_stats
+{
+  unsigned long records;        // lines read, blank lines and comments aside
+  unsigned long ingested;       // records recorded in the history
+  unsigned long invalid;        // records that could not be parsed
+  unsigned long full;           // records refused a host, certificate or chain ID
+  unsigned long certificates;   // certificates decoded
+};
+
+/* Ingests the records of a stream on the given number of threads, or one
+ * per processor if threads is 0 or less, adding to the counters in stats.
+ * Returns 1 on success, 0 if the stream could not be read or the threads
+ * could not be started. worker_global_init must have been called.
+ */
+int ingest_stream (FILE *input, int threads, struct ingest_stats *stats);
+
+/* Ingests the records of a file, - for standard input, as ingest_stream
+ * does.
+ */
+int ingest_file (const char *file_name, int threads,
+                 struct ingest_stats *stats);
+
+#endif // INGEST_H
@@ -0,0 +1,198 @@
+/** @file
+
+    @brief  Merkle: builds Merkle trees over batches of responses and computes
+            and checks inclusion proofs, following RFC 6962.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "merkle.h"
+#include <openssl/evp.h>
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Hashes two child nodes into their parent.
+ */
+static void
+node_hash (const unsigned char *left, const unsigned char *right,
+           unsigned char *parent)
+{
+  unsigned char node[1 + 2 * MERKLE_HASH_LENGTH];
+
+  node[0] = 0x01;
+  memcpy (node + 1, left, MERKLE_HASH_LENGTH);
+  memcpy (node + 1 + MERKLE_HASH_LENGTH, right, MERKLE_HASH_LENGTH);
+  EVP_Digest (node, sizeof (node), parent, NULL, EVP_sha256 (), NULL);
+} // node_hash
+
+/**
+ * @brief Returns the largest power of two smaller than n, for n > 1.
+ */
+static size_t
+split_point (size_t n)
+{
+  size_t k = 1;
+
+  while (k << 1 < n)
+    k <<= 1;
+  return k;
+} // split_point
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Computes the leaf hash of a block of data.
+ *
+ * @param data       the data in the leaf
+ * @param data_len   number of bytes in data
+ * @param leaf_hash  output buffer of MERKLE_HASH_LENGTH bytes
+ */
+void
+merkle_leaf_hash (const unsigned char *data, size_t data_len,
+                  unsigned char *leaf_hash)
+{
+  EVP_MD_CTX *context = EVP_MD_CTX_new ();
+  unsigned char prefix = 0x00;
+
+  if (context == NULL
+      || !EVP_DigestInit_ex (context, EVP_sha256 (), NULL)
+      || !EVP_DigestUpdate (context, &prefix, 1)
+      || !EVP_DigestUpdate (context, data, data_len)
+      || !EVP_DigestFinal_ex (context, leaf_hash, NULL))
+    memset (leaf_hash, 0, MERKLE_HASH_LENGTH);
+  EVP_MD_CTX_free (context);
+} // merkle_leaf_hash
+
+/**
+ * @brief Computes the root of the tree over a list of leaf hashes.
+ *
+ * @param leaf_hashes  the leaf hashes, in order
+ * @param num_leaves   number of leaves, at least 1
+ * @param root         output buffer of MERKLE_HASH_LENGTH bytes
+ */
+void
+merkle_root (unsigned char (*leaf_hashes)[MERKLE_HASH_LENGTH],
+             size_t num_leaves, unsigned char *root)
+{
+  unsigned char left[MERKLE_HASH_LENGTH], right[MERKLE_HASH_LENGTH];
+  size_t k;
+
+  if (num_leaves == 1)
+    {
+      memcpy (root, leaf_hashes[0], MERKLE_HASH_LENGTH);
+      return;
+    }
+
+  k = split_point (num_leaves);
+  merkle_root (leaf_hashes, k, left);
+  merkle_root (leaf_hashes + k, num_leaves - k, right);
+  node_hash (left, right, root);
+} // merkle_root
+
+/**
+ * @brief Computes the audit path of a leaf, deepest sibling first.
+ *
+ * @param leaf_hashes  the leaf hashes, in order
+ * @param num_leaves   number of leaves
+ * @param index        position of the leaf to prove
+ * @param path         output array of at least MERKLE_MAX_DEPTH hashes
+ * @param path_length  output parameter for the number of hashes in path
+ *
+ * @return 1 on success, 0 if the index is out of range
+ */
+int
+merkle_audit_path (unsigned char (*leaf_hashes)[MERKLE_HASH_LENGTH],
+                   size_t num_leaves, size_t index,
+                   unsigned char (*path)[MERKLE_HASH_LENGTH],
+                   size_t *path_length)
+{
+  unsigned char sibling[MERKLE_HASH_LENGTH];
+  size_t k;
+
+  if (index >= num_leaves)
+    return 0;
+
+  if (num_leaves == 1)
+    {
+      *path_length = 0;
+      return 1;
+    }
+
+  /* The path within the half holding the leaf comes first, followed by the
+   * root of the other half. */
+  k = split_point (num_leaves);
+  if (index < k)
+    {
+      merkle_audit_path (leaf_hashes, k, index, path, path_length);
+      merkle_root (leaf_hashes + k, num_leaves - k, sibling);
+    }
+  else
+    {
+      merkle_audit_path (leaf_hashes + k, num_leaves - k, index - k, path,
+                         path_length);
+      merkle_root (leaf_hashes, k, sibling);
+    }
+
+  memcpy (path[*path_length], sibling, MERKLE_HASH_LENGTH);
+  (*path_length)++;
+  return 1;
+} // merkle_audit_path
+
+/**
+ * @brief Checks that a leaf is included in a tree with a given root, using
+ *        the verification algorithm of RFC 9162, section 2.1.3.2.
+ *
+ * @param leaf_hash    the hash of the leaf
+ * @param index        position of the leaf
+ * @param tree_size    number of leaves in the tree
+ * @param path         the audit path, deepest sibling first
+ * @param path_length  number of hashes in path
+ * @param root         the expected root
+ *
+ * @return 1 if the leaf is in the tree, 0 otherwise
+ */
+int
+merkle_verify_path (const unsigned char *leaf_hash, size_t index,
+                    size_t tree_size,
+                    unsigned char (*path)[MERKLE_HASH_LENGTH],
+                    size_t path_length, const unsigned char *root)
+{
+  unsigned char hash[MERKLE_HASH_LENGTH];
+  size_t fn = index, sn = tree_size - 1, i;
+
+  if (index >= tree_size)
+    return 0;
+
+  memcpy (hash, leaf_hash, MERKLE_HASH_LENGTH);
+  for (i = 0; i < path_length; i++)
+    {
+      if (sn == 0)
+        return 0;
+
+      if ((fn & 1) || fn == sn)
+        {
+          node_hash (path[i], hash, hash);
+          while (!(fn & 1) && fn != 0)
+            {
+              fn >>= 1;
+              sn >>= 1;
+            }
+        }
+      else
+        node_hash (hash, path[i], hash);
+
+      fn >>= 1;
+      sn >>= 1;
+    }
+
+  return sn == 0 && memcmp (hash, root, MERKLE_HASH_LENGTH) == 0;
+} // merkle_verify_path
@@ -0,0 +1,63 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the Merkle tree functions used to
+ * sign a batch of responses with a single signature. Trees are built as in
+ * RFC 6962: leaves are hashed with a 0x00 prefix and interior nodes with a
+ * 0x01 prefix, using SHA-256.
+ ******************************************************************************/
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include "notary.h"
+
+/* Length of the hashes in a tree. */
+#define MERKLE_HASH_LENGTH SHA256_DIGEST_LENGTH
+
+/* Batches never exceed 2^MERKLE_MAX_DEPTH leaves. */
+#define MERKLE_MAX_DEPTH 32
+
+/* Everything a client needs to check that its response was part of a signed
+ * batch: the position of its leaf, the hashes on the path to the root, and
+ * the signature of the root.
+ */
+struct merkle_proof
+{
+  size_t index;
+  size_t tree_size;
+  size_t path_length;
+  unsigned char path[MERKLE_MAX_DEPTH][MERKLE_HASH_LENGTH];
+  unsigned char root[MERKLE_HASH_LENGTH];
+  unsigned char *signature;
+  size_t signature_len;
+};
+
+/* Computes the leaf hash of a block of data. */
+void merkle_leaf_hash (const unsigned char *data, size_t data_len,
+                       unsigned char *leaf_hash);
+
+/* Computes the root of the tree over num_leaves leaf hashes. num_leaves must
+ * be at least 1.
+ */
+void merkle_root (unsigned char (*leaf_hashes)[MERKLE_HASH_LENGTH],
+                  size_t num_leaves, unsigned char *root);
+
+/* Computes the audit path of the leaf at index, deepest sibling first, into
+ * path and stores its length in path_length. Returns 1 on success, 0 if the
+ * index is out of range.
+ */
+int merkle_audit_path (unsigned char (*leaf_hashes)[MERKLE_HASH_LENGTH],
+                       size_t num_leaves, size_t index,
+                       unsigned char (*path)[MERKLE_HASH_LENGTH],
+                       size_t *path_length);
+
+/* Checks that a leaf hash at index is included in the tree of tree_size
+ * leaves with the given root. Returns 1 if it is, 0 otherwise.
+ */
+int merkle_verify_path (const unsigned char *leaf_hash, size_t index,
+                        size_t tree_size,
+                        unsigned char (*path)[MERKLE_HASH_LENGTH],
+                        size_t path_length, const unsigned char *root);
+
+#endif // MERKLE_H
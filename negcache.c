@@ -0,0 +1,199 @@
+/** @file
+
+    @brief  Negcache: remembers hosts that could not be contacted and backs
+            off from them exponentially, with jitter.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "negcache.h"
+#include "config.h"
+#include "deadline.h"
+#include <pthread.h>
+
+/* The failures of a host. A slot whose window has passed keeps its streak,
+ * so a host that fails again soon backs off for longer. */
+struct failure
+{
+  uint32_t id;                  // the host, interned by hostkey
+  int failure_class;
+  int streak;                   // failures in a row
+  long long until_ms;           // end of the backoff window
+};
+
+static struct failure slots[NEGCACHE_SLOTS];
+static struct negcache_stats stats;
+static pthread_mutex_t negcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *class_names[NEGCACHE_CLASSES] =
+  {"dns", "connect", "tls", "timeout"};
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Finds the slot of a host. Host IDs are handed out in sequence, so
+ *        hosts seen close together get different slots.
+ */
+static struct failure *
+slot_of (uint32_t id)
+{
+  return &slots[id % NEGCACHE_SLOTS];
+} // slot_of
+
+/**
+ * @brief Returns whether a slot holds the failures of a host. Called with
+ *        the lock held.
+ */
+static int
+holds (const struct failure *slot, uint32_t id)
+{
+  return slot->streak > 0 && slot->id == id;
+} // holds
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Returns the name of a failure class.
+ */
+const char *
+negcache_class_name (int failure_class)
+{
+  if (failure_class < 0 || failure_class >= NEGCACHE_CLASSES)
+    return "none";
+  return class_names[failure_class];
+} // negcache_class_name
+
+/**
+ * @brief Checks whether a host is in its backoff window.
+ *
+ * @param id             the ID of the host
+ * @param failure_class  output parameter for the class of the last failure,
+ *                       or NULL
+ * @param retry_ms       output parameter for the time left in the window,
+ *                       or NULL
+ *
+ * @return 1 if requests about the host should fail at once, 0 otherwise
+ */
+int
+negcache_check (uint32_t id, int *failure_class, long *retry_ms)
+{
+  struct failure *slot = slot_of (id);
+  long long now = deadline_now_ms ();
+  int backing_off;
+
+  pthread_mutex_lock (&negcache_lock);
+  backing_off = holds (slot, id) && slot->until_ms > now;
+  if (backing_off)
+    {
+      stats.hits++;
+      if (failure_class != NULL)
+        *failure_class = slot->failure_class;
+      if (retry_ms != NULL)
+        *retry_ms = slot->until_ms - now;
+    }
+  pthread_mutex_unlock (&negcache_lock);
+
+  return backing_off;
+} // negcache_check
+
+/**
+ * @brief Records a failure to contact a host. The window is
+ *        negative_base_ms doubled for every earlier failure in a row, up to
+ *        negative_max_ms, and is then shortened by a random amount of up to
+ *        half, so that clients retrying together do not all wake the host at
+ *        the same moment. A host whose last window ended more than
+ *        negative_max_ms ago starts over.
+ *
+ * @param id             the ID of the host
+ * @param failure_class  why the host could not be contacted
+ *
+ * @return the length of the window in milliseconds, 0 if nothing was cached
+ */
+long
+negcache_failure (uint32_t id, int failure_class)
+{
+  struct failure *slot = slot_of (id);
+  long long now = deadline_now_ms ();
+  long window;
+  int i;
+
+  if (failure_class < 0 || failure_class >= NEGCACHE_CLASSES
+      || tunables.negative_base_ms == 0)
+    return 0;
+
+  pthread_mutex_lock (&negcache_lock);
+  stats.failures[failure_class]++;
+  if (!holds (slot, id))
+    {
+      if (slot->streak == 0)
+        stats.entries++;
+      memset (slot, 0, sizeof (*slot));
+      slot->id = id;
+    }
+  else if (now - slot->until_ms > tunables.negative_max_ms)
+    slot->streak = 0;
+
+  slot->streak++;
+  slot->failure_class = failure_class;
+
+  window = tunables.negative_base_ms;
+  for (i = 1; i < slot->streak && window < tunables.negative_max_ms; i++)
+    window *= 2;
+  if (window > tunables.negative_max_ms)
+    window = tunables.negative_max_ms;
+  window -= random () % (window / 2 + 1);
+
+  slot->until_ms = now + window;
+  pthread_mutex_unlock (&negcache_lock);
+
+  return window;
+} // negcache_failure
+
+/**
+ * @brief Forgets the failures of a host.
+ */
+void
+negcache_success (uint32_t id)
+{
+  struct failure *slot = slot_of (id);
+
+  pthread_mutex_lock (&negcache_lock);
+  if (holds (slot, id))
+    {
+      memset (slot, 0, sizeof (*slot));
+      stats.recoveries++;
+      stats.entries--;
+    }
+  pthread_mutex_unlock (&negcache_lock);
+} // negcache_success
+
+/**
+ * @brief Forgets every failure.
+ */
+void
+negcache_clear ()
+{
+  pthread_mutex_lock (&negcache_lock);
+  memset (slots, 0, sizeof (slots));
+  stats.entries = 0;
+  pthread_mutex_unlock (&negcache_lock);
+} // negcache_clear
+
+/**
+ * @brief Copies the counters of the negative cache.
+ */
+void
+negcache_get_stats (struct negcache_stats *stats_out)
+{
+  pthread_mutex_lock (&negcache_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&negcache_lock);
+} // negcache_get_stats
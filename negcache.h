@@ -0,0 +1,65 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the negative cache. Hosts that
+ * could not be contacted are remembered by hostkey ID together with the
+ * class of the failure, and requests about them are answered at once until
+ * a backoff window has passed. The window doubles, with jitter, every time
+ * another attempt fails.
+ ******************************************************************************/
+#ifndef NEGCACHE_H
+#define NEGCACHE_H
+
+#include "notary.h"
+
+/* Hosts whose failures are remembered. Slots are picked by ID, and a new
+ * host takes over the slot of an old one. */
+#define NEGCACHE_SLOTS 4096
+
+/* Why a host could not be contacted. */
+enum negcache_class
+  {
+    NEGCACHE_NONE = -1,         // not the host's fault; nothing is cached
+    NEGCACHE_DNS = 0,           // the name could not be resolved
+    NEGCACHE_CONNECT = 1,       // no address accepted a connection
+    NEGCACHE_TLS = 2,           // the handshake or certificate failed
+    NEGCACHE_TIMEOUT = 3,       // the host did not answer in time
+    NEGCACHE_CLASSES = 4
+  };
+
+/* Counters kept by the negative cache. */
+struct negcache_stats
+{
+  unsigned long hits;           // requests answered during a backoff window
+  unsigned long failures[NEGCACHE_CLASSES]; // failures recorded, by class
+  unsigned long recoveries;     // hosts that answered again after failing
+  unsigned long entries;        // hosts with a failure remembered
+};
+
+/* Returns the name of a failure class, as used in logs and metrics. */
+const char *negcache_class_name (int failure_class);
+
+/* Checks whether a host is in its backoff window. If it is, returns 1 and
+ * sets *failure_class and *retry_ms, either of which may be NULL, to the
+ * class of the last failure and the time left in the window. Returns 0
+ * otherwise.
+ */
+int negcache_check (uint32_t id, int *failure_class, long *retry_ms);
+
+/* Records a failure to contact a host and starts its next backoff window.
+ * Failures of class NEGCACHE_NONE are ignored. Returns the length of the
+ * window in milliseconds, 0 if nothing was cached.
+ */
+long negcache_failure (uint32_t id, int failure_class);
+
+/* Forgets the failures of a host that was contacted successfully. */
+void negcache_success (uint32_t id);
+
+/* Forgets every failure. */
+void negcache_clear (void);
+
+/* Copies the counters of the negative cache into stats. */
+void negcache_get_stats (struct negcache_stats *stats);
+
+#endif // NEGCACHE_H
@@ -0,0 +1,258 @@
+/**
+ *@file
+ *@author g-coders
+ *@date
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ *@section DESCRIPTION
+ * This program measures how many response signatures per second the notary
+ * can produce with each supported signature scheme, so that the number of
+ * notaries needed for a given request rate can be estimated.
+ */
+
+#include "notary.h"
+#include "response.h"
+#include "signer.h"
+#include <pthread.h>
+#include <sys/time.h>
+
+/* A typical fingerprint list, as signed by retrieve_response. */
+static const char fingerprint_list[] =
+  "{\"fingerprintList\":[{\"timestamp\":{\"start\":\"1292636531\","
+  "\"finish\":\"1292754629\"},\"fingerprint\":"
+  "\"BF:E1:FE:03:10:E9:CB:DC:96:BF:3D:AA:6E:C6:03:E5:31:CD:A9:9C\"}]}";
+
+/* What every benchmark thread needs to know, and what it reports back. */
+struct bench_thread
+{
+  pthread_t thread;
+  EVP_PKEY *private_key;
+  enum signature_scheme scheme;
+  double seconds;
+  unsigned long signatures;
+  int failed;
+};
+
+/**
+ * @brief Returns the current time in seconds.
+ */
+static double
+now ()
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+} // now
+
+/**
+ * @brief Generates a private key for a signature scheme.
+ * @param scheme The scheme to generate a key for
+ * @return the new key, or NULL on failure
+ */
+static EVP_PKEY *
+generate_key (enum signature_scheme scheme)
+{
+  EVP_PKEY *key = NULL;
+  EVP_PKEY_CTX *context;
+  int type = EVP_PKEY_RSA;
+
+  if (scheme == SCHEME_ECDSA_P256_SHA256)
+    type = EVP_PKEY_EC;
+  else if (scheme == SCHEME_ED25519)
+    type = EVP_PKEY_ED25519;
+
+  context = EVP_PKEY_CTX_new_id (type, NULL);
+  if (context == NULL || EVP_PKEY_keygen_init (context) != 1)
+    {
+      EVP_PKEY_CTX_free (context);
+      return NULL;
+    }
+
+  /* Use the key sizes notary-configure generates. */
+  if (type == EVP_PKEY_RSA)
+    EVP_PKEY_CTX_set_rsa_keygen_bits (context, 2048);
+  else if (type == EVP_PKEY_EC)
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid (context, NID_X9_62_prime256v1);
+
+  if (EVP_PKEY_keygen (context, &key) != 1)
+    key = NULL;
+
+  EVP_PKEY_CTX_free (context);
+  return key;
+} // generate_key
+
+/**
+ * @brief Signs the fingerprint list repeatedly until the time is up.
+ * @param arg The bench_thread describing this thread
+ */
+static void *
+bench_signing (void *arg)
+{
+  struct bench_thread *bench = arg;
+  unsigned char signature[1024];
+  size_t signature_size;
+  EVP_MD_CTX *md_context = EVP_MD_CTX_new ();
+  const EVP_MD *digest = signature_scheme_digest (bench->scheme);
+  double stop = now () + bench->seconds;
+
+  while (now () < stop)
+    {
+      signature_size = sizeof (signature);
+      if (!generate_signature ((unsigned char *) fingerprint_list,
+                               strlen (fingerprint_list), signature,
+                               &signature_size, bench->private_key, digest,
+                               md_context))
+        {
+          bench->failed = 1;
+          break;
+        }
+      bench->signatures++;
+    }
+
+  EVP_MD_CTX_free (md_context);
+  return NULL;
+} // bench_signing
+
+/**
+ * @brief Runs one scheme on a number of threads and prints the result.
+ * @param scheme The scheme to measure
+ * @param num_threads The number of signing threads
+ * @param seconds How long to sign for
+ * @return 1 if the benchmark ran, 0 otherwise
+ */
+static int
+run_benchmark (enum signature_scheme scheme, int num_threads, double seconds)
+{
+  struct bench_thread *benches, *bench;
+  unsigned long total = 0;
+  double started, elapsed, rate;
+  int i, started_threads, error, failed = 0;
+  EVP_PKEY *key = generate_key (scheme);
+
+  if (key == NULL)
+    {
+      fprintf (stderr, "Could not generate a %s key\n",
+               signature_scheme_name (scheme));
+      return 0;
+    }
+
+  benches = calloc (num_threads, sizeof (struct bench_thread));
+  if (benches == NULL)
+    {
+      fprintf (stderr, "Could not allocate %d benchmark threads\n",
+               num_threads);
+      EVP_PKEY_free (key);
+      return 0;
+    }
+
+  started = now ();
+  for (started_threads = 0; started_threads < num_threads; started_threads++)
+    {
+      /* Every thread signs with its own copy of the key, as the signer pool
+       * does. */
+      bench = &benches[started_threads];
+      bench->private_key = EVP_PKEY_dup (key);
+      if (bench->private_key == NULL)
+        {
+          fprintf (stderr, "Could not copy the %s key\n",
+                   signature_scheme_name (scheme));
+          break;
+        }
+      bench->scheme = scheme;
+      bench->seconds = seconds;
+      error = pthread_create (&bench->thread, NULL, bench_signing, bench);
+      if (error != 0)
+        {
+          fprintf (stderr, "Could not start a benchmark thread: %s\n",
+                   strerror (error));
+          EVP_PKEY_free (bench->private_key);
+          break;
+        }
+    }
+
+  for (i = 0; i < started_threads; i++)
+    {
+      pthread_join (benches[i].thread, NULL);
+      total += benches[i].signatures;
+      failed |= benches[i].failed;
+      EVP_PKEY_free (benches[i].private_key);
+    }
+  if (started_threads < num_threads)
+    {
+      free (benches);
+      EVP_PKEY_free (key);
+      return 0;
+    }
+  elapsed = now () - started;
+
+  rate = total / elapsed;
+  printf ("%-20s %7d %14.0f %14.0f%s\n", signature_scheme_name (scheme),
+          num_threads, rate, rate / num_threads,
+          failed ? "  (signing failed)" : "");
+
+  free (benches);
+  EVP_PKEY_free (key);
+  return !failed;
+} // run_benchmark
+
+/**
+ * @brief Print a helpful usage message.
+ */
+static void
+print_usage ()
+{
+  printf ("usage: notary-bench <options>\n \
+           Options:\n \
+	   -t <threads>     Signing threads (defaults to the number of cores).\n \
+	   -d <seconds>     Time to sign for with each scheme (defaults to 3).\n \
+	   -h               Print this help message.\n");
+} // print_usage
+
+/**
+ * @brief Measures signing throughput of every supported scheme, first on a
+ *        single core and then on all of them.
+ * @param argc The number of command-line arguments
+ * @param argv The command-line arguments
+ * @return Returns 0 if every benchmark ran, 1 otherwise.
+ */
+int
+main (int argc, char *argv[])
+{
+  enum signature_scheme schemes[3] =
+    {SCHEME_RSA_SHA1, SCHEME_ECDSA_P256_SHA256, SCHEME_ED25519};
+  int num_threads = sysconf (_SC_NPROCESSORS_ONLN);
+  double seconds = 3;
+  int i, c, result = 0;
+
+  while ((c = getopt (argc, argv, "t:d:h")) != -1)
+    {
+      switch (c)
+        {
+        case 't':
+          num_threads = atoi (optarg);
+          break;
+        case 'd':
+          seconds = atof (optarg);
+          break;
+        default:
+          print_usage ();
+          return 1;
+        }
+    }
+
+  if (num_threads < 1)
+    num_threads = 1;
+
+  printf ("%-20s %7s %14s %14s\n", "scheme", "threads", "signatures/s",
+          "per core");
+  for (i = 0; i < 3; i++)
+    {
+      if (!run_benchmark (schemes[i], 1, seconds))
+        result = 1;
+      if (num_threads > 1 && !run_benchmark (schemes[i], num_threads, seconds))
+        result = 1;
+    }
+
+  return result;
+} // main
@@ -0,0 +1,303 @@
+/**
+ *@file
+ *@author g-coders
+ *@date
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ *@section DESCRIPTION
+ * This program replays a trace of requested hosts against the observation
+ * cache, once with its W-TinyLFU policy and once as plain LRU, and prints
+ * the hit ratio of each, so that observation_max_hosts and
+ * observation_window_pct can be chosen for a given traffic. Without a trace
+ * it generates one: hosts requested with a Zipf distribution, mixed with
+ * scans of hosts requested only once.
+ */
+
+#include "notary.h"
+#include "observation.h"
+#include "hitters.h"
+#include "hostkey.h"
+#include "certpool.h"
+#include "config.h"
+#include <math.h>
+
+/* A trace of requested hosts, by their hostkey IDs. */
+struct trace
+{
+  uint32_t *ids;
+  size_t length;
+  size_t allocated;
+};
+
+/**
+ * @brief Appends a host to a trace, under its canonical key as the notary
+ *        would see it. Invalid hosts are skipped.
+ * @return 1 on success, 0 if out of memory or out of IDs
+ */
+static int
+append_host (struct trace *trace, const char *url)
+{
+  char key[HOSTKEY_LENGTH];
+  uint32_t *ids;
+
+  if (!hostkey_canonicalize (url, 0, key, sizeof (key)))
+    return 1;
+
+  if (trace->length == trace->allocated)
+    {
+      trace->allocated = trace->allocated ? 2 * trace->allocated : 4096;
+      ids = realloc (trace->ids, trace->allocated * sizeof (uint32_t));
+      if (ids == NULL)
+        return 0;
+      trace->ids = ids;
+    }
+  trace->ids[trace->length] = hostkey_intern (key);
+  if (trace->ids[trace->length] == HOSTKEY_NONE)
+    return 0;
+  trace->length++;
+  return 1;
+} // append_host
+
+/**
+ * @brief Reads a trace of one host, host:port or URL per line; blank lines
+ *        and lines starting with # are skipped.
+ * @param file_name The file to read, - for standard input
+ * @param trace The trace to append to
+ * @return 1 on success, 0 on failure
+ */
+static int
+read_trace (const char *file_name, struct trace *trace)
+{
+  char line[256];
+  FILE *file = stdin;
+  size_t length;
+
+  if (strcmp (file_name, "-") != 0 && (file = fopen (file_name, "r")) == NULL)
+    {
+      fprintf (stderr, "Could not open %s: %s\n", file_name, strerror (errno));
+      return 0;
+    }
+
+  while (fgets (line, sizeof (line), file) != NULL)
+    {
+      length = strcspn (line, " \t\r\n");
+      line[length] = '\0';
+      if (length == 0 || line[0] == '#')
+        continue;
+      if (!append_host (trace, line))
+        {
+          fprintf (stderr, "Out of memory or host IDs reading %s\n",
+                   file_name);
+          break;
+        }
+    }
+
+  if (file != stdin)
+    fclose (file);
+  return trace->length > 0;
+} // read_trace
+
+/**
+ * @brief Generates a trace: hosts requested with a Zipf distribution of the
+ *        given skew, with a scan of hosts requested only once taking the
+ *        given share of the requests.
+ * @return 1 on success, 0 if out of memory
+ */
+static int
+generate_trace (struct trace *trace, size_t requests, int hosts, double skew,
+                int scan_pct, unsigned int seed)
+{
+  char key[HOSTKEY_LENGTH];
+  unsigned long scanned = 0;
+  double *cumulative, sum = 0, draw;
+  int low, high, middle, i;
+  size_t r;
+
+  cumulative = malloc (hosts * sizeof (double));
+  if (cumulative == NULL)
+    return 0;
+  for (i = 0; i < hosts; i++)
+    {
+      sum += 1 / pow (i + 1, skew);
+      cumulative[i] = sum;
+    }
+
+  srandom (seed);
+  for (r = 0; r < requests; r++)
+    {
+      if ((int) (random () % 100) < scan_pct)
+        snprintf (key, sizeof (key), "scan-%lu.test:443", scanned++);
+      else
+        {
+          /* The first host whose cumulative weight reaches the draw. */
+          draw = (double) random () / RAND_MAX * sum;
+          low = 0;
+          high = hosts - 1;
+          while (low < high)
+            {
+              middle = (low + high) / 2;
+              if (cumulative[middle] < draw)
+                low = middle + 1;
+              else
+                high = middle;
+            }
+          snprintf (key, sizeof (key), "host-%d.test:443", low);
+        }
+      if (!append_host (trace, key))
+        {
+          free (cumulative);
+          return 0;
+        }
+    }
+
+  free (cumulative);
+  return 1;
+} // generate_trace
+
+/**
+ * @brief Replays a trace against an empty observation cache, as
+ *        retrieve_response would, and prints the hit ratio.
+ * @param name The name of the policy
+ * @param trace The trace to replay
+ * @param window_pct The observation_window_pct to replay with
+ */
+static void
+replay (const char *name, const struct trace *trace, int window_pct)
+{
+  char *fingerprints[1] =
+    {"BF:E1:FE:03:10:E9:CB:DC:96:BF:3D:AA:6E:C6:03:E5:31:CD:A9:9C"};
+  uint32_t chain = certpool_chain_of_fingerprints (fingerprints, 1);
+  struct observation_stats before, after;
+  struct observation observation;
+  time_t now = time (NULL);
+  unsigned long hits;
+  size_t i;
+
+  tunables.observation_window_pct = window_pct;
+  observation_clear ();
+  hitters_clear ();
+  observation_get_stats (&before);
+
+  for (i = 0; i < trace->length; i++)
+    {
+      hitters_record (trace->ids[i]);
+      if (observation_lookup (trace->ids[i], &observation)
+          == OBSERVATION_MISSING)
+        observation_record (trace->ids[i], chain, now, now, &observation);
+    }
+
+  observation_get_stats (&after);
+  hits = after.hits - before.hits;
+  printf ("%-12s %7d %9.2f%% %9.2f%% %9.2f%% %9.2f%% %10lu\n", name,
+          window_pct, 100.0 * hits / trace->length,
+          100.0 * (after.window_hits - before.window_hits) / trace->length,
+          100.0 * (after.probation_hits - before.probation_hits)
+          / trace->length,
+          100.0 * (after.protected_hits - before.protected_hits)
+          / trace->length, after.rejected - before.rejected);
+} // replay
+
+/**
+ * @brief Print a helpful usage message.
+ */
+static void
+print_usage ()
+{
+  printf ("usage: notary-cachesim <options>\n \
+           Options:\n \
+	   -f <file>        Replay the hosts in file, one host or URL per line\n \
+	                    (- for standard input) instead of generating them.\n \
+	   -c <hosts>       Hosts the cache holds (defaults to 1000).\n \
+	   -w <percent>     Share of the cache for the window (defaults to 1).\n \
+	   -n <requests>    Requests to generate (defaults to 1000000).\n \
+	   -u <hosts>       Hosts to generate requests for (defaults to 100000).\n \
+	   -z <skew>        Zipf skew of the generated requests (defaults to 0.9).\n \
+	   -s <percent>     Share of requests for hosts seen once (defaults to 20).\n \
+	   -r <seed>        Seed of the generated requests (defaults to 1).\n \
+	   -h               Print this help message.\n");
+} // print_usage
+
+/**
+ * @brief Replays a trace with W-TinyLFU and with LRU and prints both hit
+ *        ratios.
+ * @param argc The number of command-line arguments
+ * @param argv The command-line arguments
+ * @return Returns 0 on success, 1 otherwise.
+ */
+int
+main (int argc, char *argv[])
+{
+  struct trace trace = {NULL, 0, 0};
+  const char *file_name = NULL;
+  size_t requests = 1000000;
+  int capacity = 1000, window_pct = 1, hosts = 100000, scan_pct = 20;
+  unsigned int seed = 1;
+  double skew = 0.9;
+  int c, window;
+
+  while ((c = getopt (argc, argv, "f:c:w:n:u:z:s:r:h")) != -1)
+    {
+      switch (c)
+        {
+        case 'f':
+          file_name = optarg;
+          break;
+        case 'c':
+          capacity = atoi (optarg);
+          break;
+        case 'w':
+          window_pct = atoi (optarg);
+          break;
+        case 'n':
+          requests = strtoul (optarg, NULL, 10);
+          break;
+        case 'u':
+          hosts = atoi (optarg);
+          break;
+        case 'z':
+          skew = atof (optarg);
+          break;
+        case 's':
+          scan_pct = atoi (optarg);
+          break;
+        case 'r':
+          seed = strtoul (optarg, NULL, 10);
+          break;
+        default:
+          print_usage ();
+          return 1;
+        }
+    }
+
+  if (capacity < 1 || window_pct < 1 || window_pct > 100 || hosts < 1)
+    {
+      print_usage ();
+      return 1;
+    }
+
+  if (file_name != NULL ? !read_trace (file_name, &trace)
+      : !generate_trace (&trace, requests, hosts, skew, scan_pct, seed))
+    {
+      fprintf (stderr, "No trace to replay\n");
+      return 1;
+    }
+
+  /* Only the number of hosts bounds the cache, observations do not expire
+   * during the replay, and the frequency sketch ages over ten times the
+   * capacity, as it does with the defaults. */
+  tunables.observation_max_hosts = capacity;
+  tunables.observation_max_bytes = 1 << 30;
+  tunables.observation_ttl = 86400;
+  window = capacity * 10;
+  tunables.hitters_window = window > 1000 ? window : 1000;
+
+  printf ("%lu requests, %d hosts cached\n", (unsigned long) trace.length,
+          capacity);
+  printf ("%-12s %7s %10s %10s %10s %10s %10s\n", "policy", "window",
+          "hits", "window", "probation", "protected", "rejected");
+  replay ("W-TinyLFU", &trace, window_pct);
+  replay ("LRU", &trace, 100);
+
+  free (trace.ids);
+  return 0;
+} // main
@@ -0,0 +1,218 @@
+/**
+ *@file
+ *@author g-coders
+ *@date
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ *@section DESCRIPTION
+ * This program ingests chains collected by TLS scanners the way the notary
+ * does with -I, without contacting any host, and prints how many records a
+ * second were fingerprinted and recorded. It can also generate records to
+ * ingest: every host with a leaf of its own under a shared intermediate.
+ */
+
+#include "notary.h"
+#include "ingest.h"
+#include "certpool.h"
+#include "history.h"
+#include "worker.h"
+#include "config.h"
+#include <sys/time.h>
+
+/**
+ * @brief Returns the current time in seconds.
+ */
+static double
+now ()
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+} // now
+
+/**
+ * @brief Creates a certificate for a name, signed with a key.
+ * @return the certificate, or NULL on failure
+ */
+static X509 *
+make_certificate (EVP_PKEY *key, const char *name, long serial)
+{
+  X509 *certificate = X509_new ();
+
+  if (certificate == NULL)
+    return NULL;
+  ASN1_INTEGER_set (X509_get_serialNumber (certificate), serial);
+  X509_gmtime_adj (X509_getm_notBefore (certificate), 0);
+  X509_gmtime_adj (X509_getm_notAfter (certificate), 90 * 86400);
+  X509_NAME_add_entry_by_txt (X509_get_subject_name (certificate), "CN",
+                              MBSTRING_ASC, (const unsigned char *) name, -1,
+                              -1, 0);
+  X509_set_pubkey (certificate, key);
+  if (X509_sign (certificate, key, NULL) == 0)
+    {
+      X509_free (certificate);
+      return NULL;
+    }
+  return certificate;
+} // make_certificate
+
+/**
+ * @brief Writes the base64 of the DER encoding of a certificate.
+ * @return 1 on success, 0 on failure
+ */
+static int
+write_certificate (FILE *output, X509 *certificate)
+{
+  unsigned char *der = NULL, *base64;
+  int length;
+
+  length = i2d_X509 (certificate, &der);
+  if (length <= 0)
+    return 0;
+  base64 = malloc (4 * ((length + 2) / 3) + 1);
+  if (base64 == NULL)
+    {
+      OPENSSL_free (der);
+      return 0;
+    }
+  EVP_EncodeBlock (base64, der, length);
+  fprintf (output, " %s", base64);
+  free (base64);
+  OPENSSL_free (der);
+  return 1;
+} // write_certificate
+
+/**
+ * @brief Writes records of hosts, each showing a leaf of its own under a
+ *        shared intermediate.
+ * @param output The stream to write to
+ * @param records The number of records
+ * @return 1 on success, 0 on failure
+ */
+static int
+generate_records (FILE *output, unsigned long records)
+{
+  EVP_PKEY *key = NULL;
+  EVP_PKEY_CTX *context;
+  X509 *intermediate, *leaf;
+  char name[64];
+  unsigned long r;
+  long timestamp = time (NULL);
+  int result = 1;
+
+  context = EVP_PKEY_CTX_new_id (EVP_PKEY_ED25519, NULL);
+  if (context == NULL || EVP_PKEY_keygen_init (context) <= 0
+      || EVP_PKEY_keygen (context, &key) <= 0)
+    {
+      EVP_PKEY_CTX_free (context);
+      return 0;
+    }
+  EVP_PKEY_CTX_free (context);
+
+  intermediate = make_certificate (key, "Ingest Intermediate", 1);
+  for (r = 0; r < records && intermediate != NULL && result; r++)
+    {
+      snprintf (name, sizeof (name), "host-%lu.test", r);
+      leaf = make_certificate (key, name, r + 2);
+      fprintf (output, "%s:443 %ld", name, timestamp);
+      result = leaf != NULL && write_certificate (output, leaf)
+        && write_certificate (output, intermediate);
+      fprintf (output, "\n");
+      X509_free (leaf);
+    }
+
+  X509_free (intermediate);
+  EVP_PKEY_free (key);
+  return intermediate != NULL && result && !ferror (output);
+} // generate_records
+
+/**
+ * @brief Print a helpful usage message.
+ */
+static void
+print_usage ()
+{
+  printf ("usage: notary-ingest <options> [file]\n \
+           Ingests the records in file, or standard input, one per line:\n \
+	   host[:port] timestamp base64-DER-leaf [base64-DER ...]\n \
+           Options:\n \
+	   -t <threads>     Threads to fingerprint on (defaults to one per\n \
+	                    processor).\n \
+	   -g <records>     Write this many generated records to standard\n \
+	                    output instead of ingesting.\n \
+	   -o <name=value>  Set one of the notary's tunables.\n \
+	   -h               Print this help message.\n");
+} // print_usage
+
+/**
+ * @brief Ingests records, or generates them, and prints the rate.
+ * @param argc The number of command-line arguments
+ * @param argv The command-line arguments
+ * @return Returns 0 on success, 1 otherwise.
+ */
+int
+main (int argc, char *argv[])
+{
+  struct ingest_stats stats = {0};
+  struct certpool_stats pool;
+  struct history_stats history;
+  unsigned long generate = 0;
+  const char *file_name = "-";
+  double start, seconds;
+  int threads = 0, c;
+
+  while ((c = getopt (argc, argv, "t:g:o:h")) != -1)
+    {
+      switch (c)
+        {
+        case 't':
+          threads = atoi (optarg);
+          break;
+        case 'g':
+          generate = strtoul (optarg, NULL, 10);
+          break;
+        case 'o':
+          if (!set_tunable (optarg))
+            {
+              print_usage ();
+              return 1;
+            }
+          break;
+        default:
+          print_usage ();
+          return 1;
+        }
+    }
+  if (optind < argc)
+    file_name = argv[optind];
+
+  if (generate > 0)
+    return generate_records (stdout, generate) ? 0 : 1;
+
+  if (!worker_global_init ())
+    {
+      fprintf (stderr, "Could not initialize curl and OpenSSL\n");
+      return 1;
+    }
+
+  start = now ();
+  if (!ingest_file (file_name, threads, &stats))
+    return 1;
+  seconds = now () - start;
+
+  certpool_get_stats (&pool);
+  history_get_stats (&history);
+  printf ("%lu records, %lu ingested, %lu invalid, %lu refused an ID\n",
+          stats.records, stats.ingested, stats.invalid, stats.full);
+  printf ("%lu certificates decoded, %lu pooled, %lu chains\n",
+          stats.certificates, pool.certs, pool.chains);
+  printf ("%lu hosts, %lu runs, %lu bytes of history\n", history.hosts,
+          history.runs, history.bytes);
+  printf ("%.2f s, %.0f records/s, %.0f records/min\n", seconds,
+          seconds > 0 ? stats.records / seconds : 0,
+          seconds > 0 ? 60 * stats.records / seconds : 0);
+
+  worker_global_cleanup ();
+  return 0;
+} // main
@@ -0,0 +1,449 @@
+/**
+ *@file
+ *@author g-coders
+ *@date
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ *@section DESCRIPTION
+ * This program measures on loopback how each setting of the TCP profiles
+ * changes the time a client takes to connect and to get the first byte of
+ * a response, so that the listen_* and upstream_* tunables can be chosen
+ * for a given kernel. Every row applies one setting on top of a baseline
+ * with all of them off; the last applies the notary's defaults. Clients
+ * connect with the upstream profile and a server answers through a
+ * listener with the listener profile, each response written in two parts
+ * as a daemon writes its header and body.
+ */
+
+#include "notary.h"
+#include "config.h"
+#include "tcptune.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/* Most tunables a row of the benchmark sets. */
+#define MAX_SETTINGS 4
+
+/* The request a client sends and the response the server answers with. */
+static const char request[] = "GET /target/example.com+443 HTTP/1.1\r\n"
+  "Host: notary\r\n\r\n";
+static const char response_header[] = "HTTP/1.1 200 OK\r\n"
+  "Content-Type: application/json\r\nContent-Length: 205\r\n\r\n";
+static const char response_body[] =
+  "{\"fingerprintList\":[{\"timestamp\":{\"start\":\"1292636531\","
+  "\"finish\":\"1292754629\"},\"fingerprint\":"
+  "\"BF:E1:FE:03:10:E9:CB:DC:96:BF:3D:AA:6E:C6:03:E5:31:CD:A9:9C\"}],"
+  "\"signature\":\"MEUCIQDk\"}";
+
+/* Every setting off: the kernel's own behaviour. */
+static const char *baseline[] =
+  {"listen_backlog=4096", "listen_fastopen=0", "listen_defer_accept_s=0",
+   "listen_nodelay=0", "upstream_fastopen=0", "upstream_quickack=0",
+   "upstream_sndbuf=0", "upstream_rcvbuf=0", "upstream_port_min=0",
+   "upstream_port_max=0", NULL};
+
+/* One row of the benchmark: its label and the tunables it sets. */
+struct row
+{
+  const char *label;
+  const char *settings[MAX_SETTINGS + 1];
+};
+
+static const struct row rows[] =
+  {
+    {"baseline", {NULL}},
+    {"listen_nodelay", {"listen_nodelay=1", NULL}},
+    {"listen_defer_accept_s", {"listen_defer_accept_s=1", NULL}},
+    {"fastopen", {"listen_fastopen=256", "upstream_fastopen=1", NULL}},
+    {"upstream_quickack", {"upstream_quickack=1", NULL}},
+    {"upstream buffers", {"upstream_sndbuf=16384", "upstream_rcvbuf=65536",
+                          NULL}},
+    {"upstream ports", {"upstream_port_min=50000", "upstream_port_max=59999",
+                        NULL}},
+    {"listen_backlog=8", {"listen_backlog=8", NULL}},
+  };
+
+#define NUMBER_OF_ROWS (sizeof (rows) / sizeof (rows[0]))
+
+/* What a client thread needs to know, and what it measured. */
+struct client_thread
+{
+  pthread_t thread;
+  int port;
+  int connections;
+  double *connect_us;           // time connect took, per connection
+  double *first_byte_us;        // time to the first byte of the response
+  int syn_data;                 // connections whose request went in the SYN
+  int failed;
+};
+
+/**
+ * @brief Returns the current time in microseconds.
+ */
+static double
+now_us ()
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+} // now_us
+
+/**
+ * @brief Orders two doubles, for qsort.
+ */
+static int
+compare_doubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return (x > y) - (x < y);
+} // compare_doubles
+
+/**
+ * @brief Returns a percentile of sorted samples.
+ */
+static double
+percentile (const double *samples, int count, double percent)
+{
+  int i = (int) (count * percent / 100);
+
+  return samples[i < count ? i : count - 1];
+} // percentile
+
+/**
+ * @brief Opens a listener with the listener profile on a free port of the
+ *        loopback address.
+ * @return the socket, or -1 on failure
+ */
+static int
+open_listener (int *port)
+{
+  struct sockaddr_in address;
+  socklen_t length = sizeof (address);
+  int fd, on = 1;
+
+  fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+  memset (&address, 0, sizeof (address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (bind (fd, (struct sockaddr *) &address, sizeof (address)) != 0
+      || getsockname (fd, (struct sockaddr *) &address, &length) != 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  /* tcptune_listener listens with listen_backlog. */
+  tcptune_listener (fd);
+  *port = ntohs (address.sin_port);
+  return fd;
+} // open_listener
+
+/**
+ * @brief Answers every connection to the listener with the response,
+ *        closing it first so that the clients' ports are free at once,
+ *        until a connection sends nothing.
+ * @param arg The listening socket
+ */
+static void *
+serve (void *arg)
+{
+  int listener = *(int *) arg, fd;
+  char buffer[512];
+  ssize_t got;
+
+  while ((fd = accept (listener, NULL, NULL)) >= 0)
+    {
+      got = read (fd, buffer, sizeof (buffer));
+      if (got > 0
+          && (write (fd, response_header, sizeof (response_header) - 1) < 0
+              || write (fd, response_body, sizeof (response_body) - 1) < 0))
+        got = -1;
+      close (fd);
+      if (got == 0)
+        break;
+    }
+  return NULL;
+} // serve
+
+/**
+ * @brief Connects to the server over and over with the upstream profile,
+ *        timing the connection and the first byte of each response.
+ * @param arg The client_thread describing this thread
+ */
+static void *
+connect_repeatedly (void *arg)
+{
+  struct client_thread *client = arg;
+  struct sockaddr_in address;
+  struct tcp_info info;
+  socklen_t length;
+  char buffer[512];
+  double started;
+  int fd, i;
+
+  memset (&address, 0, sizeof (address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  address.sin_port = htons (client->port);
+
+  for (i = 0; i < client->connections; i++)
+    {
+      started = now_us ();
+      fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (fd < 0)
+        {
+          client->failed = 1;
+          break;
+        }
+      tcptune_upstream (fd, 1);
+      if (connect (fd, (struct sockaddr *) &address, sizeof (address)) != 0)
+        {
+          close (fd);
+          client->failed = 1;
+          break;
+        }
+      client->connect_us[i] = now_us () - started;
+
+      if (write (fd, request, sizeof (request) - 1) < 0
+          || read (fd, buffer, 1) != 1)
+        {
+          close (fd);
+          client->failed = 1;
+          break;
+        }
+      client->first_byte_us[i] = now_us () - started;
+
+      length = sizeof (info);
+      if (getsockopt (fd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0
+          && (info.tcpi_options & TCPI_OPT_SYN_DATA))
+        client->syn_data++;
+
+      while (read (fd, buffer, sizeof (buffer)) > 0)
+        ;
+      close (fd);
+    }
+  return NULL;
+} // connect_repeatedly
+
+/**
+ * @brief Applies a list of tunables.
+ * @return 1 on success, 0 if one could not be set
+ */
+static int
+apply_settings (const char *const *settings)
+{
+  int i;
+
+  for (i = 0; settings[i] != NULL; i++)
+    if (!set_tunable (settings[i]))
+      return 0;
+  return 1;
+} // apply_settings
+
+/**
+ * @brief Runs one row of the benchmark with the tunables as they are set
+ *        and prints the result.
+ * @param label The label of the row
+ * @param num_clients The number of client threads connecting at once
+ * @param connections The connections each client makes
+ * @return 1 if the row ran, 0 otherwise
+ */
+static int
+run_row (const char *label, int num_clients, int connections)
+{
+  struct client_thread *clients;
+  struct tcptune_stats before, after;
+  double *connect_us, *first_byte_us;
+  int listener, port, total = 0, syn_data = 0, failed = 0, i, fd, error;
+  int started_clients;
+  pthread_t server;
+  struct sockaddr_in address;
+
+  tcptune_get_stats (&before);
+  listener = open_listener (&port);
+  if (listener < 0)
+    {
+      fprintf (stderr, "Could not listen on loopback: %s\n", strerror (errno));
+      return 0;
+    }
+
+  clients = calloc (num_clients, sizeof (struct client_thread));
+  connect_us = calloc (num_clients * connections, sizeof (double));
+  first_byte_us = calloc (num_clients * connections, sizeof (double));
+  if (clients == NULL || connect_us == NULL || first_byte_us == NULL)
+    {
+      fprintf (stderr, "Could not allocate %d benchmark clients\n",
+               num_clients);
+      free (connect_us);
+      free (first_byte_us);
+      free (clients);
+      close (listener);
+      return 0;
+    }
+
+  error = pthread_create (&server, NULL, serve, &listener);
+  if (error != 0)
+    {
+      fprintf (stderr, "Could not start the benchmark server: %s\n",
+               strerror (error));
+      free (connect_us);
+      free (first_byte_us);
+      free (clients);
+      close (listener);
+      return 0;
+    }
+
+  for (started_clients = 0; started_clients < num_clients; started_clients++)
+    {
+      i = started_clients;
+      clients[i].port = port;
+      clients[i].connections = connections;
+      clients[i].connect_us = connect_us + i * connections;
+      clients[i].first_byte_us = first_byte_us + i * connections;
+      error = pthread_create (&clients[i].thread, NULL, connect_repeatedly,
+                              &clients[i]);
+      if (error != 0)
+        {
+          fprintf (stderr, "Could not start a benchmark client: %s\n",
+                   strerror (error));
+          break;
+        }
+    }
+
+  for (i = 0; i < started_clients; i++)
+    {
+      pthread_join (clients[i].thread, NULL);
+      failed |= clients[i].failed;
+      syn_data += clients[i].syn_data;
+    }
+
+  /* A connection that sends nothing stops the server; with
+   * TCP_DEFER_ACCEPT it is only accepted once the deferral ends. */
+  memset (&address, 0, sizeof (address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  address.sin_port = htons (port);
+  fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && connect (fd, (struct sockaddr *) &address,
+                          sizeof (address)) == 0)
+    shutdown (fd, SHUT_WR);
+  pthread_join (server, NULL);
+  if (fd >= 0)
+    close (fd);
+  close (listener);
+  tcptune_get_stats (&after);
+  if (started_clients < num_clients)
+    {
+      free (connect_us);
+      free (first_byte_us);
+      free (clients);
+      return 0;
+    }
+
+  /* A row only counts if every connection completed. */
+  if (!failed)
+    total = num_clients * connections;
+
+  if (total > 0)
+    {
+      qsort (connect_us, total, sizeof (double), compare_doubles);
+      qsort (first_byte_us, total, sizeof (double), compare_doubles);
+      printf ("%-22s %9.1f %9.1f %9.1f %9.1f %8d %7lu\n", label,
+              percentile (connect_us, total, 50),
+              percentile (connect_us, total, 99),
+              percentile (first_byte_us, total, 50),
+              percentile (first_byte_us, total, 99), syn_data,
+              after.refused - before.refused);
+    }
+  else
+    printf ("%-22s (connections failed)\n", label);
+
+  free (connect_us);
+  free (first_byte_us);
+  free (clients);
+  return total > 0;
+} // run_row
+
+/**
+ * @brief Print a helpful usage message.
+ */
+static void
+print_usage ()
+{
+  printf ("usage: notary-sockbench <options>\n \
+           Options:\n \
+	   -n <connections> Connections per client and row (defaults to 2000).\n \
+	   -c <clients>     Clients connecting at once (defaults to 1; use more\n \
+	                    than the backlog of 8 to see its effect).\n \
+	   -h               Print this help message.\n");
+} // print_usage
+
+/**
+ * @brief Measures connection and first-byte latency on loopback for each
+ *        setting of the TCP profiles, then for the notary's defaults.
+ * @param argc The number of command-line arguments
+ * @param argv The command-line arguments
+ * @return Returns 0 if every row ran, 1 otherwise.
+ */
+int
+main (int argc, char *argv[])
+{
+  struct notary_tunables defaults = tunables;
+  int connections = 2000, num_clients = 1;
+  int i, c, result = 0;
+  FILE *sysctl;
+
+  while ((c = getopt (argc, argv, "n:c:h")) != -1)
+    {
+      switch (c)
+        {
+        case 'n':
+          connections = atoi (optarg);
+          break;
+        case 'c':
+          num_clients = atoi (optarg);
+          break;
+        default:
+          print_usage ();
+          return 1;
+        }
+    }
+
+  if (connections < 1)
+    connections = 1;
+  if (num_clients < 1)
+    num_clients = 1;
+
+  /* Fast Open needs bit 1 for clients and bit 2 for servers. */
+  sysctl = fopen ("/proc/sys/net/ipv4/tcp_fastopen", "r");
+  if (sysctl != NULL && fscanf (sysctl, "%d", &c) == 1)
+    printf ("net.ipv4.tcp_fastopen = %d (clients %s, servers %s)\n", c,
+            c & 1 ? "on" : "off", c & 2 ? "on" : "off");
+  if (sysctl != NULL)
+    fclose (sysctl);
+
+  printf ("%-22s %9s %9s %9s %9s %8s %7s\n", "setting", "conn p50",
+          "conn p99", "1st p50", "1st p99", "syn data", "refused");
+  printf ("%-22s %9s %9s %9s %9s\n", "", "(us)", "(us)", "(us)", "(us)");
+  for (i = 0; i < NUMBER_OF_ROWS; i++)
+    {
+      tunables = defaults;
+      if (!apply_settings (baseline) || !apply_settings (rows[i].settings)
+          || !run_row (rows[i].label, num_clients, connections))
+        result = 1;
+    }
+
+  tunables = defaults;
+  if (!run_row ("notary defaults", num_clients, connections))
+    result = 1;
+
+  return result;
+} // main
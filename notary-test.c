@@ -11,13 +11,44 @@
  * of the convergence system.
  */
 
+#include "notary.h"
 #include <malloc.h>
 #include <stdio.h>
-#include "notary.h"
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <netinet/tcp.h>
 #include "connection.h"
 #include "certificate.h"
 #include "response.h"
 #include "cache.h"
+#include "signer.h"
+#include "merkle.h"
+#include "observation.h"
+#include "respcache.h"
+#include "worker.h"
+#include "resolver.h"
+#include "eyeballs.h"
+#include "deadline.h"
+#include "origin.h"
+#include "hedge.h"
+#include "admin.h"
+#include "negcache.h"
+#include "refresh.h"
+#include "hitters.h"
+#include "hostkey.h"
+#include "certpool.h"
+#include "history.h"
+#include "warm.h"
+#include "ingest.h"
+#include "snapshot.h"
+#include "handoff.h"
+#include "shmcache.h"
+#include "shard.h"
+#include "tlsfront.h"
+#include "tcptune.h"
+#include "config.h"
 
 //header for detecting memory leaks
 #include <mcheck.h>
@@ -25,7 +56,6 @@
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 // Globals
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-#define MAX_NO_OF_CERTS 7
 #define NUM_OF_CONNECTIONS 10
 int __tests = 0;
 int __fails = 0;
@@ -404,7 +434,7 @@ test_answer_to_connection_helper (void *cls, struct MHD_Connection *connection,
   if (*con_cls == NULL)
     {
       struct connection_info_struct *con_info;
-      con_info = malloc (sizeof (struct connection_info_struct));
+      con_info = calloc (1, sizeof (struct connection_info_struct));
 
       /* Process POST and GET request separately. Signal an error
        * on any other method.
@@ -527,7 +557,7 @@ test_request_completed_helper(void *cls, struct MHD_Connection *connection,
   if (*con_cls == NULL)
     {
       struct connection_info_struct *con_info;
-      con_info = malloc (sizeof (struct connection_info_struct));
+      con_info = calloc (1, sizeof (struct connection_info_struct));
 
       /* Process POST and GET request separately. Signal an error
        * on any other method.
@@ -634,9 +664,9 @@ test_request_completed ()
 void
 test_generate_signature()
 {
-  unsigned int *signature_size = malloc (sizeof (unsigned int));
+  size_t *signature_size = malloc (sizeof (size_t));
   unsigned char *signature;
-  RSA *private_key;
+  EVP_PKEY *private_key;
   FILE *key_file;
   char *json_fingerprint_list = 
     "{\n \
@@ -654,19 +684,315 @@ test_generate_signature()
   {
     fprintf(stderr, "Could not open convergence.key for reading.\n");
   } // if
-  private_key = PEM_read_RSAPrivateKey(key_file, NULL, NULL, NULL);
+  private_key = PEM_read_PrivateKey(key_file, NULL, NULL, NULL);
 
   /* Calculate the signature size and allocate space for it. */
-  *signature_size = (unsigned int) RSA_size(private_key);
+  *signature_size = (size_t) EVP_PKEY_size(private_key);
   signature = (unsigned char *) malloc (*signature_size);
 
-int ret_val = generate_signature((unsigned char *) json_fingerprint_list, signature, signature_size, private_key);
+int ret_val = generate_signature((unsigned char *) json_fingerprint_list, strlen(json_fingerprint_list), signature, signature_size, private_key, EVP_sha1(), NULL);
 
   /* Test the return value. */
   test(ret_val == 1);
 
 } // test_generate_signature
 
+/**
+ * @brief Generates a private key of the given type for the signer tests.
+ * @param type EVP_PKEY_RSA, EVP_PKEY_EC or EVP_PKEY_ED25519
+ * @return the new key
+ */
+static EVP_PKEY *
+generate_test_key (int type)
+{
+  EVP_PKEY *key = NULL;
+  EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_id(type, NULL);
+
+  EVP_PKEY_keygen_init(context);
+  if (type == EVP_PKEY_RSA)
+    EVP_PKEY_CTX_set_rsa_keygen_bits(context, 2048);
+  if (type == EVP_PKEY_EC)
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(context, NID_X9_62_prime256v1);
+  EVP_PKEY_keygen(context, &key);
+  EVP_PKEY_CTX_free(context);
+
+  return key;
+} // generate_test_key
+
+/**
+ * @brief Tests the signer pool: signatures made by the pool must verify with
+ *        the public half of the key it loaded, for every supported scheme.
+ */
+void
+test_signer ()
+{
+  const char *key_path = "signer-test.key";
+  const char *fingerprint_list =
+    "{\"fingerprintList\":[{\"timestamp\":{\"start\":\"1292636531\","
+    "\"finish\":\"1292754629\"},\"fingerprint\":"
+    "\"BF:E1:FE:03:10:E9:CB:DC:96:BF:3D:AA:6E:C6:03:E5:31:CD:A9:9C\"}]}";
+  int key_types[3] = {EVP_PKEY_RSA, EVP_PKEY_EC, EVP_PKEY_ED25519};
+  enum signature_scheme schemes[3] =
+    {SCHEME_RSA_SHA1, SCHEME_ECDSA_P256_SHA256, SCHEME_ED25519};
+  unsigned char *signature;
+  size_t signature_size;
+  struct signer_stats stats;
+  EVP_PKEY *private_key;
+  EVP_MD_CTX *verify_context;
+  FILE *key_file;
+  int i, j;
+
+  /* A missing key must be reported, not crash the notary. */
+  test(signer_init("no-such-file.key", 2) == 0);
+
+  for (j = 0; j < 3; j++)
+    {
+      /* Write a fresh key for the pool to load. */
+      private_key = generate_test_key(key_types[j]);
+      key_file = fopen(key_path, "w");
+      PEM_write_PrivateKey(key_file, private_key, NULL, NULL, 0, NULL, NULL);
+      fclose(key_file);
+
+      test(signature_scheme_of(private_key) == schemes[j]);
+      test(signer_init(key_path, 2) == 1);
+      test(signer_scheme() == schemes[j]);
+
+      for (i = 0; i < 4; i++)
+        {
+          test(signer_sign((const unsigned char *) fingerprint_list,
+                           strlen(fingerprint_list), &signature,
+                           &signature_size) == 1);
+          test(signature_size <= EVP_PKEY_size(private_key));
+
+          verify_context = EVP_MD_CTX_new();
+          EVP_DigestVerifyInit(verify_context, NULL,
+                               signature_scheme_digest(schemes[j]), NULL,
+                               private_key);
+          test(EVP_DigestVerify(verify_context, signature, signature_size,
+                                (const unsigned char *) fingerprint_list,
+                                strlen(fingerprint_list)) == 1);
+          EVP_MD_CTX_free(verify_context);
+          free(signature);
+        }
+
+      signer_get_stats(&stats);
+      test(stats.failures == 0);
+
+      signer_shutdown();
+      EVP_PKEY_free(private_key);
+    }
+
+  test(stats.signatures == 12);
+
+  /* After shutdown the pool refuses work. */
+  test(signer_sign((const unsigned char *) fingerprint_list,
+                   strlen(fingerprint_list), &signature,
+                   &signature_size) == 0);
+
+  /* Keys on other curves are refused when loaded. */
+  {
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    private_key = NULL;
+    EVP_PKEY_keygen_init(context);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(context, NID_secp384r1);
+    EVP_PKEY_keygen(context, &private_key);
+    EVP_PKEY_CTX_free(context);
+
+    key_file = fopen(key_path, "w");
+    PEM_write_PrivateKey(key_file, private_key, NULL, NULL, 0, NULL, NULL);
+    fclose(key_file);
+    test(signer_init(key_path, 1) == 0);
+    EVP_PKEY_free(private_key);
+  }
+
+  unlink(key_path);
+} // test_signer
+
+/**
+ * @brief Tests the Merkle tree functions: every leaf of trees of many sizes
+ *        must have a valid audit path, and tampered proofs must fail.
+ */
+void
+test_merkle ()
+{
+  unsigned char leaves[17][MERKLE_HASH_LENGTH];
+  unsigned char path[MERKLE_MAX_DEPTH][MERKLE_HASH_LENGTH];
+  unsigned char root[MERKLE_HASH_LENGTH], other[MERKLE_HASH_LENGTH];
+  unsigned char data[16];
+  size_t path_length, n, i;
+  int all_valid = 1, any_forged = 0;
+
+  for (i = 0; i < 17; i++)
+    {
+      sprintf((char *) data, "response %zu", i);
+      merkle_leaf_hash(data, strlen((char *) data), leaves[i]);
+    }
+
+  /* A single leaf is its own root. */
+  merkle_root(leaves, 1, root);
+  test(memcmp(root, leaves[0], MERKLE_HASH_LENGTH) == 0);
+
+  for (n = 1; n <= 17; n++)
+    {
+      merkle_root(leaves, n, root);
+      for (i = 0; i < n; i++)
+        {
+          if (!merkle_audit_path(leaves, n, i, path, &path_length)
+              || !merkle_verify_path(leaves[i], i, n, path, path_length, root))
+            all_valid = 0;
+
+          /* The proof must not hold for any other position or leaf. */
+          if (n > 1
+              && (merkle_verify_path(leaves[i], (i + 1) % n, n, path,
+                                     path_length, root)
+                  || merkle_verify_path(leaves[(i + 1) % n], i, n, path,
+                                        path_length, root)))
+            any_forged = 1;
+
+          /* Flipping a bit anywhere in the path breaks it. */
+          if (path_length > 0)
+            {
+              path[path_length - 1][0] ^= 1;
+              if (merkle_verify_path(leaves[i], i, n, path, path_length, root))
+                any_forged = 1;
+            }
+        }
+    }
+  test(all_valid == 1);
+  test(any_forged == 0);
+
+  /* Trees over different leaves have different roots. */
+  merkle_root(leaves, 16, root);
+  merkle_root(leaves + 1, 16, other);
+  test(memcmp(root, other, MERKLE_HASH_LENGTH) != 0);
+
+  /* Out of range indexes are refused. */
+  test(merkle_audit_path(leaves, 4, 4, path, &path_length) == 0);
+  test(merkle_verify_path(leaves[0], 4, 4, path, 2, root) == 0);
+} // test_merkle
+
+/* Arguments and results of a thread signing through the batcher. */
+struct batch_request
+{
+  pthread_t thread;
+  pthread_barrier_t *start;     // waited on before signing, if set
+  char fingerprint_list[256];
+  char *response;
+};
+
+/**
+ * @brief Signs a fingerprint list, as a client thread of the notary would.
+ */
+static void *
+sign_in_batch (void *arg)
+{
+  struct batch_request *request = arg;
+
+  if (request->start != NULL)
+    pthread_barrier_wait(request->start);
+  request->response = sign_fingerprint_list(request->fingerprint_list);
+  return NULL;
+} // sign_in_batch
+
+/**
+ * @brief Tests Merkle batch signing: concurrent responses are signed in one
+ *        batch, and every batched response verifies on its own.
+ */
+void
+test_batch_signing ()
+{
+  const char *key_path = "batch-test.key";
+  struct batch_request requests[9] = {{0}};
+  struct signer_stats before, after;
+  pthread_barrier_t start_signing;
+  EVP_PKEY *private_key = generate_test_key(EVP_PKEY_ED25519);
+  FILE *key_file;
+  char *tampered;
+  long long start;
+  int i, all_verified = 1;
+
+  key_file = fopen(key_path, "w");
+  PEM_write_PrivateKey(key_file, private_key, NULL, NULL, 0, NULL, NULL);
+  fclose(key_file);
+
+  test(signer_init(key_path, 2) == 1);
+  test(signer_batching_enabled() == false);
+
+  /* An unbatched response verifies too. */
+  tampered = sign_fingerprint_list("{\"fingerprintList\":[]}");
+  test(tampered != NULL && strstr(tampered, "\"signature\":") != NULL);
+  test(verify_response_signature(tampered, private_key) == 1);
+  free(tampered);
+
+  test(signer_enable_batching(200, 8) == 1);
+  test(signer_batching_enabled() == true);
+
+  signer_get_stats(&before);
+  for (i = 0; i < 8; i++)
+    {
+      sprintf(requests[i].fingerprint_list,
+              "{\"fingerprintList\":[{\"timestamp\":{\"start\":\"%d\","
+              "\"finish\":\"%d\"},\"fingerprint\":\"%02X\"}]}",
+              i, i + 1, i);
+      pthread_create(&requests[i].thread, NULL, sign_in_batch, &requests[i]);
+    }
+  for (i = 0; i < 8; i++)
+    pthread_join(requests[i].thread, NULL);
+  signer_get_stats(&after);
+
+  /* Eight responses, one full batch, one private key operation. */
+  test(after.batched - before.batched == 8);
+  test(after.batches - before.batches == 1);
+  test(after.signatures - before.signatures == 1);
+
+  for (i = 0; i < 8; i++)
+    {
+      if (requests[i].response == NULL
+          || strstr(requests[i].response, "\"merkleProof\":") == NULL
+          || !verify_response_signature(requests[i].response, private_key))
+        all_verified = 0;
+    }
+  test(all_verified == 1);
+
+  /* Changing the fingerprint list invalidates the proof. */
+  tampered = strdup(requests[0].response);
+  tampered[strlen("{\"fingerprintList\":[{\"timestamp\":{\"start\":\"")] = '9';
+  test(verify_response_signature(tampered, private_key) == 0);
+  free(tampered);
+
+  for (i = 0; i < 8; i++)
+    free(requests[i].response);
+
+  /* A batch filled halfway through its window leaves a response over,
+   * which gets a window of its own rather than what was left of the
+   * previous one. */
+  signer_get_stats(&before);
+  strcpy(requests[8].fingerprint_list, requests[7].fingerprint_list);
+  start = deadline_now_ms();
+  pthread_create(&requests[0].thread, NULL, sign_in_batch, &requests[0]);
+  usleep(100000);
+  pthread_barrier_init(&start_signing, NULL, 9);
+  for (i = 1; i < 9; i++)
+    {
+      requests[i].start = &start_signing;
+      pthread_create(&requests[i].thread, NULL, sign_in_batch, &requests[i]);
+    }
+  pthread_barrier_wait(&start_signing);
+  for (i = 0; i < 9; i++)
+    pthread_join(requests[i].thread, NULL);
+  pthread_barrier_destroy(&start_signing);
+  signer_get_stats(&after);
+  test(after.batches - before.batches == 2);
+  test(deadline_now_ms() - start >= 280);
+  for (i = 0; i < 9; i++)
+    free(requests[i].response);
+
+  signer_shutdown();
+  test(signer_batching_enabled() == false);
+  unlink(key_path);
+  EVP_PKEY_free(private_key);
+} // test_batch_signing
+
 /**
  * @brief Tests the function retrieve_response
  */
@@ -712,7 +1038,7 @@ test_retrieve_response ()
   
   /* Construct coninfo_cls. */
   struct connection_info_struct *coninfo_cls;
-  coninfo_cls = malloc (sizeof (struct connection_info_struct));
+  coninfo_cls = calloc (1, sizeof (struct connection_info_struct));
 
   /* Get url and corresponding fingerprint from valid_urls.txt. */
   /* If fingerprint_from_client matches the fingerprint from website, expect MHD_YES as the return value and answer code as MHD_HTTP_OK */
@@ -733,6 +1059,7 @@ test_retrieve_response ()
 
       //free used memory
       free((void*)coninfo_cls->answer_string);
+      response_cache_release(coninfo_cls->cached_response);
 
       test(result == MHD_YES);
       test(coninfo_cls->answer_code == MHD_HTTP_OK);
@@ -776,6 +1103,7 @@ test_retrieve_response ()
       result = retrieve_response(coninfo_cls, host_to_verify, fingerprint);
       //free used memory
       free((void*)coninfo_cls->answer_string);
+      response_cache_release(coninfo_cls->cached_response);
 
       test(result == MHD_YES);
       test(coninfo_cls->answer_code == MHD_HTTP_CONFLICT);
@@ -791,6 +1119,2806 @@ test_retrieve_response ()
   free(coninfo_cls);
 } // test_retrieve_post_response
 
+/**
+ * @brief Tests the response cache: a host's response is signed once and
+ *        shared, only the verdict changes per request, and a new
+ *        observation invalidates the cached response.
+ */
+void
+test_response_cache ()
+{
+  const char *key_path = "cache-test.key";
+  const char *known = "AA:BB:CC:DD:EE:FF:00:11:22:33:44:55:66:77:88:99:AA:BB:CC:DD";
+  const char *unknown = "00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00";
+  char *fingerprints[1];
+  uint32_t chain;
+  host unreachable = {"localhost", 1};
+  struct connection_info_struct first = {0}, second = {0}, third = {0};
+  struct observation observation;
+  struct signer_stats before, after;
+  struct cached_response *entry;
+  EVP_PKEY *private_key = generate_test_key(EVP_PKEY_ED25519);
+  FILE *key_file;
+  time_t now = time(NULL);
+  uint32_t id;
+
+  key_file = fopen(key_path, "w");
+  PEM_write_PrivateKey(key_file, private_key, NULL, NULL, 0, NULL, NULL);
+  fclose(key_file);
+  test(signer_init(key_path, 1) == 1);
+
+  /* Pretend the host was observed a minute ago. */
+  fingerprints[0] = (char *) known;
+  chain = certpool_chain_of_fingerprints(fingerprints, 1);
+  id = hostkey_of(&unreachable);
+  test(id != HOSTKEY_NONE);
+  observation_record(id, chain, now - 60, now - 59, &observation);
+
+  signer_get_stats(&before);
+  test(retrieve_response(&first, &unreachable, known) == MHD_YES);
+  test(first.answer_code == MHD_HTTP_OK);
+  test(first.cached_response != NULL);
+  test(verify_response_signature(first.cached_response->body, private_key));
+
+  /* The second client gets the same response, with its own verdict,
+   * without waiting for the host to be contacted again. */
+  test(retrieve_response(&second, &unreachable, unknown) == MHD_YES);
+  test(second.answer_code == MHD_HTTP_CONFLICT);
+  test(second.cached_response == first.cached_response);
+  signer_get_stats(&after);
+  test(after.signatures - before.signatures == 1);
+
+  /* A new observation invalidates the cached response. */
+  observation_record(id, chain, now - 1, now, &observation);
+  test(retrieve_response(&third, &unreachable, NULL) == MHD_YES);
+  test(third.answer_code == MHD_HTTP_OK);
+  test(third.cached_response != first.cached_response);
+  test(strstr(third.cached_response->body, "\"start\":\"") != NULL);
+  signer_get_stats(&after);
+  test(after.signatures - before.signatures == 2);
+
+  /* The replaced response stays valid until its holders let it go. */
+  entry = first.cached_response;
+  test(entry->cached == 0 && entry->references == 2);
+  response_cache_release(first.cached_response);
+  response_cache_release(second.cached_response);
+  response_cache_release(third.cached_response);
+
+  /* Responses from another time bucket are signed again. */
+  test(response_cache_lookup(id, observation.version,
+                             response_cache_bucket(now) + 1) == NULL);
+
+  signer_shutdown();
+  unlink(key_path);
+  EVP_PKEY_free(private_key);
+} // test_response_cache
+
+/**
+ * @brief Tests worker contexts: they are reused between requests and
+ *        fingerprint certificates like X509_digest does.
+ */
+void
+test_worker_context ()
+{
+  struct worker_context *first, *second, *third;
+  EVP_PKEY *key = generate_test_key(EVP_PKEY_ED25519);
+  X509 *certificate = X509_new();
+  unsigned char md[EVP_MAX_MD_SIZE], *der = NULL;
+  unsigned int md_length, i;
+  int der_length;
+  char fingerprint[FPT_LENGTH], expected[FPT_LENGTH];
+  uint32_t chain;
+  host unreachable = {"localhost", 1};
+
+  test(worker_global_init() == 1);
+  test(worker_global_init() == 1);
+
+  /* A released context is handed to the next request. */
+  first = worker_acquire();
+  test(first != NULL);
+  worker_release(first);
+  second = worker_acquire();
+  test(second == first);
+
+  /* Concurrent requests get contexts of their own. */
+  third = worker_acquire();
+  test(third != NULL && third != second);
+
+  /* Fingerprint a self-signed test certificate. */
+  ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+  X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+  X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+  X509_set_pubkey(certificate, key);
+  X509_sign(certificate, key, NULL);
+
+  X509_digest(certificate, EVP_sha1(), md, &md_length);
+  for (i = 0; i < md_length; i++)
+    sprintf(expected + 3 * i, i + 1 < md_length ? "%02x:" : "%02x", md[i]);
+
+  der_length = i2d_X509(certificate, &der);
+  test(der_length > 0);
+  test(worker_fingerprint_der(second, der, der_length, fingerprint) == 1);
+  test(strcmp(fingerprint, expected) == 0);
+  test(worker_fingerprint_der(third, der, der_length, fingerprint) == 1);
+  test(strcmp(fingerprint, expected) == 0);
+  OPENSSL_free(der);
+
+  worker_release(second);
+  worker_release(third);
+
+  /* A failed request returns its context to the pool as well. */
+  test(request_certificate(&unreachable, &chain, NULL, NULL) == 0);
+  first = worker_acquire();
+  second = worker_acquire();
+  test((first == second) == 0 && (first == third || second == third));
+  worker_release(first);
+  worker_release(second);
+
+  X509_free(certificate);
+  EVP_PKEY_free(key);
+} // test_worker_context
+
+/* A stand-in nameserver for the resolver tests. */
+struct fake_nameserver
+{
+  int socket;
+  int port;
+  int queries;
+  int last_port;                // source port of the last query
+  volatile int stop;
+  pthread_t thread;
+};
+
+/**
+ * @brief Answers DNS queries: hot.test and slow.test have the address
+ *        127.0.0.1 for four seconds, slow.test only after a delay,
+ *        big.test has it in a truncated answer, and everything else does
+ *        not exist.
+ */
+static void *
+fake_nameserver_loop (void *arg)
+{
+  struct fake_nameserver *server = arg;
+  unsigned char message[512];
+  struct sockaddr_in client;
+  socklen_t client_length;
+  ssize_t length;
+  size_t offset;
+  unsigned type;
+  char name[256];
+
+  while (!server->stop)
+    {
+      client_length = sizeof(client);
+      length = recvfrom(server->socket, message, sizeof(message) - 64, 0,
+                        (struct sockaddr *) &client, &client_length);
+      if (length < 17)
+        continue;
+      __sync_fetch_and_add(&server->queries, 1);
+      server->last_port = ntohs(client.sin_port);
+
+      /* Decode the question name. */
+      name[0] = '\0';
+      for (offset = 12; message[offset] != 0; offset += message[offset] + 1)
+        sprintf(name + strlen(name), "%s%.*s", offset == 12 ? "" : ".",
+                message[offset], message + offset + 1);
+      type = message[offset + 2];
+      offset += 5;
+
+      message[2] = 0x81;                // response, recursion desired
+      if (strcmp(name, "big.test") == 0)
+        message[2] |= 0x02;             // truncated
+      if (strcmp(name, "hot.test") != 0 && strcmp(name, "slow.test") != 0
+          && strcmp(name, "big.test") != 0)
+        {
+          /* NXDOMAIN with an SOA record whose minimum is 30 seconds. */
+          static const unsigned char soa[] =
+            {0xc0, 0x0c, 0, 6, 0, 1, 0, 0, 0x0e, 0x10, 0, 22,
+             0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1,
+             0, 0, 0, 30};
+          message[3] = 0x83;
+          message[9] = 1;               // one authority record
+          memcpy(message + offset, soa, sizeof(soa));
+          offset += sizeof(soa);
+        }
+      else if (type == 1)
+        {
+          static const unsigned char answer[] =
+            {0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0, 4, 0, 4, 127, 0, 0, 1};
+          message[3] = 0x80;
+          message[7] = 1;               // one answer
+          memcpy(message + offset, answer, sizeof(answer));
+          offset += sizeof(answer);
+          if (strcmp(name, "slow.test") == 0)
+            usleep(200000);
+        }
+      else
+        message[3] = 0x80;              // no IPv6 address
+
+      sendto(server->socket, message, offset, 0, (struct sockaddr *) &client,
+             client_length);
+    }
+  return NULL;
+} // fake_nameserver_loop
+
+/**
+ * @brief Starts a fake nameserver on a free loopback port.
+ */
+static void
+start_fake_nameserver (struct fake_nameserver *server)
+{
+  struct sockaddr_in address;
+  socklen_t address_length = sizeof(address);
+  struct timeval timeout = {0, 100000};
+
+  memset(server, 0, sizeof(*server));
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  server->socket = socket(AF_INET, SOCK_DGRAM, 0);
+  bind(server->socket, (struct sockaddr *) &address, sizeof(address));
+  getsockname(server->socket, (struct sockaddr *) &address, &address_length);
+  setsockopt(server->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+             sizeof(timeout));
+  server->port = ntohs(address.sin_port);
+  pthread_create(&server->thread, NULL, fake_nameserver_loop, server);
+} // start_fake_nameserver
+
+/**
+ * @brief Looks up slow.test from a thread of its own.
+ */
+static void *
+lookup_slow_name (void *arg)
+{
+  struct resolver_answer answer;
+
+  *(int *) arg = resolver_lookup("slow.test", &answer, 0);
+  return NULL;
+} // lookup_slow_name
+
+/**
+ * @brief Tests the resolver against a fake nameserver: answers are cached
+ *        for their TTLs, missing names too, concurrent lookups share one
+ *        resolution, hot names are refreshed early and curl gets the
+ *        addresses.
+ */
+void
+test_resolver ()
+{
+  struct fake_nameserver server;
+  struct resolver_answer answer;
+  struct resolver_stats stats;
+  struct curl_slist *list;
+  pthread_t threads[4];
+  int results[4];
+  char nameserver[32], name[RESOLVER_NAME_LENGTH];
+  long port;
+  int i, queries, first_port, all_found = 1;
+
+  start_fake_nameserver(&server);
+  snprintf(nameserver, sizeof(nameserver), "127.0.0.1:%d", server.port);
+  tunables.dns_prefetch_pct = 50;
+  test(resolver_init("not an address") == 0);
+  test(resolver_init(nameserver) == 1);
+
+  /* One resolution asks for both address families. */
+  test(resolver_lookup("hot.test", &answer, 0) == RESOLVER_OK);
+  test(answer.num_addresses == 1);
+  test(strcmp(answer.addresses[0], "127.0.0.1") == 0);
+  test(server.queries == 2);
+  first_port = server.last_port;
+
+  /* The second lookup is answered from the cache. */
+  test(resolver_lookup("HOT.test", &answer, 0) == RESOLVER_OK);
+  test(server.queries == 2);
+
+  /* Missing names are remembered too. */
+  test(resolver_lookup("missing.test", &answer, 0) == RESOLVER_NOT_FOUND);
+  test(resolver_lookup("missing.test", &answer, 0) == RESOLVER_NOT_FOUND);
+  test(server.queries == 4);
+
+  /* Every resolution asks from a port of its own. */
+  test(server.last_port != first_port);
+
+  /* A truncated answer is not cached; curl resolves the name instead. */
+  test(resolver_lookup("big.test", &answer, 0) == RESOLVER_FAILED);
+  test(resolver_lookup("big.test", &answer, 0) == RESOLVER_FAILED);
+  test(server.queries == 8);
+
+  /* Concurrent lookups of a name share one resolution. */
+  for (i = 0; i < 4; i++)
+    pthread_create(&threads[i], NULL, lookup_slow_name, &results[i]);
+  for (i = 0; i < 4; i++)
+    {
+      pthread_join(threads[i], NULL);
+      if (results[i] != RESOLVER_OK)
+        all_found = 0;
+    }
+  test(all_found == 1);
+  test(server.queries == 10);
+
+  /* Past half of its TTL, a hot name is refreshed while it is served. */
+  sleep(2);
+  usleep(500000);
+  queries = server.queries;
+  test(resolver_lookup("hot.test", &answer, 0) == RESOLVER_OK);
+  usleep(200000);
+  test(server.queries == queries + 2);
+  resolver_get_stats(&stats);
+  test(stats.prefetches == 1);
+  test(stats.coalesced == 3);
+
+  /* curl is given the address, or told to resolve literals itself. */
+  port = 0;
+  test(resolver_resolve_url("https://hot.test", &port, name, sizeof(name),
+                            &answer, 0) == RESOLVER_OK);
+  test(port == 443 && strcmp(name, "hot.test") == 0);
+  list = resolver_curl_entry(name, port, &answer);
+  test(list != NULL && strcmp(list->data, "hot.test:443:127.0.0.1") == 0);
+  curl_slist_free_all(list);
+  list = resolver_curl_entry(name, port, NULL);
+  test(list != NULL && strcmp(list->data, "-hot.test:443") == 0);
+  curl_slist_free_all(list);
+  test(resolver_resolve_url("https://127.0.0.1", &port, name, sizeof(name),
+                            &answer, 0) == RESOLVER_FAILED);
+
+  resolver_shutdown();
+  test(resolver_enabled() == 0);
+  tunables.dns_prefetch_pct = 10;
+  server.stop = 1;
+  pthread_join(server.thread, NULL);
+  close(server.socket);
+} // test_resolver
+
+/* A pair of loopback listeners on one port, one of which is made slow. */
+struct listener_pair
+{
+  int ipv4;
+  int ipv6;
+  int port;
+  int stalled[16];
+  int num_stalled;
+};
+
+/**
+ * @brief Listens on 127.0.0.1 and ::1 with the same port, and fills the
+ *        accept queue of the listener of one family, so that further
+ *        connections to it hang in the handshake.
+ */
+static void
+start_listener_pair (struct listener_pair *pair, int slow_family)
+{
+  struct sockaddr_in ipv4;
+  struct sockaddr_in6 ipv6;
+  socklen_t length = sizeof(ipv4);
+  struct pollfd client;
+  int one = 1;
+
+  memset(pair, 0, sizeof(*pair));
+  memset(&ipv4, 0, sizeof(ipv4));
+  memset(&ipv6, 0, sizeof(ipv6));
+
+  ipv4.sin_family = AF_INET;
+  ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  pair->ipv4 = socket(AF_INET, SOCK_STREAM, 0);
+  bind(pair->ipv4, (struct sockaddr *) &ipv4, sizeof(ipv4));
+  getsockname(pair->ipv4, (struct sockaddr *) &ipv4, &length);
+  pair->port = ntohs(ipv4.sin_port);
+
+  ipv6.sin6_family = AF_INET6;
+  ipv6.sin6_addr = in6addr_loopback;
+  ipv6.sin6_port = ipv4.sin_port;
+  pair->ipv6 = socket(AF_INET6, SOCK_STREAM, 0);
+  setsockopt(pair->ipv6, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one));
+  bind(pair->ipv6, (struct sockaddr *) &ipv6, sizeof(ipv6));
+
+  listen(pair->ipv4, slow_family == AF_INET ? 0 : 16);
+  listen(pair->ipv6, slow_family == AF_INET6 ? 0 : 16);
+
+  /* Connect until a handshake no longer completes. */
+  while (pair->num_stalled < 16)
+    {
+      client.fd = socket(slow_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+      client.events = POLLOUT;
+      pair->stalled[pair->num_stalled++] = client.fd;
+      if (slow_family == AF_INET)
+        connect(client.fd, (struct sockaddr *) &ipv4, sizeof(ipv4));
+      else
+        connect(client.fd, (struct sockaddr *) &ipv6, sizeof(ipv6));
+      if (poll(&client, 1, 50) == 0)
+        break;
+    }
+} // start_listener_pair
+
+/**
+ * @brief Closes a pair of listeners and the connections that stalled one.
+ */
+static void
+stop_listener_pair (struct listener_pair *pair)
+{
+  int i;
+
+  for (i = 0; i < pair->num_stalled; i++)
+    close(pair->stalled[i]);
+  close(pair->ipv4);
+  close(pair->ipv6);
+} // stop_listener_pair
+
+/**
+ * @brief Returns the milliseconds elapsed since a point in time.
+ */
+static long
+elapsed_ms (struct timespec *since)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) * 1000
+    + (now.tv_nsec - since->tv_nsec) / 1000000;
+} // elapsed_ms
+
+/**
+ * @brief Tests connection racing: the working family wins soon after the
+ *        head start of the broken one, and the winner is tried first next
+ *        time.
+ */
+void
+test_eyeballs ()
+{
+  struct resolver_answer answer;
+  struct listener_pair pair;
+  struct eyeballs_stats stats;
+  struct timespec start;
+  int fd, winner = -1;
+  long took;
+
+  memset(&answer, 0, sizeof(answer));
+  strcpy(answer.addresses[0], "::1");
+  answer.families[0] = AF_INET6;
+  strcpy(answer.addresses[1], "127.0.0.1");
+  answer.families[1] = AF_INET;
+  answer.num_addresses = 2;
+  tunables.eyeballs_delay_ms = 100;
+  tunables.eyeballs_timeout_ms = 3000;
+
+  /* IPv6 goes first but hangs; IPv4 wins after its head start. */
+  start_listener_pair(&pair, AF_INET6);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  fd = eyeballs_connect("https://broken-ipv6.test", &answer, pair.port, 0,
+                        &winner);
+  took = elapsed_ms(&start);
+  test(fd >= 0 && winner == 1);
+  test(took >= 100 && took < 1000);
+  close(fd);
+
+  /* The next race starts with the family that won. */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  fd = eyeballs_connect("https://broken-ipv6.test", &answer, pair.port, 0,
+                        &winner);
+  took = elapsed_ms(&start);
+  test(fd >= 0 && winner == 1);
+  test(took < 100);
+  close(fd);
+  test(eyeballs_destination_stats("https://broken-ipv6.test", &stats) == 1);
+  test(stats.races == 2 && stats.ipv4_wins == 2 && stats.fallbacks == 1);
+  stop_listener_pair(&pair);
+
+  /* With IPv4 broken, IPv6 wins at once. */
+  start_listener_pair(&pair, AF_INET);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  fd = eyeballs_connect("https://broken-ipv4.test", &answer, pair.port, 0,
+                        &winner);
+  took = elapsed_ms(&start);
+  test(fd >= 0 && winner == 0);
+  test(took < 100);
+  close(fd);
+  test(eyeballs_destination_stats("https://broken-ipv4.test", &stats) == 1);
+  test(stats.ipv6_wins == 1 && stats.fallbacks == 0);
+  stop_listener_pair(&pair);
+
+  /* Nothing listening at all is a failed race. */
+  fd = eyeballs_connect("https://nothing.test", &answer, 1, 0, &winner);
+  test(fd == -1);
+  eyeballs_get_stats(&stats);
+  test(stats.races == 4 && stats.failures == 1);
+
+  tunables.eyeballs_delay_ms = 250;
+  tunables.eyeballs_timeout_ms = 10000;
+} // test_eyeballs
+
+/* Arguments and result of a thread that waits for a fetch slot. */
+struct slot_waiter
+{
+  struct deadline deadline;
+  int acquired;
+};
+
+/**
+ * @brief Waits for a fetch slot of slow.test from a thread of its own.
+ */
+static void *
+wait_for_slot (void *arg)
+{
+  struct slot_waiter *waiter = arg;
+
+  waiter->acquired = origin_acquire("slow.test:443", &waiter->deadline);
+  return NULL;
+} // wait_for_slot
+
+/**
+ * @brief Tests verification deadlines: stages get their budgets out of the
+ *        deadline, a blackholed or silent host is given up on in time, a
+ *        client that hangs up cancels its verification and the fetches of
+ *        one origin are capped.
+ */
+void
+test_deadline ()
+{
+  struct deadline deadline;
+  struct deadline_stats before, after;
+  struct origin_stats origins, origins_before;
+  struct listener_pair pair;
+  struct slot_waiter waiter;
+  struct fake_nameserver server;
+  struct timespec start;
+  pthread_t thread;
+  char url[64], nameserver[32];
+  uint32_t chain;
+  host blackholed = {url, 0};
+  int client[2];
+  long budget;
+
+  tunables.verify_sign_ms = 200;
+  tunables.verify_connect_ms = 3000;
+  tunables.verify_tls_ms = 300;
+  tunables.verify_queue_ms = 100;
+
+  /* Stages before signing leave the signing budget alone. */
+  deadline_start(&deadline, 1000, NULL);
+  budget = deadline_budget_ms(&deadline, DEADLINE_CONNECT);
+  test(budget > 700 && budget <= 800);
+  test(deadline_budget_ms(&deadline, DEADLINE_TLS) == 300);
+  test(deadline_budget_ms(&deadline, DEADLINE_SIGN) == 200);
+  test(deadline_expired(&deadline) == 0);
+
+  deadline_start(&deadline, 0, NULL);
+  test(deadline_expired(&deadline) == 1);
+  test(deadline_budget_ms(&deadline, DEADLINE_SIGN) == 0);
+
+  /* A client that hangs up cancels its verification; one that only
+   * finished sending its request does not. */
+  socketpair(AF_UNIX, SOCK_STREAM, 0, client);
+  deadline_start(&deadline, 10000, NULL);
+  deadline.client_fd = client[0];
+  deadline.watching = 1;
+  test(deadline_expired(&deadline) == 0);
+  shutdown(client[1], SHUT_WR);
+  test(deadline_expired(&deadline) == 0);
+  close(client[1]);
+  test(deadline_expired(&deadline) == 1 && deadline.cancelled == 1);
+  close(client[0]);
+
+  /* A host that never completes a handshake is given up on in time. */
+  deadline_get_stats(&before);
+  start_listener_pair(&pair, AF_INET);
+  snprintf(url, sizeof(url), "https://127.0.0.1:%d", pair.port);
+  deadline_start(&deadline, 800, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  test(request_certificate(&blackholed, &chain, &deadline, NULL) == 0);
+  budget = elapsed_ms(&start);
+  test(budget >= 500 && budget < 1000);
+
+  stop_listener_pair(&pair);
+
+  /* One that accepts but never answers the ClientHello runs out in TLS. */
+  start_fake_nameserver(&server);
+  snprintf(nameserver, sizeof(nameserver), "127.0.0.1:%d", server.port);
+  test(resolver_init(nameserver) == 1);
+  start_listener_pair(&pair, AF_INET6);
+  snprintf(url, sizeof(url), "https://hot.test:%d", pair.port);
+  deadline_start(&deadline, 10000, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  test(request_certificate(&blackholed, &chain, &deadline, NULL) == 0);
+  budget = elapsed_ms(&start);
+  test(budget >= 300 && budget < 600);
+
+  /* A cancelled verification does not contact the host at all. */
+  deadline_cancel(&deadline);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  test(request_certificate(&blackholed, &chain, &deadline, NULL) == 0);
+  test(elapsed_ms(&start) < 100);
+  stop_listener_pair(&pair);
+  resolver_shutdown();
+  server.stop = 1;
+  pthread_join(server.thread, NULL);
+  close(server.socket);
+
+  deadline_get_stats(&after);
+  test(after.expired[DEADLINE_CONNECT] - before.expired[DEADLINE_CONNECT]
+       == 1);
+  test(after.expired[DEADLINE_TLS] - before.expired[DEADLINE_TLS] == 1);
+  test(after.cancelled - before.cancelled == 1);
+
+  /* With one fetch per origin, a second waits for the first. */
+  origin_get_stats(&origins_before);
+  tunables.origin_max_inflight = 1;
+  deadline_start(&deadline, 10000, NULL);
+  test(origin_acquire("slow.test:443", &deadline) == 1);
+  test(origin_acquire("SLOW.test:443", &deadline) == 0);
+  test(origin_acquire("other.test:443", &deadline) == 1);
+
+  tunables.verify_queue_ms = 2000;
+  deadline_start(&waiter.deadline, 10000, NULL);
+  pthread_create(&thread, NULL, wait_for_slot, &waiter);
+  usleep(50000);
+  origin_release("slow.test:443");
+  pthread_join(thread, NULL);
+  test(waiter.acquired == 1);
+
+  origin_get_stats(&origins);
+  test(origins.acquired - origins_before.acquired == 3);
+  test(origins.queued - origins_before.queued == 1);
+  test(origins.rejected - origins_before.rejected == 1);
+  test(origins.origins == 2);
+  origin_release("slow.test:443");
+  origin_release("other.test:443");
+  origin_get_stats(&origins);
+  test(origins.origins == 0);
+
+  tunables.origin_max_inflight = 4;
+  tunables.verify_sign_ms = 1000;
+  tunables.verify_connect_ms = 3000;
+  tunables.verify_tls_ms = 4000;
+  tunables.verify_queue_ms = 2000;
+} // test_deadline
+
+/* A TLS server whose first connection may never get a handshake. */
+struct stalling_server
+{
+  int socket;
+  int port;
+  int stall_first;              // whether to leave the first one hanging
+  int serve;                    // connections to answer after that
+  int stalled;                  // the connection left hanging, or -1
+  SSL_CTX *context;
+  pthread_t thread;
+};
+
+/**
+ * @brief Accepts connections: the first may be left without a handshake,
+ *        the next ones get one and an empty HTTP response.
+ */
+static void *
+stalling_server_loop (void *arg)
+{
+  struct stalling_server *server = arg;
+  char request[1024];
+  SSL *ssl;
+  int fd, i;
+
+  server->stalled = -1;
+  if (server->stall_first)
+    server->stalled = accept(server->socket, NULL, NULL);
+
+  for (i = 0; i < server->serve; i++)
+    {
+      fd = accept(server->socket, NULL, NULL);
+      if (fd < 0)
+        return NULL;
+
+      ssl = SSL_new(server->context);
+      SSL_set_fd(ssl, fd);
+      if (SSL_accept(ssl) == 1)
+        {
+          SSL_read(ssl, request, sizeof(request));
+          SSL_write(ssl, "HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n",
+                    38);
+          SSL_shutdown(ssl);
+        }
+      SSL_free(ssl);
+      close(fd);
+    }
+  return NULL;
+} // stalling_server_loop
+
+/**
+ * @brief Tests hedged fetches: the latency history of an origin sets when
+ *        a fetch is hedged, the budget caps hedges, and a hedge to a host
+ *        whose first connection stalls wins.
+ */
+void
+test_hedge ()
+{
+  struct stalling_server server;
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+  struct hedge_stats before, after;
+  struct hedge_origin_stats history;
+  struct timespec start;
+  EVP_PKEY *key = generate_test_key(EVP_PKEY_ED25519);
+  X509 *certificate = X509_new();
+  char url[64], origin[HOSTKEY_LENGTH];
+  uint32_t chain;
+  host stalling = {url, 0};
+  char *metrics, line[64];
+  long delay;
+  int i, allowed;
+
+  /* An origin is only hedged once it has enough history. */
+  for (i = 0; i < tunables.hedge_min_samples - 1; i++)
+    hedge_observe("steady.test:443", 10, 0);
+  test(hedge_delay_ms("steady.test:443") == 0);
+  hedge_observe("steady.test:443", 10, 0);
+  delay = hedge_delay_ms("steady.test:443");
+  test(delay >= 10 && delay < 20);
+  test(hedge_origin_stats("steady.test:443", &history) == 1);
+  test(history.samples == 20 && history.ewma_ms == 10);
+  test(hedge_origin_stats("unknown.test:443", &history) == 0);
+
+  /* A slow tail moves the quantile up. */
+  for (i = 0; i < 5; i++)
+    hedge_observe("steady.test:443", 400, 0);
+  test(hedge_delay_ms("steady.test:443") >= 400);
+
+  /* The budget allows a burst, then one hedge per 1 / hedge_budget_pct
+   * fetches. */
+  for (allowed = 0; hedge_start(); allowed++)
+    ;
+  test(allowed > 0 && allowed <= HEDGE_MAX_TOKENS);
+  test(hedge_start() == 0);
+  for (i = 0; i < 100 / tunables.hedge_budget_pct; i++)
+    hedge_observe("other.test:443", 10, 0);
+  test(hedge_start() == 1 && hedge_start() == 0);
+
+  /* A hedge that wins is credited with the time the slow tail takes. */
+  hedge_get_stats(&before);
+  hedge_observe("steady.test:443", 30, 1);
+  hedge_get_stats(&after);
+  test(after.hedge_wins - before.hedge_wins == 1);
+  test(after.saved_ms - before.saved_ms > 300);
+
+  /* Serve a self-signed certificate on a loopback port. */
+  ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+  X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+  X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+  X509_set_pubkey(certificate, key);
+  X509_sign(certificate, key, NULL);
+  server.context = SSL_CTX_new(TLS_server_method());
+  SSL_CTX_use_certificate(server.context, certificate);
+  SSL_CTX_use_PrivateKey(server.context, key);
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  server.socket = socket(AF_INET, SOCK_STREAM, 0);
+  bind(server.socket, (struct sockaddr *) &address, sizeof(address));
+  listen(server.socket, 4);
+  getsockname(server.socket, (struct sockaddr *) &address, &length);
+  server.port = ntohs(address.sin_port);
+  server.stall_first = 1;
+  server.serve = 1;
+  pthread_create(&server.thread, NULL, stalling_server_loop, &server);
+
+  /* The host usually answers within 50 ms; this time the first connection
+   * stalls and the hedge gets the certificate. */
+  snprintf(url, sizeof(url), "https://127.0.0.1:%d", server.port);
+  hostkey_canonicalize(stalling.url, stalling.port, origin, sizeof(origin));
+  for (i = 0; i < tunables.hedge_min_samples; i++)
+    hedge_observe(origin, 50, 0);
+  for (i = 0; i < 100 / tunables.hedge_budget_pct; i++)
+    hedge_observe("other.test:443", 10, 0);
+
+  hedge_get_stats(&before);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  test(request_certificate(&stalling, &chain, NULL, NULL) == 1);
+  test(elapsed_ms(&start) < 1000);
+  hedge_get_stats(&after);
+  test(after.hedges - before.hedges == 1);
+  test(after.hedge_wins - before.hedge_wins == 1);
+
+  /* The counters are exported for the admin interface. */
+  metrics = admin_format_metrics();
+  test(metrics != NULL);
+  snprintf(line, sizeof(line), "\nnotary_hedge_wins_total %lu\n",
+           after.hedge_wins);
+  test(strstr(metrics, line) != NULL);
+  test(strstr(metrics, "notary_deadline_expired_total{stage=\"tls\"}")
+       != NULL);
+  free(metrics);
+
+  pthread_join(server.thread, NULL);
+  close(server.stalled);
+  close(server.socket);
+  SSL_CTX_free(server.context);
+  X509_free(certificate);
+  EVP_PKEY_free(key);
+} // test_hedge
+
+/**
+ * @brief Tests the negative cache: backoff windows grow exponentially with
+ *        jitter up to a cap, and requests about a host that just failed are
+ *        answered at once without contacting it.
+ */
+void
+test_negative_cache ()
+{
+  struct connection_info_struct first = {0}, second = {0}, third = {0};
+  struct connection_info_struct unknown = {0};
+  struct negcache_stats before, after;
+  struct hostkey_stats hosts_before, hosts_after;
+  host refusing = {"127.0.0.1", 2}, never_observed = {"127.0.0.1", 3};
+  struct timespec start;
+  uint32_t example = hostkey_intern("example.org:443");
+  uint32_t other = hostkey_intern("example.net:443");
+  uint32_t id, chain;
+  char *metrics;
+  long window, retry_ms;
+  int failure_class, i;
+
+  negcache_clear();
+  tunables.negative_base_ms = 200;
+  tunables.negative_max_ms = 800;
+
+  /* Each failure doubles the window, less up to half of it as jitter. */
+  test(negcache_check(example, NULL, NULL) == 0);
+  for (i = 0; i < 5; i++)
+    {
+      window = negcache_failure(example, NEGCACHE_TLS);
+      test(window >= (100 << (i < 2 ? i : 2)));
+      test(window <= (200 << (i < 2 ? i : 2)));
+    }
+  test(negcache_check(example, &failure_class, &retry_ms) == 1);
+  test(failure_class == NEGCACHE_TLS);
+  test(retry_ms > 0 && retry_ms <= 800);
+  test(strcmp(negcache_class_name(failure_class), "tls") == 0);
+
+  /* Failures that are not the host's fault are not cached. */
+  test(negcache_failure(other, NEGCACHE_NONE) == 0);
+  test(negcache_check(other, NULL, NULL) == 0);
+
+  /* A host that answers again is forgotten. */
+  negcache_get_stats(&before);
+  negcache_success(example);
+  test(negcache_check(example, NULL, NULL) == 0);
+  negcache_get_stats(&after);
+  test(after.recoveries - before.recoveries == 1);
+  test(after.entries == before.entries - 1);
+
+  /* A host that was never observed is contacted without being given an
+   * ID, so requests about hosts that do not exist leave nothing behind. */
+  hostkey_get_stats(&hosts_before);
+  test(retrieve_response(&unknown, &never_observed, NULL) == MHD_NO);
+  test(unknown.answer_code == MHD_HTTP_SERVICE_UNAVAILABLE);
+  test(hostkey_find("127.0.0.1:3") == HOSTKEY_NONE);
+  hostkey_get_stats(&hosts_after);
+  test(hosts_after.interned == hosts_before.interned);
+
+  /* The first request about a refusing host contacts it. */
+  id = hostkey_of(&refusing);
+  test(id != HOSTKEY_NONE);
+  negcache_get_stats(&before);
+  test(retrieve_response(&first, &refusing, NULL) == MHD_NO);
+  test(first.answer_code == MHD_HTTP_SERVICE_UNAVAILABLE);
+  negcache_get_stats(&after);
+  test(after.failures[NEGCACHE_CONNECT] - before.failures[NEGCACHE_CONNECT]
+       == 1);
+
+  /* The next one fails at once, without another attempt. */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  test(retrieve_response(&second, &refusing, NULL) == MHD_NO);
+  test(elapsed_ms(&start) < 50);
+  test(second.answer_code == MHD_HTTP_SERVICE_UNAVAILABLE);
+  negcache_get_stats(&after);
+  test(after.hits - before.hits == 1);
+  test(after.failures[NEGCACHE_CONNECT] - before.failures[NEGCACHE_CONNECT]
+       == 1);
+
+  /* Once the window has passed, the host is tried again, and a further
+   * failure backs off for longer. */
+  test(negcache_check(id, NULL, &retry_ms) == 1);
+  usleep((retry_ms + 10) * 1000);
+  test(retrieve_response(&third, &refusing, NULL) == MHD_NO);
+  negcache_get_stats(&after);
+  test(after.failures[NEGCACHE_CONNECT] - before.failures[NEGCACHE_CONNECT]
+       == 2);
+  test(negcache_check(id, NULL, &retry_ms) == 1);
+  test(retry_ms > 100);
+
+  /* With Fast Open the connection is only made by the first write, and a
+   * host refusing it still failed to connect. */
+  tunables.upstream_fastopen = 1;
+  test(request_certificate(&refusing, &chain, NULL, &failure_class) == 0);
+  test(failure_class == NEGCACHE_CONNECT);
+  tunables.upstream_fastopen = 0;
+
+  /* The counters are exported for the admin interface. */
+  metrics = admin_format_metrics();
+  test(metrics != NULL);
+  test(strstr(metrics, "notary_host_failures_total{class=\"connect\"}")
+       != NULL);
+  free(metrics);
+
+  free((void *) first.answer_string);
+  free((void *) second.answer_string);
+  free((void *) third.answer_string);
+  negcache_clear();
+  tunables.negative_base_ms = 1000;
+  tunables.negative_max_ms = 60000;
+} // test_negative_cache
+
+/**
+ * @brief Tests background refreshes: a popular host about to expire is
+ *        handed out for refreshing once, keeps being served while the
+ *        refresh runs, and gets a new observation from it.
+ */
+void
+test_refresh ()
+{
+  const char *key_path = "refresh-test.key";
+  const char *known = "AA:BB:CC:DD:EE:FF:00:11:22:33:44:55:66:77:88:99:AA:BB:CC:DD";
+  struct connection_info_struct first = {0}, second = {0}, third = {0};
+  struct stalling_server server;
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+  struct refresh_stats before, after;
+  struct observation observation, refreshed;
+  EVP_PKEY *key = generate_test_key(EVP_PKEY_ED25519);
+  X509 *certificate = X509_new();
+  char url[64], finish[32];
+  char *fingerprints[1] = {(char *) known};
+  uint32_t chain = certpool_chain_of_fingerprints(fingerprints, 1);
+  const uint32_t *certs;
+  int num_certs;
+  host popular = {url, 0};
+  FILE *key_file;
+  time_t now = time(NULL);
+  uint32_t test_id = hostkey_intern("popular.test:443"), id;
+  uint32_t disputed = hostkey_intern("disputed.test:443");
+
+  key_file = fopen(key_path, "w");
+  PEM_write_PrivateKey(key_file, key, NULL, NULL, 0, NULL, NULL);
+  fclose(key_file);
+  test(signer_init(key_path, 1) == 1);
+  tunables.observation_ttl = 100;
+
+  /* Only the second lookup of a host near expiry asks for a refresh, and
+   * only once until the refresh is done. */
+  observation_record(test_id, chain, now - 200, now - 95, &observation);
+  test(observation_lookup(test_id, &observation)
+       == OBSERVATION_FRESH);
+  test(observation_lookup(test_id, &observation)
+       == OBSERVATION_REFRESH);
+  test(observation_lookup(test_id, &observation)
+       == OBSERVATION_FRESH);
+  observation_refresh_done(test_id);
+  test(observation_lookup(test_id, &observation)
+       == OBSERVATION_REFRESH);
+
+  /* A client showing another fingerprint has a host refreshed only once
+   * its observation is mismatch_recheck_s old, and only once until the
+   * refresh is done. */
+  tunables.mismatch_recheck_s = 60;
+  observation_record(disputed, chain, now - 30, now - 30, &observation);
+  test(observation_recheck(disputed) == 0);
+  tunables.mismatch_recheck_s = 20;
+  test(observation_recheck(disputed) == 1);
+  test(observation_recheck(disputed) == 0);
+  test(observation_lookup(disputed, &observation) == OBSERVATION_FRESH);
+  observation_refresh_done(disputed);
+  tunables.mismatch_recheck_s = 0;
+  test(observation_recheck(disputed) == 0);
+  tunables.mismatch_recheck_s = 60;
+
+  /* Refreshes beyond the budget are dropped. */
+  tunables.refresh_max_inflight = 0;
+  refresh_get_stats(&before);
+  test(refresh_start(&popular, test_id) == 0);
+  refresh_get_stats(&after);
+  test(after.dropped - before.dropped == 1);
+  test(after.started == before.started);
+  test(observation_lookup(test_id, &observation)
+       == OBSERVATION_REFRESH);
+  tunables.refresh_max_inflight = 4;
+
+  /* Serve a self-signed certificate on a loopback port. */
+  ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+  X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+  X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+  X509_set_pubkey(certificate, key);
+  X509_sign(certificate, key, NULL);
+  server.context = SSL_CTX_new(TLS_server_method());
+  SSL_CTX_use_certificate(server.context, certificate);
+  SSL_CTX_use_PrivateKey(server.context, key);
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  server.socket = socket(AF_INET, SOCK_STREAM, 0);
+  bind(server.socket, (struct sockaddr *) &address, sizeof(address));
+  listen(server.socket, 4);
+  getsockname(server.socket, (struct sockaddr *) &address, &length);
+  server.port = ntohs(address.sin_port);
+  server.stall_first = 0;
+  server.serve = 1;
+  pthread_create(&server.thread, NULL, stalling_server_loop, &server);
+
+  /* The host was last seen 95 s ago and its observation expires in 5 s. */
+  snprintf(url, sizeof(url), "https://127.0.0.1:%d", server.port);
+  id = hostkey_of(&popular);
+  observation_record(id, chain, now - 200, now - 95, &observation);
+
+  /* The second client starts a refresh and is answered from the
+   * observation we have, with its original timestamps. */
+  refresh_get_stats(&before);
+  test(retrieve_response(&first, &popular, known) == MHD_YES);
+  test(retrieve_response(&second, &popular, known) == MHD_YES);
+  test(second.answer_code == MHD_HTTP_OK);
+  test(second.cached_response == first.cached_response);
+  snprintf(finish, sizeof(finish), "\"finish\":\"%ld\"", (long) now - 95);
+  test(strstr(second.cached_response->body, finish) != NULL);
+
+  /* The refresh records what the host shows now. */
+  refresh_drain();
+  refresh_get_stats(&after);
+  test(after.started - before.started == 1);
+  test(after.refreshed - before.refreshed == 1);
+  test(after.inflight == 0);
+  test(observation_lookup(id, &refreshed) == OBSERVATION_FRESH);
+  test(refreshed.version != observation.version);
+  certs = certpool_chain_certs(refreshed.chain, &num_certs);
+  test(num_certs == 1);
+  test(strcmp(certpool_fingerprint(certs[0]), known) != 0);
+  test(refreshed.first_seen >= now && refreshed.last_seen >= now);
+  test(refreshed.expires >= now + 100);
+
+  /* A client still showing the old certificate is told so at once, and
+   * cannot have the host contacted again while the observation is new. */
+  refresh_get_stats(&before);
+  test(retrieve_response(&third, &popular, known) == MHD_YES);
+  test(third.answer_code == MHD_HTTP_CONFLICT);
+  refresh_get_stats(&after);
+  test(after.started == before.started);
+
+  response_cache_release(first.cached_response);
+  response_cache_release(second.cached_response);
+  response_cache_release(third.cached_response);
+  pthread_join(server.thread, NULL);
+  close(server.socket);
+  SSL_CTX_free(server.context);
+  X509_free(certificate);
+  EVP_PKEY_free(key);
+  signer_shutdown();
+  unlink(key_path);
+  tunables.observation_ttl = 600;
+} // test_refresh
+
+/**
+ * @brief Tests heavy-hitter tracking: the top-K table finds the most
+ *        requested hosts in a skewed stream, counts are halved every
+ *        window, and the observation cache spares heavy hitters.
+ */
+void
+test_hitters ()
+{
+  struct hitter top[HITTERS_TOP];
+  struct hitters_stats before, after;
+  struct observation_stats cache_before, cache_after;
+  struct observation observation;
+  char key[HOSTKEY_LENGTH], expected[64];
+  char *fingerprints[1] = {"AA:BB:CC:DD:EE:FF:00:11:22:33:44:55:66:77:88:99:AA:BB:CC:DD"};
+  uint32_t chain = certpool_chain_of_fingerprints(fingerprints, 1);
+  char *text;
+  unsigned long estimate;
+  int count, i, j, found;
+  time_t now = time(NULL);
+  uint32_t heavy = hostkey_intern("heavy.test:443");
+
+  /* One host takes a fifth of the requests, nine more take 100 each and
+   * 4000 others are seen once. */
+  hitters_clear();
+  for (i = 0; i < 4000; i++)
+    {
+      snprintf(key, sizeof(key), "once-%d.test:443", i);
+      hitters_record(hostkey_intern(key));
+      if (i % 4 == 0)
+        hitters_record(heavy);
+      if (i % 4 == 1)
+        {
+          snprintf(key, sizeof(key), "warm-%d.test:443", i / 4 % 9);
+          hitters_record(hostkey_intern(key));
+        }
+    }
+
+  count = hitters_top(top, HITTERS_TOP);
+  test(count >= 10 && count <= HITTERS_TOP);
+  test(top[0].id == heavy);
+  test(top[0].count >= 1000 && top[0].count < 1100);
+  for (i = 0; i < 9; i++)
+    {
+      snprintf(key, sizeof(key), "warm-%d.test:443", i);
+      for (found = 0, j = 1; j < 10; j++)
+        found |= top[j].id == hostkey_find(key);
+      test(found && hitters_is_heavy(hostkey_find(key)));
+    }
+  test(hitters_is_heavy(hostkey_find("once-17.test:443")) == 0);
+  estimate = hitters_estimate(heavy);
+  test(estimate >= 1000 && estimate < 1100);
+  test(hitters_estimate(hostkey_intern("never.test:443"))
+       < HITTERS_MIN_COUNT);
+
+  text = hitters_format();
+  test(text != NULL);
+  snprintf(expected, sizeof(expected), "\n%lu heavy.test:443\n",
+           top[0].count);
+  test(strstr(text, expected) != NULL);
+  free(text);
+
+  /* Counts are halved once a window of requests has passed. */
+  tunables.hitters_window = 1000;
+  hitters_get_stats(&before);
+  for (i = 0; i < 1000; i++)
+    {
+      snprintf(key, sizeof(key), "later-%d.test:443", i);
+      hitters_record(hostkey_intern(key));
+    }
+  hitters_get_stats(&after);
+  test(after.halvings - before.halvings == 1);
+  test(hitters_estimate(heavy) <= estimate / 2 + 100);
+  test(hitters_is_heavy(heavy));
+  test(after.tracked <= HITTERS_TOP);
+  tunables.hitters_window = 100000;
+
+  /* A host leaving the window of a full observation cache is evicted if it
+   * was requested less often than the host it would displace. */
+  tunables.observation_max_hosts = 2;
+  observation_record(heavy, chain, now, now, &observation);
+  observation_record(hostkey_intern("cold-1.test:443"), chain, now, now,
+                     &observation);
+  observation_get_stats(&cache_before);
+  observation_record(hostkey_intern("cold-2.test:443"), chain, now, now,
+                     &observation);
+  observation_get_stats(&cache_after);
+  test(cache_after.rejected - cache_before.rejected == 1);
+  test(cache_after.evictions - cache_before.evictions == 1);
+  test(observation_lookup(heavy, &observation) != 0);
+  test(observation_lookup(hostkey_find("cold-1.test:443"), &observation)
+       == 0);
+  tunables.observation_max_hosts = 100000;
+  hitters_clear();
+} // test_hitters
+
+/**
+ * @brief Requests the observation of a host the way retrieve_response does,
+ *        recording one when there is none.
+ *
+ * @return 1 on a hit, 0 on a miss
+ */
+static int
+request_observation (const char *key)
+{
+  uint32_t id = hostkey_intern(key);
+  char *fingerprints[1] = {"AA:BB:CC:DD:EE:FF:00:11:22:33:44:55:66:77:88:99:AA:BB:CC:DD"};
+  struct observation observation;
+  time_t now = time(NULL);
+
+  hitters_record(id);
+  if (observation_lookup(id, &observation) != OBSERVATION_MISSING)
+    return 1;
+  observation_record(id, certpool_chain_of_fingerprints(fingerprints, 1),
+                     now, now, &observation);
+  return 0;
+} // request_observation
+
+/**
+ * @brief Tests that the observation cache keeps the hosts requested again
+ *        and again through a scan of hosts requested once, which plain LRU
+ *        does not, and that it stays within its memory cap.
+ */
+void
+test_observation_policy ()
+{
+  struct observation_stats before, after;
+  struct observation observation;
+  char key[HOSTKEY_LENGTH];
+  int pct, i, round, kept;
+
+  tunables.observation_max_hosts = 100;
+  for (pct = 1; pct <= 100; pct += 99)
+    {
+      tunables.observation_window_pct = pct;
+      observation_clear();
+      hitters_clear();
+      observation_get_stats(&before);
+
+      /* 50 hosts requested 20 times each, then 1000 hosts once each. */
+      for (round = 0; round < 20; round++)
+        for (i = 0; i < 50; i++)
+          {
+            snprintf(key, sizeof(key), "hot-%d.test:443", i);
+            request_observation(key);
+          }
+      for (i = 0; i < 1000; i++)
+        {
+          snprintf(key, sizeof(key), "scan-%d.test:443", i);
+          request_observation(key);
+        }
+
+      observation_get_stats(&after);
+      test(after.hits - before.hits == 950);
+      test(after.hosts <= 100);
+      for (kept = 0, i = 0; i < 50; i++)
+        {
+          snprintf(key, sizeof(key), "hot-%d.test:443", i);
+          kept += observation_lookup(hostkey_find(key), &observation) != 0;
+        }
+
+      if (pct == 1)
+        {
+          /* The hot hosts were promoted on their second request and the
+           * scan went no further than probation. */
+          test(kept == 50);
+          test(after.protected_hits - before.protected_hits >= 850);
+          test(after.rejected - before.rejected >= 900);
+        }
+      else
+        {
+          /* With the window taking the whole cache it is plain LRU. */
+          test(kept == 0);
+          test(after.window_hits - before.window_hits == 950);
+          test(after.rejected == before.rejected);
+        }
+    }
+  tunables.observation_window_pct = 1;
+
+  /* The memory cap bounds the hosts before observation_max_hosts does, and
+   * the buckets count towards it. */
+  tunables.observation_max_hosts = 1 << 24;
+  tunables.observation_max_bytes = 1 << 16;
+  observation_clear();
+  observation_get_stats(&after);
+  test(after.hosts == 0 && after.bytes == 0);
+  for (i = 0; i < 1000; i++)
+    {
+      snprintf(key, sizeof(key), "bytes-%d.test:443", i);
+      request_observation(key);
+    }
+  observation_get_stats(&after);
+  test(after.hosts > 0 && after.hosts < 1000);
+  test(after.bytes > 0 && after.bytes <= 1 << 16);
+  tunables.observation_max_hosts = 100000;
+  tunables.observation_max_bytes = 256 << 20;
+  observation_clear();
+  hitters_clear();
+} // test_observation_policy
+
+/**
+ * @brief Interns the same 1000 keys from a thread of its own and writes
+ *        their IDs into the array given.
+ */
+static void *
+intern_keys (void *arg)
+{
+  uint32_t *ids = arg;
+  char key[HOSTKEY_LENGTH];
+  int i;
+
+  for (i = 0; i < 1000; i++)
+    {
+      snprintf(key, sizeof(key), "shared-%d.test:443", i);
+      ids[i] = hostkey_intern(key);
+    }
+  return NULL;
+} // intern_keys
+
+/**
+ * @brief Tests that every way of writing a host gives the same canonical
+ *        key and ID, that invalid hosts are refused, and that concurrent
+ *        interning hands out one ID per key.
+ */
+void
+test_hostkey ()
+{
+  struct connection_info_struct con_info = {0};
+  char key[HOSTKEY_LENGTH];
+  host shouting = {"https://EXAMPLE.org./", 0};
+  host injected = {"https://www.facebook;DELETE * FROM trusted;.com", 443};
+  static uint32_t ids[4][1000];
+  pthread_t threads[4];
+  uint32_t id;
+  int i, j, agree = 1;
+
+  test(hostkey_canonicalize("https://Example.com", 443, key, sizeof(key)));
+  test(strcmp(key, "example.com:443") == 0);
+  test(hostkey_canonicalize("https://example.com/", 0, key, sizeof(key)));
+  test(strcmp(key, "example.com:443") == 0);
+  test(hostkey_canonicalize("example.com:443", 0, key, sizeof(key)));
+  test(strcmp(key, "example.com:443") == 0);
+  test(hostkey_canonicalize("https://www.Example.COM./a?b#c", 0, key,
+                            sizeof(key)));
+  test(strcmp(key, "www.example.com:443") == 0);
+  test(hostkey_canonicalize("https://example.com:8443", 0, key, sizeof(key)));
+  test(strcmp(key, "example.com:8443") == 0);
+  test(hostkey_canonicalize("https://example.com:8443", 443, key,
+                            sizeof(key)));
+  test(strcmp(key, "example.com:443") == 0);
+  test(hostkey_canonicalize("https://B\xc3\xbc" "cher.example", 0, key,
+                            sizeof(key)));
+  test(strcmp(key, "xn--bcher-kva.example:443") == 0);
+  test(hostkey_canonicalize("https://[::1]", 0, key, sizeof(key)));
+  test(strcmp(key, "[::1]:443") == 0);
+  test(hostkey_canonicalize("127.0.0.1", 0, key, sizeof(key)));
+  test(strcmp(key, "127.0.0.1:443") == 0);
+
+  /* Hosts that are not host names or addresses are refused. */
+  test(hostkey_canonicalize(injected.url, 443, key, sizeof(key)) == 0);
+  test(hostkey_canonicalize("", 443, key, sizeof(key)) == 0);
+  test(hostkey_canonicalize("https://-bad.example", 0, key, sizeof(key))
+       == 0);
+  test(hostkey_canonicalize("https://example.com", 70000, key, sizeof(key))
+       == 0);
+  test(hostkey_canonicalize("https://example.com", 443, key, 10) == 0);
+  test(retrieve_response(&con_info, &injected, NULL) == MHD_NO);
+  test(con_info.answer_code == MHD_HTTP_BAD_REQUEST);
+  free((void *) con_info.answer_string);
+
+  /* Spellings of a host share its ID, and the ID leads back to the key. */
+  id = hostkey_intern("example.org:443");
+  test(id != HOSTKEY_NONE);
+  test(hostkey_intern("example.org:443") == id);
+  test(hostkey_of(&shouting) == id);
+  test(hostkey_find("example.org:443") == id);
+  test(hostkey_find("nowhere.test:443") == HOSTKEY_NONE);
+  test(hostkey_intern("example.net:443") != id);
+  test(strcmp(hostkey_name(id), "example.org:443") == 0);
+  test(hostkey_name(HOSTKEY_NONE) == NULL);
+
+  /* Threads interning the same keys get the same IDs. */
+  for (i = 0; i < 4; i++)
+    pthread_create(&threads[i], NULL, intern_keys, ids[i]);
+  for (i = 0; i < 4; i++)
+    pthread_join(threads[i], NULL);
+  for (i = 0; i < 1000; i++)
+    for (j = 1; j < 4; j++)
+      if (ids[j][i] != ids[0][i] || ids[0][i] == HOSTKEY_NONE)
+        agree = 0;
+  test(agree);
+  test(strcmp(hostkey_name(ids[0][999]), "shared-999.test:443") == 0);
+} // test_hostkey
+
+/**
+ * @brief Tests the certificate pool: a certificate is fingerprinted once
+ *        whatever the chains it appears in, chains are interned by their
+ *        certificates and have no fixed length.
+ */
+void
+test_certpool ()
+{
+  unsigned char digest[CERTPOOL_DIGEST_LENGTH], other[CERTPOOL_DIGEST_LENGTH];
+  char fingerprints[12][FPT_LENGTH], *names[12];
+  uint32_t certs[12], reversed[2], chain, shared, limit;
+  struct certpool_stats before, after;
+  struct observation observation;
+  const uint32_t *members;
+  time_t now = time(NULL);
+  int length, i;
+
+  /* A certificate is found by its digest once it is interned. */
+  test(certpool_digest((unsigned char *) "leaf", 4, digest) == 1);
+  test(certpool_digest((unsigned char *) "root", 4, other) == 1);
+  test(memcmp(digest, other, CERTPOOL_DIGEST_LENGTH) != 0);
+  certpool_get_stats(&before);
+  test(certpool_find(digest) == CERTPOOL_NONE);
+  certs[0] = certpool_intern(digest, "AA:AA");
+  test(certs[0] != CERTPOOL_NONE);
+  test(certpool_intern(digest, "BB:BB") == certs[0]);
+  test(certpool_find(digest) == certs[0]);
+  test(strcmp(certpool_fingerprint(certs[0]), "AA:AA") == 0);
+  test(certpool_fingerprint(CERTPOOL_NONE) == NULL);
+  certpool_get_stats(&after);
+  test(after.certs - before.certs == 1);
+  test(after.hits - before.hits == 1);
+
+  /* Chains longer than the seven certificates once kept. */
+  for (i = 0; i < 12; i++)
+    {
+      snprintf(fingerprints[i], FPT_LENGTH, "CA:%02d", i);
+      names[i] = fingerprints[i];
+    }
+  chain = certpool_chain_of_fingerprints(names, 12);
+  test(chain != CERTPOOL_NONE);
+  members = certpool_chain_certs(chain, &length);
+  test(length == 12);
+  test(strcmp(certpool_fingerprint(members[11]), "CA:11") == 0);
+  test(certpool_chain_of_fingerprints(names, 12) == chain);
+
+  /* Hosts sharing intermediates add only their leaves to the pool. */
+  certpool_get_stats(&before);
+  for (i = 0; i < 100; i++)
+    {
+      snprintf(fingerprints[0], FPT_LENGTH, "LE:%03d", i);
+      test(certpool_chain_of_fingerprints(names, 3) != CERTPOOL_NONE);
+    }
+  certpool_get_stats(&after);
+  test(after.certs - before.certs == 100);
+  test(after.chains - before.chains == 100);
+
+  /* The order of the certificates tells chains apart. */
+  memcpy(certs, certpool_chain_certs(chain, &length), 2 * sizeof(uint32_t));
+  reversed[0] = certs[1];
+  reversed[1] = certs[0];
+  shared = certpool_chain(certs, 2);
+  test(shared != CERTPOOL_NONE);
+  test(certpool_chain(reversed, 2) != shared);
+  test(certpool_chain(certs, 0) == CERTPOOL_NONE);
+  test(certpool_chain_certs(CERTPOOL_NONE, &length) == NULL && length == 0);
+
+  /* Observations keep the ID of their chain, and know all of it. */
+  observation_record(hostkey_intern("long-chain.test:443"), chain, now, now,
+                     &observation);
+  test(observation.chain == chain);
+  test(observation_contains(&observation, "ca:11") == 1);
+  test(observation_contains(&observation, "CA:12") == 0);
+
+  /* A full pool refuses new certificates but still finds the others. */
+  limit = tunables.certpool_max_ids;
+  certpool_get_stats(&before);
+  tunables.certpool_max_ids = before.certs > before.chains
+    ? before.certs : before.chains;
+  test(certpool_digest((unsigned char *) "late", 4, other) == 1);
+  test(certpool_intern(other, "CC:CC") == CERTPOOL_NONE);
+  test(certpool_intern(digest, "AA:AA") != CERTPOOL_NONE);
+  certpool_get_stats(&after);
+  test(after.full - before.full == 1);
+  tunables.certpool_max_ids = limit;
+} // test_certpool
+
+/**
+ * @brief Tests the observation history: repeat observations extend a run,
+ *        runs are found by time, the oldest are trimmed, and a host the
+ *        observation cache let go of is answered from its history with
+ *        every run and without contacting it.
+ */
+void
+test_history ()
+{
+  const char *key_path = "history-test.key";
+  char *first[1] = {"11:11:11:11:11:11:11:11:11:11:11:11:11:11:11:11:11:11:11:11"};
+  char *second[1] = {"22:22:22:22:22:22:22:22:22:22:22:22:22:22:22:22:22:22:22:22"};
+  char *third[1] = {"33:33:33:33:33:33:33:33:33:33:33:33:33:33:33:33:33:33:33:33"};
+  uint32_t a = certpool_chain_of_fingerprints(first, 1);
+  uint32_t b = certpool_chain_of_fingerprints(second, 1);
+  uint32_t c = certpool_chain_of_fingerprints(third, 1);
+  uint32_t id = hostkey_intern("history.test:443");
+  uint32_t busy = hostkey_intern("busy-history.test:443");
+  struct history_run runs[8], run;
+  struct history_stats before, after;
+  struct connection_info_struct con_info = {0};
+  struct observation observation;
+  host unreachable = {"localhost", 2};
+  EVP_PKEY *private_key = generate_test_key(EVP_PKEY_ED25519);
+  FILE *key_file;
+  time_t now = time(NULL);
+  int ttl = tunables.observation_ttl, i, found;
+  char expected[64];
+
+  /* The same chain again only extends the newest run. */
+  history_get_stats(&before);
+  history_record(id, a, 100, 110);
+  history_record(id, a, 200, 210);
+  test(history_latest(id, &run) == 1);
+  test(run.chain == a && run.first_seen == 100 && run.last_seen == 210);
+  history_record(id, b, 300, 310);
+  history_record(id, a, 400, 410);
+  history_get_stats(&after);
+  test(after.hosts - before.hosts == 1);
+  test(after.runs - before.runs == 3);
+  test(after.extended - before.extended == 1);
+  test(history_latest(hostkey_intern("no-history.test:443"), &run) == 0);
+
+  /* Runs are found by time, and gaps between them are not covered. */
+  test(history_at(id, 205, &run) == 1 && run.chain == a);
+  test(history_at(id, 305, &run) == 1 && run.chain == b);
+  test(history_at(id, 400, &run) == 1 && run.first_seen == 400);
+  test(history_at(id, 250, &run) == 0);
+  test(history_at(id, 50, &run) == 0);
+  test(history_at(id, 500, &run) == 0);
+  test(history_copy(id, runs, 2) == 2);
+  test(runs[0].chain == b && runs[1].chain == a && runs[1].first_seen == 400);
+
+  /* A run never starts before the one it follows ended. */
+  history_record(id, b, 405, 420);
+  test(history_latest(id, &run) == 1 && run.first_seen == 410);
+
+  /* The oldest runs go beyond history_max_runs. */
+  tunables.history_max_runs = 3;
+  history_get_stats(&before);
+  history_record(id, c, 500, 510);
+  history_get_stats(&after);
+  test(after.trimmed - before.trimmed == 2);
+  test(history_copy(id, runs, 8) == 3);
+  test(runs[0].chain == a && runs[1].chain == b && runs[2].chain == c);
+  tunables.history_max_runs = 1024;
+
+  /* Binary search over a long history. */
+  for (i = 0; i < 1000; i++)
+    history_record(busy, i % 2 ? a : b, 1000 + 10 * i, 1005 + 10 * i);
+  found = 0;
+  for (i = 0; i < 1000; i++)
+    found += history_at(busy, 1002 + 10 * i, &run) == 1
+      && run.first_seen == (uint32_t) (1000 + 10 * i)
+      && run.chain == (i % 2 ? a : b);
+  test(found == 1000);
+  test(history_at(busy, 1007, &run) == 0);
+  tunables.history_max_runs = 32;
+
+  /* A host the cache forgot is answered from its history. */
+  key_file = fopen(key_path, "w");
+  PEM_write_PrivateKey(key_file, private_key, NULL, NULL, 0, NULL, NULL);
+  fclose(key_file);
+  test(signer_init(key_path, 1) == 1);
+  tunables.observation_ttl = 3600;
+
+  id = hostkey_of(&unreachable);
+  observation_record(id, a, now - 300, now - 250, &observation);
+  observation_record(id, b, now - 60, now - 59, &observation);
+  observation_clear();
+  test(observation_lookup(id, &observation) == OBSERVATION_MISSING);
+  history_get_stats(&before);
+  test(retrieve_response(&con_info, &unreachable, second[0]) == MHD_YES);
+  test(con_info.answer_code == MHD_HTTP_OK);
+  test(con_info.cached_response != NULL);
+  test(strstr(con_info.cached_response->body, first[0]) != NULL);
+  test(strstr(con_info.cached_response->body, second[0]) != NULL);
+  snprintf(expected, sizeof(expected), "\"start\":\"%ld\"", (long) now - 300);
+  test(strstr(con_info.cached_response->body, expected) != NULL);
+  test(strstr(con_info.cached_response->body, first[0])
+       < strstr(con_info.cached_response->body, second[0]));
+  test(verify_response_signature(con_info.cached_response->body,
+                                 private_key));
+  test(observation_lookup(id, &observation) == OBSERVATION_FRESH);
+  test(observation.chain == b && observation.first_seen == now - 60);
+  response_cache_release(con_info.cached_response);
+
+  /* Answering from the history records nothing new in it. */
+  history_get_stats(&after);
+  test(after.extended == before.extended && after.runs == before.runs);
+
+  tunables.observation_ttl = ttl;
+  signer_shutdown();
+  unlink(key_path);
+  EVP_PKEY_free(private_key);
+} // test_history
+
+/**
+ * @brief Tests cache warming: lists are parsed, hosts are observed or found
+ *        warm already, starts are paced, readiness latches once enough
+ *        hosts are warm, and /admin/prefetch takes only the right token.
+ */
+void
+test_warm ()
+{
+  const char *token_path = "warm-test.token";
+  struct stalling_server server;
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+  struct warm_stats before, after;
+  struct history_run newest;
+  struct timespec start, end;
+  EVP_PKEY *key = generate_test_key(EVP_PKEY_ED25519);
+  X509 *certificate = X509_new();
+  char list[512], *metrics;
+  FILE *token_file;
+  long elapsed_ms;
+
+  tunables.warm_concurrency = 1;
+  tunables.warm_rate = 0;
+  tunables.warm_ready_pct = 100;
+  warm_get_stats(&before);
+  test(before.queued == 0 && warm_ready() == 1);
+
+  /* Serve a self-signed certificate on a loopback port, once. */
+  ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+  X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+  X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+  X509_set_pubkey(certificate, key);
+  X509_sign(certificate, key, NULL);
+  server.context = SSL_CTX_new(TLS_server_method());
+  SSL_CTX_use_certificate(server.context, certificate);
+  SSL_CTX_use_PrivateKey(server.context, key);
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  server.socket = socket(AF_INET, SOCK_STREAM, 0);
+  bind(server.socket, (struct sockaddr *) &address, sizeof(address));
+  listen(server.socket, 4);
+  getsockname(server.socket, (struct sockaddr *) &address, &length);
+  server.port = ntohs(address.sin_port);
+  server.stall_first = 0;
+  server.serve = 1;
+  pthread_create(&server.thread, NULL, stalling_server_loop, &server);
+
+  /* The reachable host is observed once; listed again, it is warm already.
+   * Comments and blank lines are skipped, and a refused host fails. */
+  snprintf(list, sizeof(list),
+           "# hosts to warm\n"
+           "https://127.0.0.1:%d AA:BB:CC\n"
+           "\n"
+           "example.com:99999\n"
+           "127.0.0.1:1\r\n"
+           "127.0.0.1:%d\n", server.port, server.port);
+  test(warm_queue(list) == 3);
+  warm_drain();
+  warm_get_stats(&after);
+  test(after.queued - before.queued == 3);
+  test(after.invalid - before.invalid == 1);
+  test(after.done - before.done == 3);
+  test(after.warmed - before.warmed == 2);
+  test(after.failed - before.failed == 1);
+  test(after.threads == 0);
+  snprintf(list, sizeof(list), "127.0.0.1:%d", server.port);
+  test(history_latest(hostkey_intern(list), &newest) == 1);
+  test(newest.last_seen + 1 >= (uint32_t) time(NULL));
+  pthread_join(server.thread, NULL);
+
+  /* Readiness latches once warm_ready_pct of the hosts are warm. */
+  test(warm_ready() == 0);
+  tunables.warm_ready_pct = 60;
+  test(warm_ready() == 1);
+  tunables.warm_ready_pct = 100;
+  test(warm_ready() == 1);
+
+  /* Starts are paced at warm_rate: three hosts at 20 a second take at
+   * least 100 ms. */
+  tunables.warm_rate = 20;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  test(warm_queue("localhost:3\nlocalhost:4\nlocalhost:5\n") == 3);
+  warm_drain();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  elapsed_ms = (end.tv_sec - start.tv_sec) * 1000
+    + (end.tv_nsec - start.tv_nsec) / 1000000;
+  test(elapsed_ms >= 95);
+
+  /* Hosts not yet started are dropped on shutdown. */
+  tunables.warm_rate = 2;
+  warm_get_stats(&before);
+  test(warm_queue("localhost:6\nlocalhost:7\nlocalhost:8\nlocalhost:9\n")
+       == 4);
+  warm_cancel();
+  warm_drain();
+  warm_get_stats(&after);
+  test(after.cancelled - before.cancelled >= 2);
+  test(after.done - before.done == 4);
+  test(after.warmed + after.failed + after.cancelled == after.done);
+  test(warm_ready() == 1);
+
+  metrics = admin_format_metrics();
+  test(metrics != NULL);
+  test(strstr(metrics, "notary_warm_queued_total") != NULL);
+  test(strstr(metrics, "notary_warm_ready 1\n") != NULL);
+  free(metrics);
+
+  /* Lists are taken only with the token. */
+  test(admin_check_token("Bearer ") == 0);
+  token_file = fopen(token_path, "w");
+  fprintf(token_file, "s3cret-token\n");
+  fclose(token_file);
+  test(admin_load_token(token_path) == 1);
+  test(admin_check_token("Bearer s3cret-token") == 1);
+  test(admin_check_token("Bearer s3cret-tokem") == 0);
+  test(admin_check_token("Bearer s3cret") == 0);
+  test(admin_check_token("s3cret-token") == 0);
+  token_file = fopen(token_path, "w");
+  fclose(token_file);
+  test(admin_load_token(token_path) == 0);
+  test(admin_check_token("Bearer ") == 0);
+  test(admin_load_token("no-such.token") == 0);
+  unlink(token_path);
+
+  close(server.socket);
+  SSL_CTX_free(server.context);
+  X509_free(certificate);
+  EVP_PKEY_free(key);
+  tunables.warm_rate = 50;
+  tunables.warm_concurrency = 8;
+  tunables.warm_ready_pct = 90;
+} // test_warm
+
+/**
+ * @brief Tests offline ingest: records are parsed, their certificates get
+ *        the fingerprints a live fetch would give them, shared certificates
+ *        are pooled once, invalid records are counted, and several threads
+ *        record every host.
+ */
+void
+test_ingest ()
+{
+  EVP_PKEY *key = generate_test_key(EVP_PKEY_ED25519);
+  X509 *certificate = X509_new();
+  struct ingest_stats stats = {0};
+  struct history_run newest;
+  struct certpool_stats before, after;
+  struct history_stats history_before, history_after;
+  uint32_t pair, single, live;
+  unsigned char *der = NULL, md[EVP_MAX_MD_SIZE];
+  unsigned int md_length, i, last;
+  struct history_run runs[16];
+  char base64[2048], expected[FPT_LENGTH], host_key[64], *stream;
+  const uint32_t *certs;
+  int der_length, num_certs;
+  size_t stream_length;
+  FILE *input;
+
+  ASN1_INTEGER_set(X509_get_serialNumber(certificate), 7);
+  X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+  X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+  X509_set_pubkey(certificate, key);
+  X509_sign(certificate, key, NULL);
+  der_length = i2d_X509(certificate, &der);
+  EVP_EncodeBlock((unsigned char *) base64, der, der_length);
+
+  /* The fingerprint clients know: SHA-1 of the DER, in upper case. */
+  X509_digest(certificate, EVP_sha1(), md, &md_length);
+  for (i = 0; i < md_length; i++)
+    sprintf(expected + 3 * i, "%02X:", md[i]);
+  expected[FPT_LENGTH - 1] = '\0';
+
+  /* One valid record, a comment, a blank line and five invalid ones: no
+   * timestamp, no chain, a bad timestamp, bad base64, and a certificate
+   * with bytes after it. */
+  input = open_memstream(&stream, &stream_length);
+  fprintf(input, "ingest-a.test:8443 1700000000 %s %s\n", base64, base64);
+  fprintf(input, "# a comment\n\n");
+  fprintf(input, "ingest-b.test\n");
+  fprintf(input, "ingest-b.test 1700000000\n");
+  fprintf(input, "ingest-b.test soon %s\n", base64);
+  fprintf(input, "ingest-b.test 1700000000 not-base64!\n");
+  fprintf(input, "ingest-b.test 1700000000 %sAAAA\n", base64);
+  fclose(input);
+
+  certpool_get_stats(&before);
+  input = fmemopen(stream, stream_length, "r");
+  test(ingest_stream(input, 2, &stats) == 1);
+  fclose(input);
+  free(stream);
+  certpool_get_stats(&after);
+  test(stats.records == 6);
+  test(stats.ingested == 1);
+  test(stats.invalid == 5);
+  test(stats.full == 0);
+  test(after.certs - before.certs == 1);
+
+  test(history_latest(hostkey_intern("ingest-a.test:8443"), &newest) == 1);
+  test(newest.first_seen == 1700000000 && newest.last_seen == 1700000000);
+  certs = certpool_chain_certs(newest.chain, &num_certs);
+  test(num_certs == 2 && certs[0] == certs[1]);
+  test(strcmp(certpool_fingerprint(certs[0]), expected) == 0);
+  pair = newest.chain;
+  single = certpool_chain(certs, 1);
+  test(history_latest(hostkey_intern("ingest-b.test:443"), &newest) == 0);
+
+  /* Many records over several batches and threads all land, and the runs
+   * of a host follow the order of the input. */
+  memset(&stats, 0, sizeof(stats));
+  input = open_memstream(&stream, &stream_length);
+  for (i = 0; i < 3 * INGEST_BATCH; i++)
+    fprintf(input, "ingest-%u.test %u %s%s%s\n", i % 1000, 1700000000 + i,
+            base64, i / 1000 % 2 ? " " : "", i / 1000 % 2 ? base64 : "");
+  fclose(input);
+  input = fmemopen(stream, stream_length, "r");
+  test(ingest_stream(input, 4, &stats) == 1);
+  fclose(input);
+  free(stream);
+  test(stats.records == 3 * INGEST_BATCH);
+  test(stats.ingested == 3 * INGEST_BATCH);
+  for (i = 0; i < 1000; i += 111)
+    {
+      /* Every record of a host alternates its chain, so its newest run is
+       * its last record alone. */
+      last = i + (3 * INGEST_BATCH - 1 - i) / 1000 * 1000;
+      snprintf(host_key, sizeof(host_key), "ingest-%u.test:443", i);
+      test(history_latest(hostkey_intern(host_key), &newest) == 1);
+      test(newest.first_seen == 1700000000 + last);
+      test(newest.last_seen == 1700000000 + last);
+      certpool_chain_certs(newest.chain, &num_certs);
+      test(num_certs == (last / 1000 % 2 ? 2 : 1));
+      test(history_copy(hostkey_intern(host_key), runs, 16)
+           == (3 * INGEST_BATCH - 1 - i) / 1000 + 1);
+    }
+
+  /* Sightings from a scan older than what the notary saw live go where
+   * they belong in time: the live chain's run starts earlier, another chain
+   * gets a run before it, and one seen during the live run is dropped. */
+  live = hostkey_intern("ingest-live.test:443");
+  history_record(live, single, 1700001000, 1700002000);
+  memset(&stats, 0, sizeof(stats));
+  input = open_memstream(&stream, &stream_length);
+  fprintf(input, "ingest-live.test 1700000500 %s %s\n", base64, base64);
+  fprintf(input, "ingest-live.test 1700000800 %s\n", base64);
+  fprintf(input, "ingest-live.test 1700001500 %s %s\n", base64, base64);
+  fclose(input);
+  history_get_stats(&history_before);
+  input = fmemopen(stream, stream_length, "r");
+  test(ingest_stream(input, 1, &stats) == 1);
+  fclose(input);
+  free(stream);
+  history_get_stats(&history_after);
+  test(stats.ingested == 3);
+  test(history_after.stale - history_before.stale == 1);
+  test(history_latest(live, &newest) == 1);
+  test(newest.chain == single);
+  test(newest.first_seen == 1700000800 && newest.last_seen == 1700002000);
+  test(history_copy(live, runs, 16) == 2);
+  test(runs[0].chain == pair && runs[0].first_seen == 1700000500
+       && runs[0].last_seen == 1700000500);
+
+  test(ingest_file("no-such-scan.txt", 1, &stats) == 0);
+
+  OPENSSL_free(der);
+  X509_free(certificate);
+  EVP_PKEY_free(key);
+} // test_ingest
+
+/**
+ * @brief Tests snapshots: every history is written and restored, a host
+ *        asked about is served at once, the rest are restored in the
+ *        background, a host seen since the restart gets its restored runs
+ *        merged in, files that are not valid snapshots are refused, and
+ *        the writer writes periodically.
+ */
+void
+test_snapshot ()
+{
+  const char *path = "snapshot-test.bin", *copy_path = "snapshot-copy.bin";
+  const char *key_path = "snapshot-test.key";
+  char *first[1] = {"44:44:44:44:44:44:44:44:44:44:44:44:44:44:44:44:44:44:44:44"};
+  char *second[2] = {"55:55:55:55:55:55:55:55:55:55:55:55:55:55:55:55:55:55:55:55",
+                     "66:66:66:66:66:66:66:66:66:66:66:66:66:66:66:66:66:66:66:66"};
+  char *third[1] = {"77:77:77:77:77:77:77:77:77:77:77:77:77:77:77:77:77:77:77:77"};
+  uint32_t a = certpool_chain_of_fingerprints(first, 1);
+  uint32_t b = certpool_chain_of_fingerprints(second, 2);
+  uint32_t c = certpool_chain_of_fingerprints(third, 1);
+  struct snapshot_stats before, after;
+  struct history_run runs[4], run;
+  struct connection_info_struct con_info = {0};
+  host unreachable = {"localhost", 3};
+  EVP_PKEY *private_key = generate_test_key(EVP_PKEY_ED25519);
+  FILE *file, *copy;
+  char key[64], *data;
+  time_t now = time(NULL);
+  int ttl = tunables.observation_ttl, i, restored;
+  uint32_t id;
+  long size;
+
+  for (i = 0; i < 100; i++)
+    {
+      snprintf(key, sizeof(key), "snapshot-%d.test:443", i);
+      id = hostkey_intern(key);
+      history_record(id, c, now - 600, now - 500);
+      history_record(id, i % 2 ? a : b, now - 100, now - 50);
+    }
+  id = hostkey_of(&unreachable);
+  history_record(id, a, now - 60, now - 59);
+
+  snapshot_get_stats(&before);
+  test(snapshot_write(path) == 1);
+  snapshot_get_stats(&after);
+  test(after.writes - before.writes == 1);
+  test(after.write_bytes > 0);
+  test(access("snapshot-test.bin.tmp", F_OK) != 0);
+
+  /* A restarted notary knows nothing until the snapshot is mapped. */
+  history_clear();
+  observation_clear();
+  test(history_latest(id, &run) == 0);
+
+  /* A host seen again before its runs are restored keeps that run, the
+   * restored ones going before it. */
+  history_record(hostkey_intern("snapshot-0.test:443"), a, now - 10, now - 5);
+  test(snapshot_open("no-such-snapshot.bin") == 0);
+  test(snapshot_open(path) == 1);
+
+  /* A host asked about is served from the snapshot at once. */
+  tunables.observation_ttl = 3600;
+  file = fopen(key_path, "w");
+  PEM_write_PrivateKey(file, private_key, NULL, NULL, 0, NULL, NULL);
+  fclose(file);
+  test(signer_init(key_path, 1) == 1);
+  test(retrieve_response(&con_info, &unreachable, first[0]) == MHD_YES);
+  test(con_info.answer_code == MHD_HTTP_OK);
+  test(con_info.cached_response != NULL);
+  test(strstr(con_info.cached_response->body, first[0]) != NULL);
+  response_cache_release(con_info.cached_response);
+  signer_shutdown();
+  unlink(key_path);
+
+  /* The others are restored in the background, runs and chains intact. */
+  snapshot_wait();
+  snapshot_get_stats(&after);
+  test(after.rebuilding == 0);
+  test(after.hosts >= 101);
+  test(after.restored == after.hosts);
+  test(history_copy(hostkey_intern("snapshot-0.test:443"), runs, 4) == 3);
+  test(runs[0].chain == c && runs[0].first_seen == now - 600);
+  test(runs[1].chain == b && runs[1].last_seen == now - 50);
+  test(runs[2].chain == a && runs[2].first_seen == now - 10);
+  restored = 1;
+  for (i = 1; i < 100; i++)
+    {
+      snprintf(key, sizeof(key), "snapshot-%d.test:443", i);
+      restored += history_copy(hostkey_intern(key), runs, 4) == 2
+        && runs[0].chain == c && runs[0].first_seen == now - 600
+        && runs[1].chain == (i % 2 ? a : b)
+        && runs[1].last_seen == now - 50;
+    }
+  test(restored == 100);
+  test(snapshot_restore(hostkey_intern("snapshot-0.test:443")) == 0);
+
+  /* Files that are not whole snapshots are refused. */
+  file = fopen(path, "r");
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  rewind(file);
+  data = malloc(size);
+  test(fread(data, 1, size, file) == (size_t) size);
+  fclose(file);
+  copy = fopen(copy_path, "w");
+  fwrite(data, 1, size / 2, copy);
+  fclose(copy);
+  test(snapshot_open(copy_path) == 0);
+  data[0] = 'X';
+  copy = fopen(copy_path, "w");
+  fwrite(data, 1, size, copy);
+  fclose(copy);
+  test(snapshot_open(copy_path) == 0);
+  free(data);
+  unlink(copy_path);
+
+  /* The writer writes every interval until stopped. */
+  snapshot_get_stats(&before);
+  test(snapshot_start_writer(path, 1) == 1);
+  for (i = 0; i < 300; i++)
+    {
+      snapshot_get_stats(&after);
+      if (after.writes > before.writes)
+        break;
+      usleep(10000);
+    }
+  snapshot_stop_writer();
+  test(after.writes > before.writes);
+  unlink(path);
+
+  tunables.observation_ttl = ttl;
+  EVP_PKEY_free(private_key);
+} // test_snapshot
+
+/**
+ * @brief Tests socket handoff: listening sockets are received under their
+ *        names and still accept connections, a successor that says it is
+ *        serving takes over and one that does not is given up on, signals
+ *        are reported, and draining waits for requests in flight.
+ */
+void
+test_handoff ()
+{
+  char *serving[] = {"/bin/bash", "-c",
+                     "eval \"printf R >&$" HANDOFF_ENV "\"", NULL};
+  char *failing[] = {"/bin/sh", "-c", "exit 1", NULL};
+  char *missing[] = {"/no/such/notary", NULL};
+  struct handoff_stats before, after;
+  struct sockaddr_in address, taken;
+  socklen_t length = sizeof(address);
+  int listener, inherited, channel[2], client, accepted;
+  int timeout = tunables.handoff_timeout_ms;
+  unsigned int active = 0;
+  long long start;
+
+  test(handoff_init() == 1);
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  /* A socket handed over is the same socket under a new descriptor. */
+  listener = handoff_listen("test-handoff", (struct sockaddr *) &address,
+                            sizeof(address), 0);
+  test(listener >= 0);
+  getsockname(listener, (struct sockaddr *) &address, &length);
+  test(socketpair(AF_UNIX, SOCK_STREAM, 0, channel) == 0);
+  test(handoff_send_sockets(channel[0]) == 1);
+  test(handoff_receive_sockets(channel[1]) >= 1);
+  inherited = handoff_listen("test-handoff", (struct sockaddr *) &address,
+                             sizeof(address), 0);
+  test(inherited >= 0 && inherited != listener);
+  close(listener);
+  listener = inherited;
+  length = sizeof(taken);
+  getsockname(listener, (struct sockaddr *) &taken, &length);
+  test(taken.sin_port == address.sin_port);
+  handoff_ready();
+  client = socket(AF_INET, SOCK_STREAM, 0);
+  test(connect(client, (struct sockaddr *) &address, sizeof(address)) == 0);
+  accepted = accept(listener, NULL, NULL);
+  test(accepted >= 0);
+  close(accepted);
+  close(client);
+
+  /* Names without sockets are refused. */
+  test(write(channel[0], "ssl\n", 5) == 5);
+  test(handoff_receive_sockets(channel[1]) == -1);
+  close(channel[0]);
+  close(channel[1]);
+
+  /* Only a successor that says it is serving takes over. */
+  tunables.handoff_timeout_ms = 2000;
+  handoff_get_stats(&before);
+  test(handoff_start(serving) == 1);
+  test(handoff_start(failing) == 0);
+  test(handoff_start(missing) == 0);
+  handoff_get_stats(&after);
+  test(after.handoffs - before.handoffs == 1);
+  test(after.failures - before.failures == 2);
+  tunables.handoff_timeout_ms = timeout;
+  while (waitpid(-1, NULL, WNOHANG) > 0)
+    ;
+
+  /* Signals ask for an upgrade or a stop. */
+  raise(SIGUSR2);
+  test(handoff_wait() == HANDOFF_UPGRADE);
+  raise(SIGTERM);
+  test(handoff_wait() == HANDOFF_STOP);
+  signal(SIGUSR2, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGINT, SIG_DFL);
+
+  /* Draining gives up on requests still in flight after the timeout. */
+  test(handoff_drain(&active, 1000) == 0);
+  active = 2;
+  start = deadline_now_ms();
+  test(handoff_drain(&active, 50) == 2);
+  test(deadline_now_ms() - start >= 50);
+  handoff_get_stats(&after);
+  test(after.abandoned == 2);
+  close(listener);
+} // test_handoff
+
+/* Hosts two processes race to claim in test_shmcache. */
+#define CLAIM_RACE_HOSTS 64
+
+/**
+ * @brief Claims the hosts of the claim race once start is readable, and
+ *        writes what each claim returned to results. The claims are held
+ *        until finish is readable, since those of a process that exited
+ *        are taken over.
+ */
+static void
+claim_race(int start, int results, int finish)
+{
+  signed char claimed[CLAIM_RACE_HOSTS];
+  char key[64], byte;
+  int i;
+
+  if (read(start, &byte, 1) != 1)
+    _exit(1);
+  for (i = 0; i < CLAIM_RACE_HOSTS; i++)
+    {
+      snprintf(key, sizeof(key), "shm-race-%d.test:443", i);
+      claimed[i] = shmcache_claim(key);
+    }
+  if (write(results, claimed, sizeof(claimed)) != sizeof(claimed)
+      || read(finish, &byte, 1) != 1)
+    _exit(1);
+  _exit(0);
+} // claim_race
+
+/**
+ * @brief Tests the shared observation table across processes: what one
+ *        process publishes another finds with its own IDs, claims keep all
+ *        but one process from contacting a host and die with their
+ *        process, waiters get what the claimer publishes, a writer killed
+ *        mid-write does not wedge its slot, and verifications are answered
+ *        from the table.
+ */
+void
+test_shmcache ()
+{
+  char path[64];
+  const char *key_path = "shmcache-test.key";
+  char *chain[2] = {"88:88:88:88:88:88:88:88:88:88:88:88:88:88:88:88:88:88:88:88",
+                    "99:99:99:99:99:99:99:99:99:99:99:99:99:99:99:99:99:99:99:99"};
+  char *local[1] = {"AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB:AB"};
+  struct shmcache_entry entry;
+  struct shmcache_stats before, after;
+  struct connection_info_struct con_info = {0};
+  host unreachable = {"localhost", 5};
+  EVP_PKEY *private_key = generate_test_key(EVP_PKEY_ED25519);
+  const uint32_t *certs;
+  int slots = tunables.shmcache_slots, ttl = tunables.observation_ttl;
+  int ready[2], results[2], finish[2], length, i, status, killed, once;
+  signed char claimed[2][CLAIM_RACE_HOSTS];
+  pid_t racers[2];
+  long long start;
+  time_t now = time(NULL);
+  FILE *key_file;
+  pid_t child;
+  char byte;
+
+  snprintf(path, sizeof(path), "/dev/shm/notary-test-%d", (int) getpid());
+  unlink(path);
+  tunables.shmcache_slots = 1024;
+  tunables.observation_ttl = 3600;
+  test(shmcache_claim("shm-a.test:443") == -1);
+  test(shmcache_open(path) == 1);
+
+  /* A table of another size is refused. */
+  tunables.shmcache_slots = 2048;
+  test(shmcache_open(path) == 0);
+  tunables.shmcache_slots = 1024;
+  test(shmcache_open(path) == 1);
+
+  /* What another process publishes is found, in this process's IDs. */
+  child = fork();
+  if (child == 0)
+    _exit(shmcache_publish("shm-a.test:443",
+                           certpool_chain_of_fingerprints(chain, 2),
+                           now - 10, now - 9) ? 0 : 1);
+  waitpid(child, &status, 0);
+  test(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  test(shmcache_lookup("shm-a.test:443", &entry) == 1);
+  test(entry.start == now - 10 && entry.end == now - 9);
+  certs = certpool_chain_certs(entry.chain, &length);
+  test(length == 2);
+  test(strcmp(certpool_fingerprint(certs[0]), chain[0]) == 0);
+  test(strcmp(certpool_fingerprint(certs[1]), chain[1]) == 0);
+  test(shmcache_lookup("shm-missing.test:443", &entry) == 0);
+
+  /* Stale observations are not served. */
+  test(shmcache_publish("shm-old.test:443",
+                        certpool_chain_of_fingerprints(local, 1),
+                        now - 7200, now - 7200) == 1);
+  test(shmcache_lookup("shm-old.test:443", &entry) == 0);
+
+  /* One claim at a time, released by its holder or with its process. */
+  test(shmcache_claim("shm-b.test:443") == 1);
+  test(shmcache_claim("shm-b.test:443") == 0);
+  shmcache_release("shm-b.test:443");
+  test(shmcache_claim("shm-b.test:443") == 1);
+  shmcache_release("shm-b.test:443");
+  child = fork();
+  if (child == 0)
+    _exit(shmcache_claim("shm-c.test:443") == 1 ? 0 : 1);
+  waitpid(child, &status, 0);
+  test(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  shmcache_get_stats(&before);
+  test(shmcache_claim("shm-c.test:443") == 1);
+  shmcache_get_stats(&after);
+  test(after.reclaimed - before.reclaimed == 1);
+  shmcache_release("shm-c.test:443");
+
+  /* A waiter gets what the claimer publishes, and gives up at once when
+   * the claim is released without an observation. */
+  test(pipe(ready) == 0);
+  child = fork();
+  if (child == 0)
+    {
+      shmcache_claim("shm-d.test:443");
+      shmcache_claim("shm-e.test:443");
+      byte = 1;
+      if (write(ready[1], &byte, 1) != 1)
+        _exit(1);
+      usleep(100000);
+      shmcache_publish("shm-d.test:443",
+                       certpool_chain_of_fingerprints(local, 1), now, now);
+      shmcache_release("shm-d.test:443");
+      usleep(100000);
+      shmcache_release("shm-e.test:443");
+      usleep(500000);
+      _exit(0);
+    }
+  test(read(ready[0], &byte, 1) == 1);
+  test(shmcache_claim("shm-d.test:443") == 0);
+  test(shmcache_wait("shm-d.test:443", 5000, &entry) == 1);
+  test(strcmp(certpool_fingerprint(certpool_chain_certs(entry.chain,
+                                                        &length)[0]),
+              local[0]) == 0);
+  start = deadline_now_ms();
+  test(shmcache_wait("shm-e.test:443", 5000, &entry) == 0);
+  test(deadline_now_ms() - start < 1000);
+  waitpid(child, NULL, 0);
+  close(ready[0]);
+  close(ready[1]);
+
+  /* Writers killed at random points never wedge the slot they wrote. */
+  for (killed = 0; killed < 20; killed++)
+    {
+      child = fork();
+      if (child == 0)
+        for (;;)
+          shmcache_publish("shm-f.test:443",
+                           certpool_chain_of_fingerprints(chain, 2),
+                           now, now);
+      usleep(1000 + killed * 100);
+      kill(child, SIGKILL);
+      waitpid(child, NULL, 0);
+      test(shmcache_publish("shm-f.test:443",
+                            certpool_chain_of_fingerprints(local, 1),
+                            now, now) == 1);
+      test(shmcache_lookup("shm-f.test:443", &entry) == 1);
+    }
+  for (i = 0; i < 4; i++)
+    test(shmcache_lookup("shm-a.test:443", &entry) == 1);
+
+  /* Two processes claiming the same new hosts at once: each host gets one
+   * slot, and one of them claims it. */
+  test(pipe(ready) == 0 && pipe(results) == 0 && pipe(finish) == 0);
+  for (i = 0; i < 2; i++)
+    {
+      racers[i] = fork();
+      if (racers[i] == 0)
+        claim_race(ready[0], results[1], finish[0]);
+    }
+  test(write(ready[1], "go", 2) == 2);
+  for (i = 0; i < 2; i++)
+    test(read(results[0], claimed[i], CLAIM_RACE_HOSTS) == CLAIM_RACE_HOSTS);
+  test(write(finish[1], "go", 2) == 2);
+  for (i = 0; i < 2; i++)
+    waitpid(racers[i], NULL, 0);
+  for (i = 0, once = 0; i < CLAIM_RACE_HOSTS; i++)
+    once += (claimed[0][i] == 1) + (claimed[1][i] == 1) == 1
+      && claimed[0][i] != -1 && claimed[1][i] != -1;
+  test(once == CLAIM_RACE_HOSTS);
+  close(ready[0]);
+  close(ready[1]);
+  close(results[0]);
+  close(results[1]);
+  close(finish[0]);
+  close(finish[1]);
+
+  /* A verification is answered from the table without contacting the
+   * host. */
+  key_file = fopen(key_path, "w");
+  PEM_write_PrivateKey(key_file, private_key, NULL, NULL, 0, NULL, NULL);
+  fclose(key_file);
+  test(signer_init(key_path, 1) == 1);
+  child = fork();
+  if (child == 0)
+    _exit(shmcache_publish(hostkey_name(hostkey_of(&unreachable)),
+                           certpool_chain_of_fingerprints(chain, 2),
+                           now - 5, now - 4) ? 0 : 1);
+  waitpid(child, &status, 0);
+  test(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  test(retrieve_response(&con_info, &unreachable, chain[1]) == MHD_YES);
+  test(con_info.answer_code == MHD_HTTP_OK);
+  test(con_info.cached_response != NULL);
+  test(strstr(con_info.cached_response->body, chain[0]) != NULL);
+  response_cache_release(con_info.cached_response);
+  signer_shutdown();
+  unlink(key_path);
+
+  shmcache_close();
+  unlink(path);
+  tunables.shmcache_slots = slots;
+  tunables.observation_ttl = ttl;
+  EVP_PKEY_free(private_key);
+} // test_shmcache
+
+/**
+ * @brief Connects count clients to a port on the loopback address of a
+ *        family, leaving their sockets in clients.
+ */
+static void
+connect_shards(int family, int port, int count, int clients[])
+{
+  struct sockaddr_in v4;
+  struct sockaddr_in6 v6;
+  int i;
+
+  memset(&v4, 0, sizeof(v4));
+  v4.sin_family = AF_INET;
+  v4.sin_port = htons(port);
+  v4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  memset(&v6, 0, sizeof(v6));
+  v6.sin6_family = AF_INET6;
+  v6.sin6_port = htons(port);
+  v6.sin6_addr = in6addr_loopback;
+
+  for (i = 0; i < count; i++)
+    {
+      clients[i] = socket(family, SOCK_STREAM, 0);
+      if (family == AF_INET6)
+        test(connect(clients[i], (struct sockaddr *) &v6, sizeof(v6)) == 0);
+      else
+        test(connect(clients[i], (struct sockaddr *) &v4, sizeof(v4)) == 0);
+    }
+} // connect_shards
+
+/**
+ * @brief Accepts every connection queued on the sockets of a set, counting
+ *        them per socket in accepted, and closes the clients.
+ * @return the number accepted
+ */
+static int
+accept_shards(struct shard_set *set, int accepted[], int clients[],
+              int count)
+{
+  int total = 0, fd, i;
+
+  for (i = 0; i < set->count; i++)
+    {
+      accepted[i] = 0;
+      fcntl(set->sockets[i], F_SETFL, O_NONBLOCK);
+      while ((fd = accept(set->sockets[i], NULL, NULL)) >= 0)
+        {
+          close(fd);
+          accepted[i]++;
+          total++;
+        }
+    }
+  for (i = 0; i < count; i++)
+    close(clients[i]);
+  return total;
+} // accept_shards
+
+/**
+ * @brief Closes the sockets of a set.
+ */
+static void
+close_shards(struct shard_set *set)
+{
+  int i;
+
+  for (i = 0; i < set->count; i++)
+    close(set->sockets[i]);
+} // close_shards
+
+/**
+ * @brief Tests sharded listeners: the shards of a port share it, spread
+ *        the connections over their accept queues, take IPv4 and IPv6
+ *        clients on dual-stack or separate sockets, queue a connection on
+ *        the shard of the core that received it when steered, and are
+ *        pinned to cores this process may run on.
+ */
+void
+test_shard ()
+{
+  struct shard_set set, other;
+  struct sockaddr_storage address;
+  socklen_t length;
+  cpu_set_t saved, pinned;
+  int clients[96], accepted[2 * SHARD_MAX];
+  int shards = tunables.listen_shards, ipv6 = tunables.listen_ipv6;
+  int pin = tunables.listen_pin_cpus, steer = tunables.listen_steer_cpu;
+  int used, cpu, i;
+
+  /* One socket does not share its port. */
+  tunables.listen_shards = 1;
+  tunables.listen_ipv6 = 0;
+  test(shard_listen(&set, "test-single", 0) == 1);
+  test(set.count == 1 && set.port > 0 && !set.ipv6[0]);
+  test(shard_listen(&other, "test-other", set.port) == 0);
+  close_shards(&set);
+
+  /* Dual-stack shards share a port and its connections, over both
+   * families. */
+  tunables.listen_shards = 4;
+  tunables.listen_ipv6 = 1;
+  test(shard_listen(&set, "test-shard", 0) == 1);
+  test(set.count == 4 && set.port > 0);
+  for (i = 0; i < set.count; i++)
+    {
+      length = sizeof(address);
+      getsockname(set.sockets[i], (struct sockaddr *) &address, &length);
+      test(set.ipv6[i] && address.ss_family == AF_INET6);
+      test(ntohs(((struct sockaddr_in6 *) &address)->sin6_port) == set.port);
+      test(set.cpus[i] == -1);
+    }
+  connect_shards(AF_INET, set.port, 64, clients);
+  connect_shards(AF_INET6, set.port, 16, clients + 64);
+  test(accept_shards(&set, accepted, clients, 80) == 80);
+  for (i = 0, used = 0; i < set.count; i++)
+    used += accepted[i] > 0;
+  test(used >= 2);
+  close_shards(&set);
+
+  /* Separate sockets take each family apart. */
+  tunables.listen_ipv6 = 2;
+  test(shard_listen(&set, "test-split", 0) == 1);
+  test(set.count == 8);
+  for (i = 0; i < set.count; i++)
+    test(set.ipv6[i] == (i >= 4));
+  connect_shards(AF_INET, set.port, 16, clients);
+  connect_shards(AF_INET6, set.port, 16, clients + 16);
+  test(accept_shards(&set, accepted, clients, 32) == 32);
+  test(accepted[0] + accepted[1] + accepted[2] + accepted[3] == 16);
+  test(accepted[4] + accepted[5] + accepted[6] + accepted[7] == 16);
+  close_shards(&set);
+
+  /* Steered connections queue on the shard of the core they arrive on,
+   * which for loopback is the core of the client. */
+  test(sched_getaffinity(0, sizeof(saved), &saved) == 0);
+  for (cpu = 0; !CPU_ISSET(cpu, &saved); cpu++)
+    ;
+  CPU_ZERO(&pinned);
+  CPU_SET(cpu, &pinned);
+  test(sched_setaffinity(0, sizeof(pinned), &pinned) == 0);
+  tunables.listen_ipv6 = 0;
+  tunables.listen_steer_cpu = 1;
+  tunables.listen_pin_cpus = 1;
+  test(shard_listen(&set, "test-steer", 0) == 1);
+  test(set.count == 4);
+  connect_shards(AF_INET, set.port, 32, clients);
+  test(accept_shards(&set, accepted, clients, 32) == 32);
+  test(accepted[cpu % 4] == 32);
+  close_shards(&set);
+  test(sched_setaffinity(0, sizeof(saved), &saved) == 0);
+
+  /* Pinned shards get cores this process may run on, the one a shard is
+   * steered from when there is one. */
+  for (i = 0; i < set.count; i++)
+    test(set.cpus[i] >= 0 && CPU_ISSET(set.cpus[i], &saved));
+  test(set.cpus[cpu % 4] == cpu);
+
+  tunables.listen_shards = shards;
+  tunables.listen_ipv6 = ipv6;
+  tunables.listen_pin_cpus = pin;
+  tunables.listen_steer_cpu = steer;
+} // test_shard
+
+/**
+ * @brief Tests persistent client connections and the fixed responses:
+ *        a connection closes after keepalive_max_requests, its requests
+ *        are counted, and the fixed answers are built once and chosen
+ *        instead of copied into each connection.
+ */
+void
+test_keepalive ()
+{
+  struct connection_stats before, after;
+  struct connection_info_struct con_info = {0};
+  host invalid = {"https://-bad.example", 443};
+  void *context = NULL;
+  int max = tunables.keepalive_max_requests;
+
+  connection_get_stats(&before);
+  tunables.keepalive_max_requests = 3;
+
+  /* The third request on a connection is its last. */
+  connection_notify(NULL, NULL, &context, MHD_CONNECTION_NOTIFY_STARTED);
+  test(context != NULL);
+  test(connection_count_request(context) == 0);
+  test(connection_count_request(context) == 0);
+  test(connection_count_request(context) == 1);
+  connection_notify(NULL, NULL, &context, MHD_CONNECTION_NOTIFY_CLOSED);
+  test(context == NULL);
+
+  /* A connection of unknown state is never closed early. */
+  test(connection_count_request(NULL) == 0);
+
+  /* A cap of one closes every connection after its request. */
+  tunables.keepalive_max_requests = 1;
+  connection_notify(NULL, NULL, &context, MHD_CONNECTION_NOTIFY_STARTED);
+  test(connection_count_request(context) == 1);
+  connection_notify(NULL, NULL, &context, MHD_CONNECTION_NOTIFY_CLOSED);
+
+  connection_get_stats(&after);
+  test(after.connections - before.connections == 2);
+  test(after.requests - before.requests == 5);
+  test(after.reused - before.reused == 2);
+  test(after.capped - before.capped == 2);
+
+  /* The fixed answers are built once, and sent whether the connection
+   * stays open or not. */
+  test(response_init_static() == 1);
+  test(response_init_static() == 1);
+  test(send_static_response(NULL, STATIC_BUSY, 0) == MHD_YES);
+  test(send_static_response(NULL, STATIC_BUSY, 1) == MHD_YES);
+
+  /* An answer that is a fixed one is not copied. */
+  test(retrieve_response(&con_info, &invalid, NULL) == MHD_NO);
+  test(con_info.answer_code == MHD_HTTP_BAD_REQUEST);
+  test(con_info.static_page == STATIC_INVALID_HOST);
+  test(con_info.answer_string == NULL);
+  con_info.closing = 1;
+  test(send_answer(NULL, &con_info) == MHD_YES);
+  response_free_static();
+
+  tunables.keepalive_max_requests = max;
+} // test_keepalive
+
+/**
+ * @brief Connects to a TLS port on the loopback address, offering a
+ *        session to resume if there is one, and keeps the new session.
+ * @return 1 if the session was resumed, 0 if not, -1 on failure
+ */
+static int
+connect_tls(int port, SSL_CTX *client, SSL_SESSION **session)
+{
+  struct sockaddr_in address;
+  char byte;
+  int fd, resumed = -1;
+  SSL *ssl;
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0)
+    {
+      close(fd);
+      return -1;
+    }
+
+  ssl = SSL_new(client);
+  SSL_set_fd(ssl, fd);
+  if (*session != NULL)
+    SSL_set_session(ssl, *session);
+  if (SSL_connect(ssl) == 1)
+    {
+      resumed = SSL_session_reused(ssl);
+      /* TLS 1.3 tickets follow the handshake; read until the server,
+       * with no daemon to hand the connection to, closes it. */
+      SSL_read(ssl, &byte, 1);
+      SSL_SESSION_free(*session);
+      *session = SSL_get1_session(ssl);
+      SSL_shutdown(ssl);
+    }
+  SSL_free(ssl);
+  close(fd);
+  return resumed;
+} // connect_tls
+
+/**
+ * @brief Tests the TLS front end: it serves the certificate it loaded,
+ *        resumes sessions from tickets and from its session cache, keeps
+ *        accepting tickets of the previous key after a rotation but not
+ *        older ones, and counts handshakes that fail or stall.
+ */
+void
+test_tlsfront ()
+{
+  const char *key_path = "tlsfront-test.key", *cert_path = "tlsfront-test.pem";
+  EVP_PKEY *key = generate_test_key(EVP_PKEY_EC);
+  X509 *certificate = X509_new();
+  struct tlsfront_stats before, after;
+  struct shard_set set;
+  SSL_CTX *tls12 = SSL_CTX_new(TLS_client_method());
+  SSL_CTX *tls13 = SSL_CTX_new(TLS_client_method());
+  SSL_CTX *no_tickets = SSL_CTX_new(TLS_client_method());
+  SSL_SESSION *session = NULL;
+  struct sockaddr_in address;
+  int shards = tunables.listen_shards, ipv6 = tunables.listen_ipv6;
+  int timeout = tunables.tls_handshake_timeout_ms, fd, held, i;
+  char byte;
+  long long start;
+  FILE *file;
+
+  ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+  X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+  X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+  X509_set_pubkey(certificate, key);
+  X509_sign(certificate, key, EVP_sha256());
+  file = fopen(key_path, "w");
+  PEM_write_PrivateKey(file, key, NULL, NULL, 0, NULL, NULL);
+  fclose(file);
+  file = fopen(cert_path, "w");
+  PEM_write_X509(file, certificate);
+  fclose(file);
+
+  test(tlsfront_init("no-such-key.pem", cert_path) == 0);
+  test(tlsfront_init(key_path, cert_path) == 1);
+
+  /* Without daemons, connections are closed once the handshake is done. */
+  tunables.listen_shards = 1;
+  tunables.listen_ipv6 = 0;
+  test(shard_listen(&set, "test-tls", 0) == 1);
+  set.external = 1;
+  tlsfront_get_stats(&before);
+  test(tlsfront_start(&set) == 1);
+
+  /* A returning client resumes from its ticket. */
+  SSL_CTX_set_options(tls12, SSL_OP_IGNORE_UNEXPECTED_EOF);
+  SSL_CTX_set_options(tls13, SSL_OP_IGNORE_UNEXPECTED_EOF);
+  SSL_CTX_set_options(no_tickets, SSL_OP_IGNORE_UNEXPECTED_EOF);
+  SSL_CTX_set_max_proto_version(tls12, TLS1_2_VERSION);
+  test(connect_tls(set.port, tls12, &session) == 0);
+  test(connect_tls(set.port, tls12, &session) == 1);
+
+  /* Tickets of the previous key are still taken, older ones are not. */
+  tlsfront_rotate_keys();
+  test(connect_tls(set.port, tls12, &session) == 1);
+  tlsfront_rotate_keys();
+  tlsfront_rotate_keys();
+  test(connect_tls(set.port, tls12, &session) == 0);
+  SSL_SESSION_free(session);
+  session = NULL;
+
+  /* So do clients of TLS 1.3, and clients that take no tickets resume
+   * from the session cache. */
+  test(connect_tls(set.port, tls13, &session) == 0);
+  test(connect_tls(set.port, tls13, &session) == 1);
+  SSL_SESSION_free(session);
+  session = NULL;
+  SSL_CTX_set_max_proto_version(no_tickets, TLS1_2_VERSION);
+  SSL_CTX_set_options(no_tickets, SSL_OP_NO_TICKET);
+  test(connect_tls(set.port, no_tickets, &session) == 0);
+  test(connect_tls(set.port, no_tickets, &session) == 1);
+  SSL_SESSION_free(session);
+
+  /* A client that is not speaking TLS, or stalls, is dropped. */
+  tunables.tls_handshake_timeout_ms = 200;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(set.port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (i = 0; i < 2; i++)
+    {
+      fd = socket(AF_INET, SOCK_STREAM, 0);
+      test(connect(fd, (struct sockaddr *) &address, sizeof(address)) == 0);
+      if (i == 0)
+        test(write(fd, "GET / HTTP/1.1\r\n\r\n", 18) == 18);
+      start = deadline_now_ms();
+      while (deadline_now_ms() - start < 2000
+             && read(fd, &address, 1) > 0)
+        ;
+      test(deadline_now_ms() - start < 2000);
+      close(fd);
+    }
+
+  /* A connection over tls_max_connections is closed at once, while the
+   * one holding the only place is still in its handshake. */
+  tunables.tls_max_connections = 1;
+  tunables.tls_handshake_timeout_ms = 5000;
+  tlsfront_get_stats(&after);
+  held = socket(AF_INET, SOCK_STREAM, 0);
+  test(connect(held, (struct sockaddr *) &address, sizeof(address)) == 0);
+  test(write(held, "\x16", 1) == 1);
+  start = deadline_now_ms();
+  while (tlsfront_get_stats(&after), after.accepted - before.accepted < 11
+         && deadline_now_ms() - start < 2000)
+    usleep(10000);
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  test(connect(fd, (struct sockaddr *) &address, sizeof(address)) == 0);
+  start = deadline_now_ms();
+  while (deadline_now_ms() - start < 2000 && read(fd, &byte, 1) > 0)
+    ;
+  test(deadline_now_ms() - start < 1000);
+  close(fd);
+  close(held);
+  tunables.tls_max_connections = 1020;
+
+  start = deadline_now_ms();
+  do
+    tlsfront_get_stats(&after);
+  while (after.handshakes + after.failures
+         < before.handshakes + before.failures + 11
+         && deadline_now_ms() - start < 2000 && usleep(10000) == 0);
+  test(after.accepted - before.accepted == 12);
+  test(after.overloaded - before.overloaded == 1);
+  test(after.handshakes - before.handshakes == 8);
+  test(after.resumed - before.resumed == 4);
+  test(after.failures - before.failures == 3);
+  test(after.ktls + after.relayed - before.ktls - before.relayed == 8);
+  test(after.refused - before.refused == 8);
+  test(after.rotations - before.rotations == 3);
+
+  tlsfront_quiesce();
+  tlsfront_shutdown();
+  tunables.listen_shards = shards;
+  tunables.listen_ipv6 = ipv6;
+  tunables.tls_handshake_timeout_ms = timeout;
+  SSL_CTX_free(tls12);
+  SSL_CTX_free(tls13);
+  SSL_CTX_free(no_tickets);
+  X509_free(certificate);
+  EVP_PKEY_free(key);
+  unlink(key_path);
+  unlink(cert_path);
+} // test_tlsfront
+
+/**
+ * @brief Tests the TCP profiles: a listener gets its options and backlog,
+ *        defers a connection until its request arrives and passes
+ *        TCP_NODELAY on, and an upstream socket gets its buffers, its range
+ *        of local ports and Fast Open only where asked.
+ */
+void
+test_tcptune ()
+{
+  struct notary_tunables saved = tunables;
+  struct tcptune_stats before, after;
+  struct sockaddr_in address;
+  socklen_t length;
+  struct pollfd ready;
+  int listener, client, fd, value, on = 1;
+
+  tcptune_get_stats(&before);
+  tunables.listen_backlog = 8;
+  tunables.listen_fastopen = 16;
+  tunables.listen_defer_accept_s = 5;
+  tunables.listen_nodelay = 1;
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  test(bind(listener, (struct sockaddr *) &address, sizeof(address)) == 0);
+  test(tcptune_listener(listener) == 0);
+  length = sizeof(address);
+  getsockname(listener, (struct sockaddr *) &address, &length);
+
+  length = sizeof(value);
+  test(getsockopt(listener, IPPROTO_TCP, TCP_NODELAY, &value, &length) == 0
+       && value == 1);
+  test(getsockopt(listener, IPPROTO_TCP, TCP_DEFER_ACCEPT, &value,
+                  &length) == 0 && value >= 5);
+  test(getsockopt(listener, IPPROTO_TCP, TCP_FASTOPEN, &value, &length) == 0
+       && value == 16);
+
+  /* The upstream profile, with its ports kept to a range. */
+  tunables.upstream_fastopen = 1;
+  tunables.upstream_quickack = 1;
+  tunables.upstream_sndbuf = 16384;
+  tunables.upstream_rcvbuf = 65536;
+  tunables.upstream_port_min = 40000;
+  tunables.upstream_port_max = 40099;
+  client = socket(AF_INET, SOCK_STREAM, 0);
+  test(tcptune_upstream(client, 0) == 0);
+  test(getsockopt(client, SOL_SOCKET, SO_RCVBUF, &value, &length) == 0
+       && value == 2 * 65536);
+  test(getsockopt(client, SOL_SOCKET, SO_SNDBUF, &value, &length) == 0
+       && value == 2 * 16384);
+  test(getsockopt(client, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &value,
+                  &length) == 0 && value == 0);
+
+  /* A connection that has sent nothing is not accepted. */
+  test(connect(client, (struct sockaddr *) &address, sizeof(address)) == 0);
+  ready.fd = listener;
+  ready.events = POLLIN;
+  test(poll(&ready, 1, 200) == 0);
+  test(write(client, "GET", 3) == 3);
+  test(poll(&ready, 1, 1000) == 1);
+  fd = accept(listener, NULL, NULL);
+  test(fd >= 0);
+  test(getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, &length) == 0
+       && value == 1);
+  close(fd);
+
+  /* The local port comes from the range. */
+  length = sizeof(address);
+  getsockname(client, (struct sockaddr *) &address, &length);
+  test(ntohs(address.sin_port) >= 40000 && ntohs(address.sin_port) <= 40099);
+  close(client);
+
+  /* Fast Open is only asked for where the caller allows it. */
+  client = socket(AF_INET, SOCK_STREAM, 0);
+  test(tcptune_upstream(client, 1) == 0);
+  length = sizeof(value);
+  test(getsockopt(client, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &value,
+                  &length) == 0 && value == 1);
+  close(client);
+  tunables.upstream_fastopen = 0;
+  client = socket(AF_INET, SOCK_STREAM, 0);
+  tcptune_upstream(client, 1);
+  test(getsockopt(client, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &value,
+                  &length) == 0 && value == 0);
+  close(client);
+  close(listener);
+
+  /* A datagram socket refuses both TCP options, each counted on its own. */
+  tunables.upstream_fastopen = 1;
+  client = socket(AF_INET, SOCK_DGRAM, 0);
+  test(tcptune_upstream(client, 1) == 2);
+  close(client);
+
+  tcptune_get_stats(&after);
+  test(after.listeners == before.listeners + 1);
+  test(after.upstream == before.upstream + 4);
+  test(after.refused == before.refused + 2);
+  tunables = saved;
+} // test_tcptune
+
 /**
  * @brief Tests the function verify_certificate
  */
@@ -882,7 +4010,7 @@ test_send_response_helper (void *cls, struct MHD_Connection *connection,
   if (*con_cls == NULL)
     {
       struct connection_info_struct *con_info;
-      con_info = malloc (sizeof (struct connection_info_struct));
+      con_info = calloc (1, sizeof (struct connection_info_struct));
 
       /* Process POST and GET request separately. Signal an error
        * on any other method.
@@ -1056,7 +4184,7 @@ test_request_certificate ()
   char *string_read = malloc (sizeof(char) * max_len);
   char *url;
   char* correct_fingerprint;
-  char* retrieved_fingerprints[MAX_NO_OF_CERTS];
+  struct observation retrieved = {0};
   int index_of_last_char, number_of_certs;
   host *host_to_verify = malloc (sizeof(host));
 
@@ -1077,11 +4205,6 @@ test_request_certificate ()
       exit(1);
     }
 
-  //allocate space for the fingerprints
-  int i;
-  for(i=0; i<MAX_NO_OF_CERTS; i++)
-    retrieved_fingerprints[i] = calloc(FPT_LENGTH * sizeof(char), 1);
-
   /* Read valid urls from a file and retrieve a certificate from each. */
   while (fgets (string_read, max_len, valids) != NULL)
     {
@@ -1097,15 +4220,11 @@ test_request_certificate ()
       //then get the fingerprint
       correct_fingerprint = strtok(NULL, "' '");
 
-      //Get the fingerprint by calling request_certificate
-      number_of_certs = request_certificate(host_to_verify, retrieved_fingerprints);
-
-      test (verify_certificate(correct_fingerprint, retrieved_fingerprints, number_of_certs) == 1);
+      //Get the chain by calling request_certificate
+      retrieved.chain = CERTPOOL_NONE;
+      number_of_certs = request_certificate(host_to_verify, &retrieved.chain, NULL, NULL);
 
-      //reset all the characters in each string to null to allow for the
-      //next iteration of fingerprint conversion
-      for(i=0; i<MAX_NO_OF_CERTS; i++)
-	retrieved_fingerprints[i][0] = '\0';
+      test (number_of_certs > 0 && observation_contains(&retrieved, correct_fingerprint) == 1);
     }
 
   /* Read invalid urls from a file and request a certificate from each. */
@@ -1123,26 +4242,18 @@ test_request_certificate ()
       //then get the fingerprint
       correct_fingerprint = strtok(NULL, "' '");
 
-      //Get the fingerprint by calling request_certificate
-      number_of_certs = request_certificate(host_to_verify, retrieved_fingerprints);
+      //Get the chain by calling request_certificate
+      retrieved.chain = CERTPOOL_NONE;
+      number_of_certs = request_certificate(host_to_verify, &retrieved.chain, NULL, NULL);
 
       //Check that fingerprints do not match
-      test (verify_certificate(correct_fingerprint, retrieved_fingerprints, number_of_certs) == 0);
-
-      //reset all the characters in each string to null to allow for the
-      //next iteration of fingerprint convers
-      for(i=0; i<MAX_NO_OF_CERTS; i++)
-	retrieved_fingerprints[i][0] = '\0';
+      test (observation_contains(&retrieved, correct_fingerprint) == 0);
     }
 
   fclose (valids);
   fclose (invalids);
   free(host_to_verify);
   free(string_read);
-
-  //free memory used for fingerprints
-  for(i=0; i<MAX_NO_OF_CERTS; i++)
-    free(retrieved_fingerprints[i]);
 } // test_request_certificate
 
 
@@ -1500,9 +4611,10 @@ mem_leak_check()
 int
 main (int argc, char *argv[])
 {
+  worker_global_init();
   mem_leak_check();
   /* Variables to keep track of allocated memory. */
-  //int before, after;
+  int before, after;
 
   mtrace();
   before = mem_allocated();
@@ -1517,6 +4629,31 @@ main (int argc, char *argv[])
   //after = mem_allocated();
   //test(before==after);
   //test_generate_signature();
+  test_signer ();
+  test_merkle ();
+  test_batch_signing ();
+  test_response_cache ();
+  test_worker_context ();
+  test_resolver ();
+  test_eyeballs ();
+  test_deadline ();
+  test_hedge ();
+  test_negative_cache ();
+  test_refresh ();
+  test_hitters ();
+  test_observation_policy ();
+  test_hostkey ();
+  test_certpool ();
+  test_history ();
+  test_warm ();
+  test_ingest ();
+  test_snapshot ();
+  test_handoff ();
+  test_shmcache ();
+  test_shard ();
+  test_keepalive ();
+  test_tlsfront ();
+  test_tcptune ();
   //test_retrieve_response ();
   //test_send_response ();
   //test_request_certificate ();
@@ -0,0 +1,160 @@
+/**
+ *@file
+ *@author g-coders
+ *@date
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ *@section DESCRIPTION
+ * This program checks the signature of a response returned by a notary,
+ * whether the response was signed on its own or as part of a Merkle batch.
+ */
+
+#include "notary.h"
+#include "response.h"
+#include <openssl/pem.h>
+
+/**
+ * @brief Print a helpful usage message.
+ */
+static void
+print_usage ()
+{
+  printf ("usage: notary-verify -c <certificate> [response]\n \
+           Checks the signature of a notary response read from the file\n \
+           response, or from standard input.\n \
+           Options:\n \
+	   -c <certificate> The notary's certificate or PEM public key.\n \
+	   -h               Print this help message.\n");
+} // print_usage
+
+/**
+ * @brief Reads the notary's public key from a certificate or a PEM public
+ *        key file.
+ * @param path The location of the certificate or key
+ * @return the public key, or NULL on failure
+ */
+static EVP_PKEY *
+read_public_key (const char *path)
+{
+  FILE *fp = fopen (path, "r");
+  X509 *certificate;
+  EVP_PKEY *public_key = NULL;
+
+  if (fp == NULL)
+    {
+      fprintf (stderr, "Could not open %s for reading.\n", path);
+      return NULL;
+    }
+
+  certificate = PEM_read_X509 (fp, NULL, NULL, NULL);
+  if (certificate != NULL)
+    {
+      public_key = X509_get_pubkey (certificate);
+      X509_free (certificate);
+    }
+  else
+    {
+      rewind (fp);
+      public_key = PEM_read_PUBKEY (fp, NULL, NULL, NULL);
+    }
+
+  fclose (fp);
+  return public_key;
+} // read_public_key
+
+/**
+ * @brief Reads a whole stream into a null terminated string.
+ * @param fp The stream to read
+ * @return the newly allocated contents, or NULL on failure
+ */
+static char *
+read_stream (FILE *fp)
+{
+  size_t length = 0, size = 4096, count;
+  char *contents = malloc (size);
+  char *temp;
+
+  while (contents != NULL
+         && (count = fread (contents + length, 1, size - length - 1, fp)) > 0)
+    {
+      length += count;
+      if (length + 1 == size)
+        {
+          size *= 2;
+          temp = realloc (contents, size);
+          if (temp == NULL)
+            free (contents);
+          contents = temp;
+        }
+    }
+
+  if (contents != NULL)
+    contents[length] = '\0';
+  return contents;
+} // read_stream
+
+/**
+ * @brief Verifies a notary response.
+ * @param argc The number of command-line arguments
+ * @param argv The command-line arguments
+ * @return Returns 0 if the signature is valid, 1 otherwise.
+ */
+int
+main (int argc, char *argv[])
+{
+  char *certificate_path = NULL;
+  char *response;
+  EVP_PKEY *public_key;
+  FILE *fp = stdin;
+  int c, verified;
+
+  while ((c = getopt (argc, argv, "c:h")) != -1)
+    {
+      switch (c)
+        {
+        case 'c':
+          certificate_path = optarg;
+          break;
+        default:
+          print_usage ();
+          return 1;
+        }
+    }
+
+  if (certificate_path == NULL)
+    {
+      print_usage ();
+      return 1;
+    }
+
+  public_key = read_public_key (certificate_path);
+  if (public_key == NULL)
+    {
+      fprintf (stderr, "Could not read a public key from %s\n",
+               certificate_path);
+      return 1;
+    }
+
+  if (optind < argc)
+    {
+      fp = fopen (argv[optind], "r");
+      if (fp == NULL)
+        {
+          fprintf (stderr, "Could not open %s for reading.\n", argv[optind]);
+          EVP_PKEY_free (public_key);
+          return 1;
+        }
+    }
+
+  response = read_stream (fp);
+  if (fp != stdin)
+    fclose (fp);
+
+  verified = response != NULL
+    && verify_response_signature (response, public_key);
+  printf ("%s\n", verified ? "Signature OK" : "Signature INVALID");
+
+  free (response);
+  EVP_PKEY_free (public_key);
+  return !verified;
+} // main
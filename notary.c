@@ -13,6 +13,31 @@
 #include "connection.h"
 #include "certificate.h"
 #include "response.h"
+#include "signer.h"
+#include "config.h"
+#include "observation.h"
+#include "respcache.h"
+#include "worker.h"
+#include "resolver.h"
+#include "deadline.h"
+#include "origin.h"
+#include "hedge.h"
+#include "admin.h"
+#include "negcache.h"
+#include "refresh.h"
+#include "hitters.h"
+#include "hostkey.h"
+#include "certpool.h"
+#include "history.h"
+#include "warm.h"
+#include "ingest.h"
+#include "snapshot.h"
+#include "handoff.h"
+#include "shmcache.h"
+#include "shard.h"
+#include "tlsfront.h"
+#include "tcptune.h"
+#include <netinet/in.h>
 
 
 /**
@@ -41,9 +66,34 @@ print_usage ()
 	   -u <username>    Name of user to drop privileges to (defaults to 'nobody')\n \
 	   -g <group>       Name of group to drop privileges to (defaults to 'nogroup')\n \
 	   -b <backend>     Verifier backend [perspective|google] (defaults to 'perspective')\n \
+	   -t <threads>     Number of response signing threads (defaults to 2).\n \
+	   -n <nameserver>  DNS server to resolve hosts with, as address[:port]\n \
+	                    (defaults to the first one in /etc/resolv.conf).\n \
+	   -a <admin_port>  Serve /admin/metrics, /admin/hitters, /admin/ready\n \
+	                    and /admin/prefetch on this loopback port (optional).\n \
+	   -A <token_file>  Accept lists of hosts on /admin/prefetch from holders\n \
+	                    of the token in this file (optional).\n \
+	   -w <warm_file>   Warm the caches with the hosts listed in this file,\n \
+	                    one URL or host:port per line (optional).\n \
+	   -I <scan_file>   Load chains collected by a scanner from this file,\n \
+	                    one \"host:port timestamp base64-DER...\" per line,\n \
+	                    without contacting the hosts (optional).\n \
+	   -S <snapshot>    Restore the history from this snapshot at startup\n \
+	                    and write it there on exit and every\n \
+	                    snapshot_interval_s seconds (optional).\n \
+	   -M <shm_file>    Share observations with the other notaries of this\n \
+	                    machine through this file, best under /dev/shm\n \
+	                    (optional).\n \
+	   -o <name=value>  Set one of the tunables below.\n \
 	   -f               Run in foreground.\n \
 	   -d               Run in debug mode.\n \
-	   -h               Print this help message.\n");
+	   -h               Print this help message.\n \
+           Signals:\n \
+	   SIGUSR2          Hand the listening sockets to a new copy of the\n \
+	                    binary, then finish the requests in flight and exit.\n \
+	   SIGTERM, SIGINT  Finish the requests in flight and exit.\n \
+           Tunables:\n");
+  print_tunables (stdout);
 
 } // print_usage
 
@@ -66,15 +116,15 @@ set_default_notary_option (char* default_string)
 
 /**
  * @brief Sets the appropriate notary option.
- * @param option The notary option
+ * @param option Pointer to the notary option, which may be reallocated
  * @param argument The argument for the notary option
  */
 static void
-set_notary_option (char *option, char* argument)
+set_notary_option (char **option, char* argument)
 {
   /* Reallocate the string. */
   char *temp;
-  temp = realloc(option, sizeof(char) * (strlen(argument) + 1));
+  temp = realloc(*option, sizeof(char) * (strlen(argument) + 1));
   if (temp == NULL)
     {
       /* Figure out how to print out the option for which memory could not be
@@ -84,26 +134,68 @@ set_notary_option (char *option, char* argument)
       exit(1);
     }
 
-  strcpy(option, argument);
+  strcpy(temp, argument);
+  *option = temp;
 }//set_notary_option
 
+/**
+ * @brief Reads a single line of notary.config into a newly allocated string.
+ * @param fp The open configuration file
+ * @return the line without its trailing newline, or NULL at end of file
+ */
+static char*
+read_config_line (FILE *fp)
+{
+  char line[PATH_MAX];
+
+  if (fgets(line, sizeof(line), fp) == NULL)
+    return NULL;
+
+  line[strcspn(line, "\r\n")] = '\0';
+  return set_default_notary_option(line);
+}//read_config_line
+
 /* Set the keyfile and certfile */
 static void
 set_key_and_cert_files() 
 {
-  char mykey[128];
-  char mycert[128];
   FILE *fp = fopen("./notary.config","r");
 
-  fgets(mykey, 129, fp);
-  mykey[strlen(mykey)-2] = '\0';
-  keyfile = mykey;
- 
-  fgets(mycert, 129, fp);
-  mycert[strlen(mycert)-2] = '\0';
-  certfile = mycert;
+  if (fp == NULL)
+    {
+      fprintf (stderr, "Could not open ./notary.config. Run notary-configure "
+               "first.\n");
+      exit(1);
+    }
+
+  keyfile = read_config_line(fp);
+  certfile = read_config_line(fp);
+  fclose(fp);
+
+  if (keyfile == NULL || certfile == NULL)
+    {
+      fprintf (stderr, "./notary.config must name a key and a certificate.\n");
+      exit(1);
+    }
 }
 
+/**
+ * @brief Stops a daemon from accepting connections, leaving its listening
+ *        socket to a successor, while its requests in flight go on.
+ * @param daemon The daemon, or NULL
+ */
+static void
+quiesce_daemon (struct MHD_Daemon *daemon)
+{
+  MHD_socket listener;
+
+  if (daemon == NULL)
+    return;
+  listener = MHD_quiesce_daemon (daemon);
+  if (listener != MHD_INVALID_SOCKET)
+    close (listener);
+}//quiesce_daemon
+
 /**
  * @brief Starts the daemon and runs the notary
  * @param argc The number of command-line arguments
@@ -113,8 +205,18 @@ set_key_and_cert_files()
 
 int main (int argc, char *argv[])
 {
+  long long started_ms = deadline_now_ms ();
   int i;
-  struct MHD_Daemon *ssl_daemon, *http_daemon, *fourtwo_daemon;
+  struct shard_set ssl_shards, http_shards, fourtwo_shards;
+  struct MHD_Daemon *admin_daemon = NULL;
+  enum handoff_event event;
+  unsigned int abandoned;
+  int admin_port = 0;
+  char *warm_file = NULL;
+  char *scan_file = NULL;
+  char *snapshot_file = NULL;
+  char *shm_file = NULL;
+  struct ingest_stats ingested = {0};
 
   /* Set sensible defaults for the server. */
   int http_port = 80;
@@ -127,6 +229,28 @@ int main (int argc, char *argv[])
   group = set_default_notary_option("nogroup");
   bool debug = false;
   bool foreground = false;
+  int signer_threads = DEFAULT_SIGNER_THREADS;
+  char *nameserver = NULL;
+  struct signer_stats signing;
+  struct observation_stats observations;
+  struct response_cache_stats responses;
+  struct resolver_stats dns;
+  struct deadline_stats deadlines;
+  struct origin_stats origins;
+  struct hedge_stats hedges;
+  struct negcache_stats failures;
+  struct refresh_stats refreshes;
+  struct hitters_stats hitters;
+  struct hostkey_stats hosts;
+  struct certpool_stats pool;
+  struct history_stats history;
+  struct warm_stats warming;
+  struct snapshot_stats snapshots;
+  struct handoff_stats handoffs;
+  struct shmcache_stats shared;
+  struct connection_stats clients;
+  struct tlsfront_stats tls;
+  struct tcptune_stats tcp;
 
   char c;
   opterr = 0;
@@ -134,7 +258,7 @@ int main (int argc, char *argv[])
   /* Set keyfile and certfile */
   set_key_and_cert_files();
 
-  while ((c = getopt (argc, argv, "p:s:i:c:k:u:g:df")) != -1)
+  while ((c = getopt (argc, argv, "p:s:i:c:k:u:g:t:n:a:A:w:I:S:M:o:df")) != -1)
     {
       switch (c)
         {
@@ -145,20 +269,52 @@ int main (int argc, char *argv[])
           ssl_port = atoi (optarg);
           break;
         case 'i':
-          set_notary_option (ip, optarg);
+          set_notary_option (&ip, optarg);
           break;
         case 'c':
-          set_notary_option (certfile, optarg);
+          set_notary_option (&certfile, optarg);
           break;
         case 'k':
           printf("%s\n", optarg);
-          set_notary_option (keyfile, optarg);
+          set_notary_option (&keyfile, optarg);
           break;
         case 'u':
-          set_notary_option (username, optarg);
+          set_notary_option (&username, optarg);
           break;
         case 'g':
-          set_notary_option (group, optarg);
+          set_notary_option (&group, optarg);
+          break;
+        case 't':
+          signer_threads = atoi (optarg);
+          break;
+        case 'n':
+          nameserver = optarg;
+          break;
+        case 'a':
+          admin_port = atoi (optarg);
+          break;
+        case 'A':
+          if (!admin_load_token (optarg))
+            return 1;
+          break;
+        case 'w':
+          warm_file = optarg;
+          break;
+        case 'I':
+          scan_file = optarg;
+          break;
+        case 'S':
+          snapshot_file = optarg;
+          break;
+        case 'M':
+          shm_file = optarg;
+          break;
+        case 'o':
+          if (!set_tunable (optarg))
+            {
+              print_usage();
+              return 1;
+            }
           break;
         case 'd':
           debug = true;
@@ -177,105 +333,322 @@ int main (int argc, char *argv[])
   /* Find a logging c library. */
   initiate_logging ();
 
+  /* Handle upgrade and stop signals, and take over the listening sockets
+   * of the notary this one replaces, if any. */
+  if (!handoff_init ())
+    {
+      fprintf (stderr, "Error: Could not take over from the old notary\n");
+      return 1;
+    }
+
+  /* Initialize curl and OpenSSL once, before any thread uses them. */
+  if (!worker_global_init ())
+    {
+      fprintf (stderr, "Error: Could not initialize curl and OpenSSL\n");
+      return 1;
+    }
+
+  /* Without the shared table every process contacts hosts on its own. */
+  if (shm_file != NULL && !shmcache_open (shm_file))
+    fprintf (stderr, "Warning: Not sharing observations through %s\n",
+             shm_file);
+
+  /* Map what the last run observed; hosts are restored as they are asked
+   * about, and all of them in the background. */
+  if (snapshot_file != NULL && snapshot_open (snapshot_file))
+    {
+      snapshot_get_stats (&snapshots);
+      printf ("Mapped a snapshot of %lu hosts in %lu ms\n", snapshots.hosts,
+              snapshots.map_ms);
+    }
+
+  /* Load what scanners collected before answering any client. Hosts with
+   * a history are not restored, so the snapshot goes first. */
+  if (scan_file != NULL)
+    {
+      snapshot_wait ();
+      if (!ingest_file (scan_file, 0, &ingested))
+        {
+          fprintf (stderr, "Error: Failed to ingest %s\n", scan_file);
+          return 1;
+        }
+      printf ("Ingested %lu of %lu records of %s (%lu invalid, %lu refused "
+              "an ID)\n", ingested.ingested, ingested.records, scan_file,
+              ingested.invalid, ingested.full);
+    }
+
+  /* Without the shared resolver, curl resolves every host itself. */
+  if (!resolver_init (nameserver))
+    fprintf (stderr, "Warning: Could not start the DNS resolver\n");
+
+  /* Parse the private key once; every response is signed with it. */
+  if (!signer_init (keyfile, signer_threads))
+    {
+      fprintf (stderr, "Error: Could not load the private key in %s\n",
+               keyfile);
+      return 1;
+    }
+  printf ("Signing responses with %s on %d threads\n",
+          signature_scheme_name (signer_scheme ()), signer_threads);
+
+  /* Optionally sign responses in Merkle batches, one signature per batch. */
+  if (tunables.merkle_window_ms > 0)
+    {
+      if (!signer_enable_batching (tunables.merkle_window_ms,
+                                   tunables.merkle_max_batch))
+        {
+          fprintf (stderr, "Error: Could not start batch signing\n");
+          return 1;
+        }
+      printf ("Signing in batches of up to %d responses every %d ms\n",
+              tunables.merkle_max_batch, tunables.merkle_window_ms);
+    }
+
 
   /* Make sure we can start the daemon in the background. */
 
-  /* Start the MHD daemons to listen for client requests. 
-   * We have 3 daemons to listen on 3 ports: the SSL port 
-   * (for standard traffic), the HTTP port (for proxy traffic) and 4242 traffic
-   * (for other notaries that are serving as proxies to query us)
-   *
-   * Parameters: 
-   * MHD_USE_THREAD_PER_CONNECTION: use one thread per connection 
-   * port: port to listen on
-   * NULL: allow connection from any IP
-   * NULL: additional arguments to preceding param
-   * &answer_to_connection: call this function to handle a new connection
-   * NULL: arguments to answer_to_connection,
-   * MHD_OPTION_NOTIFY_COMPLETED: indicate that request_completed is
-   * registered
-   * request_completed: function to call when a request completes
-   * NULL: arguments to the request_completed function
-   * MHD_OPTION_END: indicate that there are no more options
+  /* Build the fixed answers once, for every connection to share. */
+  if (!response_init_static ())
+    {
+      fprintf (stderr, "Error: Failed to build the fixed responses\n");
+      return 1;
+    }
+
+  /* Listen on the sockets of the notary this one replaces, if any, so no
+   * connection is refused during an upgrade. */
+  if (!shard_listen (&ssl_shards, "ssl", ssl_port)
+      || !shard_listen (&http_shards, "http", http_port)
+      || !shard_listen (&fourtwo_shards, "4242", 4242))
+    {
+      fprintf (stderr, "Error: Failed to listen for clients\n");
+      return 1;
+    }
+
+  /* Start the MHD daemons to listen for client requests.
+   * We have 3 ports: the SSL port (for standard traffic), the HTTP port
+   * (for proxy traffic) and 4242 traffic (for other notaries that are
+   * serving as proxies to query us), with a daemon for each shard of each.
+   * TLS on the SSL port is terminated in front of its daemons, with the
+   * notary's certificate.
    */
-  ssl_daemon = MHD_start_daemon (MHD_USE_THREAD_PER_CONNECTION,
-                             ssl_port,
-			     NULL,
-			     NULL,
-			     &answer_to_SSL_connection,
-                             NULL,
-                             MHD_OPTION_NOTIFY_COMPLETED,
-			     request_completed,
-                             NULL,
-                             MHD_OPTION_END
-                             );
-
-  if (ssl_daemon == NULL)
+  ssl_shards.external = 1;
+  if (!tlsfront_init (keyfile, certfile)
+      || !shard_start (&ssl_shards, &answer_to_SSL_connection,
+                       request_completed, connection_notify)
+      || !tlsfront_start (&ssl_shards))
     {
       fprintf (stderr, "Error: Failed to start the MHD SSL daemon\n");
-    return 1;
+      return 1;
     }
   else
     {
-      printf ("MHD SSL daemon is listening on port %d\n", ssl_port);
+      printf ("MHD SSL daemon is listening on port %d (%d sockets)\n",
+              ssl_port, ssl_shards.count);
     }
-  
- 
-  http_daemon = MHD_start_daemon (MHD_USE_THREAD_PER_CONNECTION, 
-                             http_port, 
-			     NULL, 
-			     NULL, 
-			     &answer_to_HTTP_connection,
-                             NULL,
-                             MHD_OPTION_NOTIFY_COMPLETED, 
-			     request_completed,
-                             NULL, 
-                             MHD_OPTION_END
-                             );
-
-  if (http_daemon == NULL)
+
+  if (!shard_start (&http_shards, &answer_to_HTTP_connection,
+                    request_completed, connection_notify))
     {
       fprintf (stderr, "Error: Failed to start the MHD HTTP daemon\n");
       return 1;
     }
   else
     {
-      printf ("MHD HTTP daemon is listening on port %d\n", http_port);
+      printf ("MHD HTTP daemon is listening on port %d (%d sockets)\n",
+              http_port, http_shards.count);
+    }
+
+  if (!shard_start (&fourtwo_shards, &answer_to_4242_connection,
+                    request_completed, connection_notify))
+    {
+      fprintf (stderr, "Error: Failed to start the MHD 4242 daemon\n");
+      return 1;
     }
-  
-  fourtwo_daemon = MHD_start_daemon (MHD_USE_THREAD_PER_CONNECTION, 
-                             4242, 
-			     NULL, 
-			     NULL, 
-			     &answer_to_4242_connection,
-                             NULL,
-                             MHD_OPTION_NOTIFY_COMPLETED, 
-			     request_completed,
-                             NULL, 
-                             MHD_OPTION_END
-                             );
-
-  if (fourtwo_daemon == NULL)
-  {
-    fprintf (stderr, "Error: Failed to start the MHD 4242 daemon\n");
-    return 1;
-  }
   else
     {
-      printf ("MHD 4242 daemon is listening on port 4242\n");
+      printf ("MHD 4242 daemon is listening on port 4242 (%d sockets)\n",
+              fourtwo_shards.count);
+    }
+
+  /* Warm while serving; /admin/ready tells when enough hosts are warm. */
+  if (warm_file != NULL && warm_queue_file (warm_file) < 0)
+    {
+      fprintf (stderr, "Error: Failed to queue the hosts in %s\n", warm_file);
+      return 1;
     }
 
-  /* Prevent the server from stopping immediately after starting. We might
-   * want to change this approach in the future. */
-  getchar ();
+  if (admin_port > 0)
+    {
+      admin_daemon = admin_start (admin_port);
+      if (admin_daemon == NULL)
+        {
+          fprintf (stderr, "Error: Failed to start the admin daemon\n");
+          return 1;
+        }
+      printf ("Admin daemon is listening on 127.0.0.1 port %d\n", admin_port);
+    }
+  handoff_ready ();
+  printf ("Serving %lld ms after start\n", deadline_now_ms () - started_ms);
+
+  if (snapshot_file != NULL
+      && !snapshot_start_writer (snapshot_file, tunables.snapshot_interval_s))
+    fprintf (stderr, "Warning: Could not start writing snapshots\n");
+
+  /* Serve until asked to stop, or until a new binary takes over. The
+   * successor maps the snapshot written for it. */
+  while ((event = handoff_wait ()) == HANDOFF_UPGRADE)
+    {
+      printf ("Handing over to a new %s\n", argv[0]);
+      if (snapshot_file != NULL)
+        {
+          snapshot_stop_writer ();
+          snapshot_write (snapshot_file);
+        }
+      if (handoff_start (argv))
+        break;
+      fprintf (stderr, "Warning: The upgrade failed; still serving\n");
+      if (snapshot_file != NULL)
+        snapshot_start_writer (snapshot_file, tunables.snapshot_interval_s);
+    }
+
+  /* Stop accepting and let the requests in flight finish. */
+  tlsfront_quiesce ();
+  shard_quiesce (&ssl_shards);
+  shard_quiesce (&http_shards);
+  shard_quiesce (&fourtwo_shards);
+  quiesce_daemon (admin_daemon);
+  abandoned = handoff_drain (&number_active_clients,
+                             tunables.drain_timeout_ms);
+  if (abandoned > 0)
+    fprintf (stderr, "Warning: %u requests were still in flight\n",
+             abandoned);
 
   /* Stop the  MHD daemon. */
-  MHD_stop_daemon (ssl_daemon);
+  shard_stop (&ssl_shards);
   printf ("SSL daemon has terminated\n");
-  MHD_stop_daemon (http_daemon);
+  shard_stop (&http_shards);
   printf ("HTTP daemon has terminated\n");
-  MHD_stop_daemon (fourtwo_daemon);
+  shard_stop (&fourtwo_shards);
   printf ("4242 daemon has terminated\n");
+  if (admin_daemon != NULL)
+    MHD_stop_daemon (admin_daemon);
+  response_free_static ();
+
+  signer_get_stats (&signing);
+  printf ("Signed %lu responses (%lu failures), average signing time %llu us, "
+          "average queueing time %llu us, slowest signature %llu us\n",
+          signing.signatures, signing.failures,
+          signing.signatures ? signing.total_sign / signing.signatures : 0,
+          signing.signatures ? signing.total_wait / signing.signatures : 0,
+          signing.max_sign);
+  if (signing.batches > 0)
+    printf ("Signed %lu responses in %lu Merkle batches\n", signing.batched,
+            signing.batches);
+
+  observation_get_stats (&observations);
+  response_cache_get_stats (&responses);
+  printf ("Observation cache: %lu hits (%lu window, %lu probation, "
+          "%lu protected), %lu misses, %lu expired, %lu evictions "
+          "(%lu rejected), %lu bytes\n", observations.hits,
+          observations.window_hits, observations.probation_hits,
+          observations.protected_hits, observations.misses,
+          observations.expired, observations.evictions, observations.rejected,
+          observations.bytes);
+  printf ("Response cache: %lu hits, %lu misses, %lu stale, %lu evictions\n",
+          responses.hits, responses.misses, responses.stale,
+          responses.evictions);
+  resolver_get_stats (&dns);
+  printf ("DNS cache: %lu hits (%lu negative), %lu misses, %lu coalesced, "
+          "%lu prefetches, %lu queries, %lu timeouts\n", dns.hits,
+          dns.negative_hits, dns.misses, dns.coalesced, dns.prefetches,
+          dns.queries, dns.timeouts);
+  deadline_get_stats (&deadlines);
+  origin_get_stats (&origins);
+  printf ("Verifications out of time: %lu queueing, %lu DNS, %lu connecting, "
+          "%lu in TLS, %lu signing; %lu cancelled\n",
+          deadlines.expired[DEADLINE_QUEUE], deadlines.expired[DEADLINE_DNS],
+          deadlines.expired[DEADLINE_CONNECT], deadlines.expired[DEADLINE_TLS],
+          deadlines.expired[DEADLINE_SIGN], deadlines.cancelled);
+  printf ("Fetch slots: %lu taken (%lu after queueing), %lu refused\n",
+          origins.acquired, origins.queued, origins.rejected);
+  hedge_get_stats (&hedges);
+  printf ("Hedged fetches: %lu of %lu fetches (%lu denied), %lu won, "
+          "about %llu ms saved\n", hedges.hedges, hedges.fetches,
+          hedges.denied, hedges.hedge_wins, hedges.saved_ms);
+  negcache_get_stats (&failures);
+  printf ("Unreachable hosts: %lu DNS, %lu connect, %lu TLS, %lu timeout "
+          "failures; %lu requests failed at once, %lu recoveries\n",
+          failures.failures[NEGCACHE_DNS], failures.failures[NEGCACHE_CONNECT],
+          failures.failures[NEGCACHE_TLS], failures.failures[NEGCACHE_TIMEOUT],
+          failures.hits, failures.recoveries);
+  refresh_drain ();
+  warm_cancel ();
+  warm_drain ();
+  /* After a handoff the snapshot belongs to the successor. */
+  if (snapshot_file != NULL)
+    {
+      snapshot_stop_writer ();
+      if (event != HANDOFF_UPGRADE)
+        snapshot_write (snapshot_file);
+    }
+  refresh_get_stats (&refreshes);
+  printf ("Background refreshes: %lu started, %lu failed, %lu dropped\n",
+          refreshes.started, refreshes.failed, refreshes.dropped);
+  hitters_get_stats (&hitters);
+  printf ("Heavy hitters: %lu hosts tracked of %lu requests, %lu evictions "
+          "spared\n", hitters.tracked, hitters.updates,
+          responses.spared);
+  hostkey_get_stats (&hosts);
+  printf ("Host keys: %lu hosts interned, %lu invalid, %lu refused an ID\n",
+          hosts.interned, hosts.invalid, hosts.full);
+  certpool_get_stats (&pool);
+  printf ("Certificate pool: %lu certificates, %lu chains, %lu found "
+          "again, %lu refused an ID, %lu bytes\n", pool.certs, pool.chains,
+          pool.hits, pool.full, pool.bytes);
+  history_get_stats (&history);
+  printf ("History: %lu runs of %lu hosts, %lu observations extended a run, "
+          "%lu runs trimmed, %lu stale sightings, %lu bytes\n", history.runs,
+          history.hosts, history.extended, history.trimmed, history.stale,
+          history.bytes);
+  warm_get_stats (&warming);
+  printf ("Warm-up: %lu of %lu hosts warm, %lu failed, %lu cancelled, "
+          "%lu invalid lines\n", warming.warmed, warming.queued,
+          warming.failed, warming.cancelled, warming.invalid);
+  snapshot_get_stats (&snapshots);
+  printf ("Snapshot: %lu of %lu hosts restored (%lu on demand) in %lu ms, "
+          "%lu written (%lu failed), last of %lu bytes in %lu ms\n",
+          snapshots.restored, snapshots.hosts, snapshots.on_demand,
+          snapshots.rebuild_ms, snapshots.writes, snapshots.write_failures,
+          snapshots.write_bytes, snapshots.write_ms);
+  handoff_get_stats (&handoffs);
+  printf ("Handoff: %lu listening sockets taken over, %lu handoffs (%lu "
+          "failed), drained in %lu ms with %lu requests abandoned\n",
+          handoffs.inherited, handoffs.handoffs, handoffs.failures,
+          handoffs.drain_ms, handoffs.abandoned);
+  shmcache_get_stats (&shared);
+  printf ("Shared observations: %lu hits, %lu misses, %lu published, "
+          "%lu claimed, %lu waited for (%lu published in time), "
+          "%lu reclaimed from dead processes\n", shared.hits, shared.misses,
+          shared.published, shared.claims, shared.waited, shared.waited_hits,
+          shared.reclaimed);
+  connection_get_stats (&clients);
+  printf ("Client connections: %lu accepted carrying %lu requests, %lu on "
+          "a reused connection, %lu closed at the request cap\n",
+          clients.connections, clients.requests, clients.reused,
+          clients.capped);
+  tlsfront_get_stats (&tls);
+  printf ("TLS: %lu handshakes (%lu resumed, %lu failed), %lu encrypted by "
+          "the kernel, %lu relayed, %lu closed over the cap, %lu ticket "
+          "keys\n", tls.handshakes, tls.resumed, tls.failures, tls.ktls,
+          tls.relayed, tls.overloaded, tls.rotations);
+  tcptune_get_stats (&tcp);
+  printf ("TCP profiles: %lu listeners and %lu upstream sockets tuned, %lu "
+          "options refused\n", tcp.listeners, tcp.upstream, tcp.refused);
+  tlsfront_shutdown ();
+  shmcache_close ();
+  resolver_shutdown ();
+  signer_shutdown ();
+  worker_global_cleanup ();
 
   return 0;
 }
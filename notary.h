@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 
 
 /* Global variables representing the locations of the key file and
@@ -53,6 +54,17 @@ enum connection_type
     POST = 1
   };
 
+/* The fixed answers, whose responses are built once and shared. */
+enum static_page
+  {
+    STATIC_NONE = 0,
+    STATIC_BUSY,                // too many requests in flight
+    STATIC_UNSUPPORTED_METHOD,  // neither GET nor POST
+    STATIC_UNAVAILABLE,         // no signed result could be produced
+    STATIC_INVALID_HOST,        // the host to verify is not valid
+    STATIC_PAGES
+  };
+
 /* This datastructure contains information about an individual connection from
  * a client. 
  */
@@ -61,6 +73,10 @@ struct connection_info_struct
   enum connection_type connection_type;
   const char *answer_string;
   int answer_code;
+  struct cached_response *cached_response; // shared signed answer, or NULL
+  struct deadline *deadline;    // deadline of the verification, or NULL
+  enum static_page static_page; // fixed answer to send, or STATIC_NONE
+  int closing;                  // last request the connection may carry
 };
 
 /* This datastructure contains the url and port of the host we need to
@@ -0,0 +1,551 @@
+/** @file
+
+    @brief  Observation: an in-memory cache of the chain the notary last
+            saw for every host, bounded in hosts and bytes. Hosts are
+            admitted and evicted by W-TinyLFU: new hosts enter a small LRU
+            window, and leave it for the main segments only if they are
+            requested more often than the host they would displace.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "observation.h"
+#include "config.h"
+#include "hitters.h"
+#include "certpool.h"
+#include "history.h"
+#include <pthread.h>
+
+/* The segments of the cache. The main segments are a segmented LRU: hosts
+ * admitted from the window are on probation until they are hit again, and
+ * then protected, up to OBSERVATION_PROTECTED_PCT of the main segments. */
+enum segment
+  {
+    SEGMENT_WINDOW = 0,
+    SEGMENT_PROBATION = 1,
+    SEGMENT_PROTECTED = 2,
+    SEGMENTS = 3
+  };
+
+/* Share of the main segments the protected segment may fill. */
+#define OBSERVATION_PROTECTED_PCT 80
+
+/* An observation in the cache, chained into its hash bucket and into the
+ * list of its segment ordered by last use. */
+struct cached_observation
+{
+  uint32_t id;                  // the host, interned by hostkey
+  struct observation observation;
+  int hits_since_record;        // lookups since the observation was recorded
+  int refreshing;               // whether a refresh was handed out
+  int segment;
+  int linked;                   // whether it is in the list of its segment
+  struct cached_observation *next_in_bucket;
+  struct cached_observation *newer;
+  struct cached_observation *older;
+};
+
+/* The hosts of a segment, from the most to the least recently used. */
+struct segment_list
+{
+  struct cached_observation *newest;
+  struct cached_observation *oldest;
+  unsigned long count;
+};
+
+static struct cached_observation **buckets = NULL;
+static size_t num_buckets = 0;
+static struct segment_list segments[SEGMENTS];
+static unsigned long next_version = 1;
+static struct observation_stats stats;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Allocates the hash buckets the first time the cache is used, sized
+ *        for the hosts that fit in both caps. The buckets count towards
+ *        observation_max_bytes. Must be called with the cache locked.
+ *
+ * @return 1 if the buckets exist, 0 otherwise
+ */
+static int
+allocate_buckets ()
+{
+  size_t wanted = 1;
+  size_t hosts = tunables.observation_max_hosts;
+  size_t fit = (size_t) tunables.observation_max_bytes
+    / (sizeof (struct cached_observation) + sizeof (*buckets));
+
+  if (buckets != NULL)
+    return 1;
+
+  /* One to two hosts per bucket when the cache is full, so that the
+   * buckets never take more than a pointer per host. */
+  if (fit < hosts)
+    hosts = fit;
+  while (wanted * 2 <= hosts)
+    wanted <<= 1;
+
+  buckets = calloc (wanted, sizeof (*buckets));
+  if (buckets == NULL)
+    return 0;
+
+  num_buckets = wanted;
+  stats.bytes += num_buckets * sizeof (*buckets);
+  return 1;
+} // allocate_buckets
+
+/**
+ * @brief Finds the cached observation of a host. Host IDs are handed out in
+ *        sequence, so they serve as their own hash. Must be called with the
+ *        cache locked.
+ *
+ * @return the cached observation, or NULL if there is none
+ */
+static struct cached_observation *
+find (uint32_t id)
+{
+  struct cached_observation *entry;
+
+  if (buckets == NULL)
+    return NULL;
+
+  for (entry = buckets[id & (num_buckets - 1)]; entry != NULL;
+       entry = entry->next_in_bucket)
+    if (entry->id == id)
+      return entry;
+
+  return NULL;
+} // find
+
+/**
+ * @brief Takes an entry out of the list of its segment.
+ */
+static void
+unlink_entry (struct cached_observation *entry)
+{
+  struct segment_list *list = &segments[entry->segment];
+
+  if (!entry->linked)
+    return;
+
+  if (entry->newer != NULL)
+    entry->newer->older = entry->older;
+  else
+    list->newest = entry->older;
+
+  if (entry->older != NULL)
+    entry->older->newer = entry->newer;
+  else
+    list->oldest = entry->newer;
+
+  entry->newer = entry->older = NULL;
+  entry->linked = 0;
+  list->count--;
+} // unlink_entry
+
+/**
+ * @brief Puts an entry at the front of the list of a segment.
+ */
+static void
+make_newest (struct cached_observation *entry, int segment)
+{
+  struct segment_list *list = &segments[segment];
+
+  if (entry->linked && entry->segment == segment && list->newest == entry)
+    return;
+
+  unlink_entry (entry);
+  entry->segment = segment;
+  entry->linked = 1;
+  entry->older = list->newest;
+  if (list->newest != NULL)
+    list->newest->newer = entry;
+  list->newest = entry;
+  if (list->oldest == NULL)
+    list->oldest = entry;
+  list->count++;
+} // make_newest
+
+/**
+ * @brief Removes an entry from the cache and frees it. Must be called with
+ *        the cache locked.
+ */
+static void
+remove_entry (struct cached_observation *entry)
+{
+  struct cached_observation **link;
+
+  link = &buckets[entry->id & (num_buckets - 1)];
+  while (*link != entry)
+    link = &(*link)->next_in_bucket;
+  *link = entry->next_in_bucket;
+
+  unlink_entry (entry);
+  free (entry);
+  stats.hosts--;
+  stats.bytes -= sizeof (*entry);
+} // remove_entry
+
+/**
+ * @brief Returns the most hosts the cache may hold: observation_max_hosts,
+ *        or fewer if observation_max_bytes, less the buckets, does not allow
+ *        as many.
+ */
+static unsigned long
+capacity ()
+{
+  unsigned long hosts = tunables.observation_max_hosts;
+  unsigned long bucket_bytes = num_buckets * sizeof (*buckets);
+  unsigned long fit = 0;
+
+  if ((unsigned long) tunables.observation_max_bytes > bucket_bytes)
+    fit = ((unsigned long) tunables.observation_max_bytes - bucket_bytes)
+      / sizeof (struct cached_observation);
+
+  if (fit < hosts)
+    hosts = fit;
+  return hosts > 0 ? hosts : 1;
+} // capacity
+
+/**
+ * @brief Moves a host that was hit to the front of its segment. A host on
+ *        probation becomes protected, and the least recently used protected
+ *        host goes back on probation if there are too many.
+ */
+static void
+touch (struct cached_observation *entry)
+{
+  unsigned long main_hosts, window;
+
+  if (entry->segment != SEGMENT_PROBATION)
+    {
+      make_newest (entry, entry->segment);
+      return;
+    }
+
+  window = capacity () * tunables.observation_window_pct / 100;
+  main_hosts = capacity () - (window > 0 ? window : 1);
+  make_newest (entry, SEGMENT_PROTECTED);
+  while (segments[SEGMENT_PROTECTED].count
+         > main_hosts * OBSERVATION_PROTECTED_PCT / 100)
+    make_newest (segments[SEGMENT_PROTECTED].oldest, SEGMENT_PROBATION);
+} // touch
+
+/**
+ * @brief Makes room after a new host entered the window. The hosts pushed
+ *        out of the window move on probation while the main segments have
+ *        room. Then each competes with the host on probation used least
+ *        recently, and the one whose requests the frequency sketch counts
+ *        fewer of is evicted. Must be called with the cache locked.
+ */
+static void
+make_room ()
+{
+  struct cached_observation *candidate, *victim;
+  unsigned long window, main_hosts;
+
+  window = capacity () * tunables.observation_window_pct / 100;
+  if (window == 0)
+    window = 1;
+  main_hosts = capacity () - window;
+
+  while (segments[SEGMENT_WINDOW].count > window)
+    {
+      candidate = segments[SEGMENT_WINDOW].oldest;
+      if (segments[SEGMENT_PROBATION].count
+          + segments[SEGMENT_PROTECTED].count < main_hosts)
+        {
+          make_newest (candidate, SEGMENT_PROBATION);
+          continue;
+        }
+
+      victim = segments[SEGMENT_PROBATION].oldest;
+      if (victim == NULL)
+        victim = segments[SEGMENT_PROTECTED].oldest;
+
+      /* A tie keeps the host already in the main segments, so a scan of
+       * hosts seen once cannot push out the ones that come back. */
+      if (victim != NULL
+          && hitters_estimate (candidate->id) > hitters_estimate (victim->id))
+        {
+          remove_entry (victim);
+          make_newest (candidate, SEGMENT_PROBATION);
+          stats.admitted++;
+        }
+      else
+        {
+          /* Without main segments, this is plain LRU. */
+          remove_entry (candidate);
+          if (victim != NULL)
+            stats.rejected++;
+        }
+      stats.evictions++;
+    }
+
+  /* The capacity may have been lowered since the hosts were admitted. */
+  while (segments[SEGMENT_PROBATION].count
+         + segments[SEGMENT_PROTECTED].count > main_hosts)
+    {
+      victim = segments[SEGMENT_PROBATION].oldest;
+      if (victim == NULL)
+        victim = segments[SEGMENT_PROTECTED].oldest;
+      remove_entry (victim);
+      stats.evictions++;
+    }
+} // make_room
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Looks up the fresh observation of a host. A popular host, or a
+ *        heavy hitter, whose observation has less than
+ *        observation_refresh_pct of its TTL left is handed to one caller
+ *        for refreshing, so that the next client
+ *        does not have to wait for the host once it expires.
+ *
+ * @param id           the ID of the host
+ * @param observation  output parameter for a copy of the observation
+ *
+ * @return an observation_status
+ */
+int
+observation_lookup (uint32_t id, struct observation *observation)
+{
+  struct cached_observation *entry;
+  time_t now = time (NULL);
+  int found = OBSERVATION_MISSING;
+
+  pthread_mutex_lock (&cache_lock);
+  entry = find (id);
+  if (entry == NULL)
+    stats.misses++;
+  else if (entry->observation.expires <= now)
+    stats.expired++;
+  else
+    {
+      if (entry->segment == SEGMENT_WINDOW)
+        stats.window_hits++;
+      else if (entry->segment == SEGMENT_PROBATION)
+        stats.probation_hits++;
+      else
+        stats.protected_hits++;
+      touch (entry);
+      *observation = entry->observation;
+      stats.hits++;
+      found = OBSERVATION_FRESH;
+
+      entry->hits_since_record++;
+      if (!entry->refreshing
+          && (entry->observation.expires - now) * 100
+             <= (time_t) tunables.observation_ttl
+                * tunables.observation_refresh_pct
+          && (entry->hits_since_record >= OBSERVATION_HOT_HITS
+              || hitters_is_heavy (id)))
+        {
+          entry->refreshing = 1;
+          stats.refreshes++;
+          found = OBSERVATION_REFRESH;
+        }
+    }
+  pthread_mutex_unlock (&cache_lock);
+
+  return found;
+} // observation_lookup
+
+/**
+ * @brief Hands a host out for refreshing after a client showed a
+ *        fingerprint that is not in its observation, if the observation is
+ *        at least mismatch_recheck_s old and no refresh of it is running.
+ *
+ * @param id  the ID of the host
+ *
+ * @return 1 if the caller should refresh the host, 0 otherwise
+ */
+int
+observation_recheck (uint32_t id)
+{
+  struct cached_observation *entry;
+  int recheck = 0;
+
+  if (tunables.mismatch_recheck_s == 0)
+    return 0;
+
+  pthread_mutex_lock (&cache_lock);
+  entry = find (id);
+  if (entry != NULL && !entry->refreshing
+      && entry->observation.last_seen + tunables.mismatch_recheck_s
+         <= time (NULL))
+    {
+      entry->refreshing = 1;
+      stats.refreshes++;
+      recheck = 1;
+    }
+  pthread_mutex_unlock (&cache_lock);
+
+  return recheck;
+} // observation_recheck
+
+/**
+ * @brief Ends a refresh that did not record an observation.
+ *
+ * @param id  the ID of the host
+ */
+void
+observation_refresh_done (uint32_t id)
+{
+  struct cached_observation *entry;
+
+  pthread_mutex_lock (&cache_lock);
+  entry = find (id);
+  if (entry != NULL)
+    entry->refreshing = 0;
+  pthread_mutex_unlock (&cache_lock);
+} // observation_refresh_done
+
+/**
+ * @brief Records the chain just fetched from a host, in the cache and in
+ *        the history of the host.
+ *
+ * @param id           the ID of the host
+ * @param chain        the ID of the chain the host showed
+ * @param start        when the fetch started
+ * @param end          when the fetch finished
+ * @param observation  output parameter for a copy of the observation
+ */
+void
+observation_record (uint32_t id, uint32_t chain, time_t start, time_t end,
+                    struct observation *observation)
+{
+  history_record (id, chain, start, end);
+  observation_cache_insert (id, chain, start, end, observation);
+} // observation_record
+
+/**
+ * @brief Puts an observation of a host in the cache only, for one already
+ *        in the history of the host.
+ *
+ * @param id           the ID of the host
+ * @param chain        the ID of the chain the host showed
+ * @param start        when the host was first seen with it
+ * @param end          when it was last seen with it
+ * @param observation  output parameter for a copy of the observation
+ */
+void
+observation_cache_insert (uint32_t id, uint32_t chain, time_t start,
+                          time_t end, struct observation *observation)
+{
+  struct cached_observation *entry;
+  size_t bucket;
+
+  pthread_mutex_lock (&cache_lock);
+  entry = find (id);
+  if (entry == NULL)
+    {
+      if (!allocate_buckets ()
+          || (entry = calloc (1, sizeof (*entry))) == NULL)
+        {
+          /* Without memory we can still answer this request. */
+          pthread_mutex_unlock (&cache_lock);
+          memset (observation, 0, sizeof (*observation));
+          observation->chain = chain;
+          observation->first_seen = start;
+          observation->last_seen = end;
+          observation->expires = end;
+          return;
+        }
+
+      entry->id = id;
+      bucket = id & (num_buckets - 1);
+      entry->next_in_bucket = buckets[bucket];
+      buckets[bucket] = entry;
+      stats.hosts++;
+      stats.bytes += sizeof (*entry);
+
+      /* New hosts start in the window. */
+      make_newest (entry, SEGMENT_WINDOW);
+      make_room ();
+    }
+  else
+    touch (entry);
+
+  if (entry->observation.chain != chain)
+    {
+      /* A different chain starts a new run of observations. */
+      entry->observation.chain = chain;
+      entry->observation.first_seen = start;
+    }
+
+  entry->observation.last_seen = end;
+  entry->observation.expires = end + tunables.observation_ttl;
+  entry->observation.version = next_version++;
+  entry->hits_since_record = 0;
+  entry->refreshing = 0;
+
+  *observation = entry->observation;
+  pthread_mutex_unlock (&cache_lock);
+} // observation_cache_insert
+
+/**
+ * @brief Checks whether a certificate of the chain of an observation has a
+ *        fingerprint.
+ *
+ * @return 1 if one does, 0 otherwise
+ */
+int
+observation_contains (struct observation *observation,
+                      const char *fingerprint)
+{
+  const uint32_t *certs;
+  int length, i;
+
+  certs = certpool_chain_certs (observation->chain, &length);
+  for (i = 0; i < length; i++)
+    if (strcasecmp (certpool_fingerprint (certs[i]), fingerprint) == 0)
+      return 1;
+
+  return 0;
+} // observation_contains
+
+/**
+ * @brief Forgets every observation. The counters other than hosts and
+ *        bytes are kept.
+ */
+void
+observation_clear ()
+{
+  struct cached_observation *entry;
+  int segment;
+
+  pthread_mutex_lock (&cache_lock);
+  for (segment = 0; segment < SEGMENTS; segment++)
+    while ((entry = segments[segment].oldest) != NULL)
+      remove_entry (entry);
+
+  /* The buckets are sized again for the caps when next used. */
+  free (buckets);
+  buckets = NULL;
+  stats.bytes -= num_buckets * sizeof (*buckets);
+  num_buckets = 0;
+  pthread_mutex_unlock (&cache_lock);
+} // observation_clear
+
+/**
+ * @brief Copies the counters of the cache.
+ */
+void
+observation_get_stats (struct observation_stats *stats_out)
+{
+  pthread_mutex_lock (&cache_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&cache_lock);
+} // observation_get_stats
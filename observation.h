@@ -0,0 +1,104 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the in-memory observation cache,
+ * which remembers the chain the notary last saw for every host so
+ * that repeated verifications do not have to contact the host again. The
+ * cache is bounded in hosts and bytes and admits hosts by W-TinyLFU, using
+ * the request counts of the heavy-hitter sketch, so that a long tail of
+ * hosts seen once does not flush the hosts asked about again and again.
+ ******************************************************************************/
+#ifndef OBSERVATION_H
+#define OBSERVATION_H
+
+#include "notary.h"
+#include <time.h>
+
+/* A host is looked up at least this often before it counts as popular. */
+#define OBSERVATION_HOT_HITS 2
+
+/* Results of observation_lookup. */
+enum observation_status
+  {
+    OBSERVATION_MISSING = 0,    // no fresh observation is cached
+    OBSERVATION_FRESH = 1,      // a fresh observation was found
+    OBSERVATION_REFRESH = 2     // found, and the caller should refresh it
+  };
+
+/* What the notary saw for a host. */
+struct observation
+{
+  uint32_t chain;               // the chain it showed, interned by certpool
+  time_t first_seen;            // first time this certificate chain was seen
+  time_t last_seen;             // most recent time it was seen
+  time_t expires;               // when the observation must be refreshed
+  unsigned long version;        // changes whenever a new observation arrives
+};
+
+/* Counters kept by the observation cache. */
+struct observation_stats
+{
+  unsigned long hits;
+  unsigned long window_hits;    // of those, hits of hosts in the window
+  unsigned long probation_hits; // hits of hosts on probation
+  unsigned long protected_hits; // hits of protected hosts
+  unsigned long misses;
+  unsigned long expired;
+  unsigned long evictions;
+  unsigned long admitted;       // hosts that displaced one on probation
+  unsigned long rejected;       // hosts evicted on leaving the window
+  unsigned long refreshes;      // hosts handed out for refreshing
+  unsigned long hosts;
+  unsigned long bytes;          // memory held by the hosts and buckets
+};
+
+/* Looks up the observation of a host, given by its hostkey ID, and copies
+ * it into observation if a fresh one is cached. Returns an
+ * observation_status: OBSERVATION_REFRESH means the host is popular and its
+ * observation will expire soon, and the caller should refresh it in the
+ * background. Only one caller at a time is asked to, until the host is
+ * recorded again or observation_refresh_done is called.
+ */
+int observation_lookup (uint32_t id, struct observation *observation);
+
+/* Returns 1 if the caller should refresh a host, given by its ID, in the
+ * background because a client showed a fingerprint not in its observation.
+ * Clients cannot have a host contacted more than once per
+ * mismatch_recheck_s, nor while a refresh of it runs.
+ */
+int observation_recheck (uint32_t id);
+
+/* Lets the next lookup of a host ask for a refresh again after a refresh
+ * that did not record an observation.
+ */
+void observation_refresh_done (uint32_t id);
+
+/* Records the chain just fetched from a host between start and end, given
+ * by its certpool ID, here and in the history of the host. If the host
+ * showed the same chain before, its run of observations is extended. The
+ * stored observation is copied into observation.
+ */
+void observation_record (uint32_t id, uint32_t chain, time_t start,
+                         time_t end, struct observation *observation);
+
+/* Puts an observation of a host between start and end in the cache only,
+ * as observation_record does, for one taken from the history of the host.
+ */
+void observation_cache_insert (uint32_t id, uint32_t chain, time_t start,
+                               time_t end, struct observation *observation);
+
+/* Forgets every observation and frees the buckets, which are sized for
+ * the caps of the time when next used. */
+void observation_clear (void);
+
+/* Returns 1 if a certificate of the chain of the observation has the
+ * fingerprint, 0 otherwise.
+ */
+int observation_contains (struct observation *observation,
+                          const char *fingerprint);
+
+/* Copies the counters of the cache into stats. */
+void observation_get_stats (struct observation_stats *stats);
+
+#endif // OBSERVATION_H
@@ -0,0 +1,215 @@
+/** @file
+
+    @brief  Origin: caps the number of verifications contacting an origin at
+            the same time, and queues the rest.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "origin.h"
+#include "config.h"
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Longest single wait for a slot, so that queued clients that hang up are
+ * noticed. */
+#define ORIGIN_POLL_MS 100
+
+/* An origin with fetches in flight. Entries are freed once no fetch holds
+ * or waits for a slot. */
+struct origin
+{
+  char *name;
+  int active;
+  int waiting;
+  struct origin *next;
+};
+
+static struct origin *buckets[ORIGIN_BUCKETS];
+static struct origin_stats stats;
+static pthread_mutex_t origin_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t slot_freed = PTHREAD_COND_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Returns the bucket of an origin.
+ */
+static struct origin **
+bucket_of (const char *name)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  while (*name)
+    {
+      hash ^= (unsigned char) tolower ((unsigned char) *name++);
+      hash *= 1099511628211ULL;
+    }
+  return &buckets[hash % ORIGIN_BUCKETS];
+} // bucket_of
+
+/**
+ * @brief Finds an origin, adding it if add is set. Called with the lock
+ *        held.
+ *
+ * @return the origin, or NULL if it is not in the table
+ */
+static struct origin *
+find (const char *name, int add)
+{
+  struct origin **bucket = bucket_of (name);
+  struct origin *entry;
+
+  for (entry = *bucket; entry != NULL; entry = entry->next)
+    if (strcasecmp (entry->name, name) == 0)
+      return entry;
+
+  if (!add)
+    return NULL;
+
+  entry = calloc (1, sizeof (*entry));
+  if (entry == NULL || (entry->name = strdup (name)) == NULL)
+    {
+      free (entry);
+      return NULL;
+    }
+  entry->next = *bucket;
+  *bucket = entry;
+  stats.origins++;
+  return entry;
+} // find
+
+/**
+ * @brief Frees an origin nobody holds or waits for. Called with the lock
+ *        held.
+ */
+static void
+drop_if_idle (struct origin *entry)
+{
+  struct origin **link;
+
+  if (entry->active > 0 || entry->waiting > 0)
+    return;
+
+  for (link = bucket_of (entry->name); *link != entry; link = &(*link)->next)
+    ;
+  *link = entry->next;
+  stats.origins--;
+  free (entry->name);
+  free (entry);
+} // drop_if_idle
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Takes a fetch slot of an origin.
+ *
+ * @param origin    the origin to contact
+ * @param deadline  the deadline of the verification
+ *
+ * @return 1 if a slot was taken, 0 if the wait ran out of time, was
+ *         cancelled or the origin could not be added
+ */
+int
+origin_acquire (const char *origin, struct deadline *deadline)
+{
+  struct origin *entry;
+  struct timespec until;
+  long long give_up;
+  long budget, wait;
+  int acquired = 0;
+
+  budget = deadline_budget_ms (deadline, DEADLINE_QUEUE);
+  give_up = deadline_now_ms () + budget;
+
+  pthread_mutex_lock (&origin_lock);
+  entry = find (origin, 1);
+  if (entry == NULL)
+    {
+      pthread_mutex_unlock (&origin_lock);
+      return 0;
+    }
+
+  if (entry->active < tunables.origin_max_inflight)
+    acquired = 1;
+  else
+    {
+      entry->waiting++;
+      while (entry->active >= tunables.origin_max_inflight)
+        {
+          wait = give_up - deadline_now_ms ();
+          if (wait <= 0 || deadline_expired (deadline))
+            break;
+          if (wait > ORIGIN_POLL_MS)
+            wait = ORIGIN_POLL_MS;
+
+          clock_gettime (CLOCK_REALTIME, &until);
+          until.tv_sec += wait / 1000;
+          until.tv_nsec += (wait % 1000) * 1000000;
+          if (until.tv_nsec >= 1000000000)
+            {
+              until.tv_sec++;
+              until.tv_nsec -= 1000000000;
+            }
+          pthread_cond_timedwait (&slot_freed, &origin_lock, &until);
+        }
+      entry->waiting--;
+      acquired = entry->active < tunables.origin_max_inflight;
+      if (acquired)
+        stats.queued++;
+    }
+
+  if (acquired)
+    {
+      entry->active++;
+      stats.acquired++;
+    }
+  else
+    {
+      stats.rejected++;
+      drop_if_idle (entry);
+    }
+  pthread_mutex_unlock (&origin_lock);
+
+  return acquired;
+} // origin_acquire
+
+/**
+ * @brief Gives back a fetch slot of an origin.
+ */
+void
+origin_release (const char *origin)
+{
+  struct origin *entry;
+
+  pthread_mutex_lock (&origin_lock);
+  entry = find (origin, 0);
+  if (entry != NULL && entry->active > 0)
+    {
+      entry->active--;
+      if (entry->waiting > 0)
+        pthread_cond_broadcast (&slot_freed);
+      drop_if_idle (entry);
+    }
+  pthread_mutex_unlock (&origin_lock);
+} // origin_release
+
+/**
+ * @brief Copies the counters of the origin table.
+ */
+void
+origin_get_stats (struct origin_stats *stats_out)
+{
+  pthread_mutex_lock (&origin_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&origin_lock);
+} // origin_get_stats
@@ -0,0 +1,39 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the per-origin concurrency caps.
+ * At most origin_max_inflight verifications contact one origin at a time;
+ * the others queue for a slot until their queueing budget runs out, so one
+ * slow site cannot tie up every thread that fetches certificates.
+ ******************************************************************************/
+#ifndef ORIGIN_H
+#define ORIGIN_H
+
+#include "notary.h"
+#include "deadline.h"
+
+/* Buckets of the table of origins with fetches in flight. */
+#define ORIGIN_BUCKETS 1024
+
+/* Counters of the origin table. */
+struct origin_stats
+{
+  unsigned long acquired;       // fetch slots handed out
+  unsigned long queued;         // of those, slots that had to be waited for
+  unsigned long rejected;       // waits that ran out of time or were cancelled
+  unsigned long origins;        // origins with fetches in flight or queued
+};
+
+/* Takes a fetch slot of an origin, waiting for one while the queueing
+ * budget of the deadline lasts. Returns 1 if a slot was taken, 0 otherwise.
+ */
+int origin_acquire (const char *origin, struct deadline *deadline);
+
+/* Gives back a fetch slot taken with origin_acquire. */
+void origin_release (const char *origin);
+
+/* Copies the counters of the origin table into stats. */
+void origin_get_stats (struct origin_stats *stats);
+
+#endif // ORIGIN_H
@@ -0,0 +1,179 @@
+/** @file
+
+    @brief  Refresh: contacts popular hosts again in the background before
+            their observations expire, within a budget of concurrent
+            refreshes.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "refresh.h"
+#include "config.h"
+#include "deadline.h"
+#include "negcache.h"
+#include "hitters.h"
+#include "observation.h"
+#include "hostkey.h"
+#include "response.h"
+#include <pthread.h>
+
+/* A refresh handed to its thread. */
+struct refresh
+{
+  host host_to_verify;
+  uint32_t id;
+};
+
+static struct refresh_stats stats;
+static pthread_mutex_t refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refresh_idle = PTHREAD_COND_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Frees a refresh.
+ */
+static void
+free_refresh (struct refresh *refresh)
+{
+  free (refresh->host_to_verify.url);
+  free (refresh);
+} // free_refresh
+
+/**
+ * @brief The thread of a refresh: observes the host like a verification
+ *        would, with a deadline of its own and no client to answer.
+ */
+static void *
+refresh_host (void *arg)
+{
+  struct refresh *refresh = arg;
+  struct observation observation;
+  struct deadline deadline;
+  int observed;
+
+  deadline_start (&deadline, tunables.verify_deadline_ms, NULL);
+  observed = observe_host (&refresh->host_to_verify, refresh->id,
+                           &observation, &deadline);
+  if (!observed)
+    observation_refresh_done (refresh->id);
+
+  pthread_mutex_lock (&refresh_lock);
+  if (observed)
+    stats.refreshed++;
+  else
+    stats.failed++;
+  if (--stats.inflight == 0)
+    pthread_cond_broadcast (&refresh_idle);
+  pthread_mutex_unlock (&refresh_lock);
+
+  free_refresh (refresh);
+  return NULL;
+} // refresh_host
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Starts refreshing a host in the background.
+ *
+ * @param host_to_verify  the host to contact
+ * @param id              the ID of the host in the caches
+ *
+ * @return 1 if the refresh was started, 0 otherwise
+ */
+int
+refresh_start (host *host_to_verify, uint32_t id)
+{
+  struct refresh *refresh;
+  pthread_attr_t attributes;
+  pthread_t thread;
+  int started = 0, limit = tunables.refresh_max_inflight;
+
+  /* A host that just failed is left alone until its backoff passes. */
+  if (negcache_check (id, NULL, NULL))
+    {
+      observation_refresh_done (id);
+      return 0;
+    }
+
+  /* A quarter of the budget is kept for heavy hitters. */
+  if (!hitters_is_heavy (id))
+    limit -= limit / 4;
+
+  pthread_mutex_lock (&refresh_lock);
+  if (stats.inflight < (unsigned long) limit)
+    {
+      stats.inflight++;
+      started = 1;
+    }
+  else
+    stats.dropped++;
+  pthread_mutex_unlock (&refresh_lock);
+
+  if (!started)
+    {
+      observation_refresh_done (id);
+      return 0;
+    }
+
+  refresh = calloc (1, sizeof (*refresh));
+  if (refresh != NULL)
+    {
+      refresh->host_to_verify.url = strdup (host_to_verify->url);
+      refresh->host_to_verify.port = host_to_verify->port;
+      refresh->id = id;
+    }
+
+  pthread_attr_init (&attributes);
+  pthread_attr_setdetachstate (&attributes, PTHREAD_CREATE_DETACHED);
+  started = refresh != NULL && refresh->host_to_verify.url != NULL
+    && pthread_create (&thread, &attributes, refresh_host, refresh) == 0;
+  pthread_attr_destroy (&attributes);
+
+  pthread_mutex_lock (&refresh_lock);
+  if (started)
+    stats.started++;
+  else if (--stats.inflight == 0)
+    pthread_cond_broadcast (&refresh_idle);
+  pthread_mutex_unlock (&refresh_lock);
+
+  if (!started)
+    {
+      fprintf (stderr, "Could not start refreshing %s\n", hostkey_name (id));
+      if (refresh != NULL)
+        free_refresh (refresh);
+      observation_refresh_done (id);
+    }
+  return started;
+} // refresh_start
+
+/**
+ * @brief Waits until no refresh is running.
+ */
+void
+refresh_drain ()
+{
+  pthread_mutex_lock (&refresh_lock);
+  while (stats.inflight > 0)
+    pthread_cond_wait (&refresh_idle, &refresh_lock);
+  pthread_mutex_unlock (&refresh_lock);
+} // refresh_drain
+
+/**
+ * @brief Copies the counters of the background refreshes.
+ */
+void
+refresh_get_stats (struct refresh_stats *stats_out)
+{
+  pthread_mutex_lock (&refresh_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&refresh_lock);
+} // refresh_get_stats
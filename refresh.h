@@ -0,0 +1,40 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for background refreshes. Popular
+ * hosts whose observations are about to expire are contacted again on a
+ * thread of their own while their current observation is still served, so
+ * clients do not wait for the host when the observation turns over. Hosts
+ * a client saw another certificate on are contacted again the same way. At
+ * most refresh_max_inflight refreshes run at a time, a quarter of which
+ * only heavy hitters may use; the rest are dropped.
+ ******************************************************************************/
+#ifndef REFRESH_H
+#define REFRESH_H
+
+#include "notary.h"
+
+/* Counters of the background refreshes. */
+struct refresh_stats
+{
+  unsigned long started;
+  unsigned long refreshed;      // refreshes that recorded an observation
+  unsigned long failed;         // refreshes that could not contact the host
+  unsigned long dropped;        // refreshes the budget did not allow
+  unsigned long inflight;       // refreshes running now
+};
+
+/* Starts refreshing the observation of a host, whose ID is given, in the
+ * background. Returns 1 if the refresh was started, 0 if the budget did not
+ * allow it, the host failed recently or no thread could be started.
+ */
+int refresh_start (host *host_to_verify, uint32_t id);
+
+/* Waits until no refresh is running. */
+void refresh_drain (void);
+
+/* Copies the counters of the background refreshes into stats. */
+void refresh_get_stats (struct refresh_stats *stats);
+
+#endif // REFRESH_H
@@ -0,0 +1,1182 @@
+/** @file
+
+    @brief  Resolver: an asynchronous DNS stub resolver shared by all
+            requests, with a cache that honours the TTLs of positive and
+            negative answers and refreshes hot names before they expire.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "resolver.h"
+#include "config.h"
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <openssl/rand.h>
+
+/* DNS message constants, RFC 1035 and RFC 3596. */
+#define DNS_HEADER_LENGTH 12
+#define DNS_MAX_MESSAGE 1232
+#define DNS_TYPE_A 1
+#define DNS_TYPE_SOA 6
+#define DNS_TYPE_AAAA 28
+#define DNS_CLASS_IN 1
+#define DNS_FLAG_RESPONSE 0x8000
+#define DNS_FLAG_TRUNCATED 0x0200
+#define DNS_FLAG_RECURSION 0x0100
+#define DNS_RCODE_MASK 0x000f
+#define DNS_RCODE_NXDOMAIN 3
+
+/* Every name is asked for both address families at once. */
+#define QUERY_A 0
+#define QUERY_AAAA 1
+#define QUERY_TYPES 2
+
+/* Times a query is sent before the resolution gives up. */
+#define MAX_ATTEMPTS 2
+
+/* Longest TTL we honour, in seconds. */
+#define MAX_TTL 86400
+
+/* Most resolutions in flight, the highest dns_max_inflight allows. */
+#define MAX_IN_FLIGHT 1024
+
+/* Random source ports tried before the kernel is left to pick one. */
+#define PORT_ATTEMPTS 16
+
+/* A name in the cache, possibly being resolved. */
+struct dns_entry
+{
+  char name[RESOLVER_NAME_LENGTH];
+  struct resolver_answer answer;        // valid when has_answer is set
+  int has_answer;
+  int negative;                         // the answer is that there is none
+  time_t ttl;                           // TTL the answer was given with
+  unsigned long hits_since_refresh;
+  int waiters;                          // lookups waiting for the resolution
+
+  /* State of a resolution in flight. */
+  int resolving;
+  int pending;                          // bit per query type still awaited
+  uint16_t ids[QUERY_TYPES];
+  int attempts;
+  struct timespec deadline;
+  struct resolver_answer collected;
+  long collected_ttl;
+  long negative_ttl;
+  int nxdomain;
+  int server_failure;
+  int truncated;                        // an answer did not fit a datagram
+  int fd;                               // the socket of the resolution
+
+  struct dns_entry *next_in_bucket;
+  struct dns_entry *newer;              // list ordered by last use
+  struct dns_entry *older;
+  struct dns_entry *next_queued;        // waiting for a query slot
+  struct dns_entry *next_in_flight;
+};
+
+static struct dns_entry **buckets = NULL;
+static size_t num_buckets = 0;
+static struct dns_entry *newest = NULL;
+static struct dns_entry *oldest = NULL;
+static struct dns_entry *queue_head = NULL;
+static struct dns_entry *queue_tail = NULL;
+static struct dns_entry *in_flight = NULL;
+static int num_in_flight = 0;
+static struct resolver_stats stats;
+
+static pthread_mutex_t resolver_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t resolved = PTHREAD_COND_INITIALIZER;
+static pthread_t resolver_thread;
+static int running = 0;
+static struct sockaddr_storage nameserver_address;
+static socklen_t nameserver_length = 0;
+static int wake_pipe[2] = {-1, -1};
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Hashes a name case-insensitively with 64-bit FNV-1a.
+ */
+static uint64_t
+hash_name (const char *name)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  while (*name)
+    {
+      hash ^= (unsigned char) tolower ((unsigned char) *name++);
+      hash *= 1099511628211ULL;
+    }
+  return hash;
+} // hash_name
+
+/**
+ * @brief Finds the entry of a name. Must be called with the resolver locked.
+ */
+static struct dns_entry *
+find (const char *name)
+{
+  struct dns_entry *entry;
+
+  for (entry = buckets[hash_name (name) & (num_buckets - 1)]; entry != NULL;
+       entry = entry->next_in_bucket)
+    if (strcasecmp (entry->name, name) == 0)
+      return entry;
+
+  return NULL;
+} // find
+
+/**
+ * @brief Takes an entry out of the list ordered by last use.
+ */
+static void
+unlink_entry (struct dns_entry *entry)
+{
+  if (entry->newer != NULL)
+    entry->newer->older = entry->older;
+  else
+    newest = entry->older;
+
+  if (entry->older != NULL)
+    entry->older->newer = entry->newer;
+  else
+    oldest = entry->newer;
+
+  entry->newer = entry->older = NULL;
+} // unlink_entry
+
+/**
+ * @brief Puts an entry at the front of the list ordered by last use.
+ */
+static void
+make_newest (struct dns_entry *entry)
+{
+  if (newest == entry)
+    return;
+
+  if (entry->newer != NULL || entry->older != NULL || oldest == entry)
+    unlink_entry (entry);
+
+  entry->older = newest;
+  if (newest != NULL)
+    newest->newer = entry;
+  newest = entry;
+  if (oldest == NULL)
+    oldest = entry;
+} // make_newest
+
+/**
+ * @brief Removes an entry from the cache and frees it. Must be called with
+ *        the resolver locked, for an entry nobody resolves or waits for.
+ */
+static void
+remove_entry (struct dns_entry *entry)
+{
+  struct dns_entry **link;
+
+  link = &buckets[hash_name (entry->name) & (num_buckets - 1)];
+  while (*link != entry)
+    link = &(*link)->next_in_bucket;
+  *link = entry->next_in_bucket;
+
+  unlink_entry (entry);
+  free (entry);
+  stats.entries--;
+} // remove_entry
+
+/**
+ * @brief Adds an entry for a name, evicting the least recently used names
+ *        that are not in use when the cache is full. Must be called with
+ *        the resolver locked.
+ *
+ * @return the new entry, or NULL if there is no memory
+ */
+static struct dns_entry *
+add_entry (const char *name)
+{
+  struct dns_entry *entry, *victim, *next;
+  size_t index;
+
+  for (victim = oldest;
+       victim != NULL
+         && stats.entries >= (unsigned long) tunables.dns_cache_entries;
+       victim = next)
+    {
+      next = victim->newer;
+      if (!victim->resolving && victim->waiters == 0)
+        remove_entry (victim);
+    }
+
+  entry = calloc (1, sizeof (*entry));
+  if (entry == NULL)
+    return NULL;
+
+  strcpy (entry->name, name);
+  entry->fd = -1;
+  index = hash_name (name) & (num_buckets - 1);
+  entry->next_in_bucket = buckets[index];
+  buckets[index] = entry;
+  make_newest (entry);
+  stats.entries++;
+
+  return entry;
+} // add_entry
+
+/**
+ * @brief Queues the resolution of an entry and wakes the resolver thread.
+ *        Must be called with the resolver locked.
+ */
+static void
+start_resolution (struct dns_entry *entry)
+{
+  char wake = 0;
+
+  entry->resolving = 1;
+  entry->next_queued = NULL;
+  if (queue_tail != NULL)
+    queue_tail->next_queued = entry;
+  else
+    queue_head = entry;
+  queue_tail = entry;
+
+  if (write (wake_pipe[1], &wake, 1) < 0 && errno != EAGAIN)
+    fprintf (stderr, "Could not wake the resolver: %s\n", strerror (errno));
+} // start_resolution
+
+/**
+ * @brief Encodes a name in DNS label format.
+ *
+ * @return the length of the encoded name, or 0 if the name is invalid
+ */
+static size_t
+encode_name (const char *name, unsigned char *out, size_t size)
+{
+  size_t length = 0, label;
+  const char *dot;
+
+  while (*name != '\0')
+    {
+      dot = strchr (name, '.');
+      label = dot != NULL ? (size_t) (dot - name) : strlen (name);
+      if (label == 0 || label > 63 || length + label + 2 > size)
+        return 0;
+
+      out[length++] = label;
+      memcpy (out + length, name, label);
+      length += label;
+      name += label;
+      if (*name == '.')
+        name++;
+    }
+
+  if (length + 1 > size)
+    return 0;
+  out[length++] = 0;
+  return length;
+} // encode_name
+
+/**
+ * @brief Skips over a possibly compressed name in a DNS message.
+ *
+ * @return 1 on success, 0 if the message is malformed
+ */
+static int
+skip_name (const unsigned char *message, size_t length, size_t *offset)
+{
+  unsigned char label;
+
+  while (*offset < length)
+    {
+      label = message[*offset];
+      if (label == 0)
+        {
+          (*offset)++;
+          return 1;
+        }
+      if ((label & 0xc0) == 0xc0)
+        {
+          *offset += 2;
+          return *offset <= length;
+        }
+      if ((label & 0xc0) != 0)
+        return 0;
+      *offset += label + 1;
+    }
+  return 0;
+} // skip_name
+
+/**
+ * @brief Reads a 16-bit big endian number.
+ */
+static unsigned
+read_16 (const unsigned char *data)
+{
+  return (data[0] << 8) | data[1];
+} // read_16
+
+/**
+ * @brief Reads a 32-bit big endian number.
+ */
+static unsigned long
+read_32 (const unsigned char *data)
+{
+  return ((unsigned long) data[0] << 24) | (data[1] << 16) | (data[2] << 8)
+    | data[3];
+} // read_32
+
+/**
+ * @brief Opens a socket connected to the nameserver from a random port.
+ *        Each resolution has its own, so that a forged answer has to guess
+ *        the port as well as the ID of a query.
+ *
+ * @return the socket, or -1 on failure
+ */
+static int
+open_query_socket ()
+{
+  struct sockaddr_storage local;
+  struct sockaddr_in *ipv4 = (struct sockaddr_in *) &local;
+  struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *) &local;
+  uint16_t port;
+  int fd, i;
+
+  fd = socket (nameserver_address.ss_family,
+               SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  /* Failing that, connect binds a port the kernel picks at random. */
+  for (i = 0; i < PORT_ATTEMPTS; i++)
+    {
+      if (RAND_bytes ((unsigned char *) &port, sizeof (port)) != 1)
+        break;
+      port = 1024 + port % (65536 - 1024);
+      memset (&local, 0, sizeof (local));
+      local.ss_family = nameserver_address.ss_family;
+      if (local.ss_family == AF_INET6)
+        {
+          ipv6->sin6_addr = in6addr_any;
+          ipv6->sin6_port = htons (port);
+        }
+      else
+        {
+          ipv4->sin_addr.s_addr = htonl (INADDR_ANY);
+          ipv4->sin_port = htons (port);
+        }
+      if (bind (fd, (struct sockaddr *) &local,
+                local.ss_family == AF_INET6 ? sizeof (*ipv6)
+                : sizeof (*ipv4)) == 0)
+        break;
+    }
+
+  /* A connected socket only receives datagrams from the nameserver. */
+  if (connect (fd, (struct sockaddr *) &nameserver_address,
+               nameserver_length) < 0)
+    {
+      close (fd);
+      return -1;
+    }
+  return fd;
+} // open_query_socket
+
+/**
+ * @brief Sends the queries of an entry still awaited, with fresh IDs. Must
+ *        be called with the resolver locked.
+ */
+static void
+send_queries (struct dns_entry *entry)
+{
+  unsigned char query[DNS_HEADER_LENGTH + RESOLVER_NAME_LENGTH + 4];
+  size_t name_length, length;
+  int type;
+
+  name_length = encode_name (entry->name, query + DNS_HEADER_LENGTH,
+                             RESOLVER_NAME_LENGTH);
+
+  for (type = 0; type < QUERY_TYPES; type++)
+    {
+      if (!(entry->pending & (1 << type)))
+        continue;
+
+      /* Unpredictable IDs make forged answers harder to get accepted. */
+      if (RAND_bytes ((unsigned char *) &entry->ids[type], 2) != 1)
+        entry->ids[type] = random ();
+
+      memset (query, 0, DNS_HEADER_LENGTH);
+      query[0] = entry->ids[type] >> 8;
+      query[1] = entry->ids[type] & 0xff;
+      query[2] = DNS_FLAG_RECURSION >> 8;
+      query[5] = 1;                     // one question
+      length = DNS_HEADER_LENGTH + name_length;
+      query[length++] = 0;
+      query[length++] = type == QUERY_A ? DNS_TYPE_A : DNS_TYPE_AAAA;
+      query[length++] = 0;
+      query[length++] = DNS_CLASS_IN;
+
+      if (send (entry->fd, query, length, 0) < 0)
+        fprintf (stderr, "Could not send a DNS query: %s\n",
+                 strerror (errno));
+      stats.queries++;
+    }
+
+  entry->attempts++;
+  clock_gettime (CLOCK_MONOTONIC, &entry->deadline);
+  entry->deadline.tv_sec += tunables.dns_timeout_ms / 1000;
+  entry->deadline.tv_nsec += (tunables.dns_timeout_ms % 1000) * 1000000L;
+  if (entry->deadline.tv_nsec >= 1000000000L)
+    {
+      entry->deadline.tv_sec++;
+      entry->deadline.tv_nsec -= 1000000000L;
+    }
+} // send_queries
+
+/**
+ * @brief Ends the resolution of an entry and wakes the lookups waiting for
+ *        it. Must be called with the resolver locked.
+ */
+static void
+finish_resolution (struct dns_entry *entry)
+{
+  struct dns_entry **link;
+  time_t now = time (NULL);
+  long ttl;
+
+  for (link = &in_flight; *link != entry; link = &(*link)->next_in_flight)
+    ;
+  *link = entry->next_in_flight;
+  num_in_flight--;
+  if (entry->fd >= 0)
+    close (entry->fd);
+  entry->fd = -1;
+
+  if (entry->truncated)
+    {
+      /* A truncated answer may miss addresses, so it is not cached; the
+       * caller resolves the name itself, over TCP if need be. */
+      stats.failures++;
+      ttl = -1;
+    }
+  else if (entry->collected.num_addresses > 0)
+    {
+      ttl = entry->collected_ttl;
+      entry->answer = entry->collected;
+      entry->negative = 0;
+    }
+  else if (!entry->server_failure && entry->pending == 0)
+    {
+      /* Both families were answered without an address. */
+      ttl = entry->negative_ttl;
+      if (ttl < 0 || ttl > tunables.dns_negative_ttl)
+        ttl = tunables.dns_negative_ttl;
+      memset (&entry->answer, 0, sizeof (entry->answer));
+      entry->negative = 1;
+    }
+  else
+    {
+      /* No usable answer; an earlier one stays until it expires. */
+      stats.failures++;
+      ttl = -1;
+    }
+
+  if (ttl >= 0)
+    {
+      if (ttl > MAX_TTL)
+        ttl = MAX_TTL;
+      entry->answer.expires = now + ttl;
+      entry->ttl = ttl;
+      entry->has_answer = 1;
+      entry->hits_since_refresh = 0;
+    }
+
+  entry->resolving = 0;
+  pthread_cond_broadcast (&resolved);
+} // finish_resolution
+
+/**
+ * @brief Starts queued resolutions while there are free query slots. Must
+ *        be called with the resolver locked.
+ */
+static void
+start_queued ()
+{
+  struct dns_entry *entry;
+
+  while (queue_head != NULL && num_in_flight < tunables.dns_max_inflight)
+    {
+      entry = queue_head;
+      queue_head = entry->next_queued;
+      if (queue_head == NULL)
+        queue_tail = NULL;
+
+      memset (&entry->collected, 0, sizeof (entry->collected));
+      entry->collected_ttl = MAX_TTL;
+      entry->negative_ttl = -1;
+      entry->nxdomain = 0;
+      entry->server_failure = 0;
+      entry->truncated = 0;
+      entry->attempts = 0;
+      entry->pending = (1 << QUERY_A) | (1 << QUERY_AAAA);
+      entry->next_in_flight = in_flight;
+      in_flight = entry;
+      num_in_flight++;
+
+      entry->fd = open_query_socket ();
+      if (entry->fd < 0)
+        {
+          fprintf (stderr, "Could not open a DNS socket: %s\n",
+                   strerror (errno));
+          entry->server_failure = 1;
+          finish_resolution (entry);
+          continue;
+        }
+      send_queries (entry);
+    }
+} // start_queued
+
+/**
+ * @brief Parses the answer to a query of an entry and records the
+ *        addresses and TTLs it holds. Must be called with the resolver
+ *        locked.
+ */
+static void
+process_response (struct dns_entry *entry, const unsigned char *message,
+                  size_t length)
+{
+  unsigned char question[RESOLVER_NAME_LENGTH];
+  size_t offset, name_length, record_end;
+  unsigned id, flags, answers, authorities, type, record_class, data_length;
+  unsigned long ttl;
+  int query, i, family;
+
+  if (length < DNS_HEADER_LENGTH)
+    return;
+
+  id = read_16 (message);
+  flags = read_16 (message + 2);
+  if (!(flags & DNS_FLAG_RESPONSE) || read_16 (message + 4) != 1)
+    return;
+
+  for (query = 0; query < QUERY_TYPES; query++)
+    if ((entry->pending & (1 << query)) && entry->ids[query] == id)
+      break;
+  if (query == QUERY_TYPES)
+    return;
+
+  /* The answer must repeat the question we asked. */
+  name_length = encode_name (entry->name, question, sizeof (question));
+  offset = DNS_HEADER_LENGTH + name_length + 4;
+  if (offset > length
+      || strncasecmp ((const char *) message + DNS_HEADER_LENGTH,
+                      (const char *) question, name_length) != 0
+      || read_16 (message + DNS_HEADER_LENGTH + name_length)
+         != (query == QUERY_A ? DNS_TYPE_A : DNS_TYPE_AAAA))
+    return;
+
+  entry->pending &= ~(1 << query);
+  if (flags & DNS_FLAG_TRUNCATED)
+    entry->truncated = 1;
+
+  if ((flags & DNS_RCODE_MASK) == DNS_RCODE_NXDOMAIN)
+    entry->nxdomain = 1;
+  else if ((flags & DNS_RCODE_MASK) != 0)
+    entry->server_failure = 1;
+
+  answers = read_16 (message + 6);
+  authorities = read_16 (message + 8);
+
+  for (i = 0; i < answers + authorities; i++)
+    {
+      if (!skip_name (message, length, &offset) || offset + 10 > length)
+        break;
+
+      type = read_16 (message + offset);
+      record_class = read_16 (message + offset + 2);
+      ttl = read_32 (message + offset + 4);
+      data_length = read_16 (message + offset + 8);
+      offset += 10;
+      record_end = offset + data_length;
+      if (record_end > length)
+        break;
+
+      if (i < answers)
+        {
+          /* CNAMEs on the way limit the TTL as much as the addresses. */
+          if ((long) ttl < entry->collected_ttl)
+            entry->collected_ttl = ttl;
+
+          family = 0;
+          if (type == DNS_TYPE_A && data_length == 4)
+            family = AF_INET;
+          else if (type == DNS_TYPE_AAAA && data_length == 16)
+            family = AF_INET6;
+
+          if (family != 0 && record_class == DNS_CLASS_IN
+              && entry->collected.num_addresses < RESOLVER_MAX_ADDRESSES)
+            {
+              inet_ntop (family, message + offset,
+                         entry->collected.addresses
+                         [entry->collected.num_addresses], INET6_ADDRSTRLEN);
+              entry->collected.families[entry->collected.num_addresses++] =
+                family;
+            }
+        }
+      else if (type == DNS_TYPE_SOA && data_length >= 20)
+        {
+          /* A negative answer lives as long as the SOA record or its
+           * minimum field, whichever is shorter (RFC 2308). */
+          if (read_32 (message + record_end - 4) < ttl)
+            ttl = read_32 (message + record_end - 4);
+          if (entry->negative_ttl < 0 || (long) ttl < entry->negative_ttl)
+            entry->negative_ttl = ttl;
+        }
+
+      offset = record_end;
+    }
+
+  if (entry->pending == 0)
+    finish_resolution (entry);
+} // process_response
+
+/**
+ * @brief Retries or gives up resolutions whose queries were not answered in
+ *        time. Must be called with the resolver locked.
+ *
+ * @return milliseconds until the next deadline, or -1 if none is pending
+ */
+static int
+handle_timeouts ()
+{
+  struct dns_entry *entry, *next;
+  struct timespec now;
+  long remaining, wait = -1;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  for (entry = in_flight; entry != NULL; entry = next)
+    {
+      next = entry->next_in_flight;
+      remaining = (entry->deadline.tv_sec - now.tv_sec) * 1000
+        + (entry->deadline.tv_nsec - now.tv_nsec) / 1000000;
+
+      if (remaining <= 0)
+        {
+          stats.timeouts++;
+          if (entry->collected.num_addresses > 0
+              || entry->attempts >= MAX_ATTEMPTS)
+            {
+              /* Settle for one family rather than wait for the other. */
+              finish_resolution (entry);
+              continue;
+            }
+          send_queries (entry);
+          remaining = tunables.dns_timeout_ms;
+        }
+
+      if (wait < 0 || remaining < wait)
+        wait = remaining;
+    }
+
+  return wait;
+} // handle_timeouts
+
+/**
+ * @brief The resolver thread: sends queued queries, reads answers and
+ *        handles timeouts.
+ */
+static void *
+resolver_loop (void *unused)
+{
+  static struct pollfd fds[1 + MAX_IN_FLIGHT];
+  static struct dns_entry *polled[1 + MAX_IN_FLIGHT];
+  unsigned char message[DNS_MAX_MESSAGE];
+  struct dns_entry *entry;
+  ssize_t length;
+  char drain[64];
+  int wait, count, i;
+
+  fds[0].fd = wake_pipe[0];
+  fds[0].events = POLLIN;
+
+  pthread_mutex_lock (&resolver_lock);
+  while (running)
+    {
+      start_queued ();
+      wait = handle_timeouts ();
+
+      /* Only this thread ends resolutions, so the entries polled stay in
+       * flight until it looks at them. */
+      count = 1;
+      for (entry = in_flight; entry != NULL && count <= MAX_IN_FLIGHT;
+           entry = entry->next_in_flight)
+        {
+          fds[count].fd = entry->fd;
+          fds[count].events = POLLIN;
+          polled[count++] = entry;
+        }
+      pthread_mutex_unlock (&resolver_lock);
+
+      poll (fds, count, wait);
+
+      pthread_mutex_lock (&resolver_lock);
+      if (fds[0].revents & POLLIN)
+        while (read (wake_pipe[0], drain, sizeof (drain)) > 0)
+          ;
+      for (i = 1; i < count; i++)
+        {
+          if (!(fds[i].revents & POLLIN))
+            continue;
+          entry = polled[i];
+          while (entry->fd >= 0
+                 && (length = recv (entry->fd, message, sizeof (message),
+                                    0)) > 0)
+            process_response (entry, message, length);
+        }
+    }
+  pthread_mutex_unlock (&resolver_lock);
+
+  return NULL;
+} // resolver_loop
+
+/**
+ * @brief Parses a nameserver given as address, address:port or
+ *        [address]:port.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+static int
+parse_nameserver (const char *nameserver, struct sockaddr_storage *address,
+                  socklen_t *address_length)
+{
+  struct sockaddr_in *ipv4 = (struct sockaddr_in *) address;
+  struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *) address;
+  char host[INET6_ADDRSTRLEN];
+  const char *port_text = NULL, *close;
+  long port = 53;
+
+  if (nameserver[0] == '[')
+    {
+      close = strchr (nameserver, ']');
+      if (close == NULL || close - nameserver - 1 >= (long) sizeof (host))
+        return 0;
+      snprintf (host, sizeof (host), "%.*s", (int) (close - nameserver - 1),
+                nameserver + 1);
+      if (close[1] == ':')
+        port_text = close + 2;
+      else if (close[1] != '\0')
+        return 0;
+    }
+  else
+    {
+      /* A single colon separates the port from an IPv4 address. */
+      close = strchr (nameserver, ':');
+      if (close != NULL && strchr (close + 1, ':') == NULL)
+        {
+          if (close - nameserver >= (long) sizeof (host))
+            return 0;
+          snprintf (host, sizeof (host), "%.*s", (int) (close - nameserver),
+                    nameserver);
+          port_text = close + 1;
+        }
+      else if (snprintf (host, sizeof (host), "%s", nameserver)
+               >= (int) sizeof (host))
+        return 0;
+    }
+
+  if (port_text != NULL)
+    {
+      port = atol (port_text);
+      if (port <= 0 || port > 65535)
+        return 0;
+    }
+
+  memset (address, 0, sizeof (*address));
+  if (inet_pton (AF_INET, host, &ipv4->sin_addr) == 1)
+    {
+      ipv4->sin_family = AF_INET;
+      ipv4->sin_port = htons (port);
+      *address_length = sizeof (*ipv4);
+      return 1;
+    }
+  if (inet_pton (AF_INET6, host, &ipv6->sin6_addr) == 1)
+    {
+      ipv6->sin6_family = AF_INET6;
+      ipv6->sin6_port = htons (port);
+      *address_length = sizeof (*ipv6);
+      return 1;
+    }
+  return 0;
+} // parse_nameserver
+
+/**
+ * @brief Reads the first nameserver from /etc/resolv.conf.
+ *
+ * @return 1 on success, 0 if none is configured
+ */
+static int
+system_nameserver (char *nameserver, size_t size)
+{
+  FILE *fp = fopen ("/etc/resolv.conf", "r");
+  char line[256], address[INET6_ADDRSTRLEN];
+  int found = 0;
+
+  if (fp == NULL)
+    return 0;
+
+  while (!found && fgets (line, sizeof (line), fp) != NULL)
+    if (sscanf (line, " nameserver %45s", address) == 1)
+      found = snprintf (nameserver, size, strchr (address, ':') != NULL
+                        ? "[%s]" : "%s", address) < (int) size;
+
+  fclose (fp);
+  return found;
+} // system_nameserver
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Starts the resolver thread.
+ *
+ * @param nameserver  the nameserver to ask, or NULL for the system's
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+resolver_init (const char *nameserver)
+{
+  char system_server[INET6_ADDRSTRLEN + 2];
+  size_t wanted = 1;
+  int probe;
+
+  if (running)
+    return 1;
+
+  if (nameserver == NULL)
+    {
+      if (!system_nameserver (system_server, sizeof (system_server)))
+        {
+          fprintf (stderr, "No nameserver found in /etc/resolv.conf\n");
+          return 0;
+        }
+      nameserver = system_server;
+    }
+
+  if (!parse_nameserver (nameserver, &nameserver_address, &nameserver_length))
+    {
+      fprintf (stderr, "Invalid nameserver %s\n", nameserver);
+      return 0;
+    }
+
+  /* Check that the nameserver can be reached before relying on it. */
+  probe = open_query_socket ();
+  if (probe < 0 || pipe2 (wake_pipe, O_NONBLOCK) < 0)
+    {
+      fprintf (stderr, "Could not reach nameserver %s: %s\n", nameserver,
+               strerror (errno));
+      if (probe >= 0)
+        close (probe);
+      return 0;
+    }
+  close (probe);
+
+  while (wanted < (size_t) tunables.dns_cache_entries)
+    wanted <<= 1;
+  buckets = calloc (wanted, sizeof (struct dns_entry *));
+  if (buckets == NULL)
+    {
+      resolver_shutdown ();
+      return 0;
+    }
+  num_buckets = wanted;
+
+  running = 1;
+  if (pthread_create (&resolver_thread, NULL, resolver_loop, NULL) != 0)
+    {
+      running = 0;
+      resolver_shutdown ();
+      return 0;
+    }
+
+  return 1;
+} // resolver_init
+
+/**
+ * @brief Stops the resolver thread and empties the cache.
+ */
+void
+resolver_shutdown ()
+{
+  char wake = 0;
+  int was_running;
+  size_t i;
+  struct dns_entry *entry;
+
+  pthread_mutex_lock (&resolver_lock);
+  was_running = running;
+  running = 0;
+  pthread_cond_broadcast (&resolved);
+  pthread_mutex_unlock (&resolver_lock);
+
+  if (was_running)
+    {
+      if (write (wake_pipe[1], &wake, 1) < 0)
+        fprintf (stderr, "Could not wake the resolver\n");
+      pthread_join (resolver_thread, NULL);
+    }
+
+  for (entry = in_flight; entry != NULL; entry = entry->next_in_flight)
+    if (entry->fd >= 0)
+      close (entry->fd);
+
+  for (i = 0; i < num_buckets; i++)
+    while ((entry = buckets[i]) != NULL)
+      {
+        buckets[i] = entry->next_in_bucket;
+        free (entry);
+      }
+  free (buckets);
+  buckets = NULL;
+  num_buckets = 0;
+  newest = oldest = NULL;
+  queue_head = queue_tail = NULL;
+  in_flight = NULL;
+  num_in_flight = 0;
+  stats.entries = 0;
+
+  if (wake_pipe[0] >= 0)
+    {
+      close (wake_pipe[0]);
+      close (wake_pipe[1]);
+    }
+  wake_pipe[0] = wake_pipe[1] = -1;
+} // resolver_shutdown
+
+/**
+ * @brief Returns whether the resolver is running.
+ */
+int
+resolver_enabled ()
+{
+  return running;
+} // resolver_enabled
+
+/**
+ * @brief Resolves a name. A cached answer is returned at once; a hot name
+ *        about to expire is refreshed in the background. Lookups of a name
+ *        already being resolved wait for that resolution.
+ *
+ * @param name        the name to resolve
+ * @param answer      output parameter for the addresses
+ * @param timeout_ms  longest wait for a resolution, 0 to wait as long as
+ *                    the resolver thread tries
+ *
+ * @return a resolver_status
+ */
+int
+resolver_lookup (const char *name, struct resolver_answer *answer,
+                 long timeout_ms)
+{
+  struct dns_entry *entry;
+  struct timespec deadline;
+  time_t now = time (NULL);
+  int status = RESOLVER_FAILED;
+  unsigned char encoded[RESOLVER_NAME_LENGTH];
+
+  if (strlen (name) >= RESOLVER_NAME_LENGTH
+      || encode_name (name, encoded, sizeof (encoded)) == 0)
+    return RESOLVER_FAILED;
+
+  pthread_mutex_lock (&resolver_lock);
+  if (!running)
+    {
+      pthread_mutex_unlock (&resolver_lock);
+      return RESOLVER_FAILED;
+    }
+
+  entry = find (name);
+  if (entry != NULL && entry->has_answer && entry->answer.expires > now)
+    {
+      make_newest (entry);
+      stats.hits++;
+      if (entry->negative)
+        stats.negative_hits++;
+
+      /* Refresh a hot name while its answer can still be served. */
+      entry->hits_since_refresh++;
+      if (!entry->resolving && !entry->negative
+          && entry->hits_since_refresh >= RESOLVER_HOT_HITS
+          && (entry->answer.expires - now) * 100
+             <= (time_t) entry->ttl * tunables.dns_prefetch_pct)
+        {
+          stats.prefetches++;
+          start_resolution (entry);
+        }
+
+      *answer = entry->answer;
+      status = entry->negative ? RESOLVER_NOT_FOUND : RESOLVER_OK;
+      pthread_mutex_unlock (&resolver_lock);
+      return status;
+    }
+
+  if (entry == NULL)
+    entry = add_entry (name);
+  if (entry == NULL)
+    {
+      pthread_mutex_unlock (&resolver_lock);
+      return RESOLVER_FAILED;
+    }
+
+  if (entry->resolving)
+    stats.coalesced++;
+  else
+    {
+      stats.misses++;
+      start_resolution (entry);
+    }
+
+  /* Wait at most as long as the resolver thread would try. A caller that
+   * gives up leaves the answer to be cached for the next lookup. */
+  clock_gettime (CLOCK_REALTIME, &deadline);
+  if (timeout_ms > 0)
+    {
+      deadline.tv_sec += timeout_ms / 1000;
+      deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+      if (deadline.tv_nsec >= 1000000000)
+        {
+          deadline.tv_sec++;
+          deadline.tv_nsec -= 1000000000;
+        }
+    }
+  else
+    deadline.tv_sec +=
+      (MAX_ATTEMPTS + 1) * tunables.dns_timeout_ms / 1000 + 1;
+
+  entry->waiters++;
+  while (entry->resolving && running)
+    if (pthread_cond_timedwait (&resolved, &resolver_lock, &deadline)
+        == ETIMEDOUT)
+      break;
+  entry->waiters--;
+
+  if (entry->has_answer && entry->answer.expires > time (NULL))
+    {
+      *answer = entry->answer;
+      status = entry->negative ? RESOLVER_NOT_FOUND : RESOLVER_OK;
+    }
+  pthread_mutex_unlock (&resolver_lock);
+
+  return status;
+} // resolver_lookup
+
+/**
+ * @brief Resolves the host of a url.
+ *
+ * @param url        the url curl will fetch
+ * @param port       the port curl will connect to, or 0 for the url's; set
+ *                   to the port used
+ * @param name       output buffer for the host name
+ * @param name_size  size of the output buffer
+ * @param answer     output parameter for the addresses
+ * @param timeout_ms  longest wait for a resolution, 0 for no limit
+ *
+ * @return a resolver_status
+ */
+int
+resolver_resolve_url (const char *url, long *port, char *name,
+                      size_t name_size, struct resolver_answer *answer,
+                      long timeout_ms)
+{
+  struct in6_addr unused;
+  CURLU *parsed;
+  char *host = NULL, *port_text = NULL;
+  int status = RESOLVER_FAILED;
+
+  name[0] = '\0';
+  if (!running)
+    return RESOLVER_FAILED;
+
+  parsed = curl_url ();
+  if (parsed != NULL
+      && !curl_url_set (parsed, CURLUPART_URL, url, CURLU_DEFAULT_SCHEME)
+      && !curl_url_get (parsed, CURLUPART_HOST, &host, 0)
+      && !curl_url_get (parsed, CURLUPART_PORT, &port_text,
+                        CURLU_DEFAULT_PORT)
+      && snprintf (name, name_size, "%s", host) < (int) name_size)
+    {
+      if (*port <= 0)
+        *port = atol (port_text);
+
+      /* Addresses need no resolving. */
+      if (name[0] != '[' && inet_pton (AF_INET, name, &unused) != 1)
+        status = resolver_lookup (name, answer, timeout_ms);
+    }
+
+  curl_free (host);
+  curl_free (port_text);
+  curl_url_cleanup (parsed);
+  return status;
+} // resolver_resolve_url
+
+/**
+ * @brief Formats addresses as a CURLOPT_RESOLVE list.
+ *
+ * @param name    the host name curl will connect to
+ * @param port    the port curl will connect to
+ * @param answer  the addresses to use, or NULL to have curl forget earlier
+ *                ones and resolve the name itself
+ *
+ * @return the newly allocated list, or NULL on failure
+ */
+struct curl_slist *
+resolver_curl_entry (const char *name, long port,
+                     const struct resolver_answer *answer)
+{
+  struct curl_slist *list = NULL;
+  char *addresses = strdup (""), *next, *entry = NULL;
+  int i;
+
+  for (i = 0; answer != NULL && addresses != NULL
+         && i < answer->num_addresses; i++)
+    {
+      if (asprintf (&next, "%s%s%s%s%s", addresses, i == 0 ? "" : ",",
+                    answer->families[i] == AF_INET6 ? "[" : "",
+                    answer->addresses[i],
+                    answer->families[i] == AF_INET6 ? "]" : "") < 0)
+        next = NULL;
+      free (addresses);
+      addresses = next;
+    }
+
+  if (addresses != NULL
+      && (answer != NULL
+          ? asprintf (&entry, "%s:%ld:%s", name, port, addresses)
+          : asprintf (&entry, "-%s:%ld", name, port)) >= 0)
+    {
+      list = curl_slist_append (NULL, entry);
+      free (entry);
+    }
+
+  free (addresses);
+  return list;
+} // resolver_curl_entry
+
+/**
+ * @brief Copies the counters of the resolver.
+ */
+void
+resolver_get_stats (struct resolver_stats *stats_out)
+{
+  pthread_mutex_lock (&resolver_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&resolver_lock);
+} // resolver_get_stats
@@ -0,0 +1,99 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the notary's DNS resolver. One
+ * resolver thread talks to a nameserver for all requests, caches positive
+ * and negative answers for their TTLs and refreshes hot names before they
+ * expire. Each resolution sends its queries from a socket of its own bound
+ * to a random port, with random IDs, so that forged answers must guess
+ * both. A truncated answer is not cached and leaves the name to curl.
+ * Answers are handed to curl so it does not resolve names itself, which
+ * means /etc/hosts is not consulted for the names the resolver answers.
+ ******************************************************************************/
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "notary.h"
+#include <time.h>
+#include <arpa/inet.h>
+
+/* Most addresses kept for a name. */
+#define RESOLVER_MAX_ADDRESSES 8
+
+/* Longest name that can be resolved, including the trailing null. */
+#define RESOLVER_NAME_LENGTH 256
+
+/* A lookup hits at least this often before its name counts as hot. */
+#define RESOLVER_HOT_HITS 2
+
+/* Outcomes of a lookup. */
+enum resolver_status
+  {
+    RESOLVER_OK = 0,            // addresses were found
+    RESOLVER_NOT_FOUND = 1,     // the name does not exist or has no address
+    RESOLVER_FAILED = 2         // no answer; the caller should resolve itself
+  };
+
+/* The addresses of a name, as text. */
+struct resolver_answer
+{
+  int num_addresses;
+  char addresses[RESOLVER_MAX_ADDRESSES][INET6_ADDRSTRLEN];
+  int families[RESOLVER_MAX_ADDRESSES]; // AF_INET or AF_INET6
+  time_t expires;
+};
+
+/* Counters kept by the resolver. */
+struct resolver_stats
+{
+  unsigned long hits;           // answered from the cache
+  unsigned long negative_hits;  // of those, answers that a name is missing
+  unsigned long misses;         // lookups that started a resolution
+  unsigned long coalesced;      // lookups that waited for one in flight
+  unsigned long prefetches;     // hot names refreshed before they expired
+  unsigned long queries;        // DNS queries sent
+  unsigned long timeouts;       // DNS queries that were not answered
+  unsigned long failures;       // resolutions that produced no answer
+  unsigned long entries;        // names in the cache
+};
+
+/* Starts the resolver. nameserver is an address with an optional port, as
+ * in 192.0.2.1, 192.0.2.1:5353 or [2001:db8::1]:53; NULL uses the first
+ * nameserver of /etc/resolv.conf. Returns 1 on success, 0 otherwise.
+ */
+int resolver_init (const char *nameserver);
+
+/* Stops the resolver and empties its cache. No lookup may be running. */
+void resolver_shutdown (void);
+
+/* Returns whether the resolver is running. */
+int resolver_enabled (void);
+
+/* Resolves a name, from the cache when possible, waiting at most timeout_ms
+ * for a resolution (0 for as long as the resolver tries). Returns a
+ * resolver_status and fills answer when it is RESOLVER_OK.
+ */
+int resolver_lookup (const char *name, struct resolver_answer *answer,
+                     long timeout_ms);
+
+/* Resolves the host of a url into name, waiting at most timeout_ms as in
+ * resolver_lookup. A port of 0 is replaced by the url's port. Returns a
+ * resolver_status and fills answer when it is RESOLVER_OK; literal
+ * addresses give RESOLVER_FAILED.
+ */
+int resolver_resolve_url (const char *url, long *port, char *name,
+                          size_t name_size, struct resolver_answer *answer,
+                          long timeout_ms);
+
+/* Formats addresses as the CURLOPT_RESOLVE list for name and port. With a
+ * NULL answer, the list makes curl forget earlier addresses and resolve the
+ * name itself. The caller frees the list.
+ */
+struct curl_slist *resolver_curl_entry (const char *name, long port,
+                                        const struct resolver_answer *answer);
+
+/* Copies the counters of the resolver into stats. */
+void resolver_get_stats (struct resolver_stats *stats);
+
+#endif // RESOLVER_H
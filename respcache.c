@@ -0,0 +1,299 @@
+/** @file
+
+    @brief  Respcache: a cache of rendered, signed responses, one per host,
+            valid for one observation version and one time bucket.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "respcache.h"
+#include "config.h"
+#include "hitters.h"
+#include <pthread.h>
+
+static struct cached_response **buckets = NULL;
+static size_t num_buckets = 0;
+static struct cached_response *newest = NULL;
+static struct cached_response *oldest = NULL;
+static struct response_cache_stats stats;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Frees an entry once neither the cache nor a connection holds it.
+ *        The MHD_Response keeps the body alive while MHD is still sending it.
+ */
+static void
+free_entry (struct cached_response *entry)
+{
+  MHD_destroy_response (entry->response);
+  free (entry);
+} // free_entry
+
+/**
+ * @brief Finds the cached response of a host. Host IDs are handed out in
+ *        sequence, so they serve as their own hash. Must be called with the
+ *        cache locked.
+ */
+static struct cached_response *
+find (uint32_t id)
+{
+  struct cached_response *entry;
+
+  if (buckets == NULL)
+    return NULL;
+
+  for (entry = buckets[id & (num_buckets - 1)]; entry != NULL;
+       entry = entry->next_in_bucket)
+    if (entry->id == id)
+      return entry;
+
+  return NULL;
+} // find
+
+/**
+ * @brief Takes an entry out of the list ordered by last use.
+ */
+static void
+unlink_entry (struct cached_response *entry)
+{
+  if (entry->newer != NULL)
+    entry->newer->older = entry->older;
+  else
+    newest = entry->older;
+
+  if (entry->older != NULL)
+    entry->older->newer = entry->newer;
+  else
+    oldest = entry->newer;
+
+  entry->newer = entry->older = NULL;
+} // unlink_entry
+
+/**
+ * @brief Puts an entry at the front of the list ordered by last use.
+ */
+static void
+make_newest (struct cached_response *entry)
+{
+  if (newest == entry)
+    return;
+
+  if (entry->newer != NULL || entry->older != NULL || oldest == entry)
+    unlink_entry (entry);
+
+  entry->older = newest;
+  if (newest != NULL)
+    newest->newer = entry;
+  newest = entry;
+  if (oldest == NULL)
+    oldest = entry;
+} // make_newest
+
+/**
+ * @brief Takes an entry out of the cache and drops the cache's reference.
+ *        Must be called with the cache locked.
+ */
+static void
+remove_entry (struct cached_response *entry)
+{
+  struct cached_response **link;
+
+  link = &buckets[entry->id & (num_buckets - 1)];
+  while (*link != entry)
+    link = &(*link)->next_in_bucket;
+  *link = entry->next_in_bucket;
+
+  unlink_entry (entry);
+  entry->cached = 0;
+  stats.entries--;
+
+  if (--entry->references == 0)
+    free_entry (entry);
+} // remove_entry
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Returns the time bucket a response signed at a given time belongs
+ *        to. Responses are signed again at least once per bucket.
+ */
+time_t
+response_cache_bucket (time_t now)
+{
+  return now / tunables.response_bucket_s;
+} // response_cache_bucket
+
+/**
+ * @brief Looks up the response for a host, observation version and time
+ *        bucket.
+ *
+ * @return a new reference to the response, or NULL if none is cached
+ */
+struct cached_response *
+response_cache_lookup (uint32_t id, unsigned long version, time_t bucket)
+{
+  struct cached_response *entry;
+
+  pthread_mutex_lock (&cache_lock);
+  entry = find (id);
+  if (entry == NULL)
+    stats.misses++;
+  else if (entry->version != version || entry->bucket != bucket)
+    {
+      /* A new observation arrived or the bucket is over. */
+      remove_entry (entry);
+      stats.stale++;
+      entry = NULL;
+    }
+  else
+    {
+      make_newest (entry);
+      entry->references++;
+      stats.hits++;
+    }
+  pthread_mutex_unlock (&cache_lock);
+
+  return entry;
+} // response_cache_lookup
+
+/**
+ * @brief Caches a signed body, replacing any older response for the host.
+ *
+ * @param id       the ID of the host
+ * @param version  the observation version the body was built from
+ * @param bucket   the time bucket the body was signed in
+ * @param body     the signed response; the cache takes ownership of it
+ *
+ * @return a new reference to the entry, or NULL on failure
+ */
+struct cached_response *
+response_cache_insert (uint32_t id, unsigned long version, time_t bucket,
+                       char *body)
+{
+  struct cached_response *entry, *old;
+  size_t index, wanted = 1;
+  int spared = 0;
+
+  entry = calloc (1, sizeof (*entry));
+  if (entry == NULL)
+    {
+      free (body);
+      return NULL;
+    }
+
+  entry->body = body;
+  entry->body_length = strlen (body);
+  entry->response = MHD_create_response_from_buffer (entry->body_length, body,
+                                                     MHD_RESPMEM_MUST_FREE);
+  if (entry->response == NULL)
+    {
+      free (body);
+      free (entry);
+      return NULL;
+    }
+
+  entry->id = id;
+  entry->version = version;
+  entry->bucket = bucket;
+  entry->references = 1;
+
+  pthread_mutex_lock (&cache_lock);
+  if (buckets == NULL)
+    {
+      while (wanted < (size_t) tunables.response_cache_entries)
+        wanted <<= 1;
+      buckets = calloc (wanted, sizeof (struct cached_response *));
+      if (buckets != NULL)
+        num_buckets = wanted;
+    }
+
+  if (buckets != NULL)
+    {
+      /* Several clients may have rendered the same response at once; the
+       * last one to arrive replaces the others. */
+      old = find (id);
+      if (old != NULL)
+        remove_entry (old);
+
+      index = id & (num_buckets - 1);
+      entry->next_in_bucket = buckets[index];
+      buckets[index] = entry;
+      entry->cached = 1;
+      entry->references++;
+      make_newest (entry);
+      stats.entries++;
+
+      /* Heavy hitters get a second chance before they are evicted. */
+      while (stats.entries > (unsigned long) tunables.response_cache_entries)
+        {
+          if (oldest != entry && spared < HITTERS_TOP
+              && hitters_is_heavy (oldest->id))
+            {
+              make_newest (oldest);
+              spared++;
+              stats.spared++;
+              continue;
+            }
+          remove_entry (oldest);
+          stats.evictions++;
+        }
+    }
+  pthread_mutex_unlock (&cache_lock);
+
+  return entry;
+} // response_cache_insert
+
+/**
+ * @brief Drops the cached response of a host, if there is one.
+ */
+void
+response_cache_invalidate (uint32_t id)
+{
+  struct cached_response *entry;
+
+  pthread_mutex_lock (&cache_lock);
+  entry = find (id);
+  if (entry != NULL)
+    remove_entry (entry);
+  pthread_mutex_unlock (&cache_lock);
+} // response_cache_invalidate
+
+/**
+ * @brief Releases a reference returned by lookup or insert.
+ */
+void
+response_cache_release (struct cached_response *entry)
+{
+  int references;
+
+  if (entry == NULL)
+    return;
+
+  pthread_mutex_lock (&cache_lock);
+  references = --entry->references;
+  pthread_mutex_unlock (&cache_lock);
+
+  if (references == 0)
+    free_entry (entry);
+} // response_cache_release
+
+/**
+ * @brief Copies the counters of the cache.
+ */
+void
+response_cache_get_stats (struct response_cache_stats *stats_out)
+{
+  pthread_mutex_lock (&cache_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&cache_lock);
+} // response_cache_get_stats
@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the cache of signed responses.
+ * A response is rendered and signed once per host, observation version and
+ * time bucket, and the same MHD_Response is then queued for every client.
+ ******************************************************************************/
+#ifndef RESPCACHE_H
+#define RESPCACHE_H
+
+#include "notary.h"
+#include "observation.h"
+#include <time.h>
+
+/* A rendered, signed response. Holders of a reference may read the body and
+ * queue the response until they release it. */
+struct cached_response
+{
+  uint32_t id;                  // the host, interned by hostkey
+  unsigned long version;        // observation version the body was built from
+  time_t bucket;                // time bucket the body was signed in
+  const char *body;
+  size_t body_length;
+  struct MHD_Response *response;
+  int references;
+  int cached;                   // whether the cache still holds the entry
+  struct cached_response *next_in_bucket;
+  struct cached_response *newer;
+  struct cached_response *older;
+};
+
+/* Counters kept by the response cache. */
+struct response_cache_stats
+{
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long stale;          // found, but for an older version or bucket
+  unsigned long evictions;
+  unsigned long spared;         // heavy hitters moved to the front instead
+  unsigned long entries;
+};
+
+/* Returns the time bucket a response signed now belongs to. */
+time_t response_cache_bucket (time_t now);
+
+/* Looks up the response for a host, given by its hostkey ID, observation
+ * version and time bucket. Returns a new reference to it, or NULL if none
+ * is cached.
+ */
+struct cached_response *response_cache_lookup (uint32_t id,
+                                               unsigned long version,
+                                               time_t bucket);
+
+/* Caches a signed body, replacing any older response for the host. The cache
+ * takes ownership of body. Returns a new reference to the entry, or NULL on
+ * failure, in which case body has been freed.
+ */
+struct cached_response *response_cache_insert (uint32_t id,
+                                               unsigned long version,
+                                               time_t bucket, char *body);
+
+/* Drops the cached response of a host, if there is one. */
+void response_cache_invalidate (uint32_t id);
+
+/* Releases a reference returned by lookup or insert. */
+void response_cache_release (struct cached_response *entry);
+
+/* Copies the counters of the cache into stats. */
+void response_cache_get_stats (struct response_cache_stats *stats);
+
+#endif // RESPCACHE_H
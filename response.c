@@ -12,13 +12,56 @@
 
 #include "response.h"
 #include "certificate.h"
-#include <openssl/rsa.h>
+#include "signer.h"
+#include "observation.h"
+#include "respcache.h"
+#include "deadline.h"
+#include "origin.h"
+#include "negcache.h"
+#include "refresh.h"
+#include "hitters.h"
+#include "hostkey.h"
+#include "certpool.h"
+#include "history.h"
+#include "snapshot.h"
+#include "shmcache.h"
+#include "config.h"
+#include <openssl/evp.h>
 #include <openssl/sha.h>
 #include <openssl/pem.h>
 
-//WE ARE NOT SURE ABOUT THIS
-#define RESPONSE_LEN 201
-#define MAX_NO_OF_CERTS 7
+/* Sent when no signed verification result can be produced. */
+const char unavailable_page[] =
+  "The notary could not produce a verification result.\n";
+
+/* Sent when the host to verify is not a valid host name or address. */
+const char invalid_host_page[] =
+  "The host to verify is not a valid host name or address.\n";
+
+/* Sent when too many requests are in flight. */
+const char busy_page[] =
+  "The server is too busy to handle the verification request.\n";
+
+/* Sent for a request that is neither a GET nor a POST. */
+const char unsupported_method_page[] =
+  "The server received a request with an unsupported method.\n";
+
+/* The fixed answers and their status codes. */
+static const struct
+{
+  const char *text;
+  int status_code;
+} static_pages[STATIC_PAGES] = {
+  [STATIC_BUSY] = {busy_page, MHD_HTTP_SERVICE_UNAVAILABLE},
+  [STATIC_UNSUPPORTED_METHOD] = {unsupported_method_page,
+                                 MHD_HTTP_BAD_REQUEST},
+  [STATIC_UNAVAILABLE] = {unavailable_page, MHD_HTTP_SERVICE_UNAVAILABLE},
+  [STATIC_INVALID_HOST] = {invalid_host_page, MHD_HTTP_BAD_REQUEST}
+};
+
+/* The responses of the fixed answers, built once by response_init_static:
+ * one to keep the connection open and one to close it. */
+static struct MHD_Response *static_responses[STATIC_PAGES][2];
 
 //+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 // Helpers
@@ -41,125 +84,705 @@ set_answer_string(struct connection_info_struct* connection_info, char* answer_s
   @brief Generates a signature of a fingerprint list.
  
   @param fingerprint_list  list of fingerprints
+  @param list_length       number of bytes in the fingerprint list
   @param signature         string to hold the digital signature of fingerprints
-  @param signature_size    FIXME
-  @param private_key       FIXME
+  @param signature_size    size of the signature buffer on input, length of
+                           the signature on output
+  @param private_key       the notary's private key
+  @param digest            digest to sign over, NULL for Ed25519
+  @param md_context        reusable digest context, or NULL
 
-  @return 1 on success, 0 on otherwise FIXME does RSA_sign return an error if it fails?
+  @return 1 on success, 0 otherwise
  */
 int
-generate_signature(unsigned char *fingerprint_list, unsigned char *signature,
-                   unsigned int *signature_size, RSA *private_key)
-{
-  unsigned char *return_val;
-  /* Digest generated by SHA-1. */
-  unsigned char digest[SHA_DIGEST_LENGTH];
-  
-  /* Generate a SHA-1 digest of the fingerprint list. */
-  return_val = SHA1(fingerprint_list, SHA_DIGEST_LENGTH, digest);
-  
-  if (return_val == NULL)
+generate_signature(unsigned char *fingerprint_list, size_t list_length,
+                   unsigned char *signature, size_t *signature_size,
+                   EVP_PKEY *private_key, const EVP_MD *digest,
+                   EVP_MD_CTX *md_context)
+{
+  EVP_MD_CTX *context = md_context;
+  int return_val;
+
+  if (context == NULL)
+    context = EVP_MD_CTX_new();
+  else
+    EVP_MD_CTX_reset(context);
+
+  if (context == NULL)
     return 0;
- 
-  /* Generate a signature of the digest using the notary's private key. */
-  return RSA_sign(NID_sha1, digest, SHA_DIGEST_LENGTH, signature,
-                  signature_size, private_key);
+
+  /* Hash the whole fingerprint list and sign it with the notary's private
+   * key. EVP_DigestSign covers RSA, ECDSA and Ed25519 alike. */
+  return_val =
+    EVP_DigestSignInit(context, NULL, digest, NULL, private_key) == 1
+    && EVP_DigestSign(context, signature, signature_size, fingerprint_list,
+                      list_length) == 1;
+
+  if (md_context == NULL)
+    EVP_MD_CTX_free(context);
+
+  return return_val;
 } // generate_signature
 
+/**
+  @brief Encodes a block of data in base64.
+
+  @return a newly allocated, null terminated string, or NULL on failure
+ */
+static char *
+encode_base64 (const unsigned char *data, size_t data_len)
+{
+  /* Base64 output is 4 bytes for every 3 input bytes plus a null. */
+  char *encoded = malloc (4 * ((data_len + 2) / 3) + 1);
+
+  if (encoded != NULL)
+    EVP_EncodeBlock ((unsigned char *) encoded, data, data_len);
+  return encoded;
+} // encode_base64
+
+/**
+  @brief Decodes a base64 string of a given length.
+
+  @param encoded      the base64 text, not necessarily null terminated
+  @param encoded_len  number of characters in encoded
+  @param decoded      output parameter for the newly allocated data
+  @param decoded_len  output parameter for the number of bytes decoded
+
+  @return 1 on success, 0 if the text is not valid base64
+ */
+static int
+decode_base64 (const char *encoded, size_t encoded_len,
+               unsigned char **decoded, size_t *decoded_len)
+{
+  int length;
+
+  if (encoded_len == 0 || encoded_len % 4 != 0)
+    return 0;
+
+  *decoded = malloc (3 * encoded_len / 4 + 1);
+  if (*decoded == NULL)
+    return 0;
+
+  length = EVP_DecodeBlock (*decoded, (const unsigned char *) encoded,
+                            encoded_len);
+  if (length < 0)
+    {
+      free (*decoded);
+      return 0;
+    }
+
+  /* EVP_DecodeBlock counts the padding as zero bytes. */
+  if (encoded[encoded_len - 1] == '=')
+    length--;
+  if (encoded[encoded_len - 2] == '=')
+    length--;
+
+  *decoded_len = length;
+  return 1;
+} // decode_base64
+
+/**
+  @brief Finds the value of a field in a notary response. Only the fields
+         this file writes are looked for, and their names never occur inside
+         values, so a plain search is enough.
+
+  @return a pointer to the first character of the value, or NULL
+ */
+static const char *
+find_field (const char *json, const char *name)
+{
+  char pattern[64];
+  const char *found;
+
+  snprintf (pattern, sizeof (pattern), "\"%s\":", name);
+  found = strstr (json, pattern);
+  return found == NULL ? NULL : found + strlen (pattern);
+} // find_field
+
+/**
+  @brief Decodes the base64 string value starting at a quote.
+
+  @param value     pointer to the opening quote of the value
+  @param data      output parameter for the decoded data
+  @param data_len  output parameter for the number of bytes decoded
+  @param end       output parameter for the character after the closing quote
+
+  @return 1 on success, 0 otherwise
+ */
+static int
+decode_string_value (const char *value, unsigned char **data,
+                     size_t *data_len, const char **end)
+{
+  const char *close;
+
+  if (value == NULL || *value != '"')
+    return 0;
+
+  close = strchr (value + 1, '"');
+  if (close == NULL)
+    return 0;
+
+  *end = close + 1;
+  return decode_base64 (value + 1, close - value - 1, data, data_len);
+} // decode_string_value
+
+/**
+  @brief Formats the Merkle inclusion proof of a batched response.
+
+  @return a newly allocated JSON object, or NULL on failure
+ */
+static char *
+format_merkle_proof (struct merkle_proof *proof)
+{
+  char *encoded_root, *encoded_signature, *encoded_node;
+  char *paths = strdup ("");
+  char *next;
+  char *formatted = NULL;
+  size_t i;
+
+  for (i = 0; paths != NULL && i < proof->path_length; i++)
+    {
+      encoded_node = encode_base64 (proof->path[i], MERKLE_HASH_LENGTH);
+      if (encoded_node == NULL
+          || asprintf (&next, "%s%s\"%s\"", paths, i == 0 ? "" : ",",
+                       encoded_node) < 0)
+        next = NULL;
+      free (encoded_node);
+      free (paths);
+      paths = next;
+    }
+
+  encoded_root = encode_base64 (proof->root, MERKLE_HASH_LENGTH);
+  encoded_signature = encode_base64 (proof->signature, proof->signature_len);
+  if (paths != NULL && encoded_root != NULL && encoded_signature != NULL
+      && asprintf (&formatted, "{\"treeSize\":%zu,\"index\":%zu,"
+                   "\"root\":\"%s\",\"path\":[%s],\"signature\":\"%s\"}",
+                   proof->tree_size, proof->index, encoded_root, paths,
+                   encoded_signature) < 0)
+    formatted = NULL;
+
+  free (paths);
+  free (encoded_root);
+  free (encoded_signature);
+  return formatted;
+} // format_merkle_proof
+
+/**
+  @brief Formats the fingerprint list of a host from its history: a run of
+         the same chain is one entry, with the leaf fingerprint and when it
+         was first and last seen, oldest first. A host without a history
+         only lists the observation.
+
+  @param id           the ID of the host
+  @param observation  the observation the response is for
+
+  @return a newly allocated JSON object, or NULL on failure
+ */
+static char *
+format_fingerprint_list (uint32_t id, struct observation *observation)
+{
+  struct history_run *runs;
+  const uint32_t *certs;
+  char *formatted = NULL;
+  size_t length;
+  FILE *stream;
+  int count, num_certs, i;
+
+  runs = malloc (tunables.history_max_runs * sizeof (struct history_run));
+  if (runs == NULL)
+    return NULL;
+
+  count = history_copy (id, runs, tunables.history_max_runs);
+  if (count == 0)
+    {
+      runs[0].chain = observation->chain;
+      runs[0].first_seen = observation->first_seen;
+      runs[0].last_seen = observation->last_seen;
+      count = 1;
+    }
+
+  stream = open_memstream (&formatted, &length);
+  if (stream == NULL)
+    {
+      free (runs);
+      return NULL;
+    }
+
+  fprintf (stream, "{\"fingerprintList\":[");
+  for (i = 0; i < count; i++)
+    {
+      certs = certpool_chain_certs (runs[i].chain, &num_certs);
+      if (num_certs == 0)
+        break;
+      fprintf (stream, "%s{\"timestamp\":"
+               "{\"start\":\"%lu\",\"finish\":\"%lu\"},"
+               "\"fingerprint\":\"%s\"}", i == 0 ? "" : ",",
+               (unsigned long) runs[i].first_seen,
+               (unsigned long) runs[i].last_seen,
+               certpool_fingerprint (certs[0]));
+    }
+  fprintf (stream, "]}");
+
+  if (fclose (stream) != 0 || i < count)
+    {
+      free (formatted);
+      formatted = NULL;
+    }
+
+  free (runs);
+  return formatted;
+} // format_fingerprint_list
+
+/**
+  @brief Signs a fingerprint list and appends the base64 encoded signature to
+         it, as described in the Convergence notary protocol. When batch
+         signing is on, the list becomes a leaf of a signed Merkle tree and
+         the response carries its inclusion proof instead.
+
+  @param fingerprint_list  the JSON object holding the fingerprint list
+
+  @return a newly allocated JSON response, or NULL if signing failed
+ */
+char *
+sign_fingerprint_list (const char *fingerprint_list)
+{
+  unsigned char *signature;
+  size_t signature_size;
+  struct merkle_proof proof;
+  char *encoded_signature;
+  char *signed_response = NULL;
+  size_t list_length = strlen (fingerprint_list);
+
+  if (signer_batching_enabled ())
+    {
+      if (!signer_sign_batched ((const unsigned char *) fingerprint_list,
+                                list_length, &proof))
+        {
+          fprintf (stderr, "Could not sign the fingerprint list\n");
+          return NULL;
+        }
+
+      encoded_signature = format_merkle_proof (&proof);
+      free (proof.signature);
+
+      if (encoded_signature != NULL
+          && asprintf (&signed_response, "%.*s,\"merkleProof\":%s}",
+                       (int) list_length - 1, fingerprint_list,
+                       encoded_signature) < 0)
+        signed_response = NULL;
+
+      free (encoded_signature);
+      return signed_response;
+    }
+
+  if (!signer_sign ((const unsigned char *) fingerprint_list, list_length,
+                    &signature, &signature_size))
+    {
+      fprintf (stderr, "Could not sign the fingerprint list\n");
+      return NULL;
+    }
+
+  encoded_signature = encode_base64 (signature, signature_size);
+  if (encoded_signature != NULL)
+    {
+      /* Replace the closing brace of the list with the signature field. */
+      if (asprintf (&signed_response, "%.*s,\"signature\":\"%s\"}",
+                    (int) list_length - 1, fingerprint_list,
+                    encoded_signature) < 0)
+        signed_response = NULL;
+    }
+
+  free (encoded_signature);
+  free (signature);
+  return signed_response;
+} // sign_fingerprint_list
+
+/**
+  @brief Checks the signature of a notary response, whether it was signed on
+         its own or as part of a Merkle batch.
+
+  @param response    the JSON response as sent by the notary
+  @param public_key  the notary's public key
+
+  @return 1 if the signature is valid, 0 otherwise
+ */
+int
+verify_response_signature (const char *response, EVP_PKEY *public_key)
+{
+  const char *proof_field = strstr (response, ",\"merkleProof\":");
+  const char *signature_field = strstr (response, ",\"signature\":");
+  const char *suffix = proof_field != NULL ? proof_field : signature_field;
+  const char *value, *end;
+  unsigned char *signature = NULL, *node = NULL;
+  unsigned char (*path)[MERKLE_HASH_LENGTH] = NULL;
+  unsigned char leaf[MERKLE_HASH_LENGTH], root[MERKLE_HASH_LENGTH];
+  unsigned char *signed_data, *decoded;
+  size_t signed_length, signature_len, decoded_len, path_length = 0;
+  size_t tree_size, index;
+  EVP_MD_CTX *context;
+  int verified = 0;
+
+  if (suffix == NULL)
+    return 0;
+
+  /* The signed data is the response without the signature or proof. */
+  signed_length = suffix - response + 1;
+  signed_data = malloc (signed_length);
+  if (signed_data == NULL)
+    return 0;
+  memcpy (signed_data, response, signed_length - 1);
+  signed_data[signed_length - 1] = '}';
+
+  if (proof_field == NULL)
+    {
+      if (!decode_string_value (signature_field + strlen (",\"signature\":"),
+                                &signature, &signature_len, &end))
+        goto done;
+    }
+  else
+    {
+      /* A batched response: rebuild the root from the leaf and the path. */
+      value = find_field (proof_field, "treeSize");
+      if (value == NULL || sscanf (value, "%zu", &tree_size) != 1)
+        goto done;
+      value = find_field (proof_field, "index");
+      if (value == NULL || sscanf (value, "%zu", &index) != 1)
+        goto done;
+
+      value = find_field (proof_field, "root");
+      if (!decode_string_value (value, &decoded, &decoded_len, &end))
+        goto done;
+      if (decoded_len != MERKLE_HASH_LENGTH)
+        {
+          free (decoded);
+          goto done;
+        }
+      memcpy (root, decoded, MERKLE_HASH_LENGTH);
+      free (decoded);
+
+      value = find_field (proof_field, "path");
+      if (value == NULL || *value != '[')
+        goto done;
+      path = malloc (MERKLE_MAX_DEPTH * MERKLE_HASH_LENGTH);
+      if (path == NULL)
+        goto done;
+      for (value++; *value == '"'; value = end + (*end == ','))
+        {
+          if (path_length == MERKLE_MAX_DEPTH
+              || !decode_string_value (value, &node, &decoded_len, &end))
+            goto done;
+          if (decoded_len != MERKLE_HASH_LENGTH)
+            goto done;
+          memcpy (path[path_length++], node, MERKLE_HASH_LENGTH);
+          free (node);
+          node = NULL;
+        }
+
+      merkle_leaf_hash (signed_data, signed_length, leaf);
+      if (!merkle_verify_path (leaf, index, tree_size, path, path_length,
+                               root))
+        goto done;
+
+      value = find_field (proof_field, "signature");
+      if (!decode_string_value (value, &signature, &signature_len, &end))
+        goto done;
+
+      /* From here on the root is what was signed. */
+      free (signed_data);
+      signed_data = malloc (MERKLE_HASH_LENGTH);
+      if (signed_data == NULL)
+        goto done;
+      memcpy (signed_data, root, MERKLE_HASH_LENGTH);
+      signed_length = MERKLE_HASH_LENGTH;
+    }
+
+  context = EVP_MD_CTX_new ();
+  if (context != NULL)
+    {
+      verified =
+        EVP_DigestVerifyInit (context, NULL,
+                              signature_scheme_digest
+                              (signature_scheme_of (public_key)),
+                              NULL, public_key) == 1
+        && EVP_DigestVerify (context, signature, signature_len, signed_data,
+                             signed_length) == 1;
+      EVP_MD_CTX_free (context);
+    }
+
+ done:
+  free (node);
+  free (path);
+  free (signature);
+  free (signed_data);
+  return verified;
+} // verify_response_signature
+
+/**
+  @brief Contacts a host and records the chain it shows as a new
+         observation, which invalidates its cached response. A host
+         without an ID is given one only once it was observed, so that
+         clients asking about hosts that do not exist cannot fill the
+         intern table. A host with an ID that cannot be contacted enters
+         the negative cache.
+
+  @param host_to_verify  the host to contact
+  @param key             the canonical key of the host
+  @param id              the ID of the host in the caches, or HOSTKEY_NONE;
+                         set to the ID given to the host
+  @param observation     output parameter for the recorded observation
+  @param deadline        the deadline of the verification
+
+  @return 1 on success, 0 if no certificate could be obtained or the host
+          could not be given an ID
+ */
+static int
+observe_key (host *host_to_verify, const char *key, uint32_t *id,
+             struct observation *observation, struct deadline *deadline)
+{
+  uint32_t chain = CERTPOOL_NONE;
+  time_t start_time, end_time;
+  int num_of_certs, failure;
+  long backoff;
+
+  /* Wait for a fetch slot, so one slow host cannot hold every thread. */
+  if (!origin_acquire(key, deadline))
+    {
+      fprintf(stderr, "Gave up waiting to contact %s\n", host_to_verify->url);
+      deadline_record(deadline, DEADLINE_QUEUE);
+      return 0;
+    }
+
+  //get the chain and the time stamps of the observation
+  start_time = time(NULL);
+  num_of_certs = request_certificate(host_to_verify, &chain, deadline,
+                                     &failure);
+  end_time = time(NULL);
+  origin_release(key);
+
+  if (num_of_certs > 0 && *id == HOSTKEY_NONE)
+    *id = hostkey_intern(key);
+
+  if (*id == HOSTKEY_NONE)
+    ; // nothing about the host is remembered
+  else if (num_of_certs > 0)
+    negcache_success(*id);
+  else if ((backoff = negcache_failure(*id, failure)) > 0)
+    fprintf(stderr, "Not contacting %s for %ld ms after a %s failure\n",
+            key, backoff, negcache_class_name(failure));
+
+  if (num_of_certs > 0)
+    shmcache_publish(key, chain, start_time, end_time);
+  if (num_of_certs > 0 && *id != HOSTKEY_NONE)
+    {
+      observation_record(*id, chain, start_time, end_time, observation);
+      response_cache_invalidate(*id);
+    }
+
+  return num_of_certs > 0 && *id != HOSTKEY_NONE;
+} // observe_key
+
+/**
+  @brief Contacts a host with an ID and records the chain it shows as a new
+         observation, as observe_key does.
+
+  @param host_to_verify  the host to contact
+  @param id              the ID of the host in the caches
+  @param observation     output parameter for the recorded observation
+  @param deadline        the deadline of the verification
+
+  @return 1 on success, 0 if no certificate could be obtained
+ */
+int
+observe_host (host *host_to_verify, uint32_t id,
+              struct observation *observation, struct deadline *deadline)
+{
+  return observe_key(host_to_verify, hostkey_name(id), &id, observation,
+                     deadline);
+} // observe_host
+
 /** 
-  @brief Obtains a response to a POST/GET request.
+  @brief Obtains a response to a POST/GET request. The signed response of a
+         host lists the runs of its history. It is rendered once per
+         observation and time bucket and shared by all clients; only the
+         verdict is computed for every request.
  
-  @param coninfo_cls             FIXME
-  @param host_to_verify          FIXME
-  @param fingerprint_from_client FIXME
+  @param coninfo_cls             the connection to answer
+  @param host_to_verify          the host the client asks about
+  @param fingerprint_from_client the fingerprint the client saw, or NULL
 
-  @return MHD_YES FIXME (209...??) if __, MHD_NO otherwise. 
+  @return MHD_YES if a signed response was prepared, MHD_NO otherwise. 
  */
 int
 retrieve_response (void *coninfo_cls, host *host_to_verify, const char *fingerprint_from_client)
 {
-  int verified, num_of_certs; // was certificate verified?
-  char *fingerprints_from_website[MAX_NO_OF_CERTS];
-  char *json_fingerprint_list; // the response to send to client
-  unsigned int *signature_size = NULL;
-  unsigned char *signature;
-  RSA *private_key;
-  FILE *key_file = fopen(keyfile, "r");
-
   struct connection_info_struct *con_info = coninfo_cls;
+  struct deadline no_deadline, *deadline = con_info->deadline;
+  struct observation observation;
+  char key[HOSTKEY_LENGTH];
+  uint32_t id = HOSTKEY_NONE;
+  char *json_fingerprint_list = NULL; // the signed part of the response
+  char *json_response; // the response to send to client
+  struct history_run newest; // the newest run in the history of the host
+  struct shmcache_entry shared; // an observation of another notary process
+  int observed = 0; // was the host contacted for this request?
+  int claimed = -1; // did this request claim the host in the shared table?
+  int found = 0; // was an observation of another process found?
+  int backing_off = 0; // did the host fail too recently to be contacted?
+  long wait_ms;
+  int status = OBSERVATION_MISSING;
+  time_t bucket;
 
-  //variables to store the time stamp
-  size_t start_time, end_time;
+  con_info->answer_string = NULL;
+  con_info->cached_response = NULL;
+  con_info->static_page = STATIC_NONE;
 
-  //create space for the fingerprints
-  int i;
-  for(i=0; i<MAX_NO_OF_CERTS; i++)
-    fingerprints_from_website[i] = calloc(FPT_LENGTH, sizeof(char));
+  if (deadline == NULL)
+    {
+      memset(&no_deadline, 0, sizeof(no_deadline));
+      deadline = &no_deadline;
+    }
 
-  //get the fingerprints
-  start_time = time(NULL);
-  num_of_certs = request_certificate(host_to_verify, fingerprints_from_website);
+  /* Every way of writing a host shares the state of its canonical key. */
+  if (!hostkey_canonicalize(host_to_verify->url, host_to_verify->port, key,
+                            sizeof(key)))
+    {
+      con_info->answer_code = MHD_HTTP_BAD_REQUEST; //400
+      con_info->static_page = STATIC_INVALID_HOST;
+      return MHD_NO;
+    }
 
-  if (num_of_certs == 0)
+  /* Only hosts that were observed, warmed, ingested or restored have an
+   * ID, and with it state in the caches. */
+  id = hostkey_find(key);
+  if (id != HOSTKEY_NONE)
+    {
+      hitters_record(id);
+
+      status = observation_lookup(id, &observation);
+
+      /* A host the cache let go of is served from its history while the
+       * newest run is fresh, and returns to the cache. Right after a
+       * restart its history may still be in the snapshot. */
+      if (status == OBSERVATION_MISSING)
+        snapshot_restore(id);
+      if (status == OBSERVATION_MISSING && history_latest(id, &newest)
+          && (time_t) newest.last_seen + tunables.observation_ttl
+             > time(NULL))
+        {
+          observation_cache_insert(id, newest.chain, newest.first_seen,
+                                   newest.last_seen, &observation);
+          status = OBSERVATION_FRESH;
+        }
+
+      /* A host that failed recently is not tried again before its
+       * backoff window has passed. */
+      if (status == OBSERVATION_MISSING)
+        backing_off = negcache_check(id, NULL, NULL);
+    }
+
+  /* Another notary process on this machine may have observed the host
+   * already, or be contacting it now. */
+  if (status == OBSERVATION_MISSING && !backing_off)
+    {
+      found = shmcache_lookup(key, &shared);
+      if (!found && (claimed = shmcache_claim(key)) == 0)
+        {
+          wait_ms = deadline_budget_ms(deadline, DEADLINE_QUEUE);
+          if (wait_ms > tunables.shmcache_wait_ms)
+            wait_ms = tunables.shmcache_wait_ms;
+          found = shmcache_wait(key, wait_ms, &shared);
+        }
+      if (found && id == HOSTKEY_NONE)
+        id = hostkey_intern(key);
+      if (found && id != HOSTKEY_NONE)
+        {
+          observation_record(id, shared.chain, shared.start, shared.end,
+                             &observation);
+          status = OBSERVATION_FRESH;
+        }
+    }
+
+  if (status != OBSERVATION_MISSING)
+    observed = -1; // a cached observation is available
+  else if (!backing_off && !found)
+    observed = observe_key(host_to_verify, key, &id, &observation, deadline);
+  if (claimed > 0)
+    shmcache_release(key);
+
+  /* A popular host about to expire is refreshed in the background
+   * while this client gets the observation we have. */
+  if (status == OBSERVATION_REFRESH)
+    refresh_start(host_to_verify, id);
+
+  if (observed == 0)
     {
       /* The notary could not obtain the certificate from the website
        * for some reason.
        */
       con_info->answer_code = MHD_HTTP_SERVICE_UNAVAILABLE; //503
+      con_info->static_page = STATIC_UNAVAILABLE;
       return MHD_NO;
     } // if
 
-  if (fingerprint_from_client != NULL)
-    {
-      verified =
-        verify_certificate (fingerprint_from_client, fingerprints_from_website, num_of_certs);
+  /* The client may have seen a certificate the host switched to after we
+   * last observed it. It is answered from what we saw, and the host is
+   * asked again in the background, so that clients cannot make the notary
+   * contact hosts at will. */
+  if (fingerprint_from_client != NULL && observed == -1
+      && !observation_contains(&observation, fingerprint_from_client)
+      && observation_recheck(id))
+    refresh_start(host_to_verify, id);
 
-      if (verified == 1)
-        con_info->answer_code = MHD_HTTP_OK; // 200
-      else
-        {
-          con_info->answer_code = MHD_HTTP_CONFLICT; // 409
-        }
+  if (fingerprint_from_client == NULL
+      || observation_contains(&observation, fingerprint_from_client))
+    con_info->answer_code = MHD_HTTP_OK; // 200
+  else
+    con_info->answer_code = MHD_HTTP_CONFLICT; // 409
+
+  /* Another client may already have caused this response to be signed. */
+  bucket = response_cache_bucket(time(NULL));
+  con_info->cached_response =
+    response_cache_lookup(id, observation.version, bucket);
+  if (con_info->cached_response != NULL)
+    return MHD_YES;
+
+  /* Signing for a client that hung up or can no longer be answered in time
+   * would only delay the others. */
+  if (deadline_budget_ms(deadline, DEADLINE_SIGN) == 0)
+    {
+      deadline_record(deadline, DEADLINE_SIGN);
+      con_info->answer_code = MHD_HTTP_SERVICE_UNAVAILABLE; //503
+      con_info->static_page = STATIC_UNAVAILABLE;
+      return MHD_NO;
     }
-  else con_info->answer_code = MHD_HTTP_OK;
 
   /* Format the response which will be sent to client.
    * Note that this response is sent both on a successful verification
    * and on a failed verification.
    * The JSON format of the response is available at
    * https://github.com/moxie0/Convergence/wiki/Notary-Protocol
+   * Clients verify the signature over the fingerprint list serialized
+   * without whitespace, so that is the form we sign and send.
    */
-  //get end_time for processing the request
-  end_time = time(NULL);
+  json_fingerprint_list = format_fingerprint_list(id, &observation);
 
-  json_fingerprint_list = malloc ( (RESPONSE_LEN + 1) * sizeof (char));
-  sprintf (json_fingerprint_list,
-           "{\n \
-\t\"fingerprintList\":\n \
-\t[\n \
-\t {\n \
-\t \"timestamp\": {\"start\": \"%Zu\", \"finish\": \"%Zu\"},\n \
-\t \"fingerprint\": \"%s\"\n \
-\t }\n \
-\t]\n\
-}\n", start_time, end_time, fingerprints_from_website[0]);
-
-  /* /\* Get the RSA private key from a file. *\/ */
-  /* private_key = PEM_read_RSAPrivateKey(key_file, NULL, NULL, NULL); */
-
-  /* //Calculate the signature size and allocate space for it. */
-  /* signature_size = RSA_size(private_key); */
-  /* signature = (unsigned char *) malloc (*signature_size); */
-
-  /* /\* generate_signature((unsigned char *) json_fingerprint_list, signature, signature_size, private_key); *\/ */
-
-  set_answer_string(con_info, json_fingerprint_list);
-  
+  json_response = NULL;
+  if (json_fingerprint_list != NULL)
+    json_response = sign_fingerprint_list (json_fingerprint_list);
   free(json_fingerprint_list);
 
-  //free memory used for fingerprints
-  for(i=0; i<MAX_NO_OF_CERTS; i++)
-    free(fingerprints_from_website[i]);
+  /* The cache takes over the response, even when it cannot keep it. */
+  if (json_response != NULL)
+    con_info->cached_response =
+      response_cache_insert(id, observation.version, bucket, json_response);
+
+  if (con_info->cached_response == NULL)
+    {
+      /* An unsigned response is worthless to the client. */
+      con_info->answer_code = MHD_HTTP_SERVICE_UNAVAILABLE; //503
+      con_info->static_page = STATIC_UNAVAILABLE;
+      return MHD_NO;
+    }
 
   return MHD_YES;
 }
@@ -181,7 +804,9 @@ send_response (struct MHD_Connection *connection, const char *response_data,
   int return_value;
   struct MHD_Response *response;
 
-  response = MHD_create_response_from_data (strlen(response_data), (void*) response_data, MHD_NO, MHD_NO);
+  response = MHD_create_response_from_buffer (strlen (response_data),
+                                              (void *) response_data,
+                                              MHD_RESPMEM_PERSISTENT);
 
   if (response == NULL)
   {
@@ -193,3 +818,141 @@ send_response (struct MHD_Connection *connection, const char *response_data,
 
   return return_value;
 }
+
+/**
+ @brief Sends a copy of a body that closes the connection after it.
+
+ @param connection   the connection to the client
+ @param body         the body
+ @param length       the length of the body
+ @param status_code  the status code
+
+ @return MHD_YES if the response was queued, MHD_NO otherwise.
+ */
+static int
+send_closing (struct MHD_Connection *connection, const char *body,
+              size_t length, int status_code)
+{
+  struct MHD_Response *response;
+  int return_value;
+
+  response = MHD_create_response_from_buffer (length, (void *) body,
+                                              MHD_RESPMEM_MUST_COPY);
+  if (response == NULL)
+    return MHD_NO;
+  MHD_add_response_header (response, MHD_HTTP_HEADER_CONNECTION, "close");
+  return_value = MHD_queue_response (connection, status_code, response);
+  MHD_destroy_response (response);
+  return return_value;
+} // send_closing
+
+/**
+ @brief Builds the responses of the fixed answers, which every connection
+        then shares instead of building its own.
+
+ @return 1 on success, 0 otherwise.
+ */
+int
+response_init_static (void)
+{
+  int page, closing;
+
+  for (page = STATIC_NONE + 1; page < STATIC_PAGES; page++)
+    for (closing = 0; closing < 2; closing++)
+      {
+        if (static_responses[page][closing] != NULL)
+          continue;
+        static_responses[page][closing] =
+          MHD_create_response_from_buffer (strlen (static_pages[page].text),
+                                           (void *) static_pages[page].text,
+                                           MHD_RESPMEM_PERSISTENT);
+        if (static_responses[page][closing] == NULL)
+          {
+            response_free_static ();
+            return 0;
+          }
+        if (closing)
+          MHD_add_response_header (static_responses[page][closing],
+                                   MHD_HTTP_HEADER_CONNECTION, "close");
+      }
+  return 1;
+} // response_init_static
+
+/**
+ @brief Destroys the responses of the fixed answers.
+ */
+void
+response_free_static (void)
+{
+  int page, closing;
+
+  for (page = STATIC_NONE + 1; page < STATIC_PAGES; page++)
+    for (closing = 0; closing < 2; closing++)
+      if (static_responses[page][closing] != NULL)
+        {
+          MHD_destroy_response (static_responses[page][closing]);
+          static_responses[page][closing] = NULL;
+        }
+} // response_free_static
+
+/**
+ @brief Sends a fixed answer, with the response built for it at startup.
+
+ @param connection  the connection to the client
+ @param page        the answer
+ @param closing     whether to close the connection after it
+
+ @return MHD_YES if the response was queued, MHD_NO otherwise.
+ */
+int
+send_static_response (struct MHD_Connection *connection,
+                      enum static_page page, int closing)
+{
+  struct MHD_Response *response = static_responses[page][closing != 0];
+
+  if (response == NULL)
+    return closing
+      ? send_closing (connection, static_pages[page].text,
+                      strlen (static_pages[page].text),
+                      static_pages[page].status_code)
+      : send_response (connection, static_pages[page].text,
+                       static_pages[page].status_code);
+  return MHD_queue_response (connection, static_pages[page].status_code,
+                             response);
+} // send_static_response
+
+/**
+ @brief Sends the answer prepared by retrieve_response back to the client.
+        A cached response is queued as it is, without copying the body,
+        unless the connection closes after it, which the shared response
+        cannot say.
+
+ @param connection  the connection to the client
+ @param con_info    the answer prepared for the connection
+
+ @return MHD_YES if the response was queued, MHD_NO otherwise.
+ */
+int
+send_answer (struct MHD_Connection *connection,
+             struct connection_info_struct *con_info)
+{
+  struct cached_response *cached = con_info->cached_response;
+
+  if (cached != NULL && con_info->closing)
+    return send_closing (connection, cached->body, cached->body_length,
+                         con_info->answer_code);
+  if (cached != NULL)
+    return MHD_queue_response (connection, con_info->answer_code,
+                               cached->response);
+
+  if (con_info->static_page != STATIC_NONE)
+    return send_static_response (connection, con_info->static_page,
+                                 con_info->closing);
+
+  if (con_info->closing)
+    return send_closing (connection, con_info->answer_string,
+                         strlen (con_info->answer_string),
+                         con_info->answer_code);
+  return send_response (connection, con_info->answer_string,
+                        con_info->answer_code);
+} // send_answer
@@ -10,14 +10,36 @@
 #define RESPONSE_H
 
 #include "notary.h"
+#include "observation.h"
+#include "deadline.h"
 
 /**
  * Generates a signature of a list of fingerprints using the notary's private
- * key.
+ * key. digest is NULL for schemes that hash the message themselves
+ * (Ed25519). md_context may be NULL, in which case one is allocated.
  */
 int
-generate_signature(unsigned char *fingerprint_list, unsigned char *signature,
-                   unsigned int *signature_size, RSA *private_key);
+generate_signature(unsigned char *fingerprint_list, size_t list_length,
+                   unsigned char *signature, size_t *signature_size,
+                   EVP_PKEY *private_key, const EVP_MD *digest,
+                   EVP_MD_CTX *md_context);
+
+/* Signs a fingerprint list, either on its own or as part of a Merkle batch,
+ * and returns the newly allocated response to send, or NULL on failure.
+ */
+char *sign_fingerprint_list (const char *fingerprint_list);
+
+/* Checks the signature of a notary response with the notary's public key.
+ * Returns 1 if it is valid, 0 otherwise.
+ */
+int verify_response_signature (const char *response, EVP_PKEY *public_key);
+
+/* Contacts a host, whose ID in the caches is given, and records what it
+ * shows as a new observation. Returns 1 on success, 0 if no certificate
+ * could be obtained, in which case the host enters the negative cache.
+ */
+int observe_host (host *host_to_verify, uint32_t id,
+                  struct observation *observation, struct deadline *deadline);
 
 /* Obtains a response to a POST/GET request. */
 int retrieve_response (void *coninfo_cls, host *host_to_verify, const char *fingerprint_from_client);
@@ -28,5 +50,25 @@ int retrieve_response (void *coninfo_cls, host *host_to_verify, const char *fing
 int send_response (struct MHD_Connection *connection, const char *response_data,
                int status_code);
 
+/* Builds the responses of the fixed answers once, for every connection to
+ * share. Returns 1 on success, 0 otherwise.
+ */
+int response_init_static (void);
+
+/* Destroys the responses of the fixed answers. */
+void response_free_static (void);
+
+/* Sends a fixed answer with the response built for it, one that closes the
+ * connection after it if closing is set.
+ */
+int send_static_response (struct MHD_Connection *connection,
+                          enum static_page page, int closing);
+
+/* Sends the answer retrieve_response prepared for a connection, queuing the
+ * shared cached response when there is one.
+ */
+int send_answer (struct MHD_Connection *connection,
+                 struct connection_info_struct *con_info);
+
 
 #endif // RESPONSE_H
@@ -0,0 +1,341 @@
+/** @file
+
+    @brief  Sharded listeners: spreads the connections to a port over
+            several listening sockets bound with SO_REUSEPORT, each served
+            by its own daemon and optionally pinned to a core.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "shard.h"
+#include "handoff.h"
+#include "tcptune.h"
+#include "config.h"
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Tells the kernel to hand a connection to the shard of the core it
+ *        arrived on, the one numbered the core modulo shards, by attaching
+ *        a program to the group of sockets fd belongs to.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+static int
+steer_by_cpu (int fd, int shards)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+  struct sock_filter code[] = {
+    {BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU},
+    {BPF_ALU | BPF_MOD | BPF_K, 0, 0, shards},
+    {BPF_RET | BPF_A, 0, 0, 0}
+  };
+  struct sock_fprog program = {sizeof (code) / sizeof (code[0]), code};
+
+  return setsockopt (fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program,
+                     sizeof (program)) == 0;
+#else
+  return 0;
+#endif
+} // steer_by_cpu
+
+/**
+ * @brief Picks the core for shard number index of shards: one this process
+ *        may run on whose number is index modulo shards, so that it gets
+ *        the connections steer_by_cpu hands it, or else any of them in turn.
+ *
+ * @return the core, or -1 if the cores cannot be told
+ */
+static int
+shard_cpu (int index, int shards)
+{
+  cpu_set_t allowed;
+  int count, cpu, nth;
+
+  if (sched_getaffinity (0, sizeof (allowed), &allowed) != 0)
+    return -1;
+  count = CPU_COUNT (&allowed);
+  if (count == 0)
+    return -1;
+
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    if (CPU_ISSET (cpu, &allowed) && cpu % shards == index)
+      return cpu;
+  nth = index % count;
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    if (CPU_ISSET (cpu, &allowed) && nth-- == 0)
+      return cpu;
+  return -1;
+} // shard_cpu
+
+/**
+ * @brief Opens the shards of a port for one address family.
+ *
+ * @param set     the set to add them to, with its port if bound already
+ * @param name    the name of the first shard; the others get a suffix
+ * @param family  AF_INET or AF_INET6
+ * @param flags   HANDOFF_V6ONLY, or 0
+ *
+ * @return 1 on success, 0 otherwise
+ */
+static int
+listen_family (struct shard_set *set, const char *name, int family,
+               int flags)
+{
+  int shards = tunables.listen_shards, first = set->count, fd, i;
+  char shard_name[HANDOFF_NAME_LENGTH];
+  struct sockaddr_storage address;
+  socklen_t length;
+
+  if (shards > 1)
+    flags |= HANDOFF_REUSE_PORT;
+
+  for (i = 0; i < shards; i++)
+    {
+      memset (&address, 0, sizeof (address));
+      if (family == AF_INET6)
+        {
+          struct sockaddr_in6 *v6 = (struct sockaddr_in6 *) &address;
+
+          v6->sin6_family = AF_INET6;
+          v6->sin6_addr = in6addr_any;
+          v6->sin6_port = htons (set->port);
+          length = sizeof (*v6);
+        }
+      else
+        {
+          struct sockaddr_in *v4 = (struct sockaddr_in *) &address;
+
+          v4->sin_family = AF_INET;
+          v4->sin_addr.s_addr = htonl (INADDR_ANY);
+          v4->sin_port = htons (set->port);
+          length = sizeof (*v4);
+        }
+
+      if (i == 0)
+        snprintf (shard_name, sizeof (shard_name), "%s", name);
+      else
+        snprintf (shard_name, sizeof (shard_name), "%s.%d", name, i);
+      fd = handoff_listen (shard_name, (struct sockaddr *) &address, length,
+                           flags);
+      if (fd < 0)
+        return 0;
+      tcptune_listener (fd);
+
+      /* Bind the other shards to the port the first one got. */
+      if (set->port == 0)
+        {
+          length = sizeof (address);
+          getsockname (fd, (struct sockaddr *) &address, &length);
+          set->port = ntohs (family == AF_INET6
+                             ? ((struct sockaddr_in6 *) &address)->sin6_port
+                             : ((struct sockaddr_in *) &address)->sin_port);
+        }
+
+      set->sockets[set->count] = fd;
+      set->ipv6[set->count] = family == AF_INET6;
+      set->cpus[set->count] = tunables.listen_pin_cpus
+        ? shard_cpu (i, shards) : -1;
+      set->count++;
+    }
+
+  if (shards > 1 && tunables.listen_steer_cpu
+      && !steer_by_cpu (set->sockets[first], shards))
+    fprintf (stderr, "Warning: Connections to %s cannot be steered by "
+             "core: %s\n", name, strerror (errno));
+  return 1;
+} // listen_family
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Opens the listening sockets of a port, listen_shards of them for
+ *        each address family listen_ipv6 asks for.
+ *
+ * @param set   the set to fill in
+ * @param name  the name the sockets are handed over under
+ * @param port  the port, or 0 for any free one
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+shard_listen (struct shard_set *set, const char *name, int port)
+{
+  char v6_name[HANDOFF_NAME_LENGTH];
+  int i;
+
+  memset (set, 0, sizeof (*set));
+  for (i = 0; i < 2 * SHARD_MAX; i++)
+    {
+      set->sockets[i] = -1;
+      set->cpus[i] = -1;
+    }
+  set->port = port;
+
+  switch (tunables.listen_ipv6)
+    {
+    case 1:
+      return listen_family (set, name, AF_INET6, 0);
+    case 2:
+      snprintf (v6_name, sizeof (v6_name), "%s6", name);
+      return listen_family (set, name, AF_INET, 0)
+        && listen_family (set, v6_name, AF_INET6, HANDOFF_V6ONLY);
+    default:
+      return listen_family (set, name, AF_INET, 0);
+    }
+} // shard_listen
+
+/**
+ * @brief Starts a daemon on each socket of a set.
+ *
+ * A daemon pinned to a core is started from the main thread pinned to it
+ * for the while, so that its accept thread and the threads of its
+ * connections, which inherit the affinity of their creator, run there.
+ *
+ * Parameters of MHD_start_daemon:
+ * MHD_USE_THREAD_PER_CONNECTION: use one thread per connection
+ * MHD_USE_PIPE_FOR_SHUTDOWN: allow the daemon to be quiesced
+ * MHD_USE_DUAL_STACK: take IPv4 connections mapped onto an IPv6 socket
+ * MHD_USE_NO_LISTEN_SOCKET: take only the connections added by the caller
+ * port: the port of the socket given
+ * NULL: allow connection from any IP
+ * NULL: additional arguments to preceding param
+ * handler: call this function to handle a new connection
+ * NULL: arguments to handler
+ * MHD_OPTION_LISTEN_SOCKET: indicate that the listening socket follows,
+ * none if the caller accepts
+ * MHD_OPTION_NOTIFY_COMPLETED: indicate that completed is registered
+ * completed: function to call when a request completes
+ * NULL: arguments to the completed function
+ * MHD_OPTION_NOTIFY_CONNECTION: indicate that notify is registered
+ * notify: function to call when a connection starts or closes
+ * NULL: arguments to the notify function
+ * MHD_OPTION_CONNECTION_TIMEOUT: close a connection idle this many seconds
+ * MHD_OPTION_CONNECTION_LIMIT: take at most this many connections, as many
+ * as the TLS front end serves for a daemon it feeds
+ * MHD_OPTION_END: indicate that there are no more options
+ *
+ * A connection is kept open after a request unless the client asks for it
+ * to be closed, speaks HTTP/1.0 without asking for it to be kept, or the
+ * response closes it, so that a client querying again skips setting up
+ * the connection.
+ *
+ * @param set        the set, opened by shard_listen
+ * @param handler    the handler of requests
+ * @param completed  the function to call when a request completes
+ * @param notify     the function to call when a connection starts or closes
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+shard_start (struct shard_set *set, MHD_AccessHandlerCallback handler,
+             MHD_RequestCompletedCallback completed,
+             MHD_NotifyConnectionCallback notify)
+{
+  pthread_t self = pthread_self ();
+  cpu_set_t saved, pinned;
+  unsigned int flags;
+  int have_saved, i;
+
+  have_saved = pthread_getaffinity_np (self, sizeof (saved), &saved) == 0;
+
+  for (i = 0; i < set->count; i++)
+    {
+      flags = MHD_USE_THREAD_PER_CONNECTION | MHD_USE_PIPE_FOR_SHUTDOWN;
+      if (set->external)
+        flags |= MHD_USE_NO_LISTEN_SOCKET;
+      else if (set->ipv6[i])
+        flags |= tunables.listen_ipv6 == 1
+          ? MHD_USE_DUAL_STACK : MHD_USE_IPv6;
+
+      if (set->cpus[i] >= 0 && have_saved)
+        {
+          CPU_ZERO (&pinned);
+          CPU_SET (set->cpus[i], &pinned);
+          pthread_setaffinity_np (self, sizeof (pinned), &pinned);
+        }
+      set->daemons[i] = MHD_start_daemon (flags,
+                                          set->port,
+                                          NULL,
+                                          NULL,
+                                          handler,
+                                          NULL,
+                                          MHD_OPTION_LISTEN_SOCKET,
+                                          set->external ? MHD_INVALID_SOCKET
+                                          : set->sockets[i],
+                                          MHD_OPTION_NOTIFY_COMPLETED,
+                                          completed,
+                                          NULL,
+                                          MHD_OPTION_NOTIFY_CONNECTION,
+                                          notify,
+                                          NULL,
+                                          MHD_OPTION_CONNECTION_TIMEOUT,
+                                          (unsigned int)
+                                          tunables.keepalive_timeout_s,
+                                          MHD_OPTION_CONNECTION_LIMIT,
+                                          (unsigned int) (set->external
+                                          ? tunables.tls_max_connections
+                                          : FD_SETSIZE - 4),
+                                          MHD_OPTION_END);
+      if (set->cpus[i] >= 0 && have_saved)
+        pthread_setaffinity_np (self, sizeof (saved), &saved);
+
+      if (set->daemons[i] == NULL)
+        {
+          shard_stop (set);
+          return 0;
+        }
+    }
+  return 1;
+} // shard_start
+
+/**
+ * @brief Stops the daemons of a set from accepting connections.
+ *
+ * @param set  the set
+ */
+void
+shard_quiesce (struct shard_set *set)
+{
+  MHD_socket listener;
+  int i;
+
+  for (i = 0; i < set->count; i++)
+    {
+      if (set->daemons[i] == NULL)
+        continue;
+      listener = MHD_quiesce_daemon (set->daemons[i]);
+      if (listener != MHD_INVALID_SOCKET)
+        close (listener);
+    }
+} // shard_quiesce
+
+/**
+ * @brief Stops the daemons of a set.
+ *
+ * @param set  the set
+ */
+void
+shard_stop (struct shard_set *set)
+{
+  int i;
+
+  for (i = 0; i < set->count; i++)
+    if (set->daemons[i] != NULL)
+      {
+        MHD_stop_daemon (set->daemons[i]);
+        set->daemons[i] = NULL;
+      }
+} // shard_stop
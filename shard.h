@@ -0,0 +1,60 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for sharded listeners, which spread
+ * the connections to a port over listen_shards listening sockets bound with
+ * SO_REUSEPORT, each with its own accept queue and its own MHD daemon, so
+ * that a burst of connections is not held up behind a single accept queue.
+ * Each shard's daemon may be pinned to a core, and the kernel may be told
+ * to hand a connection to the shard of the core it arrived on. Clients are
+ * taken over IPv4 only, over IPv6 with IPv4 mapped onto it, or over
+ * separate IPv4 and IPv6 sockets, as listen_ipv6 says.
+ ******************************************************************************/
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "notary.h"
+
+/* Most shards of a port, per address family. */
+#define SHARD_MAX 16
+
+/* The listening sockets of a port and the daemons serving them. */
+struct shard_set
+{
+  int port;                     // the port, once bound
+  int count;                    // sockets, over every family
+  int external;                 // connections are accepted by the caller
+  int sockets[2 * SHARD_MAX];
+  int ipv6[2 * SHARD_MAX];      // whether a socket is IPv6
+  int cpus[2 * SHARD_MAX];      // the core a daemon is pinned to, or -1
+  struct MHD_Daemon *daemons[2 * SHARD_MAX];
+};
+
+/* Opens, or takes over from a predecessor, the listening sockets of a port
+ * under name. A port of 0 binds any free one, the same for every shard.
+ * Returns 1 on success, 0 otherwise.
+ */
+int shard_listen (struct shard_set *set, const char *name, int port);
+
+/* Starts a daemon on each socket of set that answers with handler, calls
+ * completed when a request completes and notify when a connection starts
+ * or closes. Connections stay open between requests for up to
+ * keepalive_timeout_s. If set->external is set, the daemons do not listen
+ * and take the connections the caller adds to them with
+ * MHD_add_connection. Returns 1 on success, 0 if a daemon failed to
+ * start, in which case those started are stopped.
+ */
+int shard_start (struct shard_set *set, MHD_AccessHandlerCallback handler,
+                 MHD_RequestCompletedCallback completed,
+                 MHD_NotifyConnectionCallback notify);
+
+/* Stops the daemons of set from accepting connections, leaving their
+ * listening sockets to a successor, while their requests in flight go on.
+ */
+void shard_quiesce (struct shard_set *set);
+
+/* Stops the daemons of set. */
+void shard_stop (struct shard_set *set);
+
+#endif // SHARD_H
@@ -0,0 +1,650 @@
+/** @file
+
+    @brief  Shared observation table: the newest observations of hosts in a
+            file mapped by every notary process of the machine, read
+            without locks and claimed so that one process contacts a host.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "shmcache.h"
+#include "certpool.h"
+#include "hostkey.h"
+#include "config.h"
+#include <sched.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+/* Identifies tables, and the version of their layout. */
+#define SHMCACHE_MAGIC "NOTSHM01"
+
+/* Searches for the slot of a host before giving up on sharing it. */
+#define ASSIGN_TRIES 16
+
+/* The start of a table, describing its layout. */
+struct shm_header
+{
+  char magic[8];
+  uint32_t slots;
+  uint32_t slot_size;
+  uint32_t key_length;
+  uint32_t max_certs;
+  uint32_t fingerprint_length;
+  uint32_t reserved[9];
+};
+
+/* A certificate of a shared chain. */
+struct shm_cert
+{
+  unsigned char digest[CERTPOOL_DIGEST_LENGTH];
+  char fingerprint[FPT_LENGTH];
+};
+
+/* A host and its newest observation. The state is the sequence of the
+ * seqlock in its low half, odd while the slot is written, and the process
+ * writing it in its high half. The claim is the process contacting the
+ * host in its high half and when it started in its low half. */
+struct shm_slot
+{
+  uint64_t state;
+  uint64_t claim;
+  uint64_t hash;                // of the key, 0 for an empty slot
+  char key[HOSTKEY_LENGTH];
+  uint32_t start;
+  uint32_t end;
+  uint32_t num_certs;           // 0 until an observation is published
+  struct shm_cert certs[SHMCACHE_MAX_CERTS];
+};
+
+/* The mapped table. */
+static struct shm_header *header = NULL;
+static struct shm_slot *slots = NULL;
+static size_t mapped_size = 0;
+
+static struct shmcache_stats stats;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Adds one to a counter.
+ */
+static void
+count (unsigned long *counter)
+{
+  __atomic_add_fetch (counter, 1, __ATOMIC_RELAXED);
+} // count
+
+/**
+ * @brief Hashes a canonical key with 64 bit FNV-1a, never to 0.
+ */
+static uint64_t
+hash_key (const char *key)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  while (*key != '\0')
+    {
+      hash ^= (unsigned char) *key++;
+      hash *= 1099511628211ULL;
+    }
+  return hash != 0 ? hash : 1;
+} // hash_key
+
+/**
+ * @brief Returns the slot at some distance from the one a hash maps to.
+ */
+static struct shm_slot *
+slot_at (uint64_t hash, int distance)
+{
+  return &slots[(hash + distance) % header->slots];
+} // slot_at
+
+/**
+ * @brief Returns the ID slots and claims are held under by this process.
+ */
+static uint64_t
+self ()
+{
+  return (uint64_t) getpid ();
+} // self
+
+/**
+ * @brief Returns 1 if a process is known to have exited, 0 if it may
+ *        still run.
+ */
+static int
+process_dead (uint64_t process)
+{
+  return process != self () && kill ((pid_t) process, 0) != 0
+    && errno == ESRCH;
+} // process_dead
+
+/**
+ * @brief Takes the seqlock of a slot for writing. A slot held by a process
+ *        that exited is taken over and emptied, since its writer may have
+ *        left it half written.
+ *
+ * @return 1 on success, 0 if the slot stayed busy
+ */
+static int
+lock_slot (struct shm_slot *slot)
+{
+  uint64_t state, sequence;
+  int tries;
+
+  for (tries = 0; tries < 1000; tries++)
+    {
+      state = __atomic_load_n (&slot->state, __ATOMIC_ACQUIRE);
+      sequence = state & UINT32_MAX;
+      if (sequence % 2 == 0)
+        {
+          if (__atomic_compare_exchange_n (&slot->state, &state,
+                                           ((sequence + 1) & UINT32_MAX)
+                                           | self () << 32, 0,
+                                           __ATOMIC_ACQUIRE,
+                                           __ATOMIC_RELAXED))
+            return 1;
+        }
+      else if (process_dead (state >> 32))
+        {
+          if (__atomic_compare_exchange_n (&slot->state, &state,
+                                           sequence | self () << 32, 0,
+                                           __ATOMIC_ACQUIRE,
+                                           __ATOMIC_RELAXED))
+            {
+              memset ((char *) slot + offsetof (struct shm_slot, hash), 0,
+                      sizeof (*slot) - offsetof (struct shm_slot, hash));
+              __atomic_store_n (&slot->claim, 0, __ATOMIC_RELAXED);
+              count (&stats.reclaimed);
+              return 1;
+            }
+        }
+      else
+        sched_yield ();
+    }
+  return 0;
+} // lock_slot
+
+/**
+ * @brief Releases the seqlock of a slot, publishing what was written.
+ */
+static void
+unlock_slot (struct shm_slot *slot)
+{
+  uint64_t state = __atomic_load_n (&slot->state, __ATOMIC_RELAXED);
+
+  __atomic_store_n (&slot->state, (state + 1) & UINT32_MAX, __ATOMIC_RELEASE);
+} // unlock_slot
+
+/**
+ * @brief Copies a slot that no writer changed while it was copied.
+ *
+ * @return 1 on success, 0 if writers kept changing it
+ */
+static int
+read_slot (const struct shm_slot *slot, struct shm_slot *copy)
+{
+  uint64_t before;
+  int tries;
+
+  for (tries = 0; tries < 16; tries++)
+    {
+      before = __atomic_load_n (&slot->state, __ATOMIC_ACQUIRE);
+      if (before % 2 == 0)
+        {
+          memcpy (copy, slot, sizeof (*copy));
+          __atomic_thread_fence (__ATOMIC_ACQUIRE);
+          if (__atomic_load_n (&slot->state, __ATOMIC_RELAXED) == before)
+            {
+              copy->key[HOSTKEY_LENGTH - 1] = '\0';
+              return 1;
+            }
+        }
+      count (&stats.torn);
+      sched_yield ();
+    }
+  return 0;
+} // read_slot
+
+/**
+ * @brief Finds the slot of a host and takes its seqlock. With assign, a
+ *        host not in the table is given the empty slot, or else the one
+ *        with the oldest observation, near the slot its key hashes to.
+ *
+ * The slot to give is picked without its lock, so once locked it is
+ * checked again: if it changed meanwhile, or another caller is giving the
+ * host a slot as well, the search starts over. Of two callers giving the
+ * same host a slot at once, the one nearer the slot the key hashes to
+ * keeps it; the other finds it on the next search.
+ *
+ * @return the locked slot, or NULL if the host is not in the table or its
+ *         slots stayed busy
+ */
+static struct shm_slot *
+lock_key (const char *key, uint64_t hash, int assign)
+{
+  struct shm_slot *slot, *victim;
+  uint64_t victim_hash;
+  uint32_t oldest;
+  int tries, distance, taken, i;
+
+  for (tries = 0; tries < ASSIGN_TRIES; tries++)
+    {
+      for (i = 0; i < SHMCACHE_PROBE; i++)
+        {
+          slot = slot_at (hash, i);
+          if (__atomic_load_n (&slot->hash, __ATOMIC_RELAXED) != hash)
+            continue;
+          if (!lock_slot (slot))
+            return NULL;
+          if (slot->hash == hash
+              && strncmp (slot->key, key, HOSTKEY_LENGTH) == 0)
+            return slot;
+          unlock_slot (slot);
+        }
+      if (!assign)
+        return NULL;
+
+      victim = NULL;
+      victim_hash = 0;
+      distance = 0;
+      oldest = UINT32_MAX;
+      for (i = 0; i < SHMCACHE_PROBE && oldest > 0; i++)
+        {
+          slot = slot_at (hash, i);
+          if (__atomic_load_n (&slot->hash, __ATOMIC_RELAXED) == 0)
+            oldest = 0;
+          else if (__atomic_load_n (&slot->end, __ATOMIC_RELAXED) >= oldest)
+            continue;
+          else
+            oldest = __atomic_load_n (&slot->end, __ATOMIC_RELAXED);
+          victim = slot;
+          victim_hash = __atomic_load_n (&slot->hash, __ATOMIC_RELAXED);
+          distance = i;
+        }
+      if (victim == NULL || !lock_slot (victim))
+        return NULL;
+      if (victim->hash != victim_hash)
+        {
+          unlock_slot (victim);
+          continue;
+        }
+
+      /* Stake the slot before looking for another caller giving the host
+       * one, so that of two such callers at least one sees the other. */
+      __atomic_store_n (&victim->hash, hash, __ATOMIC_SEQ_CST);
+      taken = 0;
+      for (i = 0; i < SHMCACHE_PROBE && !taken; i++)
+        {
+          slot = slot_at (hash, i);
+          if (i == distance
+              || __atomic_load_n (&slot->hash, __ATOMIC_SEQ_CST) != hash)
+            continue;
+          if (i < distance)
+            taken = 1;
+          else if (!lock_slot (slot))
+            taken = 1;
+          else
+            {
+              /* A caller farther away yields to this one; wait for it and
+               * see whether it gave up the slot. */
+              taken = slot->hash == hash
+                && strncmp (slot->key, key, HOSTKEY_LENGTH) == 0;
+              unlock_slot (slot);
+            }
+        }
+      if (taken)
+        {
+          __atomic_store_n (&victim->hash, victim_hash, __ATOMIC_RELAXED);
+          unlock_slot (victim);
+          sched_yield ();
+          continue;
+        }
+
+      if (victim_hash != 0)
+        count (&stats.evictions);
+      memset ((char *) victim + offsetof (struct shm_slot, key), 0,
+              sizeof (*victim) - offsetof (struct shm_slot, key));
+      __atomic_store_n (&victim->claim, 0, __ATOMIC_RELAXED);
+      snprintf (victim->key, sizeof (victim->key), "%s", key);
+      return victim;
+    }
+  return NULL;
+} // lock_key
+
+/**
+ * @brief Looks up a fresh observation of a host without counting it.
+ *
+ * @param claim  output parameter for the claim of the host, or NULL
+ *
+ * @return 1 if one is in the table, 0 otherwise
+ */
+static int
+find (const char *key, struct shmcache_entry *entry, uint64_t *claim)
+{
+  uint64_t hash = hash_key (key);
+  struct shm_slot copy;
+  uint32_t certs[SHMCACHE_MAX_CERTS];
+  uint32_t i, found = 0;
+  int distance;
+
+  if (claim != NULL)
+    *claim = 0;
+  for (distance = 0; distance < SHMCACHE_PROBE && !found; distance++)
+    {
+      if (__atomic_load_n (&slot_at (hash, distance)->hash, __ATOMIC_RELAXED)
+          != hash
+          || !read_slot (slot_at (hash, distance), &copy)
+          || copy.hash != hash || strcmp (copy.key, key) != 0)
+        continue;
+      found = 1;
+      if (claim != NULL)
+        *claim = copy.claim;
+    }
+  if (!found || copy.num_certs == 0 || copy.num_certs > SHMCACHE_MAX_CERTS
+      || (time_t) copy.end + tunables.observation_ttl <= time (NULL))
+    return 0;
+
+  /* IDs are this process's own, so the chain is interned here. */
+  for (i = 0; i < copy.num_certs; i++)
+    {
+      copy.certs[i].fingerprint[FPT_LENGTH - 1] = '\0';
+      certs[i] = certpool_intern (copy.certs[i].digest,
+                                  copy.certs[i].fingerprint);
+      if (certs[i] == CERTPOOL_NONE)
+        return 0;
+    }
+  entry->chain = certpool_chain (certs, copy.num_certs);
+  entry->start = copy.start;
+  entry->end = copy.end;
+  return entry->chain != CERTPOOL_NONE;
+} // find
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Maps the shared table, creating it if needed.
+ *
+ * @param file_name  the file holding the table
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+shmcache_open (const char *file_name)
+{
+  struct shm_header expected;
+  struct stat status;
+  size_t size;
+  void *base;
+  int fd;
+
+  shmcache_close ();
+
+  memset (&expected, 0, sizeof (expected));
+  memcpy (expected.magic, SHMCACHE_MAGIC, sizeof (expected.magic));
+  expected.slots = tunables.shmcache_slots;
+  expected.slot_size = sizeof (struct shm_slot);
+  expected.key_length = HOSTKEY_LENGTH;
+  expected.max_certs = SHMCACHE_MAX_CERTS;
+  expected.fingerprint_length = FPT_LENGTH;
+  size = sizeof (expected) + (size_t) expected.slots * sizeof (struct shm_slot);
+
+  fd = open (file_name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0)
+    {
+      fprintf (stderr, "Could not open %s: %s\n", file_name, strerror (errno));
+      return 0;
+    }
+
+  /* The first process sizes the table; the file zeroes every slot. */
+  flock (fd, LOCK_EX);
+  if (fstat (fd, &status) != 0
+      || (status.st_size == 0
+          && (ftruncate (fd, size) != 0
+              || pwrite (fd, &expected, sizeof (expected), 0)
+                 != sizeof (expected))))
+    {
+      fprintf (stderr, "Could not create the table in %s: %s\n", file_name,
+               strerror (errno));
+      close (fd);
+      return 0;
+    }
+
+  if (status.st_size != 0 && (size_t) status.st_size != size)
+    {
+      fprintf (stderr, "%s holds a table of another size\n", file_name);
+      close (fd);
+      return 0;
+    }
+
+  base = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+    {
+      fprintf (stderr, "Could not map %s: %s\n", file_name, strerror (errno));
+      return 0;
+    }
+  if (memcmp (base, &expected, sizeof (expected)) != 0)
+    {
+      fprintf (stderr, "%s holds a table of another size or version\n",
+               file_name);
+      munmap (base, size);
+      return 0;
+    }
+
+  header = base;
+  slots = (struct shm_slot *) (header + 1);
+  mapped_size = size;
+  return 1;
+} // shmcache_open
+
+/**
+ * @brief Unmaps the shared table.
+ */
+void
+shmcache_close ()
+{
+  if (header == NULL)
+    return;
+  munmap (header, mapped_size);
+  header = NULL;
+  slots = NULL;
+  mapped_size = 0;
+} // shmcache_close
+
+/**
+ * @brief Looks up the observation of a host.
+ *
+ * @param key    the canonical key of the host
+ * @param entry  output parameter for the observation
+ *
+ * @return 1 if a fresh one is in the table, 0 otherwise
+ */
+int
+shmcache_lookup (const char *key, struct shmcache_entry *entry)
+{
+  if (header == NULL)
+    return 0;
+  if (find (key, entry, NULL))
+    {
+      count (&stats.hits);
+      return 1;
+    }
+  count (&stats.misses);
+  return 0;
+} // shmcache_lookup
+
+/**
+ * @brief Writes the observation of a host for the other processes.
+ *
+ * @param key    the canonical key of the host
+ * @param chain  the chain it showed, interned by certpool
+ * @param start  when the observation started
+ * @param end    and ended
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+shmcache_publish (const char *key, uint32_t chain, time_t start, time_t end)
+{
+  const uint32_t *certs;
+  const unsigned char *digest;
+  const char *fingerprint;
+  struct shm_slot *slot;
+  int length, i;
+
+  if (header == NULL)
+    return 0;
+  certs = certpool_chain_certs (chain, &length);
+  if (certs == NULL || length == 0)
+    return 0;
+  if (length > SHMCACHE_MAX_CERTS)
+    {
+      count (&stats.too_long);
+      return 0;
+    }
+
+  slot = lock_key (key, hash_key (key), 1);
+  if (slot == NULL)
+    return 0;
+  slot->num_certs = 0;
+  for (i = 0; i < length; i++)
+    {
+      digest = certpool_digest_of (certs[i]);
+      fingerprint = certpool_fingerprint (certs[i]);
+      if (digest == NULL || fingerprint == NULL)
+        break;
+      memcpy (slot->certs[i].digest, digest, CERTPOOL_DIGEST_LENGTH);
+      snprintf (slot->certs[i].fingerprint, FPT_LENGTH, "%s", fingerprint);
+    }
+  if (i == length)
+    {
+      slot->start = start;
+      slot->end = end;
+      slot->num_certs = length;
+    }
+  unlock_slot (slot);
+
+  if (i == length)
+    count (&stats.published);
+  return i == length;
+} // shmcache_publish
+
+/**
+ * @brief Claims a host about to be contacted.
+ *
+ * @param key  the canonical key of the host
+ *
+ * @return 1 if claimed, 0 if another caller is contacting it, -1 if
+ *         nothing is shared
+ */
+int
+shmcache_claim (const char *key)
+{
+  struct shm_slot *slot;
+  uint64_t claim, now = (uint32_t) time (NULL);
+  int claimed = -1;
+
+  if (header == NULL)
+    return -1;
+  slot = lock_key (key, hash_key (key), 1);
+  if (slot == NULL)
+    return -1;
+
+  claim = __atomic_load_n (&slot->claim, __ATOMIC_ACQUIRE);
+  if (claim == 0 || process_dead (claim >> 32)
+      || now - (claim & UINT32_MAX) > SHMCACHE_CLAIM_TTL)
+    {
+      if (claim != 0)
+        count (&stats.reclaimed);
+      __atomic_store_n (&slot->claim, self () << 32 | now, __ATOMIC_RELEASE);
+      count (&stats.claims);
+      claimed = 1;
+    }
+  else
+    {
+      count (&stats.busy);
+      claimed = 0;
+    }
+  unlock_slot (slot);
+
+  return claimed;
+} // shmcache_claim
+
+/**
+ * @brief Releases the claim of a host, unless it went to another caller.
+ *
+ * @param key  the canonical key of the host
+ */
+void
+shmcache_release (const char *key)
+{
+  struct shm_slot *slot;
+  uint64_t claim;
+
+  if (header == NULL)
+    return;
+  slot = lock_key (key, hash_key (key), 0);
+  if (slot == NULL)
+    return;
+  claim = __atomic_load_n (&slot->claim, __ATOMIC_RELAXED);
+  if (claim >> 32 == self ())
+    __atomic_store_n (&slot->claim, 0, __ATOMIC_RELEASE);
+  unlock_slot (slot);
+} // shmcache_release
+
+/**
+ * @brief Waits for the observation of a host another caller is contacting.
+ *
+ * @param key         the canonical key of the host
+ * @param timeout_ms  the longest to wait
+ * @param entry       output parameter for the observation
+ *
+ * @return 1 if it was published, 0 otherwise
+ */
+int
+shmcache_wait (const char *key, long timeout_ms,
+               struct shmcache_entry *entry)
+{
+  uint64_t claim;
+  long waited;
+
+  if (header == NULL)
+    return 0;
+  count (&stats.waited);
+  for (waited = 0; waited <= timeout_ms; waited += 5)
+    {
+      if (find (key, entry, &claim))
+        {
+          count (&stats.waited_hits);
+          return 1;
+        }
+      if (claim == 0 || process_dead (claim >> 32))
+        return 0;
+      usleep (5000);
+    }
+  return 0;
+} // shmcache_wait
+
+/**
+ * @brief Copies the counters of the shared table.
+ */
+void
+shmcache_get_stats (struct shmcache_stats *stats_out)
+{
+  unsigned long *from = (unsigned long *) &stats;
+  unsigned long *to = (unsigned long *) stats_out;
+  size_t i;
+
+  for (i = 0; i < sizeof (stats) / sizeof (unsigned long); i++)
+    to[i] = __atomic_load_n (&from[i], __ATOMIC_RELAXED);
+} // shmcache_get_stats
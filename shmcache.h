@@ -0,0 +1,95 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the shared observation table,
+ * through which the notary processes of one machine share what they
+ * observe. The table lives in a file all of them map, best kept under
+ * /dev/shm, and holds the newest observation of up to shmcache_slots
+ * hosts by canonical key, with the digests and fingerprints of the chain,
+ * since IDs differ between processes. Readers never block: every slot is
+ * a seqlock whose writer is recorded, so that a slot left half written by
+ * a process that died is taken over by the next writer. A process about to
+ * contact a host claims it in the table; the others wait for what it
+ * publishes instead of contacting the host too.
+ ******************************************************************************/
+#ifndef SHMCACHE_H
+#define SHMCACHE_H
+
+#include "notary.h"
+#include <time.h>
+
+/* Longest chain shared; longer ones are observed by every process. */
+#define SHMCACHE_MAX_CERTS 6
+
+/* Slots a host may be kept in, from the one its key hashes to. */
+#define SHMCACHE_PROBE 8
+
+/* Seconds after which a claim counts as abandoned even if its process
+ * lives on. */
+#define SHMCACHE_CLAIM_TTL 60
+
+/* An observation found in the table. */
+struct shmcache_entry
+{
+  uint32_t chain;               // the chain, interned in this process
+  time_t start;                 // when the observation started
+  time_t end;                   // and ended
+};
+
+/* Counters of the shared table, for this process. */
+struct shmcache_stats
+{
+  unsigned long hits;           // fresh observations found
+  unsigned long misses;
+  unsigned long published;      // observations written
+  unsigned long too_long;       // chains too long to share
+  unsigned long claims;         // hosts claimed to be contacted
+  unsigned long busy;           // hosts another process was contacting
+  unsigned long waited;         // observations waited for
+  unsigned long waited_hits;    // of those, published in time
+  unsigned long reclaimed;      // slots and claims taken from dead processes
+  unsigned long evictions;      // hosts displaced from the table
+  unsigned long torn;           // reads retried because of a writer
+};
+
+/* Maps the table in a file, creating it with shmcache_slots slots if it
+ * does not exist. Returns 1 on success, 0 if the file cannot be mapped or
+ * holds a table of another size, in which case nothing is shared.
+ */
+int shmcache_open (const char *file_name);
+
+/* Unmaps the table. */
+void shmcache_close (void);
+
+/* Copies the observation of a host, given by its canonical key, into
+ * entry if a fresh one is in the table. Returns 1 if one is, 0 otherwise.
+ */
+int shmcache_lookup (const char *key, struct shmcache_entry *entry);
+
+/* Writes the observation of a host, its chain given by certpool ID, for
+ * the other processes. Returns 1 on success, 0 otherwise.
+ */
+int shmcache_publish (const char *key, uint32_t chain, time_t start,
+                      time_t end);
+
+/* Claims a host about to be contacted. Returns 1 if this caller claimed it
+ * and must call shmcache_release, 0 if another caller, in this process or
+ * another, is contacting it, and -1 if nothing is shared.
+ */
+int shmcache_claim (const char *key);
+
+/* Releases the claim of a host. */
+void shmcache_release (const char *key);
+
+/* Waits up to timeout_ms for an observation of a host claimed by another
+ * caller, copying it into entry. Returns 1 if one was published, 0 if the
+ * claim was released without one or the time ran out.
+ */
+int shmcache_wait (const char *key, long timeout_ms,
+                   struct shmcache_entry *entry);
+
+/* Copies the counters of the shared table into stats. */
+void shmcache_get_stats (struct shmcache_stats *stats);
+
+#endif // SHMCACHE_H
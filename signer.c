@@ -0,0 +1,751 @@
+/** @file
+
+    @brief  Signer: signs verification responses with the notary's private
+            key on a small pool of dedicated threads.
+
+    The key file is read and parsed once when the notary starts. Every signer
+    thread owns a private copy of the key and a digest context, so RSA
+    blinding state is never shared and threads do not contend on it. The
+    signature scheme (RSA, ECDSA P-256 or Ed25519) follows the key type.
+
+    With batching on, a batcher thread collects the responses submitted
+    within a short window, builds a Merkle tree over them and has the root
+    signed once; every response then carries its inclusion proof.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "signer.h"
+#include "response.h"
+#include <sys/time.h>
+#include <errno.h>
+#include <openssl/pem.h>
+
+/* A request to sign a block of data, queued for the signer threads. */
+struct sign_job
+{
+  const unsigned char *data;
+  size_t data_len;
+  unsigned char *signature;
+  size_t signature_len;
+  int status;
+  int done;
+  struct timeval queued;
+  pthread_cond_t done_cond;
+  struct sign_job *next;
+};
+
+/* State kept by every signer thread. */
+struct signer_context
+{
+  pthread_t thread;
+  EVP_PKEY *private_key;
+  EVP_MD_CTX *md_context;
+};
+
+static struct signer_context *contexts = NULL;
+static int number_of_contexts = 0;
+static int number_of_signers = 0;
+
+static struct sign_job *queue_head = NULL;
+static struct sign_job *queue_tail = NULL;
+static bool stopping = false;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static struct signer_stats stats;
+static enum signature_scheme scheme = SCHEME_UNSUPPORTED;
+
+/* A response waiting for its batch to be signed. */
+struct batch_member
+{
+  const unsigned char *data;
+  size_t data_len;
+  struct merkle_proof *proof;
+  int status;
+  int done;
+  pthread_cond_t done_cond;
+  struct batch_member *next;
+};
+
+static struct batch_member *batch_head = NULL;
+static struct batch_member *batch_tail = NULL;
+static size_t batch_size = 0;
+static struct timespec batch_deadline;
+static int batch_window_ms = 0;
+static int batch_max = 0;
+static bool batcher_running = false;
+static bool batcher_stopping = false;
+static pthread_t batcher;
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_cond = PTHREAD_COND_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Computes the number of microseconds elapsed between two times.
+ */
+static unsigned long long
+elapsed_usec (struct timeval *from, struct timeval *to)
+{
+  return (to->tv_sec - from->tv_sec) * 1000000ULL
+    + (to->tv_usec - from->tv_usec);
+} // elapsed_usec
+
+/**
+ * @brief Reads the whole key file into memory.
+ *
+ * @param key_path  location of the PEM encoded private key
+ * @param length    output parameter for the number of bytes read
+ *
+ * @return a newly allocated buffer holding the file, or NULL on failure
+ */
+static char *
+read_key_file (const char *key_path, long *length)
+{
+  FILE *key_file;
+  char *buffer;
+
+  key_file = fopen (key_path, "r");
+  if (key_file == NULL)
+    {
+      fprintf (stderr, "Could not open %s for reading.\n", key_path);
+      return NULL;
+    }
+
+  fseek (key_file, 0, SEEK_END);
+  *length = ftell (key_file);
+  rewind (key_file);
+
+  buffer = malloc (*length + 1);
+  if (buffer == NULL || fread (buffer, 1, *length, key_file) != *length)
+    {
+      fprintf (stderr, "Could not read %s.\n", key_path);
+      free (buffer);
+      fclose (key_file);
+      return NULL;
+    }
+
+  fclose (key_file);
+  return buffer;
+} // read_key_file
+
+/**
+ * @brief Parses a private key out of an in-memory PEM buffer. OpenSSL keeps
+ *        blinding on for RSA keys, and the blinding state lives in the key.
+ *
+ * @return the parsed key, or NULL on failure
+ */
+static EVP_PKEY *
+parse_private_key (char *pem, long length)
+{
+  BIO *bio_buffer;
+  EVP_PKEY *private_key;
+
+  bio_buffer = BIO_new_mem_buf (pem, length);
+  if (bio_buffer == NULL)
+    return NULL;
+
+  private_key = PEM_read_bio_PrivateKey (bio_buffer, NULL, NULL, NULL);
+  BIO_free (bio_buffer);
+
+  return private_key;
+} // parse_private_key
+
+/**
+ * @brief The body of every signer thread. Takes jobs off the queue and signs
+ *        them with the thread's own copy of the key.
+ *
+ * @param arg  the signer_context of this thread
+ */
+static void *
+signer_thread (void *arg)
+{
+  struct signer_context *context = arg;
+  struct sign_job *job;
+  struct timeval started, finished;
+  unsigned long long wait_time, sign_time;
+
+  pthread_mutex_lock (&queue_lock);
+  while (true)
+    {
+      while (queue_head == NULL && !stopping)
+        pthread_cond_wait (&queue_cond, &queue_lock);
+
+      if (queue_head == NULL)
+        break;
+
+      job = queue_head;
+      queue_head = job->next;
+      if (queue_head == NULL)
+        queue_tail = NULL;
+      pthread_mutex_unlock (&queue_lock);
+
+      gettimeofday (&started, NULL);
+      job->signature_len = EVP_PKEY_size (context->private_key);
+      job->signature = malloc (job->signature_len);
+      if (job->signature != NULL)
+        job->status = generate_signature ((unsigned char *) job->data,
+                                          job->data_len, job->signature,
+                                          &job->signature_len,
+                                          context->private_key,
+                                          signature_scheme_digest (scheme),
+                                          context->md_context);
+      gettimeofday (&finished, NULL);
+
+      wait_time = elapsed_usec (&job->queued, &started);
+      sign_time = elapsed_usec (&started, &finished);
+
+      pthread_mutex_lock (&queue_lock);
+      if (job->status == 1)
+        stats.signatures++;
+      else
+        stats.failures++;
+      stats.total_wait += wait_time;
+      stats.total_sign += sign_time;
+      if (sign_time > stats.max_sign)
+        stats.max_sign = sign_time;
+
+      job->done = 1;
+      pthread_cond_signal (&job->done_cond);
+    }
+  pthread_mutex_unlock (&queue_lock);
+
+  return NULL;
+} // signer_thread
+
+/**
+ * @brief Builds the Merkle tree over a batch, signs its root and fills in the
+ *        proof of every member.
+ *
+ * @param members      the batch, linked through next
+ * @param num_members  number of members in the batch
+ */
+static void
+sign_batch (struct batch_member *members, size_t num_members)
+{
+  unsigned char (*leaf_hashes)[MERKLE_HASH_LENGTH];
+  unsigned char root[MERKLE_HASH_LENGTH];
+  unsigned char *signature = NULL;
+  size_t signature_len = 0;
+  struct batch_member *member;
+  int signed_root;
+  size_t i;
+
+  leaf_hashes = malloc (num_members * MERKLE_HASH_LENGTH);
+  if (leaf_hashes == NULL)
+    return;
+
+  for (member = members, i = 0; member != NULL; member = member->next, i++)
+    merkle_leaf_hash (member->data, member->data_len, leaf_hashes[i]);
+
+  merkle_root (leaf_hashes, num_members, root);
+  signed_root = signer_sign (root, MERKLE_HASH_LENGTH, &signature,
+                             &signature_len);
+
+  for (member = members, i = 0; signed_root && member != NULL;
+       member = member->next, i++)
+    {
+      struct merkle_proof *proof = member->proof;
+
+      proof->index = i;
+      proof->tree_size = num_members;
+      memcpy (proof->root, root, MERKLE_HASH_LENGTH);
+      merkle_audit_path (leaf_hashes, num_members, i, proof->path,
+                         &proof->path_length);
+      proof->signature = malloc (signature_len);
+      if (proof->signature == NULL)
+        continue;
+      memcpy (proof->signature, signature, signature_len);
+      proof->signature_len = signature_len;
+      member->status = 1;
+    }
+
+  free (signature);
+  free (leaf_hashes);
+} // sign_batch
+
+/**
+ * @brief Opens the window of the next batch, which closes batch_window_ms
+ *        from now. Called with batch_lock held.
+ */
+static void
+open_window ()
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  batch_deadline.tv_sec = now.tv_sec + batch_window_ms / 1000;
+  batch_deadline.tv_nsec = now.tv_usec * 1000
+    + (batch_window_ms % 1000) * 1000000L;
+  if (batch_deadline.tv_nsec >= 1000000000L)
+    {
+      batch_deadline.tv_sec++;
+      batch_deadline.tv_nsec -= 1000000000L;
+    }
+} // open_window
+
+/**
+ * @brief The body of the batcher thread. Waits for the first response of a
+ *        batch, collects more until the window closes or the batch is full,
+ *        and signs the batch.
+ */
+static void *
+batcher_thread (void *arg)
+{
+  struct batch_member *members, *member, *next;
+  size_t num_members;
+
+  pthread_mutex_lock (&batch_lock);
+  while (true)
+    {
+      while (batch_head == NULL && !batcher_stopping)
+        pthread_cond_wait (&batch_cond, &batch_lock);
+
+      if (batch_head == NULL)
+        break;
+
+      while (batch_size < batch_max && !batcher_stopping)
+        if (pthread_cond_timedwait (&batch_cond, &batch_lock,
+                                    &batch_deadline) == ETIMEDOUT)
+          break;
+
+      /* Take at most batch_max responses; later ones open the next batch,
+       * whose window starts now. */
+      members = batch_head;
+      for (member = members, num_members = 1; num_members < batch_max
+             && member->next != NULL; member = member->next)
+        num_members++;
+      batch_head = member->next;
+      member->next = NULL;
+      if (batch_head == NULL)
+        batch_tail = NULL;
+      else
+        open_window ();
+      batch_size -= num_members;
+      pthread_mutex_unlock (&batch_lock);
+
+      sign_batch (members, num_members);
+
+      pthread_mutex_lock (&queue_lock);
+      stats.batches++;
+      stats.batched += num_members;
+      pthread_mutex_unlock (&queue_lock);
+
+      pthread_mutex_lock (&batch_lock);
+      for (member = members; member != NULL; member = next)
+        {
+          next = member->next;
+          member->done = 1;
+          pthread_cond_signal (&member->done_cond);
+        }
+    }
+  pthread_mutex_unlock (&batch_lock);
+
+  return NULL;
+} // batcher_thread
+
+/**
+ * @brief Stops the batcher thread, signing whatever batch is still open.
+ */
+static void
+stop_batching ()
+{
+  pthread_mutex_lock (&batch_lock);
+  if (!batcher_running)
+    {
+      pthread_mutex_unlock (&batch_lock);
+      return;
+    }
+  batcher_stopping = true;
+  pthread_cond_broadcast (&batch_cond);
+  pthread_mutex_unlock (&batch_lock);
+
+  pthread_join (batcher, NULL);
+
+  pthread_mutex_lock (&batch_lock);
+  batcher_running = false;
+  batcher_stopping = false;
+  pthread_mutex_unlock (&batch_lock);
+} // stop_batching
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Determines which signature scheme a private key signs with.
+ *
+ * @param key  the private key
+ *
+ * @return the scheme, or SCHEME_UNSUPPORTED for other key types and curves
+ */
+enum signature_scheme
+signature_scheme_of (EVP_PKEY *key)
+{
+  switch (EVP_PKEY_base_id (key))
+    {
+    case EVP_PKEY_RSA:
+      return SCHEME_RSA_SHA1;
+    case EVP_PKEY_ED25519:
+      return SCHEME_ED25519;
+    case EVP_PKEY_EC:
+      {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        char curve[64];
+
+        if (EVP_PKEY_get_group_name (key, curve, sizeof (curve), NULL)
+            && (strcmp (curve, "prime256v1") == 0
+                || strcmp (curve, "P-256") == 0))
+          return SCHEME_ECDSA_P256_SHA256;
+#else
+        const EC_GROUP *group = EC_KEY_get0_group (EVP_PKEY_get0_EC_KEY (key));
+
+        if (group != NULL
+            && EC_GROUP_get_curve_name (group) == NID_X9_62_prime256v1)
+          return SCHEME_ECDSA_P256_SHA256;
+#endif
+        return SCHEME_UNSUPPORTED;
+      }
+    default:
+      return SCHEME_UNSUPPORTED;
+    }
+} // signature_scheme_of
+
+/**
+ * @brief Returns the digest a scheme signs over.
+ *
+ * @return the digest, or NULL if the scheme hashes the message itself
+ */
+const EVP_MD *
+signature_scheme_digest (enum signature_scheme scheme)
+{
+  switch (scheme)
+    {
+    case SCHEME_RSA_SHA1:
+      return EVP_sha1 ();
+    case SCHEME_ECDSA_P256_SHA256:
+      return EVP_sha256 ();
+    default:
+      return NULL;
+    }
+} // signature_scheme_digest
+
+/**
+ * @brief Returns a printable name of a signature scheme.
+ */
+const char *
+signature_scheme_name (enum signature_scheme scheme)
+{
+  switch (scheme)
+    {
+    case SCHEME_RSA_SHA1:
+      return "rsa-sha1";
+    case SCHEME_ECDSA_P256_SHA256:
+      return "ecdsa-p256-sha256";
+    case SCHEME_ED25519:
+      return "ed25519";
+    default:
+      return "unsupported";
+    }
+} // signature_scheme_name
+
+/**
+ * @brief Loads the private key once and starts the signer threads.
+ *
+ * @param key_path     location of the PEM encoded private key
+ * @param num_threads  the number of signer threads to start
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+signer_init (const char *key_path, int num_threads)
+{
+  char *pem;
+  long length;
+  int i;
+
+  if (num_threads < 1)
+    num_threads = DEFAULT_SIGNER_THREADS;
+
+  pem = read_key_file (key_path, &length);
+  if (pem == NULL)
+    return 0;
+
+  contexts = calloc (num_threads, sizeof (struct signer_context));
+  if (contexts == NULL)
+    {
+      OPENSSL_cleanse (pem, length);
+      free (pem);
+      return 0;
+    }
+
+  /* Every thread parses its own copy so no key state is shared. */
+  for (i = 0; i < num_threads; i++)
+    {
+      contexts[i].private_key = parse_private_key (pem, length);
+      if (contexts[i].private_key == NULL)
+        {
+          fprintf (stderr, "Could not parse the private key in %s.\n",
+                   key_path);
+          break;
+        }
+
+      contexts[i].md_context = EVP_MD_CTX_new ();
+      if (contexts[i].md_context == NULL)
+        {
+          EVP_PKEY_free (contexts[i].private_key);
+          break;
+        }
+    }
+
+  /* The key stays in memory only in parsed form. */
+  OPENSSL_cleanse (pem, length);
+  free (pem);
+
+  number_of_contexts = i;
+  if (i < num_threads)
+    {
+      signer_shutdown ();
+      return 0;
+    }
+
+  scheme = signature_scheme_of (contexts[0].private_key);
+  if (scheme == SCHEME_UNSUPPORTED)
+    {
+      fprintf (stderr, "The key in %s is not an RSA, ECDSA P-256 or Ed25519 "
+               "key.\n", key_path);
+      signer_shutdown ();
+      return 0;
+    }
+
+  stopping = false;
+  for (number_of_signers = 0; number_of_signers < num_threads;
+       number_of_signers++)
+    {
+      if (pthread_create (&contexts[number_of_signers].thread, NULL,
+                          signer_thread, &contexts[number_of_signers]) != 0)
+        {
+          fprintf (stderr, "Could not start a signer thread.\n");
+          signer_shutdown ();
+          return 0;
+        }
+    }
+
+  return 1;
+} // signer_init
+
+/**
+ * @brief Stops the signer threads and frees their keys.
+ */
+void
+signer_shutdown ()
+{
+  int i;
+
+  /* The batcher needs the signer threads to sign its last batch. */
+  stop_batching ();
+
+  pthread_mutex_lock (&queue_lock);
+  stopping = true;
+  pthread_cond_broadcast (&queue_cond);
+  pthread_mutex_unlock (&queue_lock);
+
+  for (i = 0; i < number_of_signers; i++)
+    pthread_join (contexts[i].thread, NULL);
+
+  for (i = 0; i < number_of_contexts; i++)
+    {
+      EVP_MD_CTX_free (contexts[i].md_context);
+      EVP_PKEY_free (contexts[i].private_key);
+    }
+  free (contexts);
+
+  contexts = NULL;
+  number_of_contexts = 0;
+  number_of_signers = 0;
+  scheme = SCHEME_UNSUPPORTED;
+} // signer_shutdown
+
+/**
+ * @brief Signs a block of data on one of the signer threads and waits for
+ *        the result.
+ *
+ * @param data           the data to sign
+ * @param data_len       the number of bytes in data
+ * @param signature      output parameter for the newly allocated signature
+ * @param signature_len  output parameter for the length of the signature
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+signer_sign (const unsigned char *data, size_t data_len,
+             unsigned char **signature, size_t *signature_len)
+{
+  struct sign_job job;
+
+  memset (&job, 0, sizeof (job));
+  job.data = data;
+  job.data_len = data_len;
+  pthread_cond_init (&job.done_cond, NULL);
+  gettimeofday (&job.queued, NULL);
+
+  pthread_mutex_lock (&queue_lock);
+  if (number_of_signers == 0 || stopping)
+    {
+      pthread_mutex_unlock (&queue_lock);
+      pthread_cond_destroy (&job.done_cond);
+      return 0;
+    }
+
+  if (queue_tail == NULL)
+    queue_head = &job;
+  else
+    queue_tail->next = &job;
+  queue_tail = &job;
+  pthread_cond_signal (&queue_cond);
+
+  while (!job.done)
+    pthread_cond_wait (&job.done_cond, &queue_lock);
+  pthread_mutex_unlock (&queue_lock);
+
+  pthread_cond_destroy (&job.done_cond);
+
+  if (job.status != 1)
+    {
+      free (job.signature);
+      return 0;
+    }
+
+  *signature = job.signature;
+  *signature_len = job.signature_len;
+  return 1;
+} // signer_sign
+
+/**
+ * @brief Turns on Merkle batch signing and starts the batcher thread.
+ *
+ * @param window_ms  how long to collect responses for after the first one
+ * @param max_batch  sign the batch as soon as it holds this many responses
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+signer_enable_batching (int window_ms, int max_batch)
+{
+  if (window_ms < 0 || max_batch < 1
+      || (unsigned long) max_batch > (1UL << (MERKLE_MAX_DEPTH - 1)))
+    return 0;
+
+  stop_batching ();
+
+  pthread_mutex_lock (&batch_lock);
+  batch_window_ms = window_ms;
+  batch_max = max_batch;
+  if (pthread_create (&batcher, NULL, batcher_thread, NULL) != 0)
+    {
+      pthread_mutex_unlock (&batch_lock);
+      fprintf (stderr, "Could not start the batcher thread.\n");
+      return 0;
+    }
+  batcher_running = true;
+  pthread_mutex_unlock (&batch_lock);
+
+  return 1;
+} // signer_enable_batching
+
+/**
+ * @brief Returns true if Merkle batch signing is on.
+ */
+bool
+signer_batching_enabled ()
+{
+  bool running;
+
+  pthread_mutex_lock (&batch_lock);
+  running = batcher_running && !batcher_stopping;
+  pthread_mutex_unlock (&batch_lock);
+
+  return running;
+} // signer_batching_enabled
+
+/**
+ * @brief Adds a response to the current batch and waits for the batch to be
+ *        signed.
+ *
+ * @param data      the data to sign
+ * @param data_len  the number of bytes in data
+ * @param proof     output parameter for the inclusion proof
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+signer_sign_batched (const unsigned char *data, size_t data_len,
+                     struct merkle_proof *proof)
+{
+  struct batch_member member;
+
+  memset (&member, 0, sizeof (member));
+  memset (proof, 0, sizeof (*proof));
+  member.data = data;
+  member.data_len = data_len;
+  member.proof = proof;
+  pthread_cond_init (&member.done_cond, NULL);
+
+  pthread_mutex_lock (&batch_lock);
+  if (!batcher_running || batcher_stopping)
+    {
+      pthread_mutex_unlock (&batch_lock);
+      pthread_cond_destroy (&member.done_cond);
+      return 0;
+    }
+
+  /* The first response of a batch opens its window. */
+  if (batch_head == NULL)
+    {
+      open_window ();
+      batch_head = &member;
+    }
+  else
+    batch_tail->next = &member;
+  batch_tail = &member;
+  batch_size++;
+
+  if (batch_size == 1 || batch_size >= batch_max)
+    pthread_cond_signal (&batch_cond);
+
+  while (!member.done)
+    pthread_cond_wait (&member.done_cond, &batch_lock);
+  pthread_mutex_unlock (&batch_lock);
+
+  pthread_cond_destroy (&member.done_cond);
+  return member.status;
+} // signer_sign_batched
+
+/**
+ * @brief Returns the scheme of the loaded key.
+ */
+enum signature_scheme
+signer_scheme ()
+{
+  return scheme;
+} // signer_scheme
+
+/**
+ * @brief Copies the current latency figures of the signer pool.
+ *
+ * @param stats_out  output parameter for the figures
+ */
+void
+signer_get_stats (struct signer_stats *stats_out)
+{
+  pthread_mutex_lock (&queue_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&queue_lock);
+} // signer_get_stats
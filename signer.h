@@ -0,0 +1,95 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the signer pool, which signs
+ * verification responses with the notary's private key. The key is parsed
+ * once at startup and every signer thread keeps its own copy of it.
+ ******************************************************************************/
+#ifndef SIGNER_H
+#define SIGNER_H
+
+#include "notary.h"
+#include "merkle.h"
+#include <pthread.h>
+#include <openssl/evp.h>
+
+/* The number of signer threads started when none is requested. */
+#define DEFAULT_SIGNER_THREADS 2
+
+/* Signature schemes the notary can sign with. The scheme is picked from the
+ * type of the key the notary is configured with. */
+enum signature_scheme
+  {
+    SCHEME_UNSUPPORTED = 0,
+    SCHEME_RSA_SHA1 = 1,        // RSA PKCS#1 v1.5 over SHA-1, as in the protocol
+    SCHEME_ECDSA_P256_SHA256 = 2,
+    SCHEME_ED25519 = 3
+  };
+
+/* Latency figures collected by the signer pool. Times are in microseconds. */
+struct signer_stats
+{
+  unsigned long signatures;     // signatures produced
+  unsigned long failures;       // signing attempts that failed
+  unsigned long long total_wait; // time jobs spent queued
+  unsigned long long total_sign; // time spent in the private key operation
+  unsigned long long max_sign;   // slowest private key operation
+  unsigned long batches;        // Merkle batches signed
+  unsigned long batched;        // responses covered by those batches
+};
+
+/* Determines which signature scheme a private key signs with. Returns
+ * SCHEME_UNSUPPORTED for key types the notary cannot use.
+ */
+enum signature_scheme signature_scheme_of (EVP_PKEY *key);
+
+/* Returns the digest a scheme signs over, or NULL for schemes such as Ed25519
+ * which hash the message themselves.
+ */
+const EVP_MD *signature_scheme_digest (enum signature_scheme scheme);
+
+/* Returns a printable name of a signature scheme. */
+const char *signature_scheme_name (enum signature_scheme scheme);
+
+/* Reads the private key from key_path and starts num_threads signer threads,
+ * each with its own parsed copy of the key and its own blinding state.
+ * RSA, ECDSA P-256 and Ed25519 keys are supported.
+ * Returns 1 on success, 0 otherwise.
+ */
+int signer_init (const char *key_path, int num_threads);
+
+/* Stops the signer threads and frees their keys. */
+void signer_shutdown ();
+
+/* Signs data_len bytes of data on one of the signer threads. On success
+ * *signature points to a newly allocated buffer of *signature_len bytes
+ * which the caller must free. Returns 1 on success, 0 otherwise.
+ */
+int signer_sign (const unsigned char *data, size_t data_len,
+                 unsigned char **signature, size_t *signature_len);
+
+/* Turns on Merkle batch signing: responses submitted with signer_sign_batched
+ * within window_ms of each other, up to max_batch of them, are signed with a
+ * single signature of the root of a tree over them. Returns 1 on success,
+ * 0 otherwise.
+ */
+int signer_enable_batching (int window_ms, int max_batch);
+
+/* Returns true if Merkle batch signing is on. */
+bool signer_batching_enabled ();
+
+/* Adds data_len bytes of data to the current batch and waits for the batch
+ * to be signed. On success fills in proof, whose signature the caller must
+ * free. Returns 1 on success, 0 otherwise.
+ */
+int signer_sign_batched (const unsigned char *data, size_t data_len,
+                         struct merkle_proof *proof);
+
+/* Returns the scheme of the loaded key. */
+enum signature_scheme signer_scheme ();
+
+/* Copies the current latency figures into stats. */
+void signer_get_stats (struct signer_stats *stats);
+
+#endif // SIGNER_H
@@ -0,0 +1,864 @@
+/** @file
+
+    @brief  Snapshot: writes the histories of all hosts to a file, and on
+            startup maps that file, restoring hosts from it as they are
+            asked about and all of them in the background.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "snapshot.h"
+#include "certpool.h"
+#include "deadline.h"
+#include "history.h"
+#include "hostkey.h"
+#include "config.h"
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+
+/* Identifies snapshot files, and the version of their layout. */
+#define SNAPSHOT_MAGIC "NOTSNAP1"
+#define SNAPSHOT_VERSION 1
+
+/* The sections of a snapshot, each starting at a multiple of 8 bytes. */
+enum section
+  {
+    SECTION_CERTS = 0,          // struct file_cert, from ID 0
+    SECTION_CHAIN_INDEX = 1,    // where the certificates of a chain start
+    SECTION_CHAIN_CERTS = 2,    // the certificates of all chains
+    SECTION_HOSTS = 3,          // struct file_host
+    SECTION_RUNS = 4,           // struct history_run, with file chain IDs
+    SECTION_BUCKETS = 5,        // first host of every bucket, plus one
+    SECTION_KEYS = 6,           // canonical keys, each ending with a NUL
+    SECTIONS = 7
+  };
+
+/* The start of a snapshot. */
+struct file_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t fingerprint_length;
+  uint64_t written;             // when, in seconds since the epoch
+  uint32_t num_certs;           // highest certificate ID
+  uint32_t num_chains;          // highest chain ID
+  uint32_t num_chain_certs;
+  uint32_t num_hosts;
+  uint32_t num_runs;
+  uint32_t num_buckets;         // a power of two
+  uint64_t keys_length;
+  uint64_t offsets[SECTIONS];
+  uint64_t size;                // of the whole file
+};
+
+/* A certificate; an ID that was not in use has an empty fingerprint. */
+struct file_cert
+{
+  unsigned char digest[CERTPOOL_DIGEST_LENGTH];
+  char fingerprint[FPT_LENGTH];
+};
+
+/* A host and its runs. */
+struct file_host
+{
+  uint64_t hash;                // of its key
+  uint32_t key;                 // offset of its key
+  uint32_t first_run;
+  uint32_t num_runs;
+  uint32_t next;                // next host of its bucket, plus one
+};
+
+/* The mapped snapshot, and the IDs its certificates and chains have been
+ * given so far. */
+static struct
+{
+  unsigned char *base;
+  size_t size;
+  const struct file_header *header;
+  const struct file_cert *certs;
+  const uint32_t *chain_index;
+  const uint32_t *chain_certs;
+  const struct file_host *hosts;
+  const struct history_run *runs;
+  const uint32_t *buckets;
+  const char *keys;
+  uint32_t *cert_ids;
+  uint32_t *chain_ids;
+  unsigned char *restored;      // whether each host was restored
+} mapped;
+
+static int is_mapped = 0;
+static pthread_rwlock_t map_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct snapshot_stats stats;
+static long long rebuild_started_ms;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rebuilt = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The periodic writer. */
+static pthread_t writer;
+static int writer_running = 0, writer_stop = 0, writer_interval_s;
+static char *writer_file = NULL;
+static pthread_cond_t writer_wake = PTHREAD_COND_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Hashes a canonical key with 64 bit FNV-1a.
+ */
+static uint64_t
+hash_key (const char *key)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  while (*key != '\0')
+    {
+      hash ^= (unsigned char) *key++;
+      hash *= 1099511628211ULL;
+    }
+  return hash;
+} // hash_key
+
+/**
+ * @brief Returns the length of a section of a snapshot.
+ */
+static uint64_t
+section_length (const struct file_header *header, int section)
+{
+  switch (section)
+    {
+    case SECTION_CERTS:
+      return ((uint64_t) header->num_certs + 1) * sizeof (struct file_cert);
+    case SECTION_CHAIN_INDEX:
+      return ((uint64_t) header->num_chains + 2) * sizeof (uint32_t);
+    case SECTION_CHAIN_CERTS:
+      return (uint64_t) header->num_chain_certs * sizeof (uint32_t);
+    case SECTION_HOSTS:
+      return (uint64_t) header->num_hosts * sizeof (struct file_host);
+    case SECTION_RUNS:
+      return (uint64_t) header->num_runs * sizeof (struct history_run);
+    case SECTION_BUCKETS:
+      return (uint64_t) header->num_buckets * sizeof (uint32_t);
+    default:
+      return header->keys_length;
+    }
+} // section_length
+
+/**
+ * @brief Checks that a snapshot is one this notary wrote and that its
+ *        sections lie within it.
+ *
+ * @return 1 if it is valid, 0 otherwise
+ */
+static int
+check_header (const struct file_header *header, size_t size)
+{
+  int s;
+
+  if (size < sizeof (*header)
+      || memcmp (header->magic, SNAPSHOT_MAGIC, sizeof (header->magic)) != 0
+      || header->version != SNAPSHOT_VERSION
+      || header->fingerprint_length != FPT_LENGTH
+      || header->size != size
+      || header->num_buckets == 0
+      || (header->num_buckets & (header->num_buckets - 1)) != 0
+      || header->keys_length >= UINT32_MAX)
+    return 0;
+
+  for (s = 0; s < SECTIONS; s++)
+    if (header->offsets[s] % 8 != 0
+        || header->offsets[s] < sizeof (*header)
+        || header->offsets[s] > size
+        || section_length (header, s) > size - header->offsets[s])
+      return 0;
+  return 1;
+} // check_header
+
+/**
+ * @brief Returns the key of a host of the mapped snapshot.
+ *
+ * @return the key, or NULL if it does not lie within the snapshot
+ */
+static const char *
+key_of (const struct file_host *host)
+{
+  uint64_t length = mapped.header->keys_length;
+
+  if (host->key >= length
+      || memchr (mapped.keys + host->key, '\0', length - host->key) == NULL)
+    return NULL;
+  return mapped.keys + host->key;
+} // key_of
+
+/**
+ * @brief Finds a host in the mapped snapshot by its key.
+ *
+ * @return the index of the host, or -1 if it is not there
+ */
+static long
+find_host (const char *key)
+{
+  uint64_t hash = hash_key (key);
+  uint32_t h, steps = 0;
+  const char *host_key;
+
+  h = mapped.buckets[hash & (mapped.header->num_buckets - 1)];
+  while (h != 0 && h <= mapped.header->num_hosts
+         && steps++ < mapped.header->num_hosts)
+    {
+      if (mapped.hosts[h - 1].hash == hash
+          && (host_key = key_of (&mapped.hosts[h - 1])) != NULL
+          && strcmp (host_key, key) == 0)
+        return h - 1;
+      h = mapped.hosts[h - 1].next;
+    }
+  return -1;
+} // find_host
+
+/**
+ * @brief Returns the live ID of a certificate of the mapped snapshot,
+ *        interning it the first time.
+ *
+ * @return the ID, or CERTPOOL_NONE if it is not valid or the pool is full
+ */
+static uint32_t
+cert_id (uint32_t cert)
+{
+  const struct file_cert *entry;
+  uint32_t id;
+
+  if (cert == 0 || cert > mapped.header->num_certs)
+    return CERTPOOL_NONE;
+  id = __atomic_load_n (&mapped.cert_ids[cert], __ATOMIC_RELAXED);
+  if (id != CERTPOOL_NONE)
+    return id;
+
+  entry = &mapped.certs[cert];
+  if (entry->fingerprint[0] == '\0'
+      || entry->fingerprint[FPT_LENGTH - 1] != '\0')
+    return CERTPOOL_NONE;
+  id = certpool_intern (entry->digest, entry->fingerprint);
+  __atomic_store_n (&mapped.cert_ids[cert], id, __ATOMIC_RELAXED);
+  return id;
+} // cert_id
+
+/**
+ * @brief Returns the live ID of a chain of the mapped snapshot, interning
+ *        it and its certificates the first time.
+ *
+ * @return the ID, or CERTPOOL_NONE if it is not valid or the pool is full
+ */
+static uint32_t
+chain_id (uint32_t chain)
+{
+  uint32_t id, first, end, i, *ids;
+
+  if (chain == 0 || chain > mapped.header->num_chains)
+    return CERTPOOL_NONE;
+  id = __atomic_load_n (&mapped.chain_ids[chain], __ATOMIC_RELAXED);
+  if (id != CERTPOOL_NONE)
+    return id;
+
+  first = mapped.chain_index[chain];
+  end = mapped.chain_index[chain + 1];
+  if (first >= end || end > mapped.header->num_chain_certs
+      || (ids = malloc ((end - first) * sizeof (uint32_t))) == NULL)
+    return CERTPOOL_NONE;
+
+  for (i = first; i < end; i++)
+    if ((ids[i - first] = cert_id (mapped.chain_certs[i])) == CERTPOOL_NONE)
+      break;
+  if (i == end)
+    id = certpool_chain (ids, end - first);
+  free (ids);
+
+  __atomic_store_n (&mapped.chain_ids[chain], id, __ATOMIC_RELAXED);
+  return id;
+} // chain_id
+
+/**
+ * @brief Restores the history of a host of the mapped snapshot, once.
+ *        Called with the mapping held.
+ *
+ * @return 1 if it was restored, 0 otherwise
+ */
+static int
+restore_host (uint32_t h, uint32_t id)
+{
+  const struct file_host *host = &mapped.hosts[h];
+  struct history_run *runs;
+  uint32_t i, kept = 0;
+  int restored;
+
+  if (__atomic_exchange_n (&mapped.restored[h], 1, __ATOMIC_ACQ_REL)
+      || host->num_runs == 0
+      || host->first_run > mapped.header->num_runs
+      || host->num_runs > mapped.header->num_runs - host->first_run
+      || (runs = malloc (host->num_runs * sizeof (*runs))) == NULL)
+    return 0;
+
+  for (i = 0; i < host->num_runs; i++)
+    {
+      runs[kept] = mapped.runs[host->first_run + i];
+      runs[kept].chain = chain_id (runs[kept].chain);
+      if (runs[kept].chain != CERTPOOL_NONE)
+        kept++;
+    }
+
+  restored = kept > 0 && history_restore (id, runs, kept);
+  free (runs);
+  if (restored)
+    __atomic_add_fetch (&stats.restored, 1, __ATOMIC_RELAXED);
+  return restored;
+} // restore_host
+
+/**
+ * @brief Unmaps the snapshot and frees what mapping it needed.
+ */
+static void
+unmap ()
+{
+  pthread_rwlock_wrlock (&map_lock);
+  __atomic_store_n (&is_mapped, 0, __ATOMIC_RELEASE);
+  munmap (mapped.base, mapped.size);
+  free (mapped.cert_ids);
+  free (mapped.chain_ids);
+  free (mapped.restored);
+  memset (&mapped, 0, sizeof (mapped));
+  pthread_rwlock_unlock (&map_lock);
+} // unmap
+
+/**
+ * @brief The rebuilding thread: restores every host of the mapped snapshot
+ *        not restored yet, then unmaps it.
+ */
+static void *
+rebuild_thread (void *arg)
+{
+  const char *key;
+  uint32_t h, id;
+
+  (void) arg;
+  /* Only this thread unmaps, so it reads the mapping without the lock. */
+  for (h = 0; h < mapped.header->num_hosts; h++)
+    {
+      if (__atomic_load_n (&mapped.restored[h], __ATOMIC_ACQUIRE)
+          || (key = key_of (&mapped.hosts[h])) == NULL)
+        continue;
+      id = hostkey_intern (key);
+      if (id != HOSTKEY_NONE)
+        restore_host (h, id);
+    }
+  unmap ();
+
+  pthread_mutex_lock (&snapshot_lock);
+  stats.rebuild_ms = deadline_now_ms () - rebuild_started_ms;
+  stats.rebuilding = 0;
+  pthread_cond_broadcast (&rebuilt);
+  pthread_mutex_unlock (&snapshot_lock);
+  return NULL;
+} // rebuild_thread
+
+/**
+ * @brief Writes zeros up to an offset of a snapshot being written.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+static int
+pad_to (FILE *file, uint64_t *position, uint64_t offset)
+{
+  static const char zeros[8];
+
+  if (offset - *position > sizeof (zeros)
+      || fwrite (zeros, 1, offset - *position, file) != offset - *position)
+    return 0;
+  *position = offset;
+  return 1;
+} // pad_to
+
+/**
+ * @brief Writes a section of a snapshot being written.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+static int
+write_section (FILE *file, uint64_t *position, const struct file_header *header,
+               int section, const void *data)
+{
+  uint64_t length = section_length (header, section);
+
+  if (!pad_to (file, position, header->offsets[section])
+      || (length > 0 && fwrite (data, 1, length, file) != length))
+    return 0;
+  *position += length;
+  return 1;
+} // write_section
+
+/**
+ * @brief The periodic writer: writes a snapshot every interval until
+ *        stopped.
+ */
+static void *
+writer_loop (void *arg)
+{
+  struct timespec wake;
+
+  (void) arg;
+  pthread_mutex_lock (&snapshot_lock);
+  while (!writer_stop)
+    {
+      clock_gettime (CLOCK_REALTIME, &wake);
+      wake.tv_sec += writer_interval_s;
+      while (!writer_stop
+             && pthread_cond_timedwait (&writer_wake, &snapshot_lock, &wake)
+                != ETIMEDOUT)
+        ;
+      if (writer_stop)
+        break;
+
+      pthread_mutex_unlock (&snapshot_lock);
+      snapshot_write (writer_file);
+      pthread_mutex_lock (&snapshot_lock);
+    }
+  pthread_mutex_unlock (&snapshot_lock);
+  return NULL;
+} // writer_loop
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Maps a snapshot, checks it and starts restoring its hosts in the
+ *        background.
+ *
+ * @param file_name  the snapshot
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+snapshot_open (const char *file_name)
+{
+  long long start = deadline_now_ms ();
+  const struct file_header *header;
+  pthread_attr_t attributes;
+  pthread_t thread;
+  struct stat status;
+  void *base;
+  int fd;
+
+  if (__atomic_load_n (&is_mapped, __ATOMIC_ACQUIRE))
+    return 0;
+
+  fd = open (file_name, O_RDONLY);
+  if (fd < 0)
+    {
+      if (errno != ENOENT)
+        fprintf (stderr, "Could not open %s: %s\n", file_name,
+                 strerror (errno));
+      return 0;
+    }
+  if (fstat (fd, &status) != 0 || status.st_size < (off_t) sizeof (*header))
+    {
+      fprintf (stderr, "%s is not a snapshot\n", file_name);
+      close (fd);
+      return 0;
+    }
+
+  base = mmap (NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+    {
+      fprintf (stderr, "Could not map %s: %s\n", file_name, strerror (errno));
+      return 0;
+    }
+  header = base;
+  if (!check_header (header, status.st_size))
+    {
+      fprintf (stderr, "%s is not a valid snapshot\n", file_name);
+      munmap (base, status.st_size);
+      return 0;
+    }
+
+  mapped.base = base;
+  mapped.size = status.st_size;
+  mapped.header = header;
+  mapped.certs = (void *) (mapped.base + header->offsets[SECTION_CERTS]);
+  mapped.chain_index =
+    (void *) (mapped.base + header->offsets[SECTION_CHAIN_INDEX]);
+  mapped.chain_certs =
+    (void *) (mapped.base + header->offsets[SECTION_CHAIN_CERTS]);
+  mapped.hosts = (void *) (mapped.base + header->offsets[SECTION_HOSTS]);
+  mapped.runs = (void *) (mapped.base + header->offsets[SECTION_RUNS]);
+  mapped.buckets = (void *) (mapped.base + header->offsets[SECTION_BUCKETS]);
+  mapped.keys = (void *) (mapped.base + header->offsets[SECTION_KEYS]);
+  mapped.cert_ids = calloc ((size_t) header->num_certs + 1, sizeof (uint32_t));
+  mapped.chain_ids = calloc ((size_t) header->num_chains + 1,
+                             sizeof (uint32_t));
+  mapped.restored = calloc ((size_t) header->num_hosts + 1, 1);
+  if (mapped.cert_ids == NULL || mapped.chain_ids == NULL
+      || mapped.restored == NULL)
+    {
+      fprintf (stderr, "Out of memory mapping %s\n", file_name);
+      free (mapped.cert_ids);
+      free (mapped.chain_ids);
+      free (mapped.restored);
+      munmap (base, status.st_size);
+      memset (&mapped, 0, sizeof (mapped));
+      return 0;
+    }
+  madvise (base, status.st_size, MADV_WILLNEED);
+
+  pthread_mutex_lock (&snapshot_lock);
+  stats.hosts = header->num_hosts;
+  stats.restored = 0;
+  stats.on_demand = 0;
+  stats.rebuild_ms = 0;
+  stats.rebuilding = 1;
+  stats.map_ms = deadline_now_ms () - start;
+  rebuild_started_ms = start;
+  pthread_mutex_unlock (&snapshot_lock);
+  __atomic_store_n (&is_mapped, 1, __ATOMIC_RELEASE);
+
+  pthread_attr_init (&attributes);
+  pthread_attr_setdetachstate (&attributes, PTHREAD_CREATE_DETACHED);
+  if (pthread_create (&thread, &attributes, rebuild_thread, NULL) != 0)
+    rebuild_thread (NULL);
+  pthread_attr_destroy (&attributes);
+
+  return 1;
+} // snapshot_open
+
+/**
+ * @brief Restores a host from the mapped snapshot, for a request about it.
+ *
+ * @param id  the ID of the host
+ *
+ * @return 1 if it was restored, 0 otherwise
+ */
+int
+snapshot_restore (uint32_t id)
+{
+  const char *key;
+  int restored = 0;
+  long h;
+
+  if (!__atomic_load_n (&is_mapped, __ATOMIC_ACQUIRE)
+      || (key = hostkey_name (id)) == NULL)
+    return 0;
+
+  pthread_rwlock_rdlock (&map_lock);
+  if (__atomic_load_n (&is_mapped, __ATOMIC_ACQUIRE)
+      && (h = find_host (key)) >= 0 && restore_host (h, id))
+    {
+      __atomic_add_fetch (&stats.on_demand, 1, __ATOMIC_RELAXED);
+      restored = 1;
+    }
+  pthread_rwlock_unlock (&map_lock);
+
+  return restored;
+} // snapshot_restore
+
+/**
+ * @brief Waits until every host of the mapped snapshot is restored.
+ */
+void
+snapshot_wait ()
+{
+  pthread_mutex_lock (&snapshot_lock);
+  while (stats.rebuilding)
+    pthread_cond_wait (&rebuilt, &snapshot_lock);
+  pthread_mutex_unlock (&snapshot_lock);
+} // snapshot_wait
+
+/**
+ * @brief Writes a snapshot of the histories of all hosts, to a temporary
+ *        file renamed over the snapshot once complete.
+ *
+ * @param file_name  the snapshot
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+snapshot_write (const char *file_name)
+{
+  long long start = deadline_now_ms ();
+  struct file_header header;
+  struct file_host *hosts = NULL, *grown_hosts;
+  struct history_run *runs = NULL, *grown_runs, *host_runs;
+  struct hostkey_stats interned;
+  struct certpool_stats pool;
+  struct file_cert cert;
+  uint32_t *chain_index = NULL, *chain_certs = NULL, *buckets = NULL;
+  uint32_t hosts_size = 0, runs_size = 0, id, c, *grown_certs;
+  const uint32_t *certs;
+  const unsigned char *digest;
+  const char *fingerprint, *key;
+  char *keys = NULL, *grown_keys, *temporary = NULL;
+  size_t keys_size = 0, key_length;
+  uint64_t position, offset;
+  int count, length, s, result = 0;
+  FILE *file = NULL;
+
+  /* Hosts still in the mapping would be missing from the snapshot. */
+  snapshot_wait ();
+  pthread_mutex_lock (&write_lock);
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.fingerprint_length = FPT_LENGTH;
+  header.written = time (NULL);
+
+  /* The hosts with a history, and their runs. */
+  host_runs = malloc (tunables.history_max_runs * sizeof (*host_runs));
+  if (host_runs == NULL)
+    goto done;
+  hostkey_get_stats (&interned);
+  for (id = 1; id <= interned.interned; id++)
+    {
+      key = hostkey_name (id);
+      if (key == NULL
+          || (count = history_copy (id, host_runs,
+                                    tunables.history_max_runs)) == 0)
+        continue;
+
+      key_length = strlen (key) + 1;
+      if (header.num_hosts == hosts_size)
+        {
+          hosts_size = hosts_size ? 2 * hosts_size : 4096;
+          grown_hosts = realloc (hosts, hosts_size * sizeof (*hosts));
+          if (grown_hosts == NULL)
+            goto done;
+          hosts = grown_hosts;
+        }
+      if (header.num_runs + count > runs_size)
+        {
+          runs_size = 2 * (header.num_runs + count);
+          grown_runs = realloc (runs, runs_size * sizeof (*runs));
+          if (grown_runs == NULL)
+            goto done;
+          runs = grown_runs;
+        }
+      if (header.keys_length + key_length > keys_size)
+        {
+          keys_size = 2 * (header.keys_length + key_length);
+          grown_keys = realloc (keys, keys_size);
+          if (grown_keys == NULL)
+            goto done;
+          keys = grown_keys;
+        }
+
+      hosts[header.num_hosts].hash = hash_key (key);
+      hosts[header.num_hosts].key = header.keys_length;
+      hosts[header.num_hosts].first_run = header.num_runs;
+      hosts[header.num_hosts].num_runs = count;
+      hosts[header.num_hosts].next = 0;
+      memcpy (keys + header.keys_length, key, key_length);
+      memcpy (runs + header.num_runs, host_runs, count * sizeof (*runs));
+      header.num_hosts++;
+      header.num_runs += count;
+      header.keys_length += key_length;
+    }
+
+  /* The chains and certificates, read after the runs that refer to them
+   * so that all of them are included. */
+  certpool_get_stats (&pool);
+  header.num_chains = pool.chains;
+  header.num_certs = pool.certs;
+  chain_index = calloc ((size_t) header.num_chains + 2, sizeof (uint32_t));
+  if (chain_index == NULL)
+    goto done;
+  for (c = 1; c <= header.num_chains; c++)
+    {
+      chain_index[c] = header.num_chain_certs;
+      certs = certpool_chain_certs (c, &length);
+      if (certs == NULL || length == 0)
+        continue;
+      grown_certs = realloc (chain_certs, (header.num_chain_certs + length)
+                             * sizeof (uint32_t));
+      if (grown_certs == NULL)
+        goto done;
+      chain_certs = grown_certs;
+      memcpy (chain_certs + header.num_chain_certs, certs,
+              length * sizeof (uint32_t));
+      header.num_chain_certs += length;
+    }
+  chain_index[header.num_chains + 1] = header.num_chain_certs;
+
+  /* The hash index over the keys, at most half full. */
+  header.num_buckets = 16;
+  while (header.num_buckets < 2 * header.num_hosts)
+    header.num_buckets *= 2;
+  buckets = calloc (header.num_buckets, sizeof (uint32_t));
+  if (buckets == NULL)
+    goto done;
+  for (id = 0; id < header.num_hosts; id++)
+    {
+      s = hosts[id].hash & (header.num_buckets - 1);
+      hosts[id].next = buckets[s];
+      buckets[s] = id + 1;
+    }
+
+  offset = (sizeof (header) + 7) / 8 * 8;
+  for (s = 0; s < SECTIONS; s++)
+    {
+      header.offsets[s] = offset;
+      offset = (offset + section_length (&header, s) + 7) / 8 * 8;
+    }
+  header.size = offset;
+
+  if (asprintf (&temporary, "%s.tmp", file_name) < 0)
+    {
+      temporary = NULL;
+      goto done;
+    }
+  file = fopen (temporary, "w");
+  if (file == NULL)
+    {
+      fprintf (stderr, "Could not create %s: %s\n", temporary,
+               strerror (errno));
+      goto done;
+    }
+
+  position = sizeof (header);
+  if (fwrite (&header, sizeof (header), 1, file) != 1
+      || !pad_to (file, &position, header.offsets[SECTION_CERTS]))
+    goto done;
+  for (c = 0; c <= header.num_certs; c++)
+    {
+      memset (&cert, 0, sizeof (cert));
+      digest = certpool_digest_of (c);
+      fingerprint = certpool_fingerprint (c);
+      if (digest != NULL && fingerprint != NULL)
+        {
+          memcpy (cert.digest, digest, sizeof (cert.digest));
+          strncpy (cert.fingerprint, fingerprint, FPT_LENGTH - 1);
+        }
+      if (fwrite (&cert, sizeof (cert), 1, file) != 1)
+        goto done;
+    }
+  position += section_length (&header, SECTION_CERTS);
+
+  if (!write_section (file, &position, &header, SECTION_CHAIN_INDEX,
+                      chain_index)
+      || !write_section (file, &position, &header, SECTION_CHAIN_CERTS,
+                         chain_certs)
+      || !write_section (file, &position, &header, SECTION_HOSTS, hosts)
+      || !write_section (file, &position, &header, SECTION_RUNS, runs)
+      || !write_section (file, &position, &header, SECTION_BUCKETS, buckets)
+      || !write_section (file, &position, &header, SECTION_KEYS, keys)
+      || !pad_to (file, &position, header.size)
+      || fflush (file) != 0 || fsync (fileno (file)) != 0)
+    goto done;
+
+  result = fclose (file) == 0;
+  file = NULL;
+  if (result && rename (temporary, file_name) != 0)
+    {
+      fprintf (stderr, "Could not rename %s: %s\n", temporary,
+               strerror (errno));
+      result = 0;
+    }
+
+ done:
+  if (file != NULL)
+    fclose (file);
+  if (!result && temporary != NULL)
+    unlink (temporary);
+
+  pthread_mutex_lock (&snapshot_lock);
+  if (result)
+    {
+      stats.writes++;
+      stats.write_ms = deadline_now_ms () - start;
+      stats.write_bytes = header.size;
+    }
+  else
+    {
+      stats.write_failures++;
+      fprintf (stderr, "Could not write the snapshot %s\n", file_name);
+    }
+  pthread_mutex_unlock (&snapshot_lock);
+  pthread_mutex_unlock (&write_lock);
+
+  free (temporary);
+  free (host_runs);
+  free (hosts);
+  free (runs);
+  free (keys);
+  free (chain_index);
+  free (chain_certs);
+  free (buckets);
+  return result;
+} // snapshot_write
+
+/**
+ * @brief Starts writing a snapshot periodically.
+ *
+ * @param file_name   the snapshot
+ * @param interval_s  seconds between snapshots, 0 or less for none
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+snapshot_start_writer (const char *file_name, int interval_s)
+{
+  if (interval_s <= 0 || writer_running)
+    return 1;
+
+  writer_file = strdup (file_name);
+  if (writer_file == NULL)
+    return 0;
+  writer_interval_s = interval_s;
+  writer_stop = 0;
+  if (pthread_create (&writer, NULL, writer_loop, NULL) != 0)
+    {
+      free (writer_file);
+      writer_file = NULL;
+      return 0;
+    }
+  writer_running = 1;
+  return 1;
+} // snapshot_start_writer
+
+/**
+ * @brief Stops writing snapshots periodically, waiting for a write in
+ *        progress.
+ */
+void
+snapshot_stop_writer ()
+{
+  if (!writer_running)
+    return;
+
+  pthread_mutex_lock (&snapshot_lock);
+  writer_stop = 1;
+  pthread_cond_signal (&writer_wake);
+  pthread_mutex_unlock (&snapshot_lock);
+  pthread_join (writer, NULL);
+
+  writer_running = 0;
+  free (writer_file);
+  writer_file = NULL;
+} // snapshot_stop_writer
+
+/**
+ * @brief Copies the counters of snapshots.
+ */
+void
+snapshot_get_stats (struct snapshot_stats *stats_out)
+{
+  pthread_mutex_lock (&snapshot_lock);
+  *stats_out = stats;
+  stats_out->restored = __atomic_load_n (&stats.restored, __ATOMIC_RELAXED);
+  stats_out->on_demand = __atomic_load_n (&stats.on_demand, __ATOMIC_RELAXED);
+  pthread_mutex_unlock (&snapshot_lock);
+} // snapshot_get_stats
@@ -0,0 +1,67 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for cache snapshots, which carry
+ * what the notary observed across restarts. A snapshot holds the history
+ * of every host, by its canonical key, and the certificates and chains the
+ * runs refer to, with a hash index over the keys. It is written on
+ * shutdown and every snapshot_interval_s seconds, to a temporary file that
+ * is renamed over the old one. On startup the snapshot is mapped and
+ * checked, which takes milliseconds; a host asked about is restored from
+ * the mapping at once, and a background thread restores all the others,
+ * after which the mapping is dropped. Snapshots are in the byte order of
+ * the machine that wrote them.
+ ******************************************************************************/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "notary.h"
+
+/* Counters of snapshots. */
+struct snapshot_stats
+{
+  unsigned long hosts;          // hosts in the mapped snapshot
+  unsigned long restored;       // hosts restored from it
+  unsigned long on_demand;      // of those, restored for a request
+  unsigned long map_ms;         // time taken to map and check it
+  unsigned long rebuild_ms;     // time taken to restore every host
+  int rebuilding;               // whether the mapping is still in use
+  unsigned long writes;         // snapshots written
+  unsigned long write_failures; // snapshots that could not be written
+  unsigned long write_ms;       // time the last write took
+  unsigned long write_bytes;    // size of the last snapshot written
+};
+
+/* Maps a snapshot and starts restoring its hosts in the background.
+ * Returns 1 on success, 0 if there is no snapshot or it is not valid, in
+ * which case the notary starts cold.
+ */
+int snapshot_open (const char *file_name);
+
+/* Restores a host, given by its hostkey ID, from the mapped snapshot if it
+ * is there and was not restored yet. Returns 1 if it was restored, 0
+ * otherwise. Cheap when no snapshot is mapped.
+ */
+int snapshot_restore (uint32_t id);
+
+/* Waits until every host of the mapped snapshot is restored. */
+void snapshot_wait (void);
+
+/* Writes a snapshot of the histories of all hosts. Waits for a mapped
+ * snapshot to be restored first. Returns 1 on success, 0 otherwise.
+ */
+int snapshot_write (const char *file_name);
+
+/* Starts writing a snapshot every interval_s seconds. Returns 1 on success,
+ * 0 otherwise.
+ */
+int snapshot_start_writer (const char *file_name, int interval_s);
+
+/* Stops writing snapshots periodically. */
+void snapshot_stop_writer (void);
+
+/* Copies the counters of snapshots into stats. */
+void snapshot_get_stats (struct snapshot_stats *stats);
+
+#endif // SNAPSHOT_H
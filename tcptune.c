@@ -0,0 +1,191 @@
+/** @file
+
+    @brief  TCP profiles: the socket options of the client listeners and of
+            the connections of upstream fetches.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "tcptune.h"
+#include "config.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+
+/* Linux 6.3 and later; the C library may not know it yet. */
+#ifndef IP_LOCAL_PORT_RANGE
+#define IP_LOCAL_PORT_RANGE 51
+#endif
+
+/* The options of both profiles; each is warned about once. */
+enum tcp_option
+{
+  OPTION_FASTOPEN,
+  OPTION_DEFER_ACCEPT,
+  OPTION_NODELAY,
+  OPTION_FASTOPEN_CONNECT,
+  OPTION_QUICKACK,
+  OPTION_SNDBUF,
+  OPTION_RCVBUF,
+  OPTION_PORT_RANGE
+};
+
+static struct
+{
+  int level;
+  int option;
+  const char *name;
+  int warned;
+} options[] = {
+  [OPTION_FASTOPEN] = {IPPROTO_TCP, TCP_FASTOPEN, "TCP_FASTOPEN", 0},
+  [OPTION_DEFER_ACCEPT] = {IPPROTO_TCP, TCP_DEFER_ACCEPT, "TCP_DEFER_ACCEPT",
+                           0},
+  [OPTION_NODELAY] = {IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY", 0},
+  [OPTION_FASTOPEN_CONNECT] = {IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+                               "TCP_FASTOPEN_CONNECT", 0},
+  [OPTION_QUICKACK] = {IPPROTO_TCP, TCP_QUICKACK, "TCP_QUICKACK", 0},
+  [OPTION_SNDBUF] = {SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF", 0},
+  [OPTION_RCVBUF] = {SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF", 0},
+  [OPTION_PORT_RANGE] = {IPPROTO_IP, IP_LOCAL_PORT_RANGE,
+                         "IP_LOCAL_PORT_RANGE", 0}
+};
+
+static struct tcptune_stats stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Sets a 32-bit socket option, warning the first time the kernel
+ *        refuses that option.
+ *
+ * @return 0 on success, 1 if the kernel refused it
+ */
+static int
+set_option (int fd, enum tcp_option which, uint32_t value)
+{
+  int first, error;
+
+  if (setsockopt (fd, options[which].level, options[which].option, &value,
+                  sizeof (value)) == 0)
+    return 0;
+
+  error = errno;
+  pthread_mutex_lock (&stats_lock);
+  first = !options[which].warned;
+  options[which].warned = 1;
+  pthread_mutex_unlock (&stats_lock);
+  if (first)
+    fprintf (stderr, "Warning: The kernel refused %s: %s\n",
+             options[which].name, strerror (error));
+  return 1;
+} // set_option
+
+/**
+ * @brief Counts a socket tuned and the options refused on it.
+ */
+static void
+count_tuned (unsigned long *tuned, int refused)
+{
+  pthread_mutex_lock (&stats_lock);
+  (*tuned)++;
+  stats.refused += refused;
+  pthread_mutex_unlock (&stats_lock);
+} // count_tuned
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Applies the listener profile to a listening socket.
+ *
+ * A socket taken over from a predecessor is tuned again, so that a new
+ * profile takes effect across an upgrade; listening again only changes the
+ * backlog. TCP_DEFER_ACCEPT keeps a connection out of the accept queue,
+ * and off a thread, until its request arrives or listen_defer_accept_s
+ * passes. The accepted connections inherit TCP_NODELAY.
+ *
+ * @param fd  the socket, bound already
+ *
+ * @return the number of options refused
+ */
+int
+tcptune_listener (int fd)
+{
+  int refused = 0;
+
+  if (tunables.listen_fastopen > 0)
+    refused += set_option (fd, OPTION_FASTOPEN, tunables.listen_fastopen);
+  refused += set_option (fd, OPTION_DEFER_ACCEPT,
+                         tunables.listen_defer_accept_s);
+  refused += set_option (fd, OPTION_NODELAY, tunables.listen_nodelay);
+
+  if (listen (fd, tunables.listen_backlog) != 0)
+    {
+      fprintf (stderr, "Warning: Could not set a backlog of %d: %s\n",
+               tunables.listen_backlog, strerror (errno));
+      refused++;
+    }
+
+  count_tuned (&stats.listeners, refused);
+  return refused;
+} // tcptune_listener
+
+/**
+ * @brief Applies the upstream profile to a socket before it connects.
+ *
+ * A connection with TCP_FASTOPEN_CONNECT reports itself connected at once
+ * and sends its SYN with the first write, the ClientHello, so fastopen is
+ * only set where nothing races on the connection being made.
+ *
+ * @param fd        the socket
+ * @param fastopen  whether the SYN may wait for the first write
+ *
+ * @return the number of options refused
+ */
+int
+tcptune_upstream (int fd, int fastopen)
+{
+  uint32_t range;
+  int refused = 0;
+
+  if (fastopen && tunables.upstream_fastopen)
+    refused += set_option (fd, OPTION_FASTOPEN_CONNECT, 1);
+  if (tunables.upstream_quickack)
+    refused += set_option (fd, OPTION_QUICKACK, 1);
+  if (tunables.upstream_sndbuf > 0)
+    refused += set_option (fd, OPTION_SNDBUF, tunables.upstream_sndbuf);
+  if (tunables.upstream_rcvbuf > 0)
+    refused += set_option (fd, OPTION_RCVBUF, tunables.upstream_rcvbuf);
+
+  /* The kernel picks the port within the range when connecting, so the
+   * range costs nothing until it runs out. */
+  if (tunables.upstream_port_min > 0
+      && tunables.upstream_port_min <= tunables.upstream_port_max)
+    {
+      range = (uint32_t) tunables.upstream_port_max << 16
+        | (uint32_t) tunables.upstream_port_min;
+      refused += set_option (fd, OPTION_PORT_RANGE, range);
+    }
+
+  count_tuned (&stats.upstream, refused);
+  return refused;
+} // tcptune_upstream
+
+/**
+ * @brief Copies the counters of the TCP profiles.
+ */
+void
+tcptune_get_stats (struct tcptune_stats *stats_out)
+{
+  pthread_mutex_lock (&stats_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&stats_lock);
+} // tcptune_get_stats
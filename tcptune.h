@@ -0,0 +1,40 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the TCP profiles of the notary's
+ * sockets. The listening sockets of the client ports get their backlog,
+ * TCP Fast Open, TCP_DEFER_ACCEPT and TCP_NODELAY, which the connections
+ * they accept inherit. The sockets of upstream fetches get TCP_QUICKACK,
+ * bounded send and receive buffers, a range of local ports and, where the
+ * connection is not raced against another, TCP Fast Open. Every option is
+ * a tunable, and one the kernel refuses is counted rather than fatal.
+ ******************************************************************************/
+#ifndef TCPTUNE_H
+#define TCPTUNE_H
+
+#include "notary.h"
+
+/* Counters of the TCP profiles. */
+struct tcptune_stats
+{
+  unsigned long listeners;      // listening sockets tuned
+  unsigned long upstream;       // upstream sockets tuned
+  unsigned long refused;        // options the kernel refused
+};
+
+/* Applies the listener profile to the listening socket fd and sets its
+ * backlog to listen_backlog. Returns the number of options refused.
+ */
+int tcptune_listener (int fd);
+
+/* Applies the upstream profile to fd, a socket not connected yet. If
+ * fastopen is set and upstream_fastopen allows, the SYN waits for the
+ * first write and carries it. Returns the number of options refused.
+ */
+int tcptune_upstream (int fd, int fastopen);
+
+/* Copies the counters of the TCP profiles into stats. */
+void tcptune_get_stats (struct tcptune_stats *stats);
+
+#endif // TCPTUNE_H
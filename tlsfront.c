@@ -0,0 +1,596 @@
+/** @file
+
+    @brief  TLS front end: terminates TLS on the SSL port with a session
+            cache and rotating ticket keys shared by every thread, and
+            moves record encryption into the kernel where it can.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "tlsfront.h"
+#include "config.h"
+#include <openssl/core_names.h>
+#include <openssl/rand.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+
+/* A session-ticket key. */
+struct ticket_key
+{
+  unsigned char name[16];
+  unsigned char aes[32];
+  unsigned char hmac[32];
+  time_t created;
+  int valid;
+};
+
+/* A listening socket and the daemon its connections go to. */
+struct acceptor
+{
+  int fd;
+  int cpu;                      // the core to accept on, or -1
+  struct MHD_Daemon *daemon;
+};
+
+/* A connection accepted, on its way to a daemon. */
+struct pending
+{
+  int fd;
+  struct sockaddr_storage peer;
+  socklen_t length;
+  struct MHD_Daemon *daemon;
+};
+
+static SSL_CTX *context = NULL;
+
+/* The ticket keys, the current one first, shared by every handshake. */
+static struct ticket_key keys[TLSFRONT_TICKET_KEYS];
+static pthread_rwlock_t keys_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* The threads accepting connections, stopped through stop_pipe. */
+static struct acceptor acceptors[2 * SHARD_MAX];
+static pthread_t accept_threads[2 * SHARD_MAX];
+static int num_acceptors = 0;
+static int stop_pipe[2] = {-1, -1};
+
+/* Connections in their handshake or relayed, each holding a thread. */
+static unsigned long in_flight = 0;
+
+static struct tlsfront_stats stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Adds one to a counter of the front end.
+ */
+static void
+count (unsigned long *counter)
+{
+  pthread_mutex_lock (&stats_lock);
+  (*counter)++;
+  pthread_mutex_unlock (&stats_lock);
+} // count
+
+/**
+ * @brief Fills a ticket key with random bytes.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+static int
+new_ticket_key (struct ticket_key *key)
+{
+  if (RAND_bytes (key->name, sizeof (key->name)) != 1
+      || RAND_bytes (key->aes, sizeof (key->aes)) != 1
+      || RAND_bytes (key->hmac, sizeof (key->hmac)) != 1)
+    return 0;
+  key->created = time (NULL);
+  key->valid = 1;
+  return 1;
+} // new_ticket_key
+
+/**
+ * @brief Rotates the ticket keys, if the current one is older than
+ *        tls_ticket_rotate_s or when forced. Must hold keys_lock for
+ *        writing.
+ */
+static void
+rotate_keys_locked (int force)
+{
+  struct ticket_key key;
+  int i;
+
+  if (!force && time (NULL) - keys[0].created < tunables.tls_ticket_rotate_s)
+    return;
+  if (!new_ticket_key (&key))
+    return;
+  for (i = TLSFRONT_TICKET_KEYS - 1; i > 0; i--)
+    keys[i] = keys[i - 1];
+  keys[0] = key;
+  count (&stats.rotations);
+} // rotate_keys_locked
+
+/**
+ * @brief Encrypts a new session ticket with the current key, or finds the
+ *        key a ticket presented was encrypted with. Called by OpenSSL.
+ *
+ * @return 1 if the key was found, 2 if the ticket should be renewed under
+ *         the current key, 0 if the key is unknown and -1 on error
+ */
+static int
+ticket_key_callback (SSL *ssl, unsigned char *name, unsigned char *iv,
+                     EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int encrypt)
+{
+  struct ticket_key key;
+  OSSL_PARAM params[3];
+  int found = -1, i;
+
+  pthread_rwlock_rdlock (&keys_lock);
+  if (encrypt && time (NULL) - keys[0].created >= tunables.tls_ticket_rotate_s)
+    {
+      /* A read lock cannot be upgraded, so another thread may rotate the
+       * keys in between; rotate_keys_locked checks the age again. */
+      pthread_rwlock_unlock (&keys_lock);
+      pthread_rwlock_wrlock (&keys_lock);
+      rotate_keys_locked (0);
+      pthread_rwlock_unlock (&keys_lock);
+      pthread_rwlock_rdlock (&keys_lock);
+    }
+
+  for (i = 0; i < (encrypt ? 1 : TLSFRONT_TICKET_KEYS); i++)
+    if (keys[i].valid
+        && (encrypt || memcmp (name, keys[i].name, sizeof (keys[i].name)) == 0))
+      {
+        key = keys[i];
+        found = i;
+        break;
+      }
+  pthread_rwlock_unlock (&keys_lock);
+  if (found < 0)
+    return encrypt ? -1 : 0;
+
+  params[0] = OSSL_PARAM_construct_octet_string (OSSL_MAC_PARAM_KEY, key.hmac,
+                                                 sizeof (key.hmac));
+  params[1] = OSSL_PARAM_construct_utf8_string (OSSL_MAC_PARAM_DIGEST,
+                                                (char *) "SHA256", 0);
+  params[2] = OSSL_PARAM_construct_end ();
+
+  if (encrypt)
+    {
+      memcpy (name, key.name, sizeof (key.name));
+      if (RAND_bytes (iv, EVP_CIPHER_get_iv_length (EVP_aes_256_cbc ())) != 1
+          || !EVP_EncryptInit_ex (cipher, EVP_aes_256_cbc (), NULL, key.aes,
+                                  iv))
+        return -1;
+    }
+  else if (!EVP_DecryptInit_ex (cipher, EVP_aes_256_cbc (), NULL, key.aes,
+                                iv))
+    return -1;
+  if (!EVP_MAC_CTX_set_params (mac, params))
+    return -1;
+
+  return found == 0 ? 1 : 2;
+} // ticket_key_callback
+
+/**
+ * @brief Frees a connection done with, giving up its place among those in
+ *        flight.
+ */
+static void
+finish (struct pending *pending)
+{
+  __atomic_sub_fetch (&in_flight, 1, __ATOMIC_RELAXED);
+  free (pending);
+} // finish
+
+/**
+ * @brief Writes all of a buffer to a socket.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+static int
+write_all (int fd, const char *buffer, size_t length)
+{
+  ssize_t written;
+
+  while (length > 0)
+    {
+      written = write (fd, buffer, length);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0)
+        return 0;
+      buffer += written;
+      length -= written;
+    }
+  return 1;
+} // write_all
+
+/**
+ * @brief Hands a connection to a daemon, which closes the socket even when
+ *        it refuses it.
+ *
+ * @return 1 if the daemon took the connection, 0 otherwise
+ */
+static int
+deliver (struct pending *pending, int fd)
+{
+  if (pending->daemon == NULL)
+    {
+      close (fd);
+      return 0;
+    }
+  return MHD_add_connection (pending->daemon, fd,
+                             (struct sockaddr *) &pending->peer,
+                             pending->length) == MHD_YES;
+} // deliver
+
+/**
+ * @brief Relays between a TLS connection and the socket of its daemon until
+ *        either side closes. The daemon closes its side when the connection
+ *        has been idle for keepalive_timeout_s.
+ */
+static void
+relay (SSL *ssl, int fd, int daemon_fd)
+{
+  char buffer[TLSFRONT_RELAY_BUFFER];
+  struct pollfd ready[2] = {{fd, POLLIN, 0}, {daemon_fd, POLLIN, 0}};
+  int length;
+
+  for (;;)
+    {
+      /* OpenSSL may hold a record read already. */
+      if (SSL_has_pending (ssl))
+        {
+          ready[0].revents = POLLIN;
+          ready[1].revents = 0;
+        }
+      else if (poll (ready, 2, -1) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return;
+        }
+
+      if (ready[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+          length = SSL_read (ssl, buffer, sizeof (buffer));
+          if (length <= 0 || !write_all (daemon_fd, buffer, length))
+            return;
+        }
+      if (ready[1].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+          length = read (daemon_fd, buffer, sizeof (buffer));
+          if (length < 0 && errno == EINTR)
+            continue;
+          if (length <= 0 || SSL_write (ssl, buffer, length) <= 0)
+            return;
+        }
+    }
+} // relay
+
+/**
+ * @brief Completes the handshake of a connection and hands it to its
+ *        daemon: the socket itself if the kernel encrypts its records both
+ *        ways, or else one end of a socket pair this thread relays to.
+ */
+static void *
+serve_connection (void *argument)
+{
+  struct pending *pending = argument;
+  int ms = tunables.tls_handshake_timeout_ms, pair[2];
+  struct timeval timeout = {ms / 1000, (ms % 1000) * 1000};
+  SSL *ssl;
+
+  /* A client that stalls the handshake gives up its thread. */
+  setsockopt (pending->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+              sizeof (timeout));
+  setsockopt (pending->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+              sizeof (timeout));
+  ssl = SSL_new (context);
+  if (ssl == NULL || !SSL_set_fd (ssl, pending->fd) || SSL_accept (ssl) != 1)
+    {
+      count (&stats.failures);
+      SSL_free (ssl);
+      close (pending->fd);
+      finish (pending);
+      return NULL;
+    }
+  memset (&timeout, 0, sizeof (timeout));
+  setsockopt (pending->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+              sizeof (timeout));
+  setsockopt (pending->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+              sizeof (timeout));
+
+  pthread_mutex_lock (&stats_lock);
+  stats.handshakes++;
+  if (SSL_session_reused (ssl))
+    stats.resumed++;
+  pthread_mutex_unlock (&stats_lock);
+
+  /* Freed without a shutdown, a connection would take its session out of
+   * the cache; one whose records the kernel takes over, or that is refused,
+   * is shut down quietly instead. */
+  if (BIO_get_ktls_send (SSL_get_wbio (ssl))
+      && BIO_get_ktls_recv (SSL_get_rbio (ssl)) && !SSL_has_pending (ssl))
+    {
+      SSL_set_shutdown (ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+      SSL_free (ssl);
+      count (&stats.ktls);
+      if (!deliver (pending, pending->fd))
+        count (&stats.refused);
+      finish (pending);
+      return NULL;
+    }
+
+  count (&stats.relayed);
+  if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0)
+    pair[0] = pair[1] = -1;
+  if (pair[1] < 0 || !deliver (pending, pair[1]))
+    {
+      count (&stats.refused);
+      SSL_set_shutdown (ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
+  else
+    {
+      relay (ssl, pending->fd, pair[0]);
+      SSL_shutdown (ssl);
+    }
+
+  if (pair[0] >= 0)
+    close (pair[0]);
+  SSL_free (ssl);
+  close (pending->fd);
+  finish (pending);
+  return NULL;
+} // serve_connection
+
+/**
+ * @brief Accepts connections on a listening socket, each served by a thread
+ *        of its own up to tls_max_connections, until the front end is
+ *        quiesced.
+ */
+static void *
+accept_connections (void *argument)
+{
+  struct acceptor *acceptor = argument;
+  struct pollfd ready[2] = {{acceptor->fd, POLLIN, 0},
+                            {stop_pipe[0], POLLIN, 0}};
+  struct pending *pending;
+  pthread_attr_t attributes;
+  pthread_t thread;
+  cpu_set_t pinned;
+
+  /* The threads of the connections inherit the core. */
+  if (acceptor->cpu >= 0)
+    {
+      CPU_ZERO (&pinned);
+      CPU_SET (acceptor->cpu, &pinned);
+      pthread_setaffinity_np (pthread_self (), sizeof (pinned), &pinned);
+    }
+  pthread_attr_init (&attributes);
+  pthread_attr_setdetachstate (&attributes, PTHREAD_CREATE_DETACHED);
+
+  for (;;)
+    {
+      if (poll (ready, 2, -1) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          break;
+        }
+      if (ready[1].revents != 0)
+        break;
+      if (!(ready[0].revents & POLLIN))
+        continue;
+
+      pending = malloc (sizeof (*pending));
+      if (pending == NULL)
+        continue;
+      pending->length = sizeof (pending->peer);
+      pending->daemon = acceptor->daemon;
+      pending->fd = accept4 (acceptor->fd, (struct sockaddr *) &pending->peer,
+                             &pending->length, SOCK_CLOEXEC);
+      if (pending->fd < 0)
+        {
+          // Another thread or process took it.
+          free (pending);
+          continue;
+        }
+      count (&stats.accepted);
+
+      /* A connection over the cap is closed rather than given a thread,
+       * so clients that never finish their handshake cannot take them
+       * all. */
+      if (__atomic_add_fetch (&in_flight, 1, __ATOMIC_RELAXED)
+          > (unsigned long) tunables.tls_max_connections)
+        {
+          count (&stats.overloaded);
+          close (pending->fd);
+          finish (pending);
+          continue;
+        }
+      if (pthread_create (&thread, &attributes, serve_connection, pending)
+          != 0)
+        {
+          close (pending->fd);
+          finish (pending);
+        }
+    }
+
+  pthread_attr_destroy (&attributes);
+  return NULL;
+} // accept_connections
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Sets up the TLS context the SSL port serves with.
+ *
+ * @param key_file   the PEM private key
+ * @param cert_file  the PEM certificate, followed by its chain
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+tlsfront_init (const char *key_file, const char *cert_file)
+{
+  SSL_CTX *created = SSL_CTX_new (TLS_server_method ());
+
+  if (created == NULL)
+    return 0;
+  SSL_CTX_set_min_proto_version (created, TLS1_2_VERSION);
+  if (SSL_CTX_use_certificate_chain_file (created, cert_file) != 1
+      || SSL_CTX_use_PrivateKey_file (created, key_file, SSL_FILETYPE_PEM) != 1
+      || SSL_CTX_check_private_key (created) != 1)
+    {
+      fprintf (stderr, "Could not serve TLS with %s and %s\n", cert_file,
+               key_file);
+      SSL_CTX_free (created);
+      return 0;
+    }
+
+  /* Sessions are remembered here, or in tickets only the keys of this
+   * process open, for as long as a ticket's key is kept. */
+  SSL_CTX_set_session_id_context (created, (const unsigned char *) "notary",
+                                  strlen ("notary"));
+  if (tunables.tls_session_cache_size > 0)
+    {
+      SSL_CTX_set_session_cache_mode (created, SSL_SESS_CACHE_SERVER);
+      SSL_CTX_sess_set_cache_size (created, tunables.tls_session_cache_size);
+    }
+  else
+    SSL_CTX_set_session_cache_mode (created, SSL_SESS_CACHE_OFF);
+  if (tunables.tls_ticket_rotate_s > 0)
+    {
+      pthread_rwlock_wrlock (&keys_lock);
+      if (!keys[0].valid)
+        rotate_keys_locked (1);
+      pthread_rwlock_unlock (&keys_lock);
+      SSL_CTX_set_timeout (created, TLSFRONT_TICKET_KEYS
+                           * tunables.tls_ticket_rotate_s);
+      SSL_CTX_set_tlsext_ticket_key_evp_cb (created, ticket_key_callback);
+    }
+  else
+    SSL_CTX_set_options (created, SSL_OP_NO_TICKET);
+
+  /* Clients that hang up without saying so keep their sessions. */
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+  SSL_CTX_set_options (created, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+#ifdef SSL_OP_ENABLE_KTLS
+  if (tunables.tls_ktls)
+    SSL_CTX_set_options (created, SSL_OP_ENABLE_KTLS);
+#endif
+
+  SSL_CTX_free (context);
+  context = created;
+  return 1;
+} // tlsfront_init
+
+/**
+ * @brief Starts a thread accepting TLS connections on each socket of a set.
+ *
+ * @param set  the set, its daemons started with external set
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+tlsfront_start (struct shard_set *set)
+{
+  int i;
+
+  if (context == NULL)
+    return 0;
+  if (stop_pipe[0] < 0 && pipe2 (stop_pipe, O_CLOEXEC | O_NONBLOCK) != 0)
+    return 0;
+
+  for (i = 0; i < set->count && num_acceptors < 2 * SHARD_MAX; i++)
+    {
+      struct acceptor *acceptor = &acceptors[num_acceptors];
+
+      fcntl (set->sockets[i], F_SETFL,
+             fcntl (set->sockets[i], F_GETFL) | O_NONBLOCK);
+      acceptor->fd = set->sockets[i];
+      acceptor->cpu = set->cpus[i];
+      acceptor->daemon = set->daemons[i];
+      if (pthread_create (&accept_threads[num_acceptors], NULL,
+                          accept_connections, acceptor) != 0)
+        {
+          tlsfront_quiesce ();
+          return 0;
+        }
+      num_acceptors++;
+    }
+  return 1;
+} // tlsfront_start
+
+/**
+ * @brief Stops accepting TLS connections.
+ */
+void
+tlsfront_quiesce ()
+{
+  char byte = 0;
+  int i;
+
+  if (num_acceptors == 0)
+    return;
+  if (write (stop_pipe[1], &byte, 1) < 0)
+    {
+      // The pipe is full already.
+    }
+  for (i = 0; i < num_acceptors; i++)
+    {
+      pthread_join (accept_threads[i], NULL);
+      close (acceptors[i].fd);
+    }
+  num_acceptors = 0;
+  while (read (stop_pipe[0], &byte, 1) == 1)
+    ;
+} // tlsfront_quiesce
+
+/**
+ * @brief Replaces the current session-ticket key.
+ */
+void
+tlsfront_rotate_keys ()
+{
+  pthread_rwlock_wrlock (&keys_lock);
+  rotate_keys_locked (1);
+  pthread_rwlock_unlock (&keys_lock);
+} // tlsfront_rotate_keys
+
+/**
+ * @brief Frees the TLS context; connections still served keep their own
+ *        reference to it.
+ */
+void
+tlsfront_shutdown ()
+{
+  SSL_CTX_free (context);
+  context = NULL;
+} // tlsfront_shutdown
+
+/**
+ * @brief Copies the counters of the TLS front end.
+ *
+ * @param copy  where to copy them
+ */
+void
+tlsfront_get_stats (struct tlsfront_stats *copy)
+{
+  pthread_mutex_lock (&stats_lock);
+  *copy = stats;
+  pthread_mutex_unlock (&stats_lock);
+} // tlsfront_get_stats
@@ -0,0 +1,71 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for the TLS front end of the SSL
+ * port. It accepts the connections to the shards of the port itself,
+ * completes the TLS handshake with OpenSSL under the notary's certificate
+ * and hands the connection to the shard's daemon. Every thread shares one
+ * server session cache and one set of session-ticket keys, rotated every
+ * tls_ticket_rotate_s with the previous key still accepted, so that a
+ * returning client resumes instead of doing a full handshake. Where the
+ * kernel can encrypt records itself (kTLS), the daemon is given the socket
+ * and reads and writes it in the clear; elsewhere a thread relays between
+ * TLS and the daemon. At most tls_max_connections connections are in their
+ * handshake or relayed at a time; further ones are closed on accepting.
+ ******************************************************************************/
+#ifndef TLSFRONT_H
+#define TLSFRONT_H
+
+#include "notary.h"
+#include "shard.h"
+
+/* Session-ticket keys kept: the current one and the one before it. */
+#define TLSFRONT_TICKET_KEYS 2
+
+/* Bytes relayed at a time between TLS and a daemon. */
+#define TLSFRONT_RELAY_BUFFER 16384
+
+/* Counters of the TLS front end. */
+struct tlsfront_stats
+{
+  unsigned long accepted;       // connections accepted
+  unsigned long handshakes;     // handshakes completed
+  unsigned long resumed;        // of those, resuming an earlier session
+  unsigned long failures;       // handshakes that failed or timed out
+  unsigned long ktls;           // connections the kernel encrypts
+  unsigned long relayed;        // connections relayed by a thread
+  unsigned long refused;        // connections a daemon did not take
+  unsigned long overloaded;     // connections over tls_max_connections
+  unsigned long rotations;      // session-ticket keys replaced
+};
+
+/* Loads the certificate and private key the SSL port serves under and
+ * sets up the session cache and ticket keys. Returns 1 on success, 0
+ * otherwise.
+ */
+int tlsfront_init (const char *key_file, const char *cert_file);
+
+/* Starts accepting TLS connections on every socket of set, whose daemons
+ * must have been started with set->external. Returns 1 on success, 0
+ * otherwise.
+ */
+int tlsfront_start (struct shard_set *set);
+
+/* Stops accepting connections and closes the listening sockets, leaving
+ * them to a successor. Connections already handed over go on.
+ */
+void tlsfront_quiesce (void);
+
+/* Replaces the current session-ticket key, keeping it to accept tickets
+ * made with it until the next rotation.
+ */
+void tlsfront_rotate_keys (void);
+
+/* Frees the TLS context. */
+void tlsfront_shutdown (void);
+
+/* Copies the counters of the TLS front end into stats. */
+void tlsfront_get_stats (struct tlsfront_stats *stats);
+
+#endif // TLSFRONT_H
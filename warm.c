@@ -0,0 +1,406 @@
+/** @file
+
+    @brief  Warm: observes lists of hosts before clients ask about them, at
+            a bounded rate and concurrency, and tells when enough of them
+            are warm for the notary to take traffic.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "warm.h"
+#include "config.h"
+#include "deadline.h"
+#include "negcache.h"
+#include "observation.h"
+#include "history.h"
+#include "hostkey.h"
+#include "response.h"
+#include <pthread.h>
+#include <time.h>
+
+/* A host waiting to be warmed. */
+struct warm_host
+{
+  struct warm_host *next;
+  char url[];                   // https:// and the canonical key
+};
+
+/* Length of the scheme put before canonical keys. */
+#define WARM_SCHEME_LENGTH 8
+
+static struct warm_host *first = NULL, *last = NULL;
+static struct warm_stats stats;
+static long long next_start_us = 0;
+static long long last_progress_ms = 0;
+static pthread_mutex_t warm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t warm_idle = PTHREAD_COND_INITIALIZER;
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Returns the monotonic time in microseconds.
+ */
+static long long
+now_us ()
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+} // now_us
+
+/**
+ * @brief Checks whether enough of the hosts queued so far are warm, and
+ *        says so the first time. Called with the lock held.
+ */
+static void
+update_ready ()
+{
+  if (stats.ready || stats.queued == 0 || stats.warmed * 100
+      < (unsigned long) tunables.warm_ready_pct * stats.queued)
+    return;
+
+  stats.ready = 1;
+  printf ("Warm-up: %lu of %lu hosts warm, ready for traffic\n",
+          stats.warmed, stats.queued);
+} // update_ready
+
+/**
+ * @brief Prints the progress of the warm-up at most once a second, and when
+ *        the last queued host is done. Called with the lock held.
+ */
+static void
+report_progress ()
+{
+  long long now = deadline_now_ms ();
+
+  if (stats.done < stats.queued && now - last_progress_ms < 1000)
+    return;
+
+  last_progress_ms = now;
+  printf ("Warm-up: %lu of %lu hosts done, %lu warm, %lu failed\n",
+          stats.done, stats.queued, stats.warmed, stats.failed);
+  if (stats.done == stats.queued && !stats.ready)
+    printf ("Warm-up: only %lu of %lu hosts warm, not ready for traffic "
+            "below warm_ready_pct=%d\n", stats.warmed, stats.queued,
+            tunables.warm_ready_pct);
+} // report_progress
+
+/**
+ * @brief Waits for the next start that warm_rate allows.
+ */
+static void
+pace ()
+{
+  struct timespec pause;
+  long long start, now;
+
+  if (tunables.warm_rate <= 0)
+    return;
+
+  pthread_mutex_lock (&warm_lock);
+  now = now_us ();
+  start = next_start_us > now ? next_start_us : now;
+  next_start_us = start + 1000000 / tunables.warm_rate;
+  pthread_mutex_unlock (&warm_lock);
+
+  if (start > now)
+    {
+      pause.tv_sec = (start - now) / 1000000;
+      pause.tv_nsec = (start - now) % 1000000 * 1000;
+      nanosleep (&pause, NULL);
+    }
+} // pace
+
+/**
+ * @brief Observes a host unless it is warm already or failed recently.
+ *
+ * @return 1 if the host has a fresh observation, 0 otherwise
+ */
+static int
+warm_one (struct warm_host *entry)
+{
+  host host_to_warm = {entry->url, 0};
+  struct observation observation;
+  struct history_run newest;
+  struct deadline deadline;
+  uint32_t id;
+
+  id = hostkey_intern (entry->url + WARM_SCHEME_LENGTH);
+  if (id == HOSTKEY_NONE)
+    return 0;
+
+  if (history_latest (id, &newest)
+      && (time_t) newest.last_seen + tunables.observation_ttl > time (NULL))
+    return 1;
+  if (negcache_check (id, NULL, NULL))
+    return 0;
+
+  pace ();
+  deadline_start (&deadline, tunables.verify_deadline_ms, NULL);
+  return observe_host (&host_to_warm, id, &observation, &deadline);
+} // warm_one
+
+/**
+ * @brief A warming thread: warms queued hosts until none is left.
+ */
+static void *
+warm_thread (void *arg)
+{
+  struct warm_host *entry;
+  int warm;
+
+  (void) arg;
+  pthread_mutex_lock (&warm_lock);
+  while ((entry = first) != NULL)
+    {
+      first = entry->next;
+      if (first == NULL)
+        last = NULL;
+      pthread_mutex_unlock (&warm_lock);
+
+      warm = warm_one (entry);
+      free (entry);
+
+      pthread_mutex_lock (&warm_lock);
+      stats.done++;
+      if (warm)
+        stats.warmed++;
+      else
+        stats.failed++;
+      update_ready ();
+      report_progress ();
+    }
+
+  if (--stats.threads == 0)
+    pthread_cond_broadcast (&warm_idle);
+  pthread_mutex_unlock (&warm_lock);
+  return NULL;
+} // warm_thread
+
+/**
+ * @brief Writes the canonical key of the host a line of a list names: its
+ *        first word.
+ *
+ * @return 1 on success, 0 if the line names no valid host
+ */
+static int
+key_of_line (const char *line, size_t length, char *key)
+{
+  char word[HOSTKEY_LENGTH];
+  size_t word_length = strcspn (line, " \t\r\n");
+
+  if (word_length > length)
+    word_length = length;
+  if (word_length == 0 || word_length >= sizeof (word))
+    return 0;
+
+  memcpy (word, line, word_length);
+  word[word_length] = '\0';
+  return hostkey_canonicalize (word, 0, key, HOSTKEY_LENGTH);
+} // key_of_line
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Queues the hosts of a list and starts warming threads up to
+ *        warm_concurrency.
+ *
+ * @param list  the hosts, one per line
+ *
+ * @return the number of hosts queued, or -1 if out of memory
+ */
+int
+warm_queue (const char *list)
+{
+  struct warm_host *head = NULL, *tail = NULL, *entry;
+  char key[HOSTKEY_LENGTH];
+  unsigned long count = 0, invalid = 0;
+  pthread_attr_t attributes;
+  pthread_t thread;
+  const char *line;
+  size_t length;
+  int wanted;
+
+  for (line = list; *line != '\0'; line += length + (line[length] == '\n'))
+    {
+      length = strcspn (line, "\n");
+      if (length == 0 || line[0] == '#' || line[0] == '\r')
+        continue;
+      if (!key_of_line (line, length, key))
+        {
+          invalid++;
+          continue;
+        }
+
+      entry = malloc (sizeof (*entry) + WARM_SCHEME_LENGTH + strlen (key) + 1);
+      if (entry == NULL)
+        {
+          while ((entry = head) != NULL)
+            {
+              head = entry->next;
+              free (entry);
+            }
+          return -1;
+        }
+      entry->next = NULL;
+      sprintf (entry->url, "https://%s", key);
+
+      if (tail != NULL)
+        tail->next = entry;
+      else
+        head = entry;
+      tail = entry;
+      count++;
+    }
+
+  pthread_mutex_lock (&warm_lock);
+  stats.invalid += invalid;
+  if (head != NULL)
+    {
+      if (last != NULL)
+        last->next = head;
+      else
+        first = head;
+      last = tail;
+      stats.queued += count;
+    }
+
+  /* No more threads than hosts left to warm. */
+  wanted = tunables.warm_concurrency;
+  if ((unsigned long) wanted > stats.queued - stats.done)
+    wanted = stats.queued - stats.done;
+
+  pthread_attr_init (&attributes);
+  pthread_attr_setdetachstate (&attributes, PTHREAD_CREATE_DETACHED);
+  while (stats.threads < (unsigned long) wanted
+         && pthread_create (&thread, &attributes, warm_thread, NULL) == 0)
+    stats.threads++;
+  pthread_attr_destroy (&attributes);
+
+  if (first != NULL && stats.threads == 0)
+    fprintf (stderr, "Could not start a warming thread\n");
+  pthread_mutex_unlock (&warm_lock);
+
+  return count;
+} // warm_queue
+
+/**
+ * @brief Queues the hosts of a list in a file.
+ *
+ * @param file_name  the file
+ *
+ * @return the number of hosts queued, or -1 on failure
+ */
+int
+warm_queue_file (const char *file_name)
+{
+  char *list = NULL;
+  size_t size = 0, length = 0;
+  FILE *file;
+  int queued;
+
+  file = fopen (file_name, "r");
+  if (file == NULL)
+    {
+      fprintf (stderr, "Could not open %s: %s\n", file_name, strerror (errno));
+      return -1;
+    }
+
+  do
+    {
+      if (length + 1 >= size)
+        {
+          size = size ? 2 * size : 65536;
+          list = realloc (list, size);
+          if (list == NULL)
+            break;
+        }
+      length += fread (list + length, 1, size - length - 1, file);
+    }
+  while (!feof (file) && !ferror (file));
+
+  queued = -1;
+  if (list != NULL && !ferror (file))
+    {
+      list[length] = '\0';
+      queued = warm_queue (list);
+    }
+  else
+    fprintf (stderr, "Could not read %s\n", file_name);
+
+  fclose (file);
+  free (list);
+  return queued;
+} // warm_queue_file
+
+/**
+ * @brief Tells whether enough hosts are warm for the notary to take
+ *        traffic.
+ *
+ * @return 1 if they are, 0 otherwise
+ */
+int
+warm_ready ()
+{
+  int ready;
+
+  pthread_mutex_lock (&warm_lock);
+  update_ready ();
+  ready = stats.ready || stats.queued == 0;
+  pthread_mutex_unlock (&warm_lock);
+
+  return ready;
+} // warm_ready
+
+/**
+ * @brief Drops the queued hosts no thread has started on. They count as
+ *        done, neither warm nor failed.
+ */
+void
+warm_cancel ()
+{
+  struct warm_host *entry;
+
+  pthread_mutex_lock (&warm_lock);
+  while ((entry = first) != NULL)
+    {
+      first = entry->next;
+      free (entry);
+      stats.done++;
+      stats.cancelled++;
+    }
+  last = NULL;
+  pthread_mutex_unlock (&warm_lock);
+} // warm_cancel
+
+/**
+ * @brief Waits until every queued host is done.
+ */
+void
+warm_drain ()
+{
+  pthread_mutex_lock (&warm_lock);
+  while (stats.threads > 0)
+    pthread_cond_wait (&warm_idle, &warm_lock);
+  pthread_mutex_unlock (&warm_lock);
+} // warm_drain
+
+/**
+ * @brief Copies the counters of cache warming.
+ */
+void
+warm_get_stats (struct warm_stats *stats_out)
+{
+  pthread_mutex_lock (&warm_lock);
+  *stats_out = stats;
+  pthread_mutex_unlock (&warm_lock);
+} // warm_get_stats
@@ -0,0 +1,56 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for cache warming. A new notary is
+ * given lists of hosts, in the format of valid_urls.txt or as plain
+ * host:port lines, at startup or through the admin interface, and observes
+ * them the way verifications do, at most warm_rate hosts a second on
+ * warm_concurrency threads. The notary reports itself ready for traffic
+ * once warm_ready_pct of the hosts it was given are warm.
+ ******************************************************************************/
+#ifndef WARM_H
+#define WARM_H
+
+#include "notary.h"
+
+/* Counters of cache warming. */
+struct warm_stats
+{
+  unsigned long queued;         // hosts given to warm
+  unsigned long invalid;        // lines that named no valid host
+  unsigned long done;           // hosts warmed or given up on
+  unsigned long warmed;         // hosts with a fresh observation
+  unsigned long failed;         // hosts that could not be observed
+  unsigned long cancelled;      // hosts dropped before they were started
+  unsigned long threads;        // warming threads running now
+  int ready;                    // whether the notary is ready for traffic
+};
+
+/* Queues the hosts of a list, one per line: a URL, host or host:port,
+ * optionally followed by a space and anything else, such as a fingerprint.
+ * Blank lines and lines starting with # are skipped. Returns the number of
+ * hosts queued, or -1 if out of memory.
+ */
+int warm_queue (const char *list);
+
+/* Queues the hosts of a list in a file. Returns the number of hosts queued,
+ * or -1 if the file cannot be read or memory runs out.
+ */
+int warm_queue_file (const char *file_name);
+
+/* Returns 1 once warm_ready_pct of the hosts queued so far are warm, or if
+ * none were queued, and 0 before. Once ready, the notary stays ready.
+ */
+int warm_ready (void);
+
+/* Drops the queued hosts no thread has started on, for shutdown. */
+void warm_cancel (void);
+
+/* Waits until every queued host is done. */
+void warm_drain (void);
+
+/* Copies the counters of cache warming into stats. */
+void warm_get_stats (struct warm_stats *stats);
+
+#endif // WARM_H
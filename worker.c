@@ -0,0 +1,217 @@
+/** @file
+
+    @brief  Worker: reusable per-request contexts for contacting hosts and
+            fingerprinting their certificates, and the one-time global
+            initialization of curl and OpenSSL.
+
+    @author g-coders
+
+    @date
+    Created October 19, 2026 <br />
+    Last revised: October 19, 2026
+*/
+
+#include "worker.h"
+#include <pthread.h>
+
+/* MHD starts a thread for every connection, so contexts are pooled rather
+ * than kept per thread, which would set them up again for every client. */
+static struct worker_context *idle_workers = NULL;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static int initialized = 0;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static EVP_MD *fingerprint_digest = NULL;
+#else
+static const EVP_MD *fingerprint_digest = NULL;
+#endif
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Helpers
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Initializes the libraries. Run exactly once through pthread_once.
+ */
+static void
+initialize_libraries ()
+{
+  if (curl_global_init (CURL_GLOBAL_DEFAULT) != CURLE_OK)
+    {
+      fprintf (stderr, "Could not initialize curl\n");
+      return;
+    }
+
+  /* Load the error strings once instead of for every certificate. */
+  OPENSSL_init_ssl (OPENSSL_INIT_LOAD_SSL_STRINGS
+                    | OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL);
+
+  /* Fetching the digest once spares every fingerprint a lookup; before
+   * OpenSSL 3 there is no lookup to spare. */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  fingerprint_digest = EVP_MD_fetch (NULL, "SHA1", NULL);
+#else
+  fingerprint_digest = EVP_sha1 ();
+#endif
+  if (fingerprint_digest == NULL)
+    {
+      fprintf (stderr, "Could not load the SHA-1 digest\n");
+      curl_global_cleanup ();
+      return;
+    }
+
+  initialized = 1;
+} // initialize_libraries
+
+/**
+ * @brief Frees a worker context.
+ */
+static void
+free_worker (struct worker_context *worker)
+{
+  if (worker->multi != NULL)
+    curl_multi_cleanup (worker->multi);
+  curl_easy_cleanup (worker->curl);
+  curl_easy_cleanup (worker->hedge);
+  EVP_MD_CTX_free (worker->md_context);
+  free (worker);
+} // free_worker
+
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+// Functions
+//++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
+/**
+ * @brief Initializes curl and OpenSSL for the whole process. Calling it
+ *        again has no effect.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+worker_global_init ()
+{
+  pthread_once (&init_once, initialize_libraries);
+  return initialized;
+} // worker_global_init
+
+/**
+ * @brief Frees the idle worker contexts and the libraries' global state. No
+ *        context may be in use.
+ */
+void
+worker_global_cleanup ()
+{
+  struct worker_context *worker;
+
+  pthread_mutex_lock (&pool_lock);
+  while ((worker = idle_workers) != NULL)
+    {
+      idle_workers = worker->next;
+      free_worker (worker);
+    }
+  pthread_mutex_unlock (&pool_lock);
+
+  if (initialized)
+    {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+      EVP_MD_free (fingerprint_digest);
+#endif
+      fingerprint_digest = NULL;
+      curl_global_cleanup ();
+      initialized = 0;
+    }
+} // worker_global_cleanup
+
+/**
+ * @brief Takes an idle worker context, creating one if none is idle.
+ *
+ * @return the context, or NULL if none could be created
+ */
+struct worker_context *
+worker_acquire ()
+{
+  struct worker_context *worker;
+
+  pthread_mutex_lock (&pool_lock);
+  worker = idle_workers;
+  if (worker != NULL)
+    idle_workers = worker->next;
+  pthread_mutex_unlock (&pool_lock);
+
+  if (worker != NULL)
+    return worker;
+
+  /* Only needed if main did not initialize the libraries. */
+  if (!worker_global_init ())
+    return NULL;
+
+  worker = calloc (1, sizeof (*worker));
+  if (worker == NULL)
+    return NULL;
+
+  worker->curl = curl_easy_init ();
+  worker->hedge = curl_easy_init ();
+  worker->multi = curl_multi_init ();
+  worker->md_context = EVP_MD_CTX_new ();
+  if (worker->curl == NULL || worker->hedge == NULL || worker->multi == NULL
+      || worker->md_context == NULL)
+    {
+      free_worker (worker);
+      return NULL;
+    }
+
+  return worker;
+} // worker_acquire
+
+/**
+ * @brief Returns a worker context for later requests to use.
+ */
+void
+worker_release (struct worker_context *worker)
+{
+  if (worker == NULL)
+    return;
+
+  pthread_mutex_lock (&pool_lock);
+  worker->next = idle_workers;
+  idle_workers = worker;
+  pthread_mutex_unlock (&pool_lock);
+} // worker_release
+
+/**
+ * @brief Computes the colon separated SHA-1 fingerprint of a DER encoded
+ *        certificate.
+ *
+ * @param worker       the context whose digest is used
+ * @param der          the DER encoding of the certificate
+ * @param der_length   the length of the encoding
+ * @param fingerprint  output buffer of FPT_LENGTH characters
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int
+worker_fingerprint_der (struct worker_context *worker,
+                        const unsigned char *der, size_t der_length,
+                        char *fingerprint)
+{
+  static const char hex[] = "0123456789abcdef";
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int md_length, i;
+
+  if (EVP_DigestInit_ex (worker->md_context, fingerprint_digest, NULL) != 1
+      || EVP_DigestUpdate (worker->md_context, der, der_length) != 1
+      || EVP_DigestFinal_ex (worker->md_context, md, &md_length) != 1
+      || md_length * 3 != FPT_LENGTH)
+    return 0;
+
+  for (i = 0; i < md_length; i++)
+    {
+      fingerprint[3 * i] = hex[md[i] >> 4];
+      fingerprint[3 * i + 1] = hex[md[i] & 0x0f];
+      fingerprint[3 * i + 2] = ':';
+    }
+  fingerprint[3 * md_length - 1] = '\0';
+
+  return 1;
+} // worker_fingerprint_der
@@ -0,0 +1,49 @@
+/******************************************************************************
+ * Authors: g-coders
+ * Created: October 19, 2026
+ * Revised: October 19, 2026
+ * Description: This is the header file for worker contexts: everything a
+ * request needs to contact a host and fingerprint its certificates, set up
+ * once and reused by later requests.
+ ******************************************************************************/
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "notary.h"
+#include <openssl/evp.h>
+
+/* What a request needs to fetch and fingerprint certificates. */
+struct worker_context
+{
+  CURL *curl;                   // easy handle, reset between requests
+  CURL *hedge;                  // easy handle for a second, hedged fetch
+  CURLM *multi;                 // runs the fetch and its hedge together
+  EVP_MD_CTX *md_context;       // digest context for fingerprints
+  struct worker_context *next;  // next idle context
+};
+
+/* Initializes curl and OpenSSL for the whole process. Must be called once
+ * before any other thread is started. Returns 1 on success, 0 otherwise.
+ */
+int worker_global_init (void);
+
+/* Frees the idle worker contexts and the libraries' global state. */
+void worker_global_cleanup (void);
+
+/* Takes an idle worker context, creating one if none is idle. Returns NULL
+ * if a context could not be created.
+ */
+struct worker_context *worker_acquire (void);
+
+/* Returns a worker context for later requests to use. */
+void worker_release (struct worker_context *worker);
+
+/* Writes the colon separated SHA-1 fingerprint of a DER encoded certificate
+ * into fingerprint, which must hold FPT_LENGTH characters. Returns 1 on
+ * success, 0 otherwise.
+ */
+int worker_fingerprint_der (struct worker_context *worker,
+                            const unsigned char *der, size_t der_length,
+                            char *fingerprint);
+
+#endif // WORKER_H